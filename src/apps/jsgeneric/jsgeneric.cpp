@@ -1,10 +1,13 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
+#include "ds/spinlock.h"
 #include "enclave/appinterface.h"
 #include "node/rpc/userfrontend.h"
 #include "quickjs.h"
 
+#include <cmath>
 #include <memory>
+#include <unordered_map>
 #include <vector>
 
 namespace ccfapp
@@ -68,7 +71,7 @@ namespace ccfapp
     JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
   {
     auto log_table_view = (LogTable::TxView*)JS_GetContextOpaque(ctx);
-    if (!JS_IsInteger(argv[0]))
+    if (log_table_view == nullptr || !JS_IsInteger(argv[0]))
       return JS_EXCEPTION;
     int32_t i = JS_VALUE_GET_INT(argv[0]);
     auto str = log_table_view->get(i);
@@ -82,7 +85,7 @@ namespace ccfapp
     JSContext* ctx, JSValueConst this_val, int argc, JSValueConst* argv)
   {
     auto log_table_view = (LogTable::TxView*)JS_GetContextOpaque(ctx);
-    if (!JS_IsInteger(argv[0]))
+    if (log_table_view == nullptr || !JS_IsInteger(argv[0]))
       return JS_EXCEPTION;
     int32_t i = JS_VALUE_GET_INT(argv[0]);
     auto v = JS_ToCString(ctx, argv[1]);
@@ -95,12 +98,322 @@ namespace ccfapp
     return JS_NULL;
   }
 
+  // Frees the value it holds when it goes out of scope
+  struct JSValueGuard
+  {
+    JSContext* ctx;
+    JSValue val;
+
+    JSValueGuard(JSContext* ctx, JSValue val) : ctx(ctx), val(val) {}
+    JSValueGuard(const JSValueGuard&) = delete;
+
+    ~JSValueGuard()
+    {
+      JS_FreeValue(ctx, val);
+    }
+  };
+
+  static constexpr size_t max_json_depth = 256;
+
+  static nlohmann::json js_stringify_to_json(JSContext* ctx, JSValueConst val)
+  {
+    JSValueGuard str(ctx, JS_JSONStringify(ctx, val, JS_NULL, JS_NULL));
+    if (JS_IsException(str.val))
+      throw std::runtime_error("Failed to convert script result to JSON");
+    if (JS_IsUndefined(str.val))
+      return nullptr;
+
+    size_t len;
+    auto cstr = JS_ToCStringLen(ctx, &len, str.val);
+    auto j = nlohmann::json::parse(cstr, cstr + len);
+    JS_FreeCString(ctx, cstr);
+    return j;
+  }
+
+  /** Convert a value to JSON as JSON.stringify would, without going through
+   * its string representation. Values that JSON.stringify omits (undefined,
+   * functions and symbols) are returned empty. Objects with a toJSON method
+   * are passed to JSON.stringify.
+   */
+  static std::optional<nlohmann::json> js_to_json(
+    JSContext* ctx, JSValueConst val, size_t depth = 0)
+  {
+    if (depth > max_json_depth)
+      throw std::runtime_error("Script result is too deeply nested");
+
+    switch (JS_VALUE_GET_NORM_TAG(val))
+    {
+      case JS_TAG_INT:
+        return JS_VALUE_GET_INT(val);
+
+      case JS_TAG_BOOL:
+        return (bool)JS_VALUE_GET_BOOL(val);
+
+      case JS_TAG_NULL:
+        return nullptr;
+
+      case JS_TAG_FLOAT64:
+      {
+        const double d = JS_VALUE_GET_FLOAT64(val);
+        if (!std::isfinite(d))
+          return nullptr;
+        // integral values are printed without a fractional part by
+        // JSON.stringify, so are parsed back as integers
+        if (std::trunc(d) == d && std::fabs(d) < 9007199254740992.0)
+          return (int64_t)d;
+        return d;
+      }
+
+      case JS_TAG_STRING:
+      {
+        size_t len;
+        auto cstr = JS_ToCStringLen(ctx, &len, val);
+        if (cstr == nullptr)
+          throw std::runtime_error("Failed to convert script result string");
+        std::string str(cstr, len);
+        JS_FreeCString(ctx, cstr);
+        return str;
+      }
+
+      case JS_TAG_OBJECT:
+        break;
+
+      default:
+        return std::nullopt;
+    }
+
+    if (JS_IsFunction(ctx, val))
+      return std::nullopt;
+
+    {
+      JSValueGuard to_json(ctx, JS_GetPropertyStr(ctx, val, "toJSON"));
+      if (JS_IsFunction(ctx, to_json.val))
+        return js_stringify_to_json(ctx, val);
+    }
+
+    if (JS_IsArray(ctx, val) > 0)
+    {
+      JSValueGuard length_val(ctx, JS_GetPropertyStr(ctx, val, "length"));
+      int64_t length;
+      if (JS_ToInt64(ctx, &length, length_val.val) < 0)
+        throw std::runtime_error("Failed to get length of script result array");
+
+      auto arr = nlohmann::json::array();
+      for (int64_t i = 0; i < length; ++i)
+      {
+        JSValueGuard element(ctx, JS_GetPropertyUint32(ctx, val, i));
+        if (JS_IsException(element.val))
+          throw std::runtime_error("Failed to get script result element");
+        auto j = js_to_json(ctx, element.val, depth + 1);
+        arr.push_back(std::move(j).value_or(nullptr));
+      }
+      return arr;
+    }
+
+    JSPropertyEnum* props;
+    uint32_t n_props;
+    if (
+      JS_GetOwnPropertyNames(
+        ctx, &props, &n_props, val, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) < 0)
+      throw std::runtime_error("Failed to get script result properties");
+
+    auto obj = nlohmann::json::object();
+    std::exception_ptr error;
+    for (uint32_t i = 0; i < n_props; ++i)
+    {
+      if (error == nullptr)
+      {
+        try
+        {
+          JSValueGuard prop(ctx, JS_GetProperty(ctx, val, props[i].atom));
+          if (JS_IsException(prop.val))
+            throw std::runtime_error("Failed to get script result property");
+          auto j = js_to_json(ctx, prop.val, depth + 1);
+          if (j.has_value())
+          {
+            auto name = JS_AtomToCString(ctx, props[i].atom);
+            obj[name] = std::move(*j);
+            JS_FreeCString(ctx, name);
+          }
+        }
+        catch (...)
+        {
+          error = std::current_exception();
+        }
+      }
+      JS_FreeAtom(ctx, props[i].atom);
+    }
+    js_free(ctx, props);
+
+    if (error != nullptr)
+      std::rethrow_exception(error);
+
+    return obj;
+  }
+
+  /** QuickJS runtime, kept to run further scripts. Each script runs in a
+   * context of its own on it, so that the globals a script declares are not
+   * seen by the scripts that run after it.
+   */
+  class JSInterpreter
+  {
+  public:
+    JSRuntime* rt;
+
+    JSInterpreter()
+    {
+      rt = JS_NewRuntime();
+      if (rt == nullptr)
+      {
+        throw std::runtime_error("Failed to initialise QuickJS runtime");
+      }
+    }
+
+    JSInterpreter(const JSInterpreter&) = delete;
+
+    ~JSInterpreter()
+    {
+      JS_FreeRuntime(rt);
+    }
+  };
+
+  // Context with the globals that scripts use, freed when it goes out of
+  // scope
+  struct JSContextGuard
+  {
+    JSContext* ctx;
+
+    JSContextGuard(JSRuntime* rt)
+    {
+      ctx = JS_NewContext(rt);
+      if (ctx == nullptr)
+      {
+        throw std::runtime_error("Failed to initialise QuickJS context");
+      }
+
+      auto global_obj = JS_GetGlobalObject(ctx);
+
+      auto console = JS_NewObject(ctx);
+      JS_SetPropertyStr(
+        ctx, console, "log", JS_NewCFunction(ctx, ccfapp::js_print, "log", 1));
+      JS_SetPropertyStr(ctx, global_obj, "console", console);
+
+      auto log = JS_NewObject(ctx);
+      JS_SetPropertyStr(
+        ctx, log, "get", JS_NewCFunction(ctx, ccfapp::js_get, "get", 1));
+      JS_SetPropertyStr(
+        ctx, log, "put", JS_NewCFunction(ctx, ccfapp::js_put, "put", 2));
+      auto tables_ = JS_NewObject(ctx);
+      JS_SetPropertyStr(ctx, tables_, "log", log);
+      JS_SetPropertyStr(ctx, global_obj, "tables", tables_);
+
+      JS_FreeValue(ctx, global_obj);
+    }
+
+    JSContextGuard(const JSContextGuard&) = delete;
+
+    ~JSContextGuard()
+    {
+      JS_FreeContext(ctx);
+    }
+  };
+
   class JSHandlers : public UserHandlerRegistry
   {
   private:
     NetworkTables& network;
     LogTable& log_table;
 
+    // Interpreters not currently in use. Each worker takes one for the
+    // duration of a script, so there are never more than the number of
+    // workers running scripts concurrently.
+    SpinLock pool_lock;
+    std::vector<std::unique_ptr<JSInterpreter>> pool;
+
+    // Compiled scripts, serialised so that every context can load them
+    // without compiling them again
+    using Bytecode = std::pair<kv::Version, std::vector<uint8_t>>;
+    SpinLock bytecode_lock;
+    std::unordered_map<std::string, Bytecode> bytecode;
+
+    std::unique_ptr<JSInterpreter> acquire()
+    {
+      {
+        std::lock_guard<SpinLock> guard(pool_lock);
+        if (!pool.empty())
+        {
+          auto interp = std::move(pool.back());
+          pool.pop_back();
+          return interp;
+        }
+      }
+      return std::make_unique<JSInterpreter>();
+    }
+
+    void release(std::unique_ptr<JSInterpreter> interp)
+    {
+      std::lock_guard<SpinLock> guard(pool_lock);
+      pool.push_back(std::move(interp));
+    }
+
+    static JSValue compile(
+      JSContext* ctx, const std::string& method, const std::string& code)
+    {
+      auto path = fmt::format("app_scripts::{}", method);
+      return JS_Eval(
+        ctx,
+        code.c_str(),
+        code.size(),
+        path.c_str(),
+        JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_COMPILE_ONLY);
+    }
+
+    /** Get the compiled script for a method, in the context it is to run
+     * in, compiling it only if it has not been compiled at this version yet.
+     * Compiled scripts refer to the context they were loaded in, so they are
+     * kept serialised rather than as values.
+     *
+     * @return Compiled script, owned by the caller, or an exception
+     */
+    JSValue get_script(
+      JSContext* ctx,
+      const std::string& method,
+      const std::optional<kv::Version>& version,
+      const std::string& code)
+    {
+      // Only happens if the script was written by this transaction
+      if (!version.has_value())
+        return compile(ctx, method, code);
+
+      {
+        std::lock_guard<SpinLock> guard(bytecode_lock);
+        auto bc = bytecode.find(method);
+        if (bc != bytecode.end() && bc->second.first == *version)
+        {
+          return JS_ReadObject(
+            ctx,
+            bc->second.second.data(),
+            bc->second.second.size(),
+            JS_READ_OBJ_BYTECODE);
+        }
+      }
+
+      auto script = compile(ctx, method, code);
+      if (JS_IsException(script))
+        return script;
+
+      size_t size;
+      auto buf = JS_WriteObject(ctx, &size, script, JS_WRITE_OBJ_BYTECODE);
+      if (buf != nullptr)
+      {
+        std::lock_guard<SpinLock> guard(bytecode_lock);
+        bytecode[method] = {*version, {buf, buf + size}};
+        js_free(ctx, buf);
+      }
+
+      return script;
+    }
+
   public:
     JSHandlers(NetworkTables& network) :
       UserHandlerRegistry(network),
@@ -130,82 +443,57 @@ namespace ccfapp
           return;
         }
 
-        JSRuntime* rt = JS_NewRuntime();
-        if (rt == nullptr)
-        {
-          throw std::runtime_error("Failed to initialise QuickJS runtime");
-        }
-
-        JSContext* ctx = JS_NewContext(rt);
-        if (ctx == nullptr)
-        {
-          JS_FreeRuntime(rt);
-          throw std::runtime_error("Failed to initialise QuickJS context");
-        }
-
-        auto ltv = args.tx.get_view(log_table);
-        JS_SetContextOpaque(ctx, (void*)ltv);
-
-        auto global_obj = JS_GetGlobalObject(ctx);
-
-        auto console = JS_NewObject(ctx);
-        JS_SetPropertyStr(
-          ctx,
-          console,
-          "log",
-          JS_NewCFunction(ctx, ccfapp::js_print, "log", 1));
-        JS_SetPropertyStr(ctx, global_obj, "console", console);
-
-        auto log = JS_NewObject(ctx);
-        JS_SetPropertyStr(
-          ctx, log, "get", JS_NewCFunction(ctx, ccfapp::js_get, "get", 1));
-        JS_SetPropertyStr(
-          ctx, log, "put", JS_NewCFunction(ctx, ccfapp::js_put, "put", 2));
-        auto tables_ = JS_NewObject(ctx);
-        JS_SetPropertyStr(ctx, tables_, "log", log);
-        JS_SetPropertyStr(ctx, global_obj, "tables", tables_);
-
-        auto args_str = JS_NewStringLen(
-          ctx, (const char*)args.rpc_ctx->raw.data(), args.rpc_ctx->raw.size());
-        JS_SetPropertyStr(ctx, global_obj, "args", args_str);
-        JS_FreeValue(ctx, global_obj);
-
         if (!handler_script.value().text.has_value())
         {
           throw std::runtime_error("Could not find script text");
         }
 
-        std::string code = handler_script.value().text.value();
-        auto path = fmt::format("app_scripts::{}", args.method);
-        JSValue val = JS_Eval(
-          ctx, code.c_str(), code.size(), path.c_str(), JS_EVAL_TYPE_GLOBAL);
-
-        auto status = true;
-
-        if (JS_IsException(val))
+        // If anything throws, the interpreter is discarded rather than
+        // returned to the pool
+        auto interp = acquire();
         {
-          js_dump_error(ctx);
-          int err_code = jsonrpc::CCFErrorCodes::SCRIPT_ERROR;
-          std::string msg = "";
-          args.rpc_ctx->set_response_error(err_code, msg);
-          return;
+          JSContextGuard context(interp->rt);
+          auto ctx = context.ctx;
+
+          auto script = get_script(
+            ctx,
+            args.method,
+            scripts->get_version(args.method),
+            handler_script.value().text.value());
+
+          JSValue val = JS_EXCEPTION;
+          if (!JS_IsException(script))
+          {
+            auto global_obj = JS_GetGlobalObject(ctx);
+            auto args_str = JS_NewStringLen(
+              ctx,
+              (const char*)args.rpc_ctx->raw.data(),
+              args.rpc_ctx->raw.size());
+            JS_SetPropertyStr(ctx, global_obj, "args", args_str);
+            JS_FreeValue(ctx, global_obj);
+
+            // the view is only reachable from scripts while this one runs
+            auto ltv = args.tx.get_view(log_table);
+            JS_SetContextOpaque(ctx, (void*)ltv);
+            val = JS_EvalFunction(ctx, script);
+            JS_SetContextOpaque(ctx, nullptr);
+          }
+
+          if (JS_IsException(val))
+          {
+            js_dump_error(ctx);
+            int err_code = jsonrpc::CCFErrorCodes::SCRIPT_ERROR;
+            std::string msg = "";
+            args.rpc_ctx->set_response_error(err_code, msg);
+          }
+          else
+          {
+            JSValueGuard result(ctx, val);
+            args.rpc_ctx->set_response_result(
+              js_to_json(ctx, result.val).value_or(nullptr));
+          }
         }
-
-        if (JS_IsBool(val) && !JS_VALUE_GET_BOOL(val))
-          status = false;
-
-        JSValue rval = JS_JSONStringify(ctx, val, JS_NULL, JS_NULL);
-        auto cstr = JS_ToCString(ctx, rval);
-        auto response = nlohmann::json::parse(cstr);
-
-        JS_FreeCString(ctx, cstr);
-        JS_FreeValue(ctx, val);
-
-        JS_FreeContext(ctx);
-        JS_FreeRuntime(rt);
-
-        args.rpc_ctx->set_response_result(std::move(response));
-        return;
+        release(std::move(interp));
       };
 
       set_default(default_handler, Write);
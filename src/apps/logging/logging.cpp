@@ -5,51 +5,11 @@
 #include "node/rpc/userfrontend.h"
 
 #include <fmt/format_header_only.h>
-#include <valijson/adapters/nlohmann_json_adapter.hpp>
-#include <valijson/schema.hpp>
-#include <valijson/schema_parser.hpp>
-#include <valijson/validator.hpp>
 
 using namespace std;
 using namespace nlohmann;
 using namespace ccf;
 
-namespace fmt
-{
-  template <>
-  struct formatter<valijson::ValidationResults::Error>
-  {
-    template <typename ParseContext>
-    constexpr auto parse(ParseContext& ctx)
-    {
-      return ctx.begin();
-    }
-
-    template <typename FormatContext>
-    auto format(const valijson::ValidationResults::Error& e, FormatContext& ctx)
-    {
-      return format_to(
-        ctx.begin(), "[{}] {}", fmt::join(e.context, ""), e.description);
-    }
-  };
-
-  template <>
-  struct formatter<valijson::ValidationResults>
-  {
-    template <typename ParseContext>
-    constexpr auto parse(ParseContext& ctx)
-    {
-      return ctx.begin();
-    }
-
-    template <typename FormatContext>
-    auto format(const valijson::ValidationResults& vr, FormatContext& ctx)
-    {
-      return format_to(ctx.begin(), "{}", fmt::join(vr, "\n\t"));
-    }
-  };
-}
-
 namespace ccfapp
 {
   struct Procs
@@ -112,26 +72,6 @@ namespace ccfapp
     const nlohmann::json get_public_params_schema;
     const nlohmann::json get_public_result_schema;
 
-    std::optional<std::string> validate(
-      const nlohmann::json& params, const nlohmann::json& j_schema)
-    {
-      valijson::Schema schema;
-      valijson::SchemaParser parser;
-      valijson::adapters::NlohmannJsonAdapter schema_adapter(j_schema);
-      parser.populateSchema(schema_adapter, schema);
-
-      valijson::Validator validator;
-      valijson::ValidationResults results;
-      valijson::adapters::NlohmannJsonAdapter params_adapter(params);
-
-      if (!validator.validate(schema, params_adapter, &results))
-      {
-        return fmt::format("Error during validation:\n\t{}", results);
-      }
-
-      return std::nullopt;
-    }
-
   public:
     // SNIPPET_START: constructor
     LoggerHandlers(NetworkTables& nwt, AbstractNotifier& notifier) :
@@ -148,49 +88,42 @@ namespace ccfapp
     {
       // SNIPPET_START: record
       // SNIPPET_START: macro_validation_record
-      auto record = [this](Store::Tx& tx, const nlohmann::json& params) {
-        const auto in = params.get<LoggingRecord::In>();
+      auto record = [this](Store::Tx& tx, LoggingRecord::In&& in) {
         // SNIPPET_END: macro_validation_record
 
         if (in.msg.empty())
         {
-          return make_error(
-            LoggerErrors::MESSAGE_EMPTY, "Cannot record an empty log message");
+          throw RpcException(
+            "Cannot record an empty log message",
+            (int)LoggerErrors::MESSAGE_EMPTY);
         }
 
         auto view = tx.get_view(records);
         view->put(in.id, in.msg);
-        return make_success(true);
+        return true;
       };
       // SNIPPET_END: record
 
       // SNIPPET_START: get
-      auto get = [this](Store::Tx& tx, const nlohmann::json& params) {
-        const auto in = params.get<LoggingGet::In>();
+      auto get = [this](Store::Tx& tx, LoggingGet::In&& in) {
         auto view = tx.get_view(records);
         auto r = view->get(in.id);
 
-        if (r.has_value())
-          return make_success(LoggingGet::Out{r.value()});
+        if (!r.has_value())
+        {
+          throw RpcException(
+            fmt::format("No such record: {}", in.id),
+            (int)LoggerErrors::UNKNOWN_ID);
+        }
 
-        return make_error(
-          LoggerErrors::UNKNOWN_ID, fmt::format("No such record: {}", in.id));
+        return LoggingGet::Out{r.value()};
       };
       // SNIPPET_END: get
 
       // SNIPPET_START: record_public
-      // SNIPPET_START: valijson_record_public
+      // Params have already been validated against the schema this handler is
+      // installed with
       auto record_public = [this](Store::Tx& tx, const nlohmann::json& params) {
-        const auto validation_error =
-          validate(params, record_public_params_schema);
-
-        if (validation_error.has_value())
-        {
-          return make_error(
-            jsonrpc::StandardErrorCodes::PARSE_ERROR, *validation_error);
-        }
-        // SNIPPET_END: valijson_record_public
-
         const auto msg = params["msg"].get<std::string>();
         if (msg.empty())
         {
@@ -206,15 +139,6 @@ namespace ccfapp
 
       // SNIPPET_START: get_public
       auto get_public = [this](Store::Tx& tx, const nlohmann::json& params) {
-        const auto validation_error =
-          validate(params, get_public_params_schema);
-
-        if (validation_error.has_value())
-        {
-          return make_error(
-            jsonrpc::StandardErrorCodes::PARSE_ERROR, *validation_error);
-        }
-
         auto view = tx.get_view(public_records);
         const auto id = params["id"];
         auto r = view->get(id);
@@ -233,17 +157,18 @@ namespace ccfapp
       // SNIPPET_END: get_public
 
       install_with_auto_schema<LoggingRecord::In, bool>(
-        Procs::LOG_RECORD, handler_adapter(record), Write);
+        Procs::LOG_RECORD, record, Write);
       // SNIPPET: install_get
-      install_with_auto_schema<LoggingGet>(
-        Procs::LOG_GET, handler_adapter(get), Read);
+      install_with_auto_schema<LoggingGet>(Procs::LOG_GET, get, Read);
 
+      // SNIPPET_START: valijson_record_public
       install(
         Procs::LOG_RECORD_PUBLIC,
         handler_adapter(record_public),
         Write,
         record_public_params_schema,
         record_public_result_schema);
+      // SNIPPET_END: valijson_record_public
       install(
         Procs::LOG_GET_PUBLIC,
         handler_adapter(get_public),
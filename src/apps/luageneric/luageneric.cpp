@@ -53,9 +53,7 @@ namespace ccfapp
       lua_pop(l, 1);
     }
 
-    void setup_environment(
-      lua::Interpreter& li,
-      const std::optional<Script>& env_script) const override
+    void setup_globals(lua::Interpreter& li) const override
     {
       auto l = li.get_state();
 
@@ -71,8 +69,6 @@ namespace ccfapp
       lua_register(l, "LOG_FATAL", lua_log_fatal);
 
       add_error_codes(li.get_state());
-
-      TxScriptRunner::setup_environment(li, env_script);
     }
 
     const std::vector<GenericTable*> app_tables;
@@ -137,12 +133,23 @@ namespace ccfapp
           return;
         }
 
+        // the versions of the scripts let the runner reuse an interpreter
+        // which has already loaded them
+        const auto handler_version = scripts->get_version(args.method);
+        const auto env_version =
+          scripts->get_version(UserScriptIds::ENV_HANDLER);
+
+        TxScript txs{*handler_script,
+                     {},
+                     WlIds::USER_APP_CAN_READ_ONLY,
+                     scripts->get(UserScriptIds::ENV_HANDLER)};
+        if (handler_version)
+          txs.script_version = std::make_pair(args.method, *handler_version);
+        txs.env_script_version = env_version;
+
         auto response = tsr->run<nlohmann::json>(
           args.tx,
-          {*handler_script,
-           {},
-           WlIds::USER_APP_CAN_READ_ONLY,
-           scripts->get(UserScriptIds::ENV_HANDLER)},
+          txs,
           // vvv arguments to the script vvv
           args);
 
@@ -584,3 +584,116 @@ TEST_CASE("pre-populated environment")
     }
   }
 }
+
+TEST_CASE("interpreters are reused across requests")
+{
+  NetworkTables network;
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  network.tables->set_encryptor(encryptor);
+  Store::Tx gen_tx;
+  GenesisGenerator gen(network, gen_tx);
+  gen.init_values();
+  StubNotifier notifier;
+  // create network with 1 user and 3 active members
+  auto frontend = init_frontend(network, gen, notifier, 1, 3);
+  set_lua_logger();
+  const enclave::SessionContext user_session(
+    enclave::InvalidSessionId, user_caller_der);
+
+  auto call = [&](const string& method) {
+    const auto packed = make_pc(method, {});
+    auto rpc_ctx = enclave::make_rpc_context(user_session, packed);
+    return frontend->process(rpc_ctx).value();
+  };
+
+  constexpr auto count = R"xxx(
+    tables, gov_tables, args = ...
+    calls = (calls or 0) + 1
+    return env.succ(calls)
+  )xxx";
+  set_handler(network, "count", {count});
+
+  INFO("Globals set by a script do not outlive the request");
+  {
+    check_success(call("count"), 1);
+    check_success(call("count"), 1);
+  }
+
+  INFO("Shared tables cannot be changed");
+  {
+    constexpr auto extra = R"xxx(
+      tables, gov_tables, args = ...
+      rawset(string, "extra", true)
+      return env.succ(tostring(string.extra))
+    )xxx";
+    set_handler(network, "extra", {extra});
+
+    constexpr auto replace = R"xxx(
+      tables, gov_tables, args = ...
+      string.upper = function (s) return "mutated" end
+      return env.succ(string.upper("a"))
+    )xxx";
+    set_handler(network, "replace", {replace});
+
+    constexpr auto replace_meta = R"xxx(
+      tables, gov_tables, args = ...
+      getmetatable("").__index.upper = function (s) return "mutated" end
+      return env.succ(string.upper("a"))
+    )xxx";
+    set_handler(network, "replace_meta", {replace_meta});
+
+    constexpr auto upper = R"xxx(
+      tables, gov_tables, args = ...
+      return env.succ(string.upper("a") .. tostring(string.extra))
+    )xxx";
+    set_handler(network, "upper", {upper});
+
+    check_success<std::string>(call("extra"), "true");
+    check_error(call("replace"), jsonrpc::CCFErrorCodes::SCRIPT_ERROR);
+    check_error(call("replace_meta"), jsonrpc::CCFErrorCodes::SCRIPT_ERROR);
+    check_success<std::string>(call("upper"), "Anil");
+  }
+
+  INFO("Updated scripts are loaded again");
+  {
+    constexpr auto count_twice = R"xxx(
+      tables, gov_tables, args = ...
+      calls = (calls or 0) + 2
+      return env.succ(calls)
+    )xxx";
+    set_handler(network, "count", {count_twice});
+    check_success(call("count"), 2);
+  }
+
+  INFO("Updated environment scripts are run again");
+  {
+    constexpr auto env = R"xxx(
+      function env.succ (result)
+        return {result = result + 100}
+      end
+    )xxx";
+    set_handler(network, UserScriptIds::ENV_HANDLER, {env});
+    check_success(call("count"), 102);
+  }
+
+  INFO("Interpreters are usable after a script fails");
+  {
+    set_handler(network, "fail", {"LOG_FATAL(\"failed\")"});
+    check_error(call("fail"), jsonrpc::StandardErrorCodes::INTERNAL_ERROR);
+    check_success(call("count"), 102);
+  }
+
+  INFO("State kept by environment functions does not outlive the request");
+  {
+    constexpr auto env = R"xxx(
+      local succs = 0
+      function env.succ (result)
+        succs = succs + 1
+        return {result = result + succs}
+      end
+    )xxx";
+    set_handler(network, UserScriptIds::ENV_HANDLER, {env});
+    check_success(call("count"), 3);
+    check_success(call("count"), 3);
+  }
+}
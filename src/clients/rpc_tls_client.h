@@ -183,12 +183,12 @@ public:
 
   virtual void handle_message(
     http_method method,
-    const std::string& path,
-    const std::string& query,
-    const enclave::http::HeaderMap& headers,
-    const std::vector<uint8_t>& body) override
+    const std::string_view& path,
+    const std::string_view& query,
+    const enclave::http::HeaderViews& headers,
+    const CBuffer& body) override
   {
-    message_body = body;
+    message_body.assign(body.p, body.p + body.n);
   }
 };
 
@@ -3,9 +3,13 @@
 #pragma once
 
 #include "consensus/ledgerenclavetypes.h"
+#include "ds/logger.h"
 #include "ds/serialized.h"
+#include "ds/thread_messaging.h"
+#include "kv/kvtypes.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <sstream>
 
@@ -16,13 +20,71 @@ namespace consensus
   public:
     static constexpr size_t FRAME_SIZE = sizeof(uint32_t);
 
+    // Snapshots are sent to the host in fragments of at most this size, well
+    // within the maximum size of a ringbuffer message, however large the
+    // store is
+    static constexpr size_t max_snapshot_fragment_size = 1 << 20;
+
   private:
     ringbuffer::WriterPtr to_host;
 
+    // Snapshots are serialised and sent on a worker thread, through their own
+    // writer, while entries carry on being written. Only one snapshot is
+    // written at a time.
+    struct SnapshotWriter
+    {
+      ringbuffer::WriterPtr to_host;
+      std::atomic<bool> busy{false};
+    };
+    std::shared_ptr<SnapshotWriter> snapshot_writer;
+
+    struct SnapshotMsg
+    {
+      std::shared_ptr<SnapshotWriter> writer;
+      std::unique_ptr<kv::AbstractSnapshot> snapshot;
+    };
+
+    static void write_snapshot(
+      SnapshotWriter& writer, kv::AbstractSnapshot& snapshot)
+    {
+      const auto idx = static_cast<Index>(snapshot.get_version());
+
+      try
+      {
+        const auto data = snapshot.serialise();
+        for (size_t offset = 0; offset < data.size();
+             offset += max_snapshot_fragment_size)
+        {
+          serializer::ByteRange fragment = {
+            data.data() + offset,
+            std::min(max_snapshot_fragment_size, data.size() - offset)};
+          RINGBUFFER_WRITE_MESSAGE(
+            consensus::ledger_snapshot, writer.to_host, idx, fragment);
+        }
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_snapshot_end, writer.to_host, idx);
+      }
+      catch (const std::exception& e)
+      {
+        // The host discards a snapshot that is never ended
+        LOG_FAIL_FMT("Failed to write snapshot at {}: {}", idx, e.what());
+      }
+
+      writer.busy.store(false);
+    }
+
+    static void snapshot_cb(std::unique_ptr<enclave::Tmsg<SnapshotMsg>> msg)
+    {
+      write_snapshot(*msg->data.writer, *msg->data.snapshot);
+    }
+
   public:
     LedgerEnclave(ringbuffer::AbstractWriterFactory& writer_factory_) :
-      to_host(writer_factory_.create_writer_to_outside())
-    {}
+      to_host(writer_factory_.create_writer_to_outside()),
+      snapshot_writer(std::make_shared<SnapshotWriter>())
+    {
+      snapshot_writer->to_host = writer_factory_.create_writer_to_outside();
+    }
 
     /**
      * Put a single entry to be written the ledger, when primary.
@@ -103,5 +165,39 @@ namespace consensus
     {
       RINGBUFFER_WRITE_MESSAGE(consensus::ledger_truncate, to_host, idx);
     }
+
+    /**
+     * Put a snapshot of the store to be written alongside the ledger.
+     *
+     * The snapshot is serialised and sent to the host on the first worker
+     * thread, so that it holds up neither the caller nor signatures, which
+     * are signed on the last worker thread. If the previous snapshot is still
+     * being written, this one is dropped.
+     *
+     * @param snapshot Snapshot of the store at a committed index
+     */
+    void put_snapshot(std::unique_ptr<kv::AbstractSnapshot> snapshot)
+    {
+      if (snapshot_writer->busy.exchange(true))
+      {
+        LOG_INFO_FMT(
+          "Skipping snapshot at {} while the previous snapshot is written",
+          snapshot->get_version());
+        return;
+      }
+
+      if (enclave::ThreadMessaging::thread_count > 1)
+      {
+        auto msg = std::make_unique<enclave::Tmsg<SnapshotMsg>>(&snapshot_cb);
+        msg->data.writer = snapshot_writer;
+        msg->data.snapshot = std::move(snapshot);
+        enclave::ThreadMessaging::thread_messaging.add_task<SnapshotMsg>(
+          enclave::ThreadMessaging::main_thread + 1, std::move(msg));
+      }
+      else
+      {
+        write_snapshot(*snapshot_writer, *snapshot);
+      }
+    }
   };
 }
\ No newline at end of file
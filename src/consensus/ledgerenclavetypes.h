@@ -10,12 +10,16 @@ namespace consensus
   /// Consensus-related ringbuffer messages
   enum : ringbuffer::Message
   {
-    /// Request individual log entries. Enclave -> Host
+    /// Request a range of log entries. Enclave -> Host
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_get),
 
     ///@{
-    /// Respond to log_get. Host -> Enclave
-    DEFINE_RINGBUFFER_MSG_TYPE(ledger_entry),
+    /// Respond to ledger_get. The requested entries are sent, in order, as
+    /// one or more batches of framed entries, each with the index of its
+    /// first entry. If the range runs past the end of the log, the entries
+    /// that exist are followed by the index of the first missing entry.
+    /// Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_entries),
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_no_entry),
     ///@}
 
@@ -24,14 +28,47 @@ namespace consensus
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_append),
     DEFINE_RINGBUFFER_MSG_TYPE(ledger_truncate),
     ///@}
+
+    ///@{
+    /// Write a snapshot of the store at a committed index, to be stored
+    /// alongside the ledger. The serialised snapshot is sent, in order, as
+    /// one or more bounded fragments, followed by the end of the snapshot.
+    /// Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_snapshot),
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_snapshot_end),
+    ///@}
+
+    /// Request a range of committed log entries, to produce receipts for
+    /// transactions that are no longer in memory. Enclave -> Host
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_get_historical),
+
+    ///@{
+    /// Respond to ledger_get_historical, as ledger_entries and
+    /// ledger_no_entry respond to ledger_get. Host -> Enclave
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_historical_entries),
+    DEFINE_RINGBUFFER_MSG_TYPE(ledger_historical_no_entry),
+    ///@}
   };
 }
 
-DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_get, consensus::Index);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
-  consensus::ledger_entry, std::vector<uint8_t>);
-DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_no_entry);
+  consensus::ledger_get, consensus::Index, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_entries, consensus::Index, std::vector<uint8_t>);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(consensus::ledger_no_entry, consensus::Index);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_append, std::vector<uint8_t>);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   consensus::ledger_truncate, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_snapshot, consensus::Index, std::vector<uint8_t>);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_snapshot_end, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_get_historical, consensus::Index, consensus::Index);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_historical_entries,
+  consensus::Index,
+  std::vector<uint8_t>);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  consensus::ledger_historical_no_entry, consensus::Index);
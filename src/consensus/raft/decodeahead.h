@@ -0,0 +1,162 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/ringbuffer.h"
+#include "ds/thread_messaging.h"
+#include "kv/kvtypes.h"
+#include "rafttypes.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace raft
+{
+  // Decrypts and deserialises the entries of an append entries batch on the
+  // worker threads, ahead of them being applied to the store in order. Each
+  // worker claims entries from the front of the batch, and an entry that no
+  // worker has claimed by the time it is needed is decoded by the caller, so
+  // that applying never waits on a worker that is busy with other tasks.
+  template <typename S>
+  class DecodeAhead
+  {
+  private:
+    enum EntryState : uint8_t
+    {
+      Pending = 0,
+      Decoding,
+      Decoded,
+      Cancelled
+    };
+
+    struct Entry
+    {
+      std::vector<uint8_t> data;
+      kv::DecodedTxPtr decoded;
+      std::atomic<uint8_t> state{Pending};
+    };
+
+    struct Batch
+    {
+      Store<S>& store;
+      bool public_only;
+      std::vector<Entry> entries;
+
+      Batch(Store<S>& store, bool public_only, size_t count) :
+        store(store),
+        public_only(public_only),
+        entries(count)
+      {}
+
+      bool claim(Entry& e)
+      {
+        uint8_t expected = Pending;
+        return e.state.compare_exchange_strong(expected, Decoding);
+      }
+
+      void decode(Entry& e)
+      {
+        try
+        {
+          e.decoded = store.decode(e.data, public_only);
+        }
+        catch (const std::exception& ex)
+        {
+          // The entry is deserialised directly instead, which reports the
+          // error when it is applied
+          e.decoded = nullptr;
+        }
+        e.state.store(Decoded);
+      }
+
+      // A worker that has claimed an entry only takes as long as decoding
+      // it, so this spins rather than sleeps
+      static void wait_while_decoding(Entry& e)
+      {
+        while (e.state.load() == Decoding)
+          CCF_PAUSE();
+      }
+    };
+
+    struct DecodeMsg
+    {
+      std::shared_ptr<Batch> batch;
+    };
+
+    std::shared_ptr<Batch> batch;
+    size_t next_entry = 0;
+
+    static void decode_cb(std::unique_ptr<enclave::Tmsg<DecodeMsg>> msg)
+    {
+      auto& batch = *msg->data.batch;
+      for (auto& e : batch.entries)
+      {
+        if (batch.claim(e))
+          batch.decode(e);
+      }
+    }
+
+  public:
+    static bool enabled()
+    {
+      return enclave::ThreadMessaging::thread_count > 1;
+    }
+
+    /** Start decoding entries on all worker threads
+     *
+     * @param store Store the entries will be applied to
+     * @param public_only Whether only the public domain is deserialised
+     * @param entries Serialised entries, in the order they will be applied
+     */
+    DecodeAhead(
+      Store<S>& store,
+      bool public_only,
+      std::vector<std::vector<uint8_t>>&& entries) :
+      batch(std::make_shared<Batch>(store, public_only, entries.size()))
+    {
+      for (size_t i = 0; i < entries.size(); ++i)
+        batch->entries[i].data = std::move(entries[i]);
+
+      const uint16_t worker_count = enclave::ThreadMessaging::thread_count - 1;
+      for (uint16_t i = 0; i < worker_count && i < entries.size(); ++i)
+      {
+        auto msg = std::make_unique<enclave::Tmsg<DecodeMsg>>(&decode_cb);
+        msg->data.batch = batch;
+        enclave::ThreadMessaging::thread_messaging.add_task<DecodeMsg>(
+          i + 1, std::move(msg));
+      }
+    }
+
+    ~DecodeAhead()
+    {
+      // Stop workers from claiming the remaining entries, and wait for those
+      // being decoded since decoding refers to the store.
+      for (auto& e : batch->entries)
+      {
+        uint8_t expected = Pending;
+        if (!e.state.compare_exchange_strong(expected, Cancelled))
+          Batch::wait_while_decoding(e);
+      }
+    }
+
+    /** Take the next entry, in order, decoding it now if no worker has
+     * started decoding it yet.
+     *
+     * @return Decoded entry, or nullptr if it should be deserialised directly
+     */
+    kv::DecodedTxPtr next()
+    {
+      if (next_entry >= batch->entries.size())
+        return nullptr;
+
+      auto& e = batch->entries[next_entry++];
+      if (batch->claim(e))
+        batch->decode(e);
+      else
+        Batch::wait_while_decoding(e);
+
+      return std::move(e.decoded);
+    }
+  };
+}
@@ -2,6 +2,7 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "decodeahead.h"
 #include "ds/logger.h"
 #include "ds/serialized.h"
 #include "ds/spinlock.h"
@@ -56,12 +57,21 @@ namespace raft
       Candidate
     };
 
+    struct InFlight
+    {
+      Index prev_idx;
+      Index idx;
+    };
+
     struct NodeState
     {
       // the highest matching index with the node that was confirmed
       Index match_idx;
       // the highest index sent to the node
       Index sent_idx;
+      // each append entries sent to the node in this term that has not yet
+      // been answered, in the order they were sent
+      std::deque<InFlight> in_flight;
     };
 
     struct Configuration
@@ -103,6 +113,15 @@ namespace raft
     static constexpr int batch_window_size = 100;
     int batch_window_sum = 0;
 
+    // Maximum number of unacknowledged batches of entries sent to each node
+    size_t append_entries_window;
+
+    // A snapshot of the store is written to the ledger when at least this
+    // many entries have been committed since the last one. 0 disables
+    // snapshots.
+    size_t snapshot_interval;
+    Index last_snapshot_idx = 0;
+
     // Indices that are eligible for global commit, from a Node's perspective
     std::deque<Index> committable_indices;
 
@@ -132,7 +151,9 @@ namespace raft
       NodeId id,
       std::chrono::milliseconds request_timeout_,
       std::chrono::milliseconds election_timeout_,
-      bool public_only_ = false) :
+      bool public_only_ = false,
+      size_t append_entries_window_ = std::numeric_limits<size_t>::max(),
+      size_t snapshot_interval_ = 0) :
       store(std::move(store)),
 
       current_term(0),
@@ -148,6 +169,8 @@ namespace raft
 
       request_timeout(request_timeout_),
       election_timeout(election_timeout_),
+      append_entries_window(std::max(append_entries_window_, (size_t)1)),
+      snapshot_interval(snapshot_interval_),
       public_only(public_only_),
 
       ledger(std::move(ledger_)),
@@ -255,6 +278,18 @@ namespace raft
       become_leader();
     }
 
+    void init_from_snapshot(Index index, Term term)
+    {
+      // The store has been restored from a snapshot at index, which is
+      // globally committed. Entries are then replicated from index + 1.
+      std::lock_guard<SpinLock> guard(lock);
+      current_term = term;
+      last_idx = index;
+      commit_idx = index;
+      last_snapshot_idx = index;
+      term_history.update(index, term);
+    }
+
     Index get_last_idx()
     {
       return last_idx;
@@ -401,10 +436,12 @@ namespace raft
           timeout_elapsed = 0ms;
 
           update_batch_size();
-          // Send newly available entries to all nodes.
+          // Send newly available entries to all nodes, or a heartbeat to those
+          // that are up to date or cannot be sent more
           for (const auto& it : nodes)
           {
-            send_append_entries(it.first, it.second.sent_idx + 1);
+            send_append_entries_or_heartbeat(
+              it.first, it.second.sent_idx + 1);
           }
         }
       }
@@ -443,21 +480,48 @@ namespace raft
       return term_history.term_at(idx);
     }
 
-    void send_append_entries(NodeId to, Index start_idx)
+    bool can_send_append_entries(const NodeState& node)
     {
+      return node.in_flight.size() < append_entries_window;
+    }
+
+    // Sends the entries from start_idx, in batches, for as long as the window
+    // of unanswered append entries allows. Returns whether any was sent.
+    bool send_append_entries(NodeId to, Index start_idx)
+    {
+      auto& node = nodes.at(to);
+      bool sent = false;
+
       Index end_idx = (last_idx == 0) ?
         0 :
         std::min(start_idx + entries_batch_size, last_idx);
 
-      for (Index i = end_idx; i < last_idx; i += entries_batch_size)
+      for (Index i = end_idx;
+           i < last_idx && can_send_append_entries(node);
+           i += entries_batch_size)
       {
         send_append_entries_range(to, start_idx, i);
         start_idx = std::min(i + 1, last_idx);
+        sent = true;
       }
 
-      if (last_idx == 0 || end_idx <= last_idx)
+      if (start_idx <= last_idx && can_send_append_entries(node))
       {
         send_append_entries_range(to, start_idx, last_idx);
+        sent = true;
+      }
+
+      return sent;
+    }
+
+    void send_append_entries_or_heartbeat(NodeId to, Index start_idx)
+    {
+      if (!send_append_entries(to, start_idx))
+      {
+        // Nothing new can be sent, so only send a heartbeat for the index
+        // before start_idx. This stops the node from starting an election, and
+        // makes it report any gap in its log.
+        send_append_entries_range(to, start_idx, start_idx - 1);
       }
     }
 
@@ -489,6 +553,18 @@ namespace raft
       // Record the most recent index we have sent to this node.
       node.sent_idx = end_idx;
 
+      // Record the append entries until it is answered. Heartbeats repeated
+      // while the node does not answer are only recorded once.
+      auto& in_flight = node.in_flight;
+      if (
+        std::find_if(
+          in_flight.begin(), in_flight.end(), [&ae](const InFlight& f) {
+            return f.prev_idx == ae.prev_idx && f.idx == ae.idx;
+          }) == in_flight.end())
+      {
+        in_flight.push_back({ae.prev_idx, ae.idx});
+      }
+
       // The host will append log entries to this message when it is
       // sent to the destination node.
       channels->send_authenticated(ccf::NodeMsgType::consensus_msg, to, ae);
@@ -552,7 +628,7 @@ namespace raft
           "Recv append entries to {} from {} but our term is later",
           local_id,
           r.from_node);
-        send_append_entries_response(r.from_node, false);
+        send_append_entries_response(r, false);
         return;
       }
 
@@ -580,7 +656,7 @@ namespace raft
             prev_term,
             r.prev_term);
         }
-        send_append_entries_response(r.from_node, false);
+        send_append_entries_response(r, false);
         return;
       }
 
@@ -591,6 +667,10 @@ namespace raft
         r.idx,
         r.prev_idx);
 
+      // Entries after the first one applied from this batch are decoded ahead
+      // on the worker threads, once any rollback of the store is done
+      std::optional<DecodeAhead<kv::DeserialiseSuccess>> decode_ahead;
+
       for (Index i = r.prev_idx + 1; i <= r.idx; i++)
       {
         if (i <= last_idx)
@@ -613,7 +693,7 @@ namespace raft
             // whole batch
             LOG_INFO_FMT(
               "Replication suspended: {} > {}", i, recovery_max_index.value());
-            send_append_entries_response(r.from_node, false);
+            send_append_entries_response(r, false);
             return;
           }
           else
@@ -624,7 +704,7 @@ namespace raft
               "Replication suspended up to {} but deserialised up to {}",
               recovery_max_index.value(),
               i - 1);
-            send_append_entries_response(r.from_node, true);
+            send_append_entries_response(r, true);
             return;
           }
         }
@@ -645,13 +725,41 @@ namespace raft
 
           last_idx = r.prev_idx;
           ledger->truncate(r.prev_idx);
-          send_append_entries_response(r.from_node, false);
+          send_append_entries_response(r, false);
           return;
         }
 
         Term sig_term = 0;
-        auto deserialise_success =
-          store->deserialise(ret.first, public_only, &sig_term);
+        kv::DeserialiseSuccess deserialise_success;
+        if (decode_ahead.has_value())
+        {
+          deserialise_success = store->deserialise(
+            decode_ahead->next(), ret.first, public_only, &sig_term);
+        }
+        else
+        {
+          deserialise_success =
+            store->deserialise(ret.first, public_only, &sig_term);
+
+          auto last_decoded_idx = recovery_max_index.has_value() ?
+            std::min(r.idx, recovery_max_index.value()) :
+            r.idx;
+          if (
+            DecodeAhead<kv::DeserialiseSuccess>::enabled() &&
+            deserialise_success != kv::DeserialiseSuccess::FAILED &&
+            i < last_decoded_idx)
+          {
+            std::vector<std::vector<uint8_t>> entries;
+            auto entries_data = data;
+            auto entries_size = size;
+            for (Index j = i + 1; j <= last_decoded_idx; j++)
+            {
+              entries.push_back(
+                ledger->get_entry(entries_data, entries_size).first);
+            }
+            decode_ahead.emplace(*store, public_only, std::move(entries));
+          }
+        }
 
         switch (deserialise_success)
         {
@@ -682,26 +790,31 @@ namespace raft
         LOG_DEBUG_FMT("Node {} thinks leader is {}", local_id, leader_id);
       }
 
-      send_append_entries_response(r.from_node, true);
+      send_append_entries_response(r, true);
       commit_if_possible(r.leader_commit_idx);
 
       term_history.update(commit_idx + 1, r.term_of_idx);
     }
 
-    void send_append_entries_response(NodeId to, bool answer)
+    void send_append_entries_response(const AppendEntries& ae, bool answer)
     {
       LOG_DEBUG_FMT(
         "Send append entries response from {} to {} for index {}: {}",
         local_id,
-        to,
+        ae.from_node,
         last_idx,
         answer);
 
-      AppendEntriesResponse response = {
-        raft_append_entries_response, local_id, current_term, last_idx, answer};
+      AppendEntriesResponse response = {raft_append_entries_response,
+                                        local_id,
+                                        current_term,
+                                        last_idx,
+                                        ae.prev_idx,
+                                        ae.idx,
+                                        answer};
 
       channels->send_authenticated(
-        ccf::NodeMsgType::consensus_msg, to, response);
+        ccf::NodeMsgType::consensus_msg, ae.from_node, response);
     }
 
     void recv_append_entries_response(const uint8_t* data, size_t size)
@@ -766,17 +879,43 @@ namespace raft
           return;
       }
 
+      auto& in_flight = node->second.in_flight;
+      if (!r.success)
+      {
+        // Only a failure to append entries sent in this term that have not
+        // been answered yet is acted on. Any other is for append entries sent
+        // before the last time sending was rewound, and so has been handled.
+        auto failed = std::find_if(
+          in_flight.begin(), in_flight.end(), [&r](const InFlight& f) {
+            return f.prev_idx == r.prev_idx && f.idx == r.idx;
+          });
+        if (r.term != current_term || failed == in_flight.end())
+        {
+          LOG_DEBUG_FMT(
+            "Recv append entries response to {} from {}: failed, ignored",
+            local_id,
+            r.from_node);
+          return;
+        }
+      }
+
       // Update next and match for the responding node.
       node->second.match_idx = std::min(r.last_log_idx, last_idx);
 
       if (!r.success)
       {
-        // Failed due to log inconsistency. Reset sent_idx and try again.
+        // Failed due to log inconsistency. The node reports the end of its
+        // log, so rewind sent_idx straight to it and try again. Any other
+        // unanswered append entries will fail in the same way, so they are
+        // forgotten and their responses are ignored.
         LOG_DEBUG_FMT(
           "Recv append entries response to {} from {}: failed",
           local_id,
           r.from_node);
-        send_append_entries(r.from_node, node->second.match_idx + 1);
+        in_flight.clear();
+        node->second.sent_idx = node->second.match_idx;
+        send_append_entries_or_heartbeat(
+          r.from_node, node->second.match_idx + 1);
         return;
       }
 
@@ -785,6 +924,22 @@ namespace raft
         local_id,
         r.from_node,
         r.last_log_idx);
+
+      // Responses report the end of the node's log, so acknowledge every
+      // append entries up to it, even if the responses to earlier ones were
+      // lost or reordered.
+      const auto was_blocked = !can_send_append_entries(node->second);
+      while (!in_flight.empty() && in_flight.front().idx <= r.last_log_idx)
+      {
+        in_flight.pop_front();
+      }
+
+      // If sending was held back by the window, resume now that there is room
+      if (was_blocked && node->second.sent_idx < last_idx)
+      {
+        send_append_entries(r.from_node, node->second.sent_idx + 1);
+      }
+
       update_commit();
     }
 
@@ -1022,9 +1177,10 @@ namespace raft
       {
         it->second.match_idx = 0;
         it->second.sent_idx = next - 1;
+        it->second.in_flight.clear();
 
         // Send an empty append_entries to all nodes.
-        send_append_entries(it->first, next);
+        send_append_entries_or_heartbeat(it->first, next);
       }
     }
 
@@ -1136,6 +1292,22 @@ namespace raft
       store->compact(idx);
       LOG_DEBUG_FMT("Commit on {}: {}", local_id, idx);
 
+      // Only indices at which there is a signature are committed, so
+      // snapshots are always taken at a signature. While only the public
+      // domain is deserialised, private maps are incomplete and snapshots
+      // are not taken. Capturing the snapshot is cheap, and it is serialised
+      // and written by the ledger away from the commit path.
+      if (
+        snapshot_interval > 0 && !public_only &&
+        idx - last_snapshot_idx >= snapshot_interval)
+      {
+        LOG_DEBUG_FMT("Snapshot at {}", idx);
+        auto snapshot = store->snapshot(idx);
+        if (snapshot != nullptr)
+          ledger->put_snapshot(std::move(snapshot));
+        last_snapshot_idx = idx;
+      }
+
       // Examine all configurations that are followed by a globally committed
       // configuration.
       bool changed = false;
@@ -1226,7 +1398,7 @@ namespace raft
           nodes[node_id] = {0, index};
 
           if (state == Leader)
-            send_append_entries(node_id, index);
+            send_append_entries_or_heartbeat(node_id, index);
 
           LOG_INFO_FMT("Added node {}", node_id);
         }
@@ -4,6 +4,7 @@
 
 #include "consensus/consensustypes.h"
 #include "ds/ringbuffer_types.h"
+#include "kv/kvtypes.h"
 
 #include <chrono>
 #include <cstdint>
@@ -23,7 +24,13 @@ namespace raft
   {
     size_t request_timeout;
     size_t election_timeout;
-    MSGPACK_DEFINE(request_timeout, election_timeout);
+    size_t append_entries_window;
+    size_t snapshot_interval;
+    MSGPACK_DEFINE(
+      request_timeout,
+      election_timeout,
+      append_entries_window,
+      snapshot_interval);
   };
 
   template <typename S>
@@ -35,8 +42,16 @@ namespace raft
       const std::vector<uint8_t>& data,
       bool public_only = false,
       Term* term = nullptr) = 0;
+    virtual kv::DecodedTxPtr decode(
+      const std::vector<uint8_t>& data, bool public_only = false) = 0;
+    virtual S deserialise(
+      kv::DecodedTxPtr decoded,
+      const std::vector<uint8_t>& data,
+      bool public_only = false,
+      Term* term = nullptr) = 0;
     virtual void compact(Index v) = 0;
     virtual void rollback(Index v) = 0;
+    virtual std::unique_ptr<kv::AbstractSnapshot> snapshot(Index v) = 0;
   };
 
   template <typename T, typename S>
@@ -60,6 +75,29 @@ namespace raft
       return S::FAILED;
     }
 
+    kv::DecodedTxPtr decode(
+      const std::vector<uint8_t>& data, bool public_only = false)
+    {
+      auto p = x.lock();
+      if (p)
+        return p->decode(data, public_only);
+
+      return nullptr;
+    }
+
+    S deserialise(
+      kv::DecodedTxPtr decoded,
+      const std::vector<uint8_t>& data,
+      bool public_only = false,
+      Term* term = nullptr)
+    {
+      auto p = x.lock();
+      if (p)
+        return p->deserialise(std::move(decoded), data, public_only, term);
+
+      return S::FAILED;
+    }
+
     void compact(Index v)
     {
       auto p = x.lock();
@@ -73,6 +111,15 @@ namespace raft
       if (p)
         p->rollback(v);
     }
+
+    std::unique_ptr<kv::AbstractSnapshot> snapshot(Index v)
+    {
+      auto p = x.lock();
+      if (p)
+        return p->snapshot(v);
+
+      return nullptr;
+    }
   };
 
   enum RaftMsgType : Node2NodeMsg
@@ -103,6 +150,9 @@ namespace raft
   {
     Term term;
     Index last_log_idx;
+    // prev_idx and idx of the append entries this responds to
+    Index prev_idx;
+    Index idx;
     bool success;
   };
 
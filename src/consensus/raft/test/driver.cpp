@@ -11,6 +11,9 @@
 
 using namespace std;
 
+enclave::ThreadMessaging enclave::ThreadMessaging::thread_messaging;
+std::atomic<uint16_t> enclave::ThreadMessaging::thread_count = 0;
+
 constexpr auto shash = ds::fnv_1a<size_t>;
 
 int main(int argc, char** argv)
@@ -29,8 +32,15 @@ int main(int argc, char** argv)
     switch (shash(items[0].c_str()))
     {
       case shash("nodes"):
+        assert(items.size() == 2 || items.size() == 3);
+        if (items.size() == 3)
+          driver = make_shared<RaftDriver>(stoi(items[1]), stoi(items[2]));
+        else
+          driver = make_shared<RaftDriver>(stoi(items[1]));
+        break;
+      case shash("latency"):
         assert(items.size() == 2);
-        driver = make_shared<RaftDriver>(stoi(items[1]));
+        driver->latency(ms(stoi(items[1])));
         break;
       case shash("connect"):
         assert(items.size() == 3);
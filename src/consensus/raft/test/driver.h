@@ -6,6 +6,8 @@
 #include "ds/logger.h"
 
 #include <chrono>
+#include <functional>
+#include <map>
 #include <set>
 #include <sstream>
 #include <string>
@@ -32,8 +34,17 @@ private:
   std::unordered_map<raft::NodeId, NodeDriver> _nodes;
   std::set<std::pair<raft::NodeId, raft::NodeId>> _connections;
 
+  // Messages are delivered after a configurable latency, measured against a
+  // clock that is advanced by periodic_all. Messages in transit are ordered
+  // by delivery time, and then by the order in which they were sent.
+  ms _now = ms(0);
+  ms _latency = ms(0);
+  std::multimap<ms, std::function<void()>> _in_transit;
+
 public:
-  RaftDriver(size_t number_of_nodes)
+  RaftDriver(
+    size_t number_of_nodes,
+    size_t append_entries_window = std::numeric_limits<size_t>::max())
   {
     std::unordered_set<raft::NodeId> configuration;
 
@@ -48,7 +59,9 @@ public:
         std::make_shared<raft::ChannelStubProxy>(),
         node_id,
         ms(10),
-        ms(i * 100));
+        ms(i * 100),
+        false,
+        append_entries_window);
 
       _nodes.emplace(node_id, NodeDriver{kv, raft});
       configuration.insert(node_id);
@@ -130,6 +143,7 @@ public:
 
   void periodic_all(ms ms_)
   {
+    _now += ms_;
     for (auto& node : _nodes)
     {
       periodic_one(node.first, ms_);
@@ -171,18 +185,56 @@ public:
         _connections.find(std::make_pair(node_id, tgt_node_id)) !=
         _connections.end())
       {
-        auto contents = std::get<1>(message);
-        log_msg_details(node_id, tgt_node_id, contents);
-        _nodes.at(tgt_node_id)
-          .raft->recv_message(
-            reinterpret_cast<uint8_t*>(&contents), sizeof(contents));
-        count++;
+        auto deliver = [this, node_id, tgt_node_id, message]() {
+          auto contents = std::get<1>(message);
+          log_msg_details(node_id, tgt_node_id, contents);
+          _nodes.at(tgt_node_id)
+            .raft->recv_message(
+              reinterpret_cast<uint8_t*>(&contents), sizeof(contents));
+        };
+
+        if (_latency == ms(0))
+        {
+          deliver();
+          count++;
+        }
+        else
+        {
+          _in_transit.emplace(_now + _latency, deliver);
+        }
       }
     }
 
     return count;
   }
 
+  size_t deliver_in_transit()
+  {
+    size_t count = 0;
+
+    while (!_in_transit.empty() && _in_transit.begin()->first <= _now)
+    {
+      auto deliver = std::move(_in_transit.begin()->second);
+      _in_transit.erase(_in_transit.begin());
+      deliver();
+      count++;
+    }
+
+    return count;
+  }
+
+  size_t due_in_transit() const
+  {
+    return std::distance(_in_transit.begin(), _in_transit.upper_bound(_now));
+  }
+
+  void latency(ms ms_)
+  {
+    std::cout << "  Note over Node0: latency " << ms_.count() << " ms"
+              << std::endl;
+    _latency = ms_;
+  }
+
   void dispatch_one(raft::NodeId node_id)
   {
     auto raft = _nodes.at(node_id).raft;
@@ -198,18 +250,21 @@ public:
     {
       dispatch_one(node.first);
     }
+
+    deliver_in_transit();
   }
 
   void dispatch_all()
   {
     size_t iterations = 0;
-    while (std::accumulate(
-             _nodes.begin(),
-             _nodes.end(),
-             0,
-             [](int acc, auto& node) {
-               return node.second.raft->channels->sent_msg_count() + acc;
-             }) &&
+    while ((std::accumulate(
+              _nodes.begin(),
+              _nodes.end(),
+              0,
+              [](int acc, auto& node) {
+                return node.second.raft->channels->sent_msg_count() + acc;
+              }) ||
+            due_in_transit()) &&
            iterations++ < 5)
     {
       dispatch_all_once();
@@ -9,6 +9,9 @@
 
 #undef FAIL
 
+enclave::ThreadMessaging enclave::ThreadMessaging::thread_messaging;
+std::atomic<uint16_t> enclave::ThreadMessaging::thread_count = 0;
+
 using namespace consensus;
 
 using WFactory = ringbuffer::WriterFactory;
@@ -107,4 +110,123 @@ TEST_CASE("Enclave record")
       ++num_msgs;
     });
   REQUIRE(num_msgs == 1);
-}
\ No newline at end of file
+}
+class TestSnapshot : public kv::AbstractSnapshot
+{
+public:
+  kv::Version version;
+  std::vector<uint8_t> data;
+
+  TestSnapshot(kv::Version version_, const std::vector<uint8_t>& data_) :
+    version(version_),
+    data(data_)
+  {}
+
+  kv::Version get_version() const override
+  {
+    return version;
+  }
+
+  std::vector<uint8_t> serialise() override
+  {
+    return data;
+  }
+};
+
+TEST_CASE("Enclave put snapshot")
+{
+  ringbuffer::Circuit eio(1 << 23);
+  std::unique_ptr<WFactory> writer_factory = std::make_unique<WFactory>(eio);
+
+  auto enclave = LedgerEnclave(*writer_factory);
+
+  // Large enough to be sent in several fragments
+  const auto size = 2 * LedgerEnclave::max_snapshot_fragment_size + 10;
+  std::vector<uint8_t> snapshot(size);
+  for (size_t i = 0; i < size; ++i)
+    snapshot[i] = i % 251;
+
+  enclave.put_snapshot(std::make_unique<TestSnapshot>(42, snapshot));
+
+  std::vector<uint8_t> received;
+  size_t num_fragments = 0;
+  bool ended = false;
+  eio.read_from_inside().read(
+    -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+      REQUIRE(!ended);
+      switch (m)
+      {
+        case consensus::ledger_snapshot:
+        {
+          auto [idx, fragment] =
+            ringbuffer::read_message<consensus::ledger_snapshot>(data, size);
+          REQUIRE(idx == 42);
+          REQUIRE(
+            fragment.size() <= LedgerEnclave::max_snapshot_fragment_size);
+          received.insert(received.end(), fragment.begin(), fragment.end());
+          ++num_fragments;
+        }
+        break;
+        case consensus::ledger_snapshot_end:
+        {
+          auto [idx] =
+            ringbuffer::read_message<consensus::ledger_snapshot_end>(
+              data, size);
+          REQUIRE(idx == 42);
+          ended = true;
+        }
+        break;
+        default:
+          REQUIRE(false);
+      }
+    });
+
+  REQUIRE(ended);
+  REQUIRE(num_fragments == 3);
+  REQUIRE(received == snapshot);
+}
+
+TEST_CASE("Enclave put snapshot on worker thread")
+{
+  ringbuffer::Circuit eio(1 << 10);
+  std::unique_ptr<WFactory> writer_factory = std::make_unique<WFactory>(eio);
+
+  auto enclave = LedgerEnclave(*writer_factory);
+  const std::vector<uint8_t> snapshot = {1, 2, 3};
+
+  auto read_msgs = [&eio]() {
+    std::vector<ringbuffer::Message> msgs;
+    eio.read_from_inside().read(
+      -1, [&](ringbuffer::Message m, const uint8_t*, size_t) {
+        msgs.push_back(m);
+      });
+    return msgs;
+  };
+
+  enclave::ThreadMessaging::thread_count = 2;
+
+  INFO("The snapshot is only written once the worker thread runs");
+  {
+    enclave.put_snapshot(std::make_unique<TestSnapshot>(10, snapshot));
+    REQUIRE(read_msgs().empty());
+
+    INFO("Snapshots put while one is being written are skipped");
+    enclave.put_snapshot(std::make_unique<TestSnapshot>(20, snapshot));
+
+    REQUIRE(enclave::ThreadMessaging::thread_messaging.run_one(1));
+    REQUIRE_FALSE(enclave::ThreadMessaging::thread_messaging.run_one(1));
+    const auto msgs = read_msgs();
+    REQUIRE(msgs.size() == 2);
+    REQUIRE(msgs[0] == consensus::ledger_snapshot);
+    REQUIRE(msgs[1] == consensus::ledger_snapshot_end);
+  }
+
+  INFO("Once it is written, the next snapshot is accepted");
+  {
+    enclave.put_snapshot(std::make_unique<TestSnapshot>(30, snapshot));
+    REQUIRE(enclave::ThreadMessaging::thread_messaging.run_one(1));
+    REQUIRE(read_msgs().size() == 2);
+  }
+
+  enclave::ThreadMessaging::thread_count = 0;
+}
@@ -50,6 +50,12 @@ namespace raft
       return std::make_pair(*buffer, true);
     }
 
+    std::pair<std::vector<uint8_t>, bool> get_entry(
+      const uint8_t*& data, size_t& size)
+    {
+      return std::make_pair(std::vector<uint8_t>(data, data + size), true);
+    }
+
     void skip_entry(const uint8_t*& data, size_t& size)
     {
       skip_count++;
@@ -68,6 +74,14 @@ namespace raft
     {
       skip_count = 0;
     }
+
+    void put_snapshot(std::unique_ptr<kv::AbstractSnapshot> snapshot)
+    {
+#ifdef STUB_LOG
+      std::cout << "  Node" << _id << "->>Ledger" << _id
+                << ": snapshot i: " << snapshot->get_version() << std::endl;
+#endif
+    }
   };
 
   class ChannelStubProxy
@@ -155,6 +169,44 @@ namespace raft
     {
       return kv::DeserialiseSuccess::PASS;
     }
+
+    virtual kv::DecodedTxPtr decode(
+      const std::vector<uint8_t>& data, bool public_only = false)
+    {
+      return nullptr;
+    }
+
+    virtual kv::DeserialiseSuccess deserialise(
+      kv::DecodedTxPtr decoded,
+      const std::vector<uint8_t>& data,
+      bool public_only = false,
+      Term* term = nullptr)
+    {
+      return deserialise(data, public_only, term);
+    }
+
+    class Snapshot : public kv::AbstractSnapshot
+    {
+    public:
+      kv::Version version;
+
+      Snapshot(kv::Version version_) : version(version_) {}
+
+      kv::Version get_version() const override
+      {
+        return version;
+      }
+
+      std::vector<uint8_t> serialise() override
+      {
+        return {};
+      }
+    };
+
+    virtual std::unique_ptr<kv::AbstractSnapshot> snapshot(Index i)
+    {
+      return std::make_unique<Snapshot>(i);
+    }
   };
 
   class LoggingStubStoreSig : public LoggingStubStore
@@ -162,6 +214,8 @@ namespace raft
   public:
     LoggingStubStoreSig(raft::NodeId id) : LoggingStubStore(id) {}
 
+    using LoggingStubStore::deserialise;
+
     kv::DeserialiseSuccess deserialise(
       const std::vector<uint8_t>& data,
       bool public_only = false,
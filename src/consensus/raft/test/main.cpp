@@ -7,10 +7,15 @@
 
 #include <chrono>
 #include <doctest/doctest.h>
+#include <iostream>
 #include <string>
+#include <thread>
 
 using namespace std;
 
+enclave::ThreadMessaging enclave::ThreadMessaging::thread_messaging;
+std::atomic<uint16_t> enclave::ThreadMessaging::thread_count = 0;
+
 using ms = std::chrono::milliseconds;
 using TRaft = raft::Raft<raft::LedgerStubProxy, raft::ChannelStubProxy>;
 using Store = raft::LoggingStubStore;
@@ -590,19 +595,28 @@ TEST_CASE("Recv append entries logic" * doctest::test_suite("multiple"))
     REQUIRE(r0.channels->sent_append_entries.size() == 1);
     r0.channels->sent_append_entries.pop_front();
 
-    // Simulate that the append entries was not deserialised successfully
-    // This ensures that r0 re-sends an AE with prev_idx = 3 next time
-    auto aer = r1.channels->sent_append_entries_response.front().second;
-    r1.channels->sent_append_entries_response.pop_front();
+    // Responses to append entries answered before sending was last rewound
+    // are ignored, even if they fail
+    auto stale_aer = r1.channels->sent_append_entries_response.front().second;
+    stale_aer.success = false;
+    r0.recv_message(
+      reinterpret_cast<uint8_t*>(&stale_aer), sizeof(stale_aer));
+    REQUIRE(r0.channels->sent_append_entries.size() == 0);
+
+    // Simulate that the last append entries answered was not deserialised
+    // successfully. This ensures that r0 re-sends an AE with prev_idx = 4 next
+    // time
+    auto aer = r1.channels->sent_append_entries_response.back().second;
+    r1.channels->sent_append_entries_response.clear();
     aer.success = false;
     r0.recv_message(reinterpret_cast<uint8_t*>(&aer), sizeof(aer));
     REQUIRE(r0.channels->sent_append_entries.size() == 1);
 
-    // Receive append entries (idx: 5, prev_idx: 3)
+    // Receive append entries (idx: 5, prev_idx: 4)
     r1.ledger->reset_skip_count();
     REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
     REQUIRE(r1.ledger->ledger.size() == 5);
-    REQUIRE(r1.ledger->skip_count == 2);
+    REQUIRE(r1.ledger->skip_count == 0);
   }
 }
 
@@ -743,6 +757,130 @@ TEST_CASE("Exceed append entries limit")
   REQUIRE(r2.ledger->ledger.size() == individual_entries);
 }
 
+TEST_CASE("Append entries window")
+{
+  auto kv_store0 = std::make_shared<Store>(0);
+  auto kv_store1 = std::make_shared<Store>(1);
+
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+
+  ms request_timeout(10);
+  const size_t window = 2;
+
+  TRaft r0(
+    std::make_unique<Adaptor>(kv_store0),
+    std::make_unique<raft::LedgerStubProxy>(node_id0),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id0,
+    request_timeout,
+    ms(20),
+    false,
+    window);
+  TRaft r1(
+    std::make_unique<Adaptor>(kv_store1),
+    std::make_unique<raft::LedgerStubProxy>(node_id1),
+    std::make_shared<raft::ChannelStubProxy>(),
+    node_id1,
+    request_timeout,
+    ms(100),
+    false,
+    window);
+
+  std::unordered_set<raft::NodeId> config0 = {node_id0, node_id1};
+  r0.add_configuration(0, config0);
+  r1.add_configuration(0, config0);
+
+  map<raft::NodeId, TRaft*> nodes;
+  nodes[node_id0] = &r0;
+  nodes[node_id1] = &r1;
+
+  r0.periodic(std::chrono::milliseconds(200));
+
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_request_vote));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_request_vote_response));
+  REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+  REQUIRE(1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+  REQUIRE(r0.is_leader());
+
+  // Each entry exceeds the append entries limit, so is sent on its own as soon
+  // as it is replicated
+  std::vector<uint8_t> data(r0.append_entries_size_limit, 1);
+
+  INFO("Only a window of unanswered batches is sent");
+  {
+    for (size_t i = 1; i <= 3; ++i)
+    {
+      REQUIRE(r0.replicate(kv::BatchVector{{i, data, true}}));
+    }
+
+    // The third entry is held back, and nothing is sent instead
+    REQUIRE(r0.channels->sent_append_entries.size() == 2);
+    REQUIRE(r0.channels->sent_append_entries.back().second.idx == 2);
+
+    REQUIRE(2 == dispatch_all(nodes, r0.channels->sent_append_entries));
+    REQUIRE(r1.ledger->ledger.size() == 2);
+  }
+
+  INFO("An acknowledgement makes room for the next batch");
+  {
+    auto aer = r1.channels->sent_append_entries_response.front().second;
+    r1.channels->sent_append_entries_response.pop_front();
+    REQUIRE(aer.last_log_idx == 1);
+    r0.recv_message(reinterpret_cast<uint8_t*>(&aer), sizeof(aer));
+
+    REQUIRE(r0.channels->sent_append_entries.size() == 1);
+    const auto ae = r0.channels->sent_append_entries.front().second;
+    REQUIRE(ae.idx == 3);
+    REQUIRE(ae.prev_idx == 2);
+
+    // This batch is lost
+    r0.channels->sent_append_entries.pop_front();
+  }
+
+  INFO("Only heartbeats are sent while the window is full");
+  {
+    REQUIRE(r0.replicate(kv::BatchVector{{4, data, true}}));
+    REQUIRE(r0.channels->sent_append_entries.size() == 0);
+
+    // Repeated heartbeats are all rejected, since the follower is missing
+    // entry 3
+    for (size_t i = 0; i < 2; ++i)
+    {
+      r0.periodic(request_timeout);
+      REQUIRE(r0.channels->sent_append_entries.size() == 1);
+      const auto heartbeat = r0.channels->sent_append_entries.back().second;
+      REQUIRE(heartbeat.idx == 3);
+      REQUIRE(heartbeat.prev_idx == 3);
+      REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+    }
+  }
+
+  INFO("A nack rewinds sending to the end of the follower's log once");
+  {
+    REQUIRE(
+      3 ==
+      dispatch_all_and_check(
+        nodes,
+        r1.channels->sent_append_entries_response,
+        [](const auto& msg) { REQUIRE(msg.last_log_idx == 2); }));
+
+    // The first heartbeat to be rejected rewinds sending, and the rejection
+    // of the repeated heartbeat is ignored
+    REQUIRE(r0.channels->sent_append_entries.size() == 1);
+    const auto ae = r0.channels->sent_append_entries.front().second;
+    REQUIRE(ae.prev_idx == 2);
+    REQUIRE(ae.idx == 4);
+
+    REQUIRE(1 == dispatch_all(nodes, r0.channels->sent_append_entries));
+    REQUIRE(r1.ledger->ledger.size() == 4);
+
+    REQUIRE(
+      1 == dispatch_all(nodes, r1.channels->sent_append_entries_response));
+    REQUIRE(r0.channels->sent_append_entries.size() == 0);
+  }
+}
+
 // Reproduces issue described here: https://github.com/microsoft/CCF/issues/521
 // Once this is fixed test will need to be modified since right now it checks
 // that the issue stands
@@ -969,4 +1107,154 @@ TEST_CASE(
     CHECK(r2.get_commit_idx() == 2);
     CHECK(r2.get_last_idx() == 3);
   }
-}
\ No newline at end of file
+}
+
+// Stands in for a store whose entries are expensive to decrypt and
+// deserialise, so that decoding dominates the follower's apply rate
+class DecodeStubStore : public Store
+{
+private:
+  struct DecodedTx : public kv::AbstractDecodedTx
+  {
+    uint64_t result;
+  };
+
+  size_t decode_work;
+
+  uint64_t decode_entry(const std::vector<uint8_t>& data)
+  {
+    uint64_t x = data.size();
+    for (size_t i = 0; i < decode_work; ++i)
+      x = x * 6364136223846793005ull + 1442695040888963407ull;
+    return x;
+  }
+
+public:
+  std::atomic<size_t> decoded_count = 0;
+  size_t applied_decoded_count = 0;
+  uint64_t applied_result = 0;
+
+  DecodeStubStore(raft::NodeId id, size_t decode_work) :
+    Store(id),
+    decode_work(decode_work)
+  {}
+
+  kv::DecodedTxPtr decode(
+    const std::vector<uint8_t>& data, bool public_only = false) override
+  {
+    auto decoded = std::make_unique<DecodedTx>();
+    decoded->result = decode_entry(data);
+    decoded_count++;
+    return decoded;
+  }
+
+  kv::DeserialiseSuccess deserialise(
+    const std::vector<uint8_t>& data,
+    bool public_only = false,
+    raft::Term* term = nullptr) override
+  {
+    applied_result = decode_entry(data);
+    return Store::deserialise(data, public_only, term);
+  }
+
+  kv::DeserialiseSuccess deserialise(
+    kv::DecodedTxPtr decoded,
+    const std::vector<uint8_t>& data,
+    bool public_only = false,
+    raft::Term* term = nullptr) override
+  {
+    if (decoded == nullptr)
+      return deserialise(data, public_only, term);
+
+    applied_result = dynamic_cast<DecodedTx*>(decoded.get())->result;
+    applied_decoded_count++;
+    return Store::deserialise(data, public_only, term);
+  }
+};
+
+TEST_CASE("Follower decodes entries on worker threads")
+{
+  raft::NodeId node_id0(0);
+  raft::NodeId node_id1(1);
+
+  constexpr size_t decode_work = 200000;
+  constexpr raft::Index batch_size = 32;
+  constexpr size_t batch_count = 16;
+
+  for (uint16_t worker_count : {0, 1, 2, 4})
+  {
+    enclave::ThreadMessaging::thread_count = worker_count + 1;
+
+    std::atomic<uint16_t> registered = 0;
+    std::vector<std::thread> workers;
+    for (uint16_t tid = 1; tid <= worker_count; ++tid)
+    {
+      workers.emplace_back([&registered, worker_count, tid]() {
+        static SpinLock ids_lock;
+        {
+          std::lock_guard<SpinLock> guard(ids_lock);
+          thread_ids[std::this_thread::get_id()] = tid;
+        }
+        registered++;
+        while (registered != worker_count)
+          ;
+        enclave::ThreadMessaging::thread_messaging.run();
+      });
+    }
+    while (registered != worker_count)
+      ;
+
+    auto kv_store1 = std::make_shared<DecodeStubStore>(node_id1, decode_work);
+    TRaft r1(
+      std::make_unique<raft::Adaptor<DecodeStubStore, kv::DeserialiseSuccess>>(
+        kv_store1),
+      std::make_unique<raft::LedgerStubProxy>(node_id1),
+      std::make_shared<raft::ChannelStubProxy>(),
+      node_id1,
+      ms(10),
+      ms(100));
+    r1.add_configuration(0, {node_id0, node_id1});
+
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t b = 0; b < batch_count; ++b)
+    {
+      const raft::Index prev_idx = b * batch_size;
+      raft::AppendEntries ae = {raft::raft_append_entries,
+                                node_id0,
+                                prev_idx + batch_size,
+                                prev_idx,
+                                1,
+                                prev_idx == 0 ? 0 : 1,
+                                0,
+                                1};
+      r1.recv_message(reinterpret_cast<uint8_t*>(&ae), sizeof(ae));
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    enclave::ThreadMessaging::thread_messaging.set_finished();
+    for (auto& worker : workers)
+      worker.join();
+    enclave::ThreadMessaging::thread_messaging.set_finished(false);
+    enclave::ThreadMessaging::thread_count = 0;
+
+    const size_t entry_count = batch_count * batch_size;
+    REQUIRE(r1.get_last_idx() == entry_count);
+    REQUIRE(r1.channels->sent_append_entries_response.size() == batch_count);
+    for (const auto& [to, aer] : r1.channels->sent_append_entries_response)
+      REQUIRE(aer.success);
+
+    // The first entry of each batch is applied directly, in case it rolls the
+    // store back. The others are decoded ahead once workers are available.
+    const size_t decoded_ahead =
+      worker_count == 0 ? 0 : batch_count * (batch_size - 1);
+    REQUIRE(kv_store1->decoded_count == decoded_ahead);
+    REQUIRE(kv_store1->applied_decoded_count == decoded_ahead);
+
+    const auto seconds = std::chrono::duration<double>(elapsed).count();
+    std::cout << fmt::format(
+                   "{} worker threads: {:.0f} entries/s",
+                   worker_count,
+                   entry_count / seconds)
+              << std::endl;
+  }
+}
@@ -57,16 +57,18 @@ namespace crypto
 
     std::vector<uint8_t> serialise()
     {
-      auto space = RAW_DATA_SIZE;
-      std::vector<uint8_t> serial_hdr(space);
-
-      auto data_ = serial_hdr.data();
-      serialized::write(data_, space, tag, sizeof(tag));
-      serialized::write(data_, space, iv, sizeof(iv));
-
+      std::vector<uint8_t> serial_hdr(RAW_DATA_SIZE);
+      serialise(serial_hdr.data());
       return serial_hdr;
     }
 
+    void serialise(uint8_t* serial_hdr)
+    {
+      auto space = RAW_DATA_SIZE;
+      serialized::write(serial_hdr, space, tag, sizeof(tag));
+      serialized::write(serial_hdr, space, iv, sizeof(iv));
+    }
+
     void deserialise(const std::vector<uint8_t>& serial_hdr)
     {
       auto data_ = serial_hdr.data();
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <memory>
 #include <optional>
 #include <vector>
@@ -34,6 +35,18 @@ namespace champ
     return (hash >> ((Hash)depth * index_mask_bits)) & index_mask;
   }
 
+  // Nodes created by a Transient are tagged with its Owner, and may be mutated
+  // in place by that Transient until it is made persistent. Owners are never
+  // reused, so nodes of a persistent Map are immutable.
+  using Owner = uint64_t;
+  static constexpr Owner no_owner = 0;
+
+  static inline Owner new_owner()
+  {
+    static std::atomic<Owner> next_owner(1);
+    return next_owner.fetch_add(1);
+  }
+
   class Bitmap
   {
     uint32_t _bits;
@@ -96,6 +109,7 @@ namespace champ
   struct Collisions
   {
     std::array<std::vector<std::shared_ptr<Entry<K, V>>>, collision_bins> bins;
+    Owner owner = no_owner;
 
     const V* getp(Hash hash, const K& k) const
     {
@@ -145,6 +159,7 @@ namespace champ
     std::vector<Node<K, V, H>> nodes;
     Bitmap node_map;
     Bitmap data_map;
+    Owner owner = no_owner;
 
     SubNodes() {}
 
@@ -185,7 +200,12 @@ namespace champ
       return node_as<SubNodes<K, V, H>>(c_idx)->getp(depth + 1, hash, k);
     }
 
-    bool put_mut(SmallIndex depth, Hash hash, const K& k, const V& v)
+    bool put_mut(
+      SmallIndex depth,
+      Hash hash,
+      const K& k,
+      const V& v,
+      Owner owner_ = no_owner)
     {
       const auto idx = mask(hash, depth);
       auto c_idx = compressed_idx(idx);
@@ -204,13 +224,23 @@ namespace champ
         bool insert;
         if (depth < (collision_depth - 1))
         {
-          auto sn = *node_as<SubNodes<K, V, H>>(c_idx);
-          insert = sn.put_mut(depth + 1, hash, k, v);
+          const auto& sn0 = node_as<SubNodes<K, V, H>>(c_idx);
+          if (owner_ != no_owner && sn0->owner == owner_)
+            return sn0->put_mut(depth + 1, hash, k, v, owner_);
+
+          auto sn = *sn0;
+          sn.owner = owner_;
+          insert = sn.put_mut(depth + 1, hash, k, v, owner_);
           nodes[c_idx] = std::make_shared<SubNodes<K, V, H>>(std::move(sn));
         }
         else
         {
-          auto sn = *node_as<Collisions<K, V, H>>(c_idx);
+          const auto& sn0 = node_as<Collisions<K, V, H>>(c_idx);
+          if (owner_ != no_owner && sn0->owner == owner_)
+            return sn0->put_mut(hash, k, v);
+
+          auto sn = *sn0;
+          sn.owner = owner_;
           insert = sn.put_mut(hash, k, v);
           nodes[c_idx] = std::make_shared<Collisions<K, V, H>>(std::move(sn));
         }
@@ -230,7 +260,8 @@ namespace champ
         const auto idx0 = mask(hash0, depth + 1);
         auto sub_node =
           SubNodes<K, V, H>({entry0}, Bitmap(0), Bitmap(0).set(idx0));
-        sub_node.put_mut(depth + 1, hash, k, v);
+        sub_node.owner = owner_;
+        sub_node.put_mut(depth + 1, hash, k, v, owner_);
 
         nodes.erase(nodes.begin() + c_idx);
         data_map = data_map.clear(idx);
@@ -243,6 +274,7 @@ namespace champ
       else
       {
         auto sub_node = Collisions<K, V, H>();
+        sub_node.owner = owner_;
         const auto hash0 = H()(entry0->key);
         const auto idx0 = mask(hash0, collision_depth);
         sub_node.bins[idx0].push_back(entry0);
@@ -304,10 +336,15 @@ namespace champ
     }
   };
 
+  template <class K, class V, class H>
+  class Transient;
+
   template <class K, class V, class H = std::hash<K>>
   class Map
   {
   private:
+    friend class Transient<K, V, H>;
+
     std::shared_ptr<SubNodes<K, V, H>> root;
     size_t _size = 0;
 
@@ -359,5 +396,81 @@ namespace champ
     {
       return root->foreach(0, std::forward<F>(f));
     }
+
+    /** Create a Transient to apply a batch of puts to this map
+     *
+     * The returned Transient shares all nodes with this map, which is left
+     * unmodified.
+     */
+    Transient<K, V, H> transient() const
+    {
+      return Transient<K, V, H>(*this);
+    }
+  };
+
+  // A batch builder for a Map. The first put through a path copies its nodes,
+  // as for Map::put, but the copies are owned by the Transient and later puts
+  // through them mutate them in place. Applying N puts therefore allocates
+  // O(N) nodes, rather than O(N * depth). persistent() freezes the nodes built
+  // so far; the Transient remains usable, but will copy them again.
+  template <class K, class V, class H = std::hash<K>>
+  class Transient
+  {
+  private:
+    std::shared_ptr<SubNodes<K, V, H>> root;
+    size_t _size;
+    Owner owner;
+
+  public:
+    Transient(const Map<K, V, H>& map) :
+      root(map.root),
+      _size(map._size),
+      owner(new_owner())
+    {}
+
+    // A copy would share the owner, and mutate the nodes of the original
+    Transient(const Transient&) = delete;
+    Transient& operator=(const Transient&) = delete;
+    Transient(Transient&&) = default;
+    Transient& operator=(Transient&&) = default;
+
+    size_t size() const
+    {
+      return _size;
+    }
+
+    std::optional<V> get(const K& key) const
+    {
+      auto v = root->getp(0, H()(key), key);
+
+      if (v)
+        return *v;
+      else
+        return {};
+    }
+
+    const V* getp(const K& key) const
+    {
+      return root->getp(0, H()(key), key);
+    }
+
+    void put(const K& key, const V& value)
+    {
+      if (root->owner != owner)
+      {
+        auto node = *root;
+        node.owner = owner;
+        root = std::make_shared<SubNodes<K, V, H>>(std::move(node));
+      }
+
+      if (root->put_mut(0, H()(key), key, value, owner))
+        _size++;
+    }
+
+    const Map<K, V, H> persistent()
+    {
+      owner = new_owner();
+      return Map<K, V, H>(root, _size);
+    }
   };
 }
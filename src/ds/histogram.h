@@ -6,6 +6,7 @@
 #  include <intrin.h>
 #endif
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <limits>
@@ -113,45 +114,60 @@ namespace histogram
     static constexpr size_t SIGNIFICANT = (size_t)1 << SIGNIFICANT_BITS;
     static constexpr size_t SIGNIFICANT_MASK = (SIGNIFICANT >> 1) - 1;
 
-    V low;
-    V high;
+    // Each histogram is recorded to by one thread at a time, but may be read
+    // from others while it is recorded to, so its counters are atomic. As they
+    // have a single writer, they are incremented without read-modify-writes.
+    std::atomic<V> low;
+    std::atomic<V> high;
 
-    size_t underflow = 0;
-    size_t overflow = 0;
-    size_t count[BUCKETS];
+    std::atomic<size_t> underflow = 0;
+    std::atomic<size_t> overflow = 0;
+    std::atomic<size_t> count[BUCKETS] = {};
 
     This* next;
 
+    template <typename T>
+    static void increment(std::atomic<T>& counter, T by = 1)
+    {
+      counter.store(
+        counter.load(std::memory_order_relaxed) + by,
+        std::memory_order_relaxed);
+    }
+
   public:
-    Histogram(Global<This>& g) :
+    // A histogram that is not registered with any Global, eg. to add others to
+    Histogram() :
       low((std::numeric_limits<V>::max)()),
       high((std::numeric_limits<V>::min)()),
       next(nullptr)
+    {}
+
+    Histogram(Global<This>& g) : Histogram()
     {
       g.add(*this);
     }
 
     void record(V value)
     {
-      if (value < low)
-        low = value;
+      if (value < low.load(std::memory_order_relaxed))
+        low.store(value, std::memory_order_relaxed);
 
-      if (value > high)
-        high = value;
+      if (value > high.load(std::memory_order_relaxed))
+        high.store(value, std::memory_order_relaxed);
 
       if (value < LOW)
       {
-        underflow++;
+        increment(underflow);
       }
       else if (value >= HIGH)
       {
-        overflow++;
+        increment(overflow);
       }
       else
       {
         auto i = get_index(value);
         assert(i < BUCKETS);
-        count[i]++;
+        increment(count[i]);
       }
     }
 
@@ -188,6 +204,46 @@ namespace histogram
       return count[index];
     }
 
+    // Number of values recorded, including underflows and overflows
+    size_t get_total()
+    {
+      size_t total = underflow + overflow;
+
+      for (size_t i = 0; i < BUCKETS; i++)
+        total += count[i];
+
+      return total;
+    }
+
+    // Upper bound of the bucket holding the value at percentile p (0..1),
+    // clamped to the lowest and highest values recorded. 0 if none has been.
+    V get_percentile(double p)
+    {
+      const auto total = get_total();
+      if (total == 0)
+        return 0;
+
+      auto rank = (size_t)(p * total);
+      if (rank >= total)
+        rank = total - 1;
+
+      const V lowest = low;
+      const V highest = high;
+
+      size_t seen = underflow;
+      if (rank < seen)
+        return lowest;
+
+      for (size_t i = 0; i < BUCKETS; i++)
+      {
+        seen += count[i];
+        if (rank < seen)
+          return std::max(lowest, std::min(highest, get_range(i).second));
+      }
+
+      return highest;
+    }
+
     std::pair<V, V> get_range(size_t index)
     {
       if (index >= BUCKETS)
@@ -198,13 +254,13 @@ namespace histogram
 
     void add(Histogram<V, LOW, HIGH, SIGNIFICANT_BITS>& that)
     {
-      low = std::min(low, that.low);
-      high = std::max(high, that.high);
-      underflow += that.underflow;
-      overflow += that.overflow;
+      low = std::min(low.load(), that.low.load());
+      high = std::max(high.load(), that.high.load());
+      increment(underflow, that.underflow.load());
+      increment(overflow, that.overflow.load());
 
       for (size_t i = 0; i < BUCKETS; i++)
-        count[i] += that.count[i];
+        increment(count[i], that.count[i].load());
     }
 
     void print(std::stringstream& ss)
@@ -90,6 +90,21 @@ namespace std
   }
 }
 
+namespace ds
+{
+  namespace json
+  {
+    /** Refers to t as its base type, keeping its constness, so that the fields
+     * of a base may be visited with the same visitor as those of t
+     */
+    template <typename Base, typename T>
+    std::conditional_t<std::is_const_v<T>, const Base&, Base&> as_base(T& t)
+    {
+      return t;
+    }
+  }
+}
+
 // FOREACH macro machinery for counting args
 #define __FOR_JSON_COUNT_NN( \
   _0, \
@@ -367,6 +382,26 @@ namespace std
 #define FILL_SCHEMA_OPTIONAL_FOR_JSON_FINAL(TYPE, FIELD) \
   FILL_SCHEMA_OPTIONAL_WITH_RENAMES_FOR_JSON_FINAL(TYPE, FIELD, FIELD)
 
+#define VISIT_REQUIRED_WITH_RENAMES_FOR_JSON_NEXT(TYPE, C_FIELD, JSON_FIELD) \
+  v.required(#JSON_FIELD, t.C_FIELD);
+#define VISIT_REQUIRED_WITH_RENAMES_FOR_JSON_FINAL(TYPE, C_FIELD, JSON_FIELD) \
+  VISIT_REQUIRED_WITH_RENAMES_FOR_JSON_NEXT(TYPE, C_FIELD, JSON_FIELD)
+
+#define VISIT_REQUIRED_FOR_JSON_NEXT(TYPE, FIELD) \
+  VISIT_REQUIRED_WITH_RENAMES_FOR_JSON_NEXT(TYPE, FIELD, FIELD)
+#define VISIT_REQUIRED_FOR_JSON_FINAL(TYPE, FIELD) \
+  VISIT_REQUIRED_WITH_RENAMES_FOR_JSON_FINAL(TYPE, FIELD, FIELD)
+
+#define VISIT_OPTIONAL_WITH_RENAMES_FOR_JSON_NEXT(TYPE, C_FIELD, JSON_FIELD) \
+  v.optional(#JSON_FIELD, t.C_FIELD, t_default.C_FIELD);
+#define VISIT_OPTIONAL_WITH_RENAMES_FOR_JSON_FINAL(TYPE, C_FIELD, JSON_FIELD) \
+  VISIT_OPTIONAL_WITH_RENAMES_FOR_JSON_NEXT(TYPE, C_FIELD, JSON_FIELD)
+
+#define VISIT_OPTIONAL_FOR_JSON_NEXT(TYPE, FIELD) \
+  VISIT_OPTIONAL_WITH_RENAMES_FOR_JSON_NEXT(TYPE, FIELD, FIELD)
+#define VISIT_OPTIONAL_FOR_JSON_FINAL(TYPE, FIELD) \
+  VISIT_OPTIONAL_WITH_RENAMES_FOR_JSON_FINAL(TYPE, FIELD, FIELD)
+
 #define JSON_FIELD_FOR_JSON_NEXT(TYPE, FIELD) \
   JsonField<decltype(TYPE::FIELD)>{#FIELD},
 #define JSON_FIELD_FOR_JSON_FINAL(TYPE, FIELD) \
@@ -393,6 +428,11 @@ namespace std
  *  - If there are optional fields, add DECLARE_JSON_OPTIONAL_FIELDS
  *  - If the json and struct fields have different names, use WITH_RENAMES
  *
+ * visit_json_fields is also defined, calling v.required(name, field) and
+ * v.optional(name, field, default_value) for each field (including those of
+ * the base). This lets other formats, such as msgpack in json_msgpack.h,
+ * (de)serialise these types directly rather than through a JSON document.
+ *
  * Examples:
  *  struct X
  *  {
@@ -473,13 +513,21 @@ namespace std
   PRE_FROM_JSON, \
   POST_FROM_JSON, \
   PRE_FILL_SCHEMA, \
-  POST_FILL_SCHEMA) \
+  POST_FILL_SCHEMA, \
+  PRE_VISIT, \
+  POST_VISIT) \
   void to_json_required_fields(nlohmann::json& j, const TYPE& t); \
   void to_json_optional_fields(nlohmann::json& j, const TYPE& t); \
   void from_json_required_fields(const nlohmann::json& j, TYPE& t); \
   void from_json_optional_fields(const nlohmann::json& j, TYPE& t); \
   void fill_json_schema_required_fields(nlohmann::json& j, const TYPE& t); \
   void fill_json_schema_optional_fields(nlohmann::json& j, const TYPE& t); \
+  template <typename T, typename V> \
+  std::enable_if_t<std::is_same_v<std::remove_const_t<T>, TYPE>> \
+  visit_json_required_fields(T& t, V& v); \
+  template <typename T, typename V> \
+  std::enable_if_t<std::is_same_v<std::remove_const_t<T>, TYPE>> \
+  visit_json_optional_fields(T& t, V& v); \
   inline void to_json(nlohmann::json& j, const TYPE& t) \
   { \
     PRE_TO_JSON; \
@@ -497,9 +545,17 @@ namespace std
     PRE_FILL_SCHEMA; \
     fill_json_schema_required_fields(j, t); \
     POST_FILL_SCHEMA; \
+  } \
+  template <typename T, typename V> \
+  inline std::enable_if_t<std::is_same_v<std::remove_const_t<T>, TYPE>> \
+  visit_json_fields(T& t, V& v) \
+  { \
+    PRE_VISIT; \
+    visit_json_required_fields(t, v); \
+    POST_VISIT; \
   }
 
-#define DECLARE_JSON_TYPE(TYPE) DECLARE_JSON_TYPE_IMPL(TYPE, , , , , , )
+#define DECLARE_JSON_TYPE(TYPE) DECLARE_JSON_TYPE_IMPL(TYPE, , , , , , , , )
 
 #define DECLARE_JSON_TYPE_WITH_BASE(TYPE, BASE) \
   DECLARE_JSON_TYPE_IMPL( \
@@ -508,7 +564,9 @@ namespace std
     , \
     from_json(j, static_cast<BASE&>(t)), \
     , \
-    fill_json_schema(j, static_cast<const BASE&>(t)), )
+    fill_json_schema(j, static_cast<const BASE&>(t)), \
+    , \
+    visit_json_fields(::ds::json::as_base<BASE>(t), v), )
 
 #define DECLARE_JSON_TYPE_WITH_OPTIONAL_FIELDS(TYPE) \
   DECLARE_JSON_TYPE_IMPL( \
@@ -518,7 +576,9 @@ namespace std
     , \
     from_json_optional_fields(j, t), \
     , \
-    fill_json_schema_optional_fields(j, t))
+    fill_json_schema_optional_fields(j, t), \
+    , \
+    visit_json_optional_fields(t, v))
 
 #define DECLARE_JSON_TYPE_WITH_BASE_AND_OPTIONAL_FIELDS(TYPE, BASE) \
   DECLARE_JSON_TYPE_IMPL( \
@@ -528,7 +588,9 @@ namespace std
     from_json(j, static_cast<BASE&>(t)), \
     from_json_optional_fields(j, t), \
     fill_json_schema(j, static_cast<const BASE&>(t)), \
-    fill_json_schema_optional_fields(j, t))
+    fill_json_schema_optional_fields(j, t), \
+    visit_json_fields(::ds::json::as_base<BASE>(t), v), \
+    visit_json_optional_fields(t, v))
 
 #define DECLARE_JSON_REQUIRED_FIELDS(TYPE, ...) \
   inline void to_json_required_fields(nlohmann::json& j, const TYPE& t) \
@@ -552,6 +614,12 @@ namespace std
     j["type"] = "object"; \
     _FOR_JSON_COUNT_NN(__VA_ARGS__) \
     (POP1)(FILL_SCHEMA_REQUIRED, TYPE, ##__VA_ARGS__) \
+  } \
+  template <typename T, typename V> \
+  inline std::enable_if_t<std::is_same_v<std::remove_const_t<T>, TYPE>> \
+  visit_json_required_fields(T& t, V& v) \
+  { \
+    _FOR_JSON_COUNT_NN(__VA_ARGS__)(POP1)(VISIT_REQUIRED, TYPE, ##__VA_ARGS__) \
   }
 
 #define DECLARE_JSON_REQUIRED_FIELDS_WITH_RENAMES(TYPE, ...) \
@@ -578,6 +646,13 @@ namespace std
     j["type"] = "object"; \
     _FOR_JSON_COUNT_NN(__VA_ARGS__) \
     (POP2)(FILL_SCHEMA_REQUIRED_WITH_RENAMES, TYPE, ##__VA_ARGS__) \
+  } \
+  template <typename T, typename V> \
+  inline std::enable_if_t<std::is_same_v<std::remove_const_t<T>, TYPE>> \
+  visit_json_required_fields(T& t, V& v) \
+  { \
+    _FOR_JSON_COUNT_NN(__VA_ARGS__) \
+    (POP2)(VISIT_REQUIRED_WITH_RENAMES, TYPE, ##__VA_ARGS__) \
   }
 
 #define DECLARE_JSON_OPTIONAL_FIELDS(TYPE, ...) \
@@ -595,6 +670,13 @@ namespace std
   { \
     _FOR_JSON_COUNT_NN(__VA_ARGS__) \
     (POP1)(FILL_SCHEMA_OPTIONAL, TYPE, ##__VA_ARGS__) \
+  } \
+  template <typename T, typename V> \
+  inline std::enable_if_t<std::is_same_v<std::remove_const_t<T>, TYPE>> \
+  visit_json_optional_fields(T& t, V& v) \
+  { \
+    const TYPE t_default{}; \
+    _FOR_JSON_COUNT_NN(__VA_ARGS__)(POP1)(VISIT_OPTIONAL, TYPE, ##__VA_ARGS__) \
   }
 
 #define DECLARE_JSON_OPTIONAL_FIELDS_WITH_RENAMES(TYPE, ...) \
@@ -614,6 +696,14 @@ namespace std
   { \
     _FOR_JSON_COUNT_NN(__VA_ARGS__) \
     (POP2)(FILL_SCHEMA_OPTIONAL_WITH_RENAMES, TYPE, ##__VA_ARGS__) \
+  } \
+  template <typename T, typename V> \
+  inline std::enable_if_t<std::is_same_v<std::remove_const_t<T>, TYPE>> \
+  visit_json_optional_fields(T& t, V& v) \
+  { \
+    const TYPE t_default{}; \
+    _FOR_JSON_COUNT_NN(__VA_ARGS__) \
+    (POP2)(VISIT_OPTIONAL_WITH_RENAMES, TYPE, ##__VA_ARGS__) \
   }
 
 #define DECLARE_JSON_ENUM(TYPE, ...) \
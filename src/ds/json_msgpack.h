@@ -0,0 +1,442 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "json.h"
+
+#include <cstring>
+#include <msgpack.hpp>
+
+/** Converts types declared with the DECLARE_JSON_* macros directly to and from
+ * msgpack, without building an intermediate nlohmann::json document. The
+ * msgpack is equivalent to that produced and accepted for their JSON
+ * representation by nlohmann::json::to_msgpack and from_msgpack, though object
+ * fields are written in declaration order rather than sorted.
+ *
+ * Types not declared with these macros, other than optionals, vectors,
+ * strings and arithmetic types, are converted through nlohmann::json.
+ */
+namespace ds
+{
+  namespace json
+  {
+    template <typename T>
+    void read_msgpack(const msgpack::object& o, T& t);
+
+    template <typename Stream, typename T>
+    void write_msgpack(msgpack::packer<Stream>& pk, const T& t);
+
+    namespace
+    {
+      struct NoopVisitor
+      {
+        template <typename F>
+        void required(const char*, F&)
+        {}
+
+        template <typename F, typename D>
+        void optional(const char*, F&, const D&)
+        {}
+      };
+
+      template <typename T, typename = void>
+      struct has_json_fields : std::false_type
+      {};
+
+      template <typename T>
+      struct has_json_fields<
+        T,
+        std::void_t<decltype(visit_json_fields(
+          std::declval<T&>(), std::declval<NoopVisitor&>()))>>
+        : std::true_type
+      {};
+
+      template <typename T>
+      struct is_optional : std::false_type
+      {};
+
+      template <typename T>
+      struct is_optional<std::optional<T>> : std::true_type
+      {};
+
+      template <typename T>
+      struct is_vector : std::false_type
+      {};
+
+      template <typename T>
+      struct is_vector<std::vector<T>> : std::true_type
+      {};
+    }
+
+    inline nlohmann::json msgpack_to_json(const msgpack::object& o)
+    {
+      switch (o.type)
+      {
+        case msgpack::type::NIL:
+          return nullptr;
+        case msgpack::type::BOOLEAN:
+          return o.via.boolean;
+        case msgpack::type::POSITIVE_INTEGER:
+          return o.via.u64;
+        case msgpack::type::NEGATIVE_INTEGER:
+          return o.via.i64;
+        case msgpack::type::FLOAT32:
+        case msgpack::type::FLOAT64:
+          return o.via.f64;
+        case msgpack::type::STR:
+          return std::string(o.via.str.ptr, o.via.str.size);
+        case msgpack::type::ARRAY:
+        {
+          auto j = nlohmann::json::array();
+          for (auto i = 0u; i < o.via.array.size; ++i)
+          {
+            j.push_back(msgpack_to_json(o.via.array.ptr[i]));
+          }
+          return j;
+        }
+        case msgpack::type::MAP:
+        {
+          auto j = nlohmann::json::object();
+          for (auto i = 0u; i < o.via.map.size; ++i)
+          {
+            const auto& kv = o.via.map.ptr[i];
+            if (kv.key.type != msgpack::type::STR)
+            {
+              throw JsonParseError("Expected string keys in msgpack map");
+            }
+            j[std::string(kv.key.via.str.ptr, kv.key.via.str.size)] =
+              msgpack_to_json(kv.val);
+          }
+          return j;
+        }
+        default:
+          throw JsonParseError(
+            fmt::format("Unsupported msgpack type: {}", (int)o.type));
+      }
+    }
+
+    template <typename Stream>
+    void json_to_msgpack(msgpack::packer<Stream>& pk, const nlohmann::json& j)
+    {
+      switch (j.type())
+      {
+        case nlohmann::json::value_t::boolean:
+          pk.pack(j.get<bool>());
+          break;
+        case nlohmann::json::value_t::number_integer:
+          pk.pack(j.get<int64_t>());
+          break;
+        case nlohmann::json::value_t::number_unsigned:
+          pk.pack(j.get<uint64_t>());
+          break;
+        case nlohmann::json::value_t::number_float:
+          pk.pack_double(j.get<double>());
+          break;
+        case nlohmann::json::value_t::string:
+        {
+          const auto& s = j.get_ref<const std::string&>();
+          pk.pack_str(s.size());
+          pk.pack_str_body(s.data(), s.size());
+          break;
+        }
+        case nlohmann::json::value_t::array:
+          pk.pack_array(j.size());
+          for (const auto& e : j)
+          {
+            json_to_msgpack(pk, e);
+          }
+          break;
+        case nlohmann::json::value_t::object:
+          pk.pack_map(j.size());
+          for (auto it = j.begin(); it != j.end(); ++it)
+          {
+            pk.pack_str(it.key().size());
+            pk.pack_str_body(it.key().data(), it.key().size());
+            json_to_msgpack(pk, it.value());
+          }
+          break;
+        default:
+          pk.pack_nil();
+          break;
+      }
+    }
+
+    namespace
+    {
+      class MsgpackFieldReader
+      {
+      private:
+        const msgpack::object& o;
+
+        const msgpack::object* find(const char* name) const
+        {
+          const auto size = strlen(name);
+          for (auto i = 0u; i < o.via.map.size; ++i)
+          {
+            const auto& key = o.via.map.ptr[i].key;
+            if (
+              key.type == msgpack::type::STR && key.via.str.size == size &&
+              memcmp(key.via.str.ptr, name, size) == 0)
+            {
+              return &o.via.map.ptr[i].val;
+            }
+          }
+          return nullptr;
+        }
+
+      public:
+        MsgpackFieldReader(const msgpack::object& o) : o(o) {}
+
+        template <typename F>
+        void required(const char* name, F& field)
+        {
+          const auto v = find(name);
+          if (v == nullptr)
+          {
+            throw JsonParseError(fmt::format(
+              "Missing required field '{}' in object: {}",
+              name,
+              msgpack_to_json(o).dump()));
+          }
+
+          try
+          {
+            read_msgpack(*v, field);
+          }
+          catch (JsonParseError& jpe)
+          {
+            jpe.pointer_elements.push_back(name);
+            throw;
+          }
+        }
+
+        template <typename F>
+        void optional(const char* name, F& field, const F&)
+        {
+          const auto v = find(name);
+          if (v != nullptr)
+          {
+            read_msgpack(*v, field);
+          }
+        }
+      };
+
+      // Visits the fields twice: first to count those to be written, for the
+      // map header, and then to write them
+      template <typename Stream>
+      class MsgpackFieldWriter
+      {
+      private:
+        msgpack::packer<Stream>& pk;
+        bool counting = true;
+        size_t count = 0;
+
+      public:
+        MsgpackFieldWriter(msgpack::packer<Stream>& pk) : pk(pk) {}
+
+        template <typename T>
+        void write(const T& t)
+        {
+          visit_json_fields(t, *this);
+          pk.pack_map(count);
+          counting = false;
+          visit_json_fields(t, *this);
+        }
+
+        template <typename F>
+        void required(const char* name, const F& field)
+        {
+          if (counting)
+          {
+            ++count;
+            return;
+          }
+
+          const auto size = strlen(name);
+          pk.pack_str(size);
+          pk.pack_str_body(name, size);
+          write_msgpack(pk, field);
+        }
+
+        template <typename F>
+        void optional(const char* name, const F& field, const F& default_value)
+        {
+          if (field != default_value)
+          {
+            required(name, field);
+          }
+        }
+      };
+    }
+
+    /** Read t from a msgpack object, as from_json would from its JSON
+     * equivalent
+     *
+     * @throws JsonParseError if o does not match the type of t
+     */
+    template <typename T>
+    void read_msgpack(const msgpack::object& o, T& t)
+    {
+      if constexpr (has_json_fields<T>::value)
+      {
+        if (o.type != msgpack::type::MAP)
+        {
+          throw JsonParseError(
+            "Expected object, found: " + msgpack_to_json(o).dump());
+        }
+        MsgpackFieldReader reader(o);
+        visit_json_fields(t, reader);
+      }
+      else if constexpr (is_optional<T>::value)
+      {
+        if (o.type != msgpack::type::NIL)
+        {
+          typename T::value_type v;
+          read_msgpack(o, v);
+          t = std::move(v);
+        }
+      }
+      else if constexpr (is_vector<T>::value)
+      {
+        if (o.type != msgpack::type::ARRAY)
+        {
+          throw JsonParseError(
+            "Expected array, found: " + msgpack_to_json(o).dump());
+        }
+
+        t.reserve(t.size() + o.via.array.size);
+        for (auto i = 0u; i < o.via.array.size; ++i)
+        {
+          try
+          {
+            typename T::value_type e;
+            read_msgpack(o.via.array.ptr[i], e);
+            t.push_back(std::move(e));
+          }
+          catch (JsonParseError& jpe)
+          {
+            jpe.pointer_elements.push_back(std::to_string(i));
+            throw;
+          }
+        }
+      }
+      else if constexpr (std::is_same_v<T, std::string>)
+      {
+        if (o.type != msgpack::type::STR)
+        {
+          throw JsonParseError(
+            "Expected string, found: " + msgpack_to_json(o).dump());
+        }
+        t.assign(o.via.str.ptr, o.via.str.size);
+      }
+      else if constexpr (std::is_same_v<T, bool>)
+      {
+        if (o.type != msgpack::type::BOOLEAN)
+        {
+          throw JsonParseError(
+            "Expected boolean, found: " + msgpack_to_json(o).dump());
+        }
+        t = o.via.boolean;
+      }
+      else if constexpr (std::is_arithmetic_v<T>)
+      {
+        // Converted as nlohmann::json's get<T>() would be, including between
+        // integers and floats
+        switch (o.type)
+        {
+          case msgpack::type::POSITIVE_INTEGER:
+            t = static_cast<T>(o.via.u64);
+            break;
+          case msgpack::type::NEGATIVE_INTEGER:
+            t = static_cast<T>(o.via.i64);
+            break;
+          case msgpack::type::FLOAT32:
+          case msgpack::type::FLOAT64:
+            t = static_cast<T>(o.via.f64);
+            break;
+          default:
+            throw JsonParseError(
+              "Expected number, found: " + msgpack_to_json(o).dump());
+        }
+      }
+      else if constexpr (std::is_same_v<T, nlohmann::json>)
+      {
+        t = msgpack_to_json(o);
+      }
+      else
+      {
+        t = msgpack_to_json(o).template get<T>();
+      }
+    }
+
+    /** Write t as msgpack, as to_json would write it as JSON
+     */
+    template <typename Stream, typename T>
+    void write_msgpack(msgpack::packer<Stream>& pk, const T& t)
+    {
+      if constexpr (has_json_fields<T>::value)
+      {
+        MsgpackFieldWriter<Stream> writer(pk);
+        writer.write(t);
+      }
+      else if constexpr (is_optional<T>::value)
+      {
+        if (t.has_value())
+        {
+          write_msgpack(pk, t.value());
+        }
+        else
+        {
+          pk.pack_nil();
+        }
+      }
+      else if constexpr (is_vector<T>::value)
+      {
+        pk.pack_array(t.size());
+        for (const auto& e : t)
+        {
+          write_msgpack(pk, e);
+        }
+      }
+      else if constexpr (std::is_same_v<T, std::string>)
+      {
+        pk.pack_str(t.size());
+        pk.pack_str_body(t.data(), t.size());
+      }
+      else if constexpr (std::is_floating_point_v<T>)
+      {
+        pk.pack_double(t);
+      }
+      else if constexpr (std::is_arithmetic_v<T>)
+      {
+        pk.pack(t);
+      }
+      else if constexpr (std::is_same_v<T, nlohmann::json>)
+      {
+        json_to_msgpack(pk, t);
+      }
+      else
+      {
+        json_to_msgpack(pk, nlohmann::json(t));
+      }
+    }
+
+    template <typename T>
+    T from_msgpack(const uint8_t* data, size_t size)
+    {
+      const auto handle = msgpack::unpack((const char*)data, size);
+      T t;
+      read_msgpack(handle.get(), t);
+      return t;
+    }
+
+    template <typename T>
+    std::vector<uint8_t> to_msgpack(const T& t)
+    {
+      msgpack::sbuffer sb;
+      msgpack::packer<msgpack::sbuffer> pk(sb);
+      write_msgpack(pk, t);
+      return {(const uint8_t*)sb.data(), (const uint8_t*)sb.data() + sb.size()};
+    }
+  }
+}
@@ -0,0 +1,103 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <fmt/format_header_only.h>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <valijson/adapters/nlohmann_json_adapter.hpp>
+#include <valijson/schema.hpp>
+#include <valijson/schema_parser.hpp>
+#include <valijson/validator.hpp>
+
+namespace fmt
+{
+  template <>
+  struct formatter<valijson::ValidationResults::Error>
+  {
+    template <typename ParseContext>
+    constexpr auto parse(ParseContext& ctx)
+    {
+      return ctx.begin();
+    }
+
+    template <typename FormatContext>
+    auto format(const valijson::ValidationResults::Error& e, FormatContext& ctx)
+    {
+      return format_to(
+        ctx.begin(), "[{}] {}", fmt::join(e.context, ""), e.description);
+    }
+  };
+
+  template <>
+  struct formatter<valijson::ValidationResults>
+  {
+    template <typename ParseContext>
+    constexpr auto parse(ParseContext& ctx)
+    {
+      return ctx.begin();
+    }
+
+    template <typename FormatContext>
+    auto format(const valijson::ValidationResults& vr, FormatContext& ctx)
+    {
+      return format_to(ctx.begin(), "{}", fmt::join(vr, "\n\t"));
+    }
+  };
+}
+
+namespace ds
+{
+  namespace json
+  {
+    /** Validates documents against a JSON schema
+     *
+     * The schema is parsed once, on construction, rather than for each
+     * document. Validation does not modify the validator, so a single
+     * validator may be shared between threads.
+     */
+    class SchemaValidator
+    {
+    private:
+      std::unique_ptr<valijson::Schema> schema;
+
+    public:
+      /** Parse a schema
+       *
+       * @param j_schema JSON schema
+       *
+       * @throws std::exception if the schema cannot be parsed
+       */
+      SchemaValidator(const nlohmann::json& j_schema) :
+        schema(std::make_unique<valijson::Schema>())
+      {
+        valijson::SchemaParser parser;
+        valijson::adapters::NlohmannJsonAdapter schema_adapter(j_schema);
+        parser.populateSchema(schema_adapter, *schema);
+      }
+
+      /** Validate a document against the schema
+       *
+       * @return Description of every validation error, or nothing if the
+       * document is valid
+       */
+      std::optional<std::string> validate(const nlohmann::json& j) const
+      {
+        valijson::Validator validator;
+        valijson::adapters::NlohmannJsonAdapter adapter(j);
+
+        // Without results, validation stops at the first failure. The errors
+        // are only collected, with a second pass, for invalid documents.
+        if (validator.validate(*schema, adapter, nullptr))
+        {
+          return std::nullopt;
+        }
+
+        valijson::ValidationResults results;
+        validator.validate(*schema, adapter, &results);
+        return fmt::format("Error during validation:\n\t{}", results);
+      }
+    };
+  }
+}
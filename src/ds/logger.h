@@ -4,6 +4,9 @@
 
 #include "ringbuffer.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
 #include <cstring>
 #include <ctime>
@@ -13,11 +16,13 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
 #include <optional>
 #include <sstream>
 #include <string>
 #include <thread>
+#include <vector>
 
 extern std::map<std::thread::id, uint16_t> thread_ids;
 
@@ -35,6 +40,9 @@ namespace logger
 
   static constexpr size_t ns_per_s = 1'000'000'000;
 
+  // Reported as the thread id of lines logged on the host
+  static constexpr uint16_t host_thread_id = 100;
+
   class AbstractLogger
   {
   protected:
@@ -252,6 +260,19 @@ namespace logger
       return the_msg;
     }
 
+    // Messages describing each LogSite, and carrying the records logged there
+    static inline int& site_msg()
+    {
+      static int the_msg = ringbuffer::Const::msg_none;
+      return the_msg;
+    }
+
+    static inline int& record_msg()
+    {
+      static int the_msg = ringbuffer::Const::msg_none;
+      return the_msg;
+    }
+
     static inline ringbuffer::WriterPtr& writer()
     {
       static ringbuffer::WriterPtr the_writer;
@@ -276,7 +297,7 @@ namespace logger
     // from the enclave. Combined with the elapsed ms reported by the enclave,
     // and used to compute the offset between time inside the enclave, and time
     // on the host when the log message is received.
-    static ::timespec start;
+    static inline ::timespec start{0, 0};
 
     static void set_start(
       const std::chrono::time_point<std::chrono::system_clock>& start_)
@@ -290,6 +311,14 @@ namespace logger
           .count() -
         start.tv_sec * ns_per_s;
     }
+
+    // Held while writing to the loggers, which may be written to by the
+    // AsyncWriter's thread as well as by the thread logging a line
+    static inline std::mutex& write_lock()
+    {
+      static std::mutex the_lock;
+      return the_lock;
+    }
 #endif
 
     static inline bool ok(Level l)
@@ -298,6 +327,232 @@ namespace logger
     }
   };
 
+  /** A LOG_*_FMT statement. Each is constructed on its first use and lives
+   * for the rest of the program, so that log records can refer to it rather
+   * than carrying its file name and format string.
+   */
+  struct LogSite
+  {
+    Level level;
+    const char* file_name;
+    size_t line_number;
+    const char* format;
+
+#ifdef INSIDE_ENCLAVE
+    // The host cannot read enclave memory, so each site is described to it
+    // once, on construction, and records refer to the site by this id
+    uint32_t id;
+
+    static inline std::atomic<uint32_t>& next_id()
+    {
+      static std::atomic<uint32_t> the_id = 0;
+      return the_id;
+    }
+
+    LogSite(
+      Level level,
+      const char* file_name,
+      size_t line_number,
+      const char* format) :
+      level(level),
+      file_name(file_name),
+      line_number(line_number),
+      format(format),
+      id(next_id()++)
+    {
+      config::writer()->write(
+        config::site_msg(),
+        id,
+        level,
+        std::string(file_name),
+        line_number,
+        std::string(format));
+    }
+#else
+    LogSite(
+      Level level,
+      const char* file_name,
+      size_t line_number,
+      const char* format) :
+      level(level),
+      file_name(file_name),
+      line_number(line_number),
+      format(format)
+    {}
+#endif
+  };
+
+  // Log records hold the arguments of a LOG_*_FMT statement in a compact
+  // binary form, each prefixed by its type, to be formatted later
+  enum class ArgType : uint8_t
+  {
+    Signed,
+    Unsigned,
+    Float,
+    Bool,
+    Char,
+    String,
+    Pointer
+  };
+
+  static constexpr size_t max_record_args = 32;
+
+  template <typename T>
+  static constexpr bool is_string_arg =
+    std::is_convertible_v<const T&, fmt::string_view>;
+
+  /** Arguments of types that records cannot hold are formatted immediately,
+   * and recorded as strings
+   */
+  template <typename T>
+  decltype(auto) to_record_arg(const T& t)
+  {
+    if constexpr (
+      (std::is_arithmetic_v<T> && !std::is_same_v<T, long double>) ||
+      is_string_arg<T> || std::is_pointer_v<T>)
+    {
+      return (t);
+    }
+    else
+    {
+      return fmt::format("{}", t);
+    }
+  }
+
+  template <typename T>
+  size_t record_arg_size(const T& t)
+  {
+    if constexpr (std::is_same_v<T, bool> || std::is_same_v<T, char>)
+    {
+      return sizeof(ArgType) + sizeof(T);
+    }
+    else if constexpr (is_string_arg<T>)
+    {
+      return sizeof(ArgType) + sizeof(uint32_t) + fmt::string_view(t).size();
+    }
+    else
+    {
+      return sizeof(ArgType) + sizeof(uint64_t);
+    }
+  }
+
+  template <typename T>
+  void write_record_arg(uint8_t*& data, size_t& size, const T& t)
+  {
+    if constexpr (std::is_same_v<T, bool>)
+    {
+      serialized::write(data, size, ArgType::Bool);
+      serialized::write(data, size, t);
+    }
+    else if constexpr (std::is_same_v<T, char>)
+    {
+      serialized::write(data, size, ArgType::Char);
+      serialized::write(data, size, t);
+    }
+    else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+    {
+      serialized::write(data, size, ArgType::Signed);
+      serialized::write(data, size, static_cast<int64_t>(t));
+    }
+    else if constexpr (std::is_integral_v<T>)
+    {
+      serialized::write(data, size, ArgType::Unsigned);
+      serialized::write(data, size, static_cast<uint64_t>(t));
+    }
+    else if constexpr (std::is_floating_point_v<T>)
+    {
+      serialized::write(data, size, ArgType::Float);
+      serialized::write(data, size, static_cast<double>(t));
+    }
+    else if constexpr (is_string_arg<T>)
+    {
+      const fmt::string_view s(t);
+      serialized::write(data, size, ArgType::String);
+      serialized::write(data, size, static_cast<uint32_t>(s.size()));
+      serialized::write(
+        data, size, reinterpret_cast<const uint8_t*>(s.data()), s.size());
+    }
+    else
+    {
+      serialized::write(data, size, ArgType::Pointer);
+      serialized::write(data, size, reinterpret_cast<uint64_t>(t));
+    }
+  }
+
+  /** Format the arguments of a log record, as fmt::format would have formatted
+   * the arguments they were written from. By now, the statement that logged
+   * the record may have returned, so errors are reported in the returned
+   * message rather than thrown.
+   */
+  inline std::string format_record(
+    const char* format, const uint8_t* data, size_t size)
+  {
+    std::array<fmt::basic_format_arg<fmt::format_context>, max_record_args>
+      args;
+    size_t count = 0;
+
+    try
+    {
+      while (size > 0)
+      {
+        if (count == args.size())
+          throw std::logic_error("Too many arguments in log record");
+
+        auto& arg = args[count++];
+        switch (serialized::read<ArgType>(data, size))
+        {
+          case ArgType::Signed:
+            arg = fmt::internal::make_arg<fmt::format_context>(
+              static_cast<long long>(serialized::read<int64_t>(data, size)));
+            break;
+          case ArgType::Unsigned:
+            arg = fmt::internal::make_arg<fmt::format_context>(
+              static_cast<unsigned long long>(
+                serialized::read<uint64_t>(data, size)));
+            break;
+          case ArgType::Float:
+            arg = fmt::internal::make_arg<fmt::format_context>(
+              serialized::read<double>(data, size));
+            break;
+          case ArgType::Bool:
+            arg = fmt::internal::make_arg<fmt::format_context>(
+              serialized::read<bool>(data, size));
+            break;
+          case ArgType::Char:
+            arg = fmt::internal::make_arg<fmt::format_context>(
+              serialized::read<char>(data, size));
+            break;
+          case ArgType::String:
+          {
+            const auto length = serialized::read<uint32_t>(data, size);
+            if (length > size)
+              throw std::logic_error("Truncated string in log record");
+
+            arg = fmt::internal::make_arg<fmt::format_context>(
+              fmt::string_view(reinterpret_cast<const char*>(data), length));
+            data += length;
+            size -= length;
+            break;
+          }
+          case ArgType::Pointer:
+            arg = fmt::internal::make_arg<fmt::format_context>(
+              reinterpret_cast<const void*>(
+                serialized::read<uint64_t>(data, size)));
+            break;
+          default:
+            throw std::logic_error("Unknown argument type in log record");
+        }
+      }
+
+      return fmt::vformat(format, fmt::format_args(args.data(), count));
+    }
+    catch (const std::exception& e)
+    {
+      return fmt::format(
+        "Could not format log record \"{}\": {}", format, e.what());
+    }
+  }
+
   class LogLine
   {
   private:
@@ -318,7 +573,7 @@ namespace logger
 #ifdef INSIDE_ENCLAVE
       thread_id(thread_ids[std::this_thread::get_id()])
 #else
-      thread_id(100)
+      thread_id(host_thread_id)
 #endif
     {}
 
@@ -358,8 +613,41 @@ namespace logger
 
       return true;
     }
+
+    static void write_record(
+      const LogSite& site, const uint8_t* args, size_t args_size)
+    {
+      const auto elapsed = config::elapsed_ms();
+      const uint16_t thread_id = thread_ids[std::this_thread::get_id()];
+
+      // Written as write(record_msg(), elapsed, site.id, thread_id, args)
+      // would be, but without allocating a section for each field
+      auto& writer = config::writer();
+      const auto marker = writer->prepare(
+        config::record_msg(),
+        sizeof(elapsed) + sizeof(site.id) + sizeof(thread_id) + args_size);
+      auto next = writer->write_bytes(
+        marker, reinterpret_cast<const uint8_t*>(&elapsed), sizeof(elapsed));
+      next = writer->write_bytes(
+        next, reinterpret_cast<const uint8_t*>(&site.id), sizeof(site.id));
+      next = writer->write_bytes(
+        next, reinterpret_cast<const uint8_t*>(&thread_id), sizeof(thread_id));
+      writer->write_bytes(next, args, args_size);
+      writer->finish(marker);
+    }
   };
 #else
+  // A log record, as queued by the AsyncWriter. Followed by args_size bytes of
+  // arguments.
+  struct RecordHeader
+  {
+    const LogSite* site;
+    ::timespec ts;
+    std::optional<size_t> ms_offset_from_start;
+    uint16_t thread_id;
+    uint32_t args_size;
+  };
+
   struct Out
   {
     bool operator==(LogLine& line)
@@ -375,6 +663,12 @@ namespace logger
       return true;
     }
 
+    /** Write the records queued by the AsyncWriter that must be written
+     * before a line at log_level is written immediately, so that it does not
+     * overtake them.
+     */
+    static void flush_queued(const Level& log_level);
+
     static void write(
       const std::string& file_name,
       size_t line_number,
@@ -382,23 +676,14 @@ namespace logger
       uint16_t thread_id,
       const std::string& msg)
     {
+      flush_queued(log_level);
+
       // When logging from host code, print local time.
       ::timespec ts;
       ::timespec_get(&ts, TIME_UTC);
-      std::tm now;
-      ::gmtime_r(&ts.tv_sec, &now);
 
-      for (auto const& logger : config::loggers())
-      {
-        logger->write(logger->format(
-          file_name,
-          line_number,
-          config::to_string(log_level),
-          msg,
-          now,
-          ts,
-          thread_id));
-      }
+      write_at(
+        file_name, line_number, log_level, thread_id, msg, ts, std::nullopt);
     }
 
     static void write(
@@ -409,54 +694,86 @@ namespace logger
       const std::string& msg,
       size_t ms_offset_from_start)
     {
-      // When logging messages received from the enclave, print local time,
-      // and the offset to time inside the enclave at the time the message
-      // was logged there.
-      // Not thread-safe (uses std::localtime)
+      flush_queued(log_level);
+
       ::timespec ts;
       ::timespec_get(&ts, TIME_UTC);
+
+      write_at(
+        file_name,
+        line_number,
+        log_level,
+        thread_id,
+        msg,
+        ts,
+        ms_offset_from_start);
+    }
+
+    /** Write a line logged at host time ts. Lines received from the enclave
+     * also print the offset to time inside the enclave, ms_offset_from_start
+     * after it started, when the line was logged there.
+     */
+    static void write_at(
+      const std::string& file_name,
+      size_t line_number,
+      const Level& log_level,
+      uint16_t thread_id,
+      const std::string& msg,
+      const ::timespec& ts,
+      std::optional<size_t> ms_offset_from_start)
+    {
       std::tm now;
       ::gmtime_r(&ts.tv_sec, &now);
-      time_t elapsed_s = ms_offset_from_start / 1000;
-      ssize_t elapsed_ns = (ms_offset_from_start % 1000) * 1000000;
-
-      // Enclave time is recomputed every time. If multiple threads
-      // log inside the enclave, offsets may not always increase
-      ::timespec enclave_ts{logger::config::start.tv_sec + elapsed_s,
-                            logger::config::start.tv_nsec + elapsed_ns};
 
-      if (enclave_ts.tv_nsec > ns_per_s)
+      std::optional<::timespec> enclave_ts;
+      if (ms_offset_from_start.has_value())
       {
-        enclave_ts.tv_sec++;
-        enclave_ts.tv_nsec -= ns_per_s;
-      }
+        time_t elapsed_s = ms_offset_from_start.value() / 1000;
+        ssize_t elapsed_ns = (ms_offset_from_start.value() % 1000) * 1000000;
 
-      // We assume time in the enclave is behind (less than) time on the host.
-      // This would reliably be the case if we used a monotonic clock,
-      // but we want human-readable wall-clock time. Inaccurate offsets may
-      // occasionally occur as a result.
-      enclave_ts.tv_sec = ts.tv_sec - enclave_ts.tv_sec;
-      enclave_ts.tv_nsec = ts.tv_nsec - enclave_ts.tv_nsec;
-      if (enclave_ts.tv_nsec < 0)
-      {
-        enclave_ts.tv_sec--;
-        enclave_ts.tv_nsec += ns_per_s;
+        // Enclave time is recomputed every time. If multiple threads
+        // log inside the enclave, offsets may not always increase
+        ::timespec offset{logger::config::start.tv_sec + elapsed_s,
+                          logger::config::start.tv_nsec + elapsed_ns};
+
+        if (offset.tv_nsec > ns_per_s)
+        {
+          offset.tv_sec++;
+          offset.tv_nsec -= ns_per_s;
+        }
+
+        // We assume time in the enclave is behind (less than) time on the
+        // host. This would reliably be the case if we used a monotonic clock,
+        // but we want human-readable wall-clock time. Inaccurate offsets may
+        // occasionally occur as a result.
+        offset.tv_sec = ts.tv_sec - offset.tv_sec;
+        offset.tv_nsec = ts.tv_nsec - offset.tv_nsec;
+        if (offset.tv_nsec < 0)
+        {
+          offset.tv_sec--;
+          offset.tv_nsec += ns_per_s;
+        }
+
+        enclave_ts = offset;
       }
 
-      for (auto const& logger : config::loggers())
       {
-        logger->write(logger->format(
-          file_name,
-          line_number,
-          config::to_string(log_level),
-          msg,
-          now,
-          ts,
-          thread_id,
-          enclave_ts));
+        std::lock_guard<std::mutex> guard(config::write_lock());
+        for (auto const& logger : config::loggers())
+        {
+          logger->write(logger->format(
+            file_name,
+            line_number,
+            config::to_string(log_level),
+            msg,
+            now,
+            ts,
+            thread_id,
+            enclave_ts));
+        }
       }
 
-      if (log_level == Level::FATAL)
+      if (enclave_ts.has_value() && log_level == Level::FATAL)
         throw std::logic_error(
           "Fatal: " +
           config::loggers().front()->format(
@@ -469,9 +786,415 @@ namespace logger
             thread_id,
             enclave_ts));
     }
+
+    /** Write a log record, on the AsyncWriter's thread if there is one. FAIL
+     * and FATAL records are always written immediately, as the program may be
+     * about to end.
+     */
+    static void write_record(
+      const LogSite& site,
+      uint16_t thread_id,
+      const uint8_t* args,
+      size_t args_size,
+      std::optional<size_t> ms_offset_from_start = std::nullopt);
+
+    static void write_record_now(const RecordHeader& h, const uint8_t* args)
+    {
+      auto msg = format_record(h.site->format, args, h.args_size);
+
+      // As LOG_*_FMT lines were once written through the LOG_* streams, with
+      // std::endl
+      msg.push_back('\n');
+
+      write_at(
+        h.site->file_name,
+        h.site->line_number,
+        h.site->level,
+        h.thread_id,
+        msg,
+        h.ts,
+        h.ms_offset_from_start);
+    }
+  };
+
+  /** Log records written by one thread, to be read by the AsyncWriter's
+   * thread. The ring is lock-free, as it has a single producer and a single
+   * consumer.
+   */
+  class LogRing
+  {
+  private:
+    static constexpr size_t capacity = 1 << 16;
+
+    std::unique_ptr<uint8_t[]> buffer = std::make_unique<uint8_t[]>(capacity);
+
+    // Total bytes ever written and read. Each is only modified by one thread,
+    // so they are kept on separate cache lines.
+    alignas(64) std::atomic<size_t> written = 0;
+    alignas(64) std::atomic<size_t> read = 0;
+
+    void copy_in(size_t at, const void* data, size_t size)
+    {
+      const auto offset = at % capacity;
+      const auto first = std::min(size, capacity - offset);
+      memcpy(buffer.get() + offset, data, first);
+      memcpy(
+        buffer.get(), static_cast<const uint8_t*>(data) + first, size - first);
+    }
+
+    void copy_out(size_t at, void* data, size_t size) const
+    {
+      const auto offset = at % capacity;
+      const auto first = std::min(size, capacity - offset);
+      memcpy(data, buffer.get() + offset, first);
+      memcpy(static_cast<uint8_t*>(data) + first, buffer.get(), size - first);
+    }
+
+  public:
+    // Larger records are written immediately rather than queued
+    static constexpr size_t max_record_size = capacity / 4;
+
+    // Once this much is queued, the AsyncWriter's thread is woken to read it
+    static constexpr size_t wake_size = capacity / 4;
+
+    // Set by the producer while it may be writing to the ring
+    alignas(64) std::atomic<bool> busy = false;
+
+    size_t size() const
+    {
+      return written.load(std::memory_order_relaxed) -
+        read.load(std::memory_order_acquire);
+    }
+
+    bool empty() const
+    {
+      return read.load() == written.load();
+    }
+
+    bool try_push(const RecordHeader& h, const uint8_t* args)
+    {
+      const auto total = sizeof(h) + h.args_size;
+      if (capacity - size() < total)
+        return false;
+
+      const auto at = written.load(std::memory_order_relaxed);
+      copy_in(at, &h, sizeof(h));
+      copy_in(at + sizeof(h), args, h.args_size);
+      written.store(at + total, std::memory_order_release);
+      return true;
+    }
+
+    // Call f with each queued record, copied to args so that it is
+    // contiguous. Returns the number of records read.
+    template <typename F>
+    size_t pop_all(std::vector<uint8_t>& args, F&& f)
+    {
+      auto at = read.load(std::memory_order_relaxed);
+      const auto end = written.load(std::memory_order_acquire);
+      size_t count = 0;
+
+      while (at < end)
+      {
+        RecordHeader h;
+        copy_out(at, &h, sizeof(h));
+        args.resize(h.args_size);
+        copy_out(at + sizeof(h), args.data(), h.args_size);
+
+        at += sizeof(h) + h.args_size;
+        read.store(at, std::memory_order_release);
+
+        f(h, args.data());
+        ++count;
+      }
+
+      return count;
+    }
+  };
+
+  /** While an AsyncWriter exists, log records from each host thread are
+   * queued in that thread's LogRing, and formatted and written by a single
+   * background thread. Logging a line then costs the logging thread little
+   * more than copying its arguments.
+   *
+   * Lines logged through the LOG_* streams, FAIL and FATAL records, and
+   * records too large to queue are still written immediately. Before such a
+   * line is written, the records its thread queued are written, so each
+   * thread's lines keep their order. FAIL and FATAL lines first write the
+   * records queued by every thread, so that the lines leading up to a failure
+   * are not lost if the host then dies. Lines from different threads may
+   * otherwise be written in a different order than they were logged.
+   *
+   * Records still queued when the AsyncWriter is destroyed are written before
+   * its destructor returns. Records queued when the host ends without
+   * destroying it, for example on abort, are lost. Only one AsyncWriter may
+   * exist at a time.
+   */
+  class AsyncWriter
+  {
+  private:
+    static constexpr auto poll_period = std::chrono::milliseconds(10);
+
+    std::atomic<bool> stopping = false;
+    ds::Waiter waiter;
+    std::thread consumer;
+
+    // Held while records are read from the rings and written, by the
+    // consumer or by a thread flushing them before writing a line itself
+    std::mutex drain_lock;
+
+    // Used only under drain_lock, and kept to reuse their allocations
+    std::vector<std::shared_ptr<LogRing>> draining;
+    std::vector<uint8_t> args;
+
+    static std::atomic<AsyncWriter*>& current()
+    {
+      static std::atomic<AsyncWriter*> the_writer = nullptr;
+      return the_writer;
+    }
+
+    static std::mutex& rings_lock()
+    {
+      static std::mutex the_lock;
+      return the_lock;
+    }
+
+    static std::vector<std::shared_ptr<LogRing>>& rings()
+    {
+      static std::vector<std::shared_ptr<LogRing>> the_rings;
+      return the_rings;
+    }
+
+    static LogRing& local_ring()
+    {
+      thread_local std::shared_ptr<LogRing> ring = []() {
+        auto r = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> guard(rings_lock());
+        rings().push_back(r);
+        return r;
+      }();
+      return *ring;
+    }
+
+    void push(LogRing& ring, const RecordHeader& h, const uint8_t* args)
+    {
+      while (!ring.try_push(h, args))
+      {
+        waiter.notify();
+        std::this_thread::yield();
+      }
+
+      if (ring.size() >= LogRing::wake_size)
+        waiter.notify();
+    }
+
+    size_t drain()
+    {
+      std::lock_guard<std::mutex> drain_guard(drain_lock);
+      {
+        std::lock_guard<std::mutex> guard(rings_lock());
+        auto& all = rings();
+
+        // Rings of threads that have exited are dropped once they are empty
+        all.erase(
+          std::remove_if(
+            all.begin(),
+            all.end(),
+            [](const auto& r) { return r.use_count() == 1 && r->empty(); }),
+          all.end());
+        draining.assign(all.begin(), all.end());
+      }
+
+      size_t count = 0;
+      for (auto& ring : draining)
+      {
+        count += ring->pop_all(args, Out::write_record_now);
+      }
+      draining.clear();
+      return count;
+    }
+
+    void run()
+    {
+      while (true)
+      {
+        const auto seen = waiter.prepare_wait();
+        const auto stop = stopping.load();
+        if (drain() == 0)
+        {
+          if (stop)
+            return;
+
+          waiter.wait(seen, poll_period);
+        }
+      }
+    }
+
+  public:
+    AsyncWriter()
+    {
+      AsyncWriter* none = nullptr;
+      if (!current().compare_exchange_strong(none, this))
+        throw std::logic_error("Only one AsyncWriter may exist at a time");
+
+      consumer = std::thread([this]() { run(); });
+    }
+
+    ~AsyncWriter()
+    {
+      current().store(nullptr);
+
+      // Threads that saw this writer before it was cleared may still be
+      // pushing to it
+      std::vector<std::shared_ptr<LogRing>> all;
+      {
+        std::lock_guard<std::mutex> guard(rings_lock());
+        all = rings();
+      }
+      for (const auto& ring : all)
+      {
+        while (ring->busy.load())
+          std::this_thread::yield();
+      }
+
+      stopping.store(true);
+      waiter.notify();
+      consumer.join();
+    }
+
+    /** Queue a record, if there is an AsyncWriter
+     *
+     * @return false if the record should be written immediately instead
+     */
+    static bool try_push(const RecordHeader& h, const uint8_t* args)
+    {
+      if (sizeof(h) + h.args_size > LogRing::max_record_size)
+        return false;
+
+      auto& ring = local_ring();
+      ring.busy.store(true);
+      const auto writer = current().load();
+      if (writer != nullptr)
+        writer->push(ring, h, args);
+      ring.busy.store(false, std::memory_order_release);
+
+      return writer != nullptr;
+    }
+
+    /** Write the records queued by the calling thread, or by every thread if
+     * all is set, if there is an AsyncWriter. Records the consumer has
+     * already taken are written before this returns.
+     */
+    static void flush(bool all)
+    {
+      if (current().load() == nullptr)
+        return;
+
+      auto& ring = local_ring();
+      ring.busy.store(true);
+      const auto writer = current().load();
+      if (writer != nullptr)
+      {
+        if (all)
+        {
+          writer->drain();
+        }
+        else
+        {
+          std::lock_guard<std::mutex> guard(writer->drain_lock);
+          ring.pop_all(writer->args, Out::write_record_now);
+        }
+      }
+      ring.busy.store(false, std::memory_order_release);
+    }
   };
+
+  inline void Out::flush_queued(const Level& log_level)
+  {
+    AsyncWriter::flush(log_level >= Level::FAIL);
+  }
+
+  inline void Out::write_record(
+    const LogSite& site,
+    uint16_t thread_id,
+    const uint8_t* args,
+    size_t args_size,
+    std::optional<size_t> ms_offset_from_start)
+  {
+    RecordHeader h{
+      &site, {}, ms_offset_from_start, thread_id, (uint32_t)args_size};
+    ::timespec_get(&h.ts, TIME_UTC);
+
+    if (site.level < Level::FAIL && AsyncWriter::try_push(h, args))
+      return;
+
+    flush_queued(site.level);
+    write_record_now(h, args);
+  }
 #endif
 
+  template <typename... Ts>
+  void write_record(const LogSite& site, const Ts&... args)
+  {
+    static_assert(
+      sizeof...(Ts) <= max_record_args, "Too many arguments to log");
+
+    const size_t size = (record_arg_size(args) + ... + 0);
+
+    // Most records fit on the stack
+    std::array<uint8_t, 256> small;
+    std::unique_ptr<uint8_t[]> large;
+    auto buffer = small.data();
+    if (size > small.size())
+    {
+      large = std::make_unique<uint8_t[]>(size);
+      buffer = large.get();
+    }
+
+    // Unused by records without arguments
+    [[maybe_unused]] auto data = buffer;
+    [[maybe_unused]] auto remaining = size;
+    (write_record_arg(data, remaining, args), ...);
+
+#ifdef INSIDE_ENCLAVE
+    Out::write_record(site, buffer, size);
+#else
+    Out::write_record(site, host_thread_id, buffer, size);
+#endif
+  }
+
+  template <typename T>
+  struct is_format_literal : std::false_type
+  {};
+
+  template <size_t N>
+  struct is_format_literal<const char (&)[N]> : std::true_type
+  {};
+
+  /** Log a line from a LOG_*_FMT statement, once its level has been checked.
+   * Only the arguments are written to the log record. The file, line and
+   * format string are held by the statement's LogSite, returned by get_site.
+   */
+  template <
+    bool FormatIsLiteral,
+    typename GetSite,
+    typename Format,
+    typename... Args>
+  bool log_fmt(GetSite get_site, const Format& format, const Args&... args)
+  {
+    if constexpr (FormatIsLiteral)
+    {
+      write_record(get_site(format), to_record_arg(args)...);
+    }
+    else
+    {
+      // A format string that is not a literal may differ between calls, so the
+      // line is formatted now, and the site only prints it
+      write_record(get_site("{}"), fmt::format(format, args...));
+    }
+
+    return true;
+  }
+
   // The == operator is being used to:
   // 1. Be a lower precedence than <<, such that using << on the LogLine will
   // happen before the LogLine is "equalitied" with the Out.
@@ -480,28 +1203,41 @@ namespace logger
   // This allows:
   // LOG_DEBUG << "info" << std::endl;
 
+  // The LOG_*_FMT macros do not format their line. The arguments are copied to
+  // a log record, and formatted later, on the host. The LogSite describing the
+  // statement is constructed on its first use.
+#define LOG_FMT_IMPL(LEVEL, FMT, ...) \
+  logger::config::ok(LEVEL) && \
+    logger::log_fmt<logger::is_format_literal<decltype(FMT)>::value>( \
+      [](const char* format) -> const logger::LogSite& { \
+        static const logger::LogSite site(LEVEL, __FILE__, __LINE__, format); \
+        return site; \
+      }, \
+      FMT, \
+      ##__VA_ARGS__)
+
 #define LOG_TRACE \
   logger::config::ok(logger::TRACE) && \
     logger::Out() == logger::LogLine(logger::TRACE, __FILE__, __LINE__)
-#define LOG_TRACE_FMT(...) LOG_TRACE << fmt::format(__VA_ARGS__) << std::endl
+#define LOG_TRACE_FMT(...) LOG_FMT_IMPL(logger::TRACE, __VA_ARGS__)
 
 #define LOG_DEBUG \
   logger::config::ok(logger::DBG) && \
     logger::Out() == logger::LogLine(logger::DBG, __FILE__, __LINE__)
-#define LOG_DEBUG_FMT(...) LOG_DEBUG << fmt::format(__VA_ARGS__) << std::endl
+#define LOG_DEBUG_FMT(...) LOG_FMT_IMPL(logger::DBG, __VA_ARGS__)
 
 #define LOG_INFO \
   logger::config::ok(logger::INFO) && \
     logger::Out() == logger::LogLine(logger::INFO, __FILE__, __LINE__)
-#define LOG_INFO_FMT(...) LOG_INFO << fmt::format(__VA_ARGS__) << std::endl
+#define LOG_INFO_FMT(...) LOG_FMT_IMPL(logger::INFO, __VA_ARGS__)
 
 #define LOG_FAIL \
   logger::config::ok(logger::FAIL) && \
     logger::Out() == logger::LogLine(logger::FAIL, __FILE__, __LINE__)
-#define LOG_FAIL_FMT(...) LOG_FAIL << fmt::format(__VA_ARGS__) << std::endl
+#define LOG_FAIL_FMT(...) LOG_FMT_IMPL(logger::FAIL, __VA_ARGS__)
 
 #define LOG_FATAL \
   logger::config::ok(logger::FATAL) && \
     logger::Out() == logger::LogLine(logger::FATAL, __FILE__, __LINE__)
-#define LOG_FATAL_FMT(...) LOG_FATAL << fmt::format(__VA_ARGS__) << std::endl
-}
\ No newline at end of file
+#define LOG_FATAL_FMT(...) LOG_FMT_IMPL(logger::FATAL, __VA_ARGS__)
+}
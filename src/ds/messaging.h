@@ -8,6 +8,7 @@
 #include "thread_messaging.h"
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <map>
 #include <stdexcept>
@@ -154,8 +155,14 @@ namespace messaging
   {
     RingbufferDispatcher dispatcher;
     std::atomic<bool> finished;
+    size_t max_idle_spins =
+      enclave::ThreadMessaging::default_max_idle_spins;
 
   public:
+    // Writers outside the enclave cannot wake a sleeping processor, so it
+    // sleeps for at most this long before polling its ringbuffer again
+    static constexpr std::chrono::milliseconds max_sleep{1};
+
     BufferProcessor(char const* name = "") : dispatcher(name), finished(false)
     {}
 
@@ -175,6 +182,14 @@ namespace messaging
       finished.store(v);
     }
 
+    /** Set how many consecutive idle iterations run() spins for before it
+     * sleeps. With SIZE_MAX, it never sleeps.
+     */
+    void set_max_idle_spins(size_t n)
+    {
+      max_idle_spins = n;
+    }
+
     size_t read_n(size_t max_messages, ringbuffer::Reader& r)
     {
       size_t total_read = 0;
@@ -205,9 +220,13 @@ namespace messaging
       size_t total_read = 0;
 
       uint16_t tid = thread_ids[std::this_thread::get_id()];
+      auto& waiter = enclave::ThreadMessaging::thread_messaging.get_waiter(tid);
+      size_t idle_spins = 0;
 
       while (!finished.load())
       {
+        const auto seen = waiter.prepare_wait();
+
         auto num_read = read_n(-1, r);
         if (num_read != 0)
         {
@@ -216,10 +235,19 @@ namespace messaging
 
         bool task_run = enclave::ThreadMessaging::thread_messaging.run_one(tid);
 
-        if (num_read == 0 && !task_run)
+        if (num_read != 0 || task_run)
+        {
+          idle_spins = 0;
+        }
+        else if (idle_spins < max_idle_spins)
         {
+          ++idle_spins;
           CCF_PAUSE();
         }
+        else
+        {
+          waiter.wait(seen, max_sleep);
+        }
       }
 
       return total_read;
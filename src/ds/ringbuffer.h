@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ringbuffer_types.h"
+#include "waiter.h"
 
 #include <atomic>
 #include <cstring>
@@ -417,6 +418,31 @@ namespace ringbuffer
     }
   };
 
+  // A Writer which wakes a reader sleeping on the given Waiter after each
+  // message. This is only possible when the reader runs in the same process
+  // and trust domain as the writer - readers of other buffers must poll.
+  class NotifyingWriter : public Writer
+  {
+    ds::Waiter& waiter;
+
+  public:
+    NotifyingWriter(const Reader& r, ds::Waiter& waiter) :
+      Writer(r),
+      waiter(waiter)
+    {}
+
+    NotifyingWriter(const NotifyingWriter& that) :
+      Writer(that),
+      waiter(that.waiter)
+    {}
+
+    virtual void finish(const WriteMarker& marker) override
+    {
+      Writer::finish(marker);
+      waiter.notify();
+    }
+  };
+
   // This is entirely non-virtual so can be safely passed to the enclave
   class Circuit
   {
@@ -1,7 +1,9 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
 #include "../json.h"
+#include "../json_msgpack.h"
 #include "../json_schema.h"
+#include "../json_validator.h"
 
 #define PICOBENCH_IMPLEMENT_WITH_MAIN
 #include <picobench/picobench.hpp>
@@ -248,6 +250,130 @@ void valjson(picobench::state& s)
   }
 }
 
+// Validate with a schema compiled once, as the handler registry does
+template <typename T>
+void valjson_cached(picobench::state& s)
+{
+  std::vector<nlohmann::json> entries = build_entries<T, nlohmann::json>(s);
+
+  const ds::json::SchemaValidator validator(
+    ds::json::build_schema<T>("Schema"));
+
+  clobber_memory();
+  picobench::scope scope(s);
+
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    const auto error = validator.validate(entries[i]);
+    do_not_optimize(error);
+    clobber_memory();
+  }
+}
+
+// Parse the schema again for every document, as handlers validating their own
+// params used to
+template <typename T>
+void valjson_parse_each(picobench::state& s)
+{
+  std::vector<nlohmann::json> entries = build_entries<T, nlohmann::json>(s);
+
+  const auto schema_doc = ds::json::build_schema<T>("Schema");
+
+  clobber_memory();
+  picobench::scope scope(s);
+
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    const ds::json::SchemaValidator validator(schema_doc);
+    const auto error = validator.validate(entries[i]);
+    do_not_optimize(error);
+    clobber_memory();
+  }
+}
+
+template <typename T>
+std::vector<std::vector<uint8_t>> build_packed_entries(picobench::state& s)
+{
+  std::vector<std::vector<uint8_t>> entries(s.iterations());
+
+  for (auto& e : entries)
+  {
+    T t;
+    t.randomise();
+    e = nlohmann::json::to_msgpack(t);
+  }
+
+  return entries;
+}
+
+// Unpack msgpack params to a JSON document, and then convert it
+template <typename T>
+void unpack_dom(picobench::state& s)
+{
+  const auto entries = build_packed_entries<T>(s);
+
+  clobber_memory();
+  picobench::scope scope(s);
+
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    const nlohmann::json j = nlohmann::json::from_msgpack(entries[i]);
+    const auto b = j.get<T>();
+    do_not_optimize(b);
+    clobber_memory();
+  }
+}
+
+// Unpack msgpack params directly, as handlers with typed params do
+template <typename T>
+void unpack_direct(picobench::state& s)
+{
+  const auto entries = build_packed_entries<T>(s);
+
+  clobber_memory();
+  picobench::scope scope(s);
+
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    const auto b =
+      ds::json::from_msgpack<T>(entries[i].data(), entries[i].size());
+    do_not_optimize(b);
+    clobber_memory();
+  }
+}
+
+template <typename T>
+void pack_dom(picobench::state& s)
+{
+  const auto entries = build_entries<T>(s);
+
+  clobber_memory();
+  picobench::scope scope(s);
+
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    const auto b = nlohmann::json::to_msgpack(entries[i]);
+    do_not_optimize(b);
+    clobber_memory();
+  }
+}
+
+template <typename T>
+void pack_direct(picobench::state& s)
+{
+  const auto entries = build_entries<T>(s);
+
+  clobber_memory();
+  picobench::scope scope(s);
+
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    const auto b = ds::json::to_msgpack(entries[i]);
+    do_not_optimize(b);
+    clobber_memory();
+  }
+}
+
 const std::vector<int> sizes = {200, 2'000};
 
 PICOBENCH_SUITE("simple");
@@ -261,7 +387,23 @@ PICOBENCH(conv<Complex_macros>).iterations(sizes).samples(10);
 PICOBENCH_SUITE("validation simple");
 PICOBENCH(valmacro<Simple_macros>).iterations(sizes).samples(10);
 PICOBENCH(valjson<Simple_macros>).iterations(sizes).samples(10);
+PICOBENCH(valjson_cached<Simple_macros>).iterations(sizes).samples(10);
+PICOBENCH(valjson_parse_each<Simple_macros>).iterations(sizes).samples(10);
 
 PICOBENCH_SUITE("validation complex");
 PICOBENCH(valmacro<Complex_macros>).iterations(sizes).samples(10);
 PICOBENCH(valjson<Complex_macros>).iterations(sizes).samples(10);
+PICOBENCH(valjson_cached<Complex_macros>).iterations(sizes).samples(10);
+PICOBENCH(valjson_parse_each<Complex_macros>).iterations(sizes).samples(10);
+
+PICOBENCH_SUITE("msgpack simple");
+PICOBENCH(unpack_dom<Simple_macros>).iterations(sizes).samples(10).baseline();
+PICOBENCH(unpack_direct<Simple_macros>).iterations(sizes).samples(10);
+PICOBENCH(pack_dom<Simple_macros>).iterations(sizes).samples(10);
+PICOBENCH(pack_direct<Simple_macros>).iterations(sizes).samples(10);
+
+PICOBENCH_SUITE("msgpack complex");
+PICOBENCH(unpack_dom<Complex_macros>).iterations(sizes).samples(10).baseline();
+PICOBENCH(unpack_direct<Complex_macros>).iterations(sizes).samples(10);
+PICOBENCH(pack_dom<Complex_macros>).iterations(sizes).samples(10);
+PICOBENCH(pack_direct<Complex_macros>).iterations(sizes).samples(10);
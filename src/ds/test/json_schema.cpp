@@ -1,6 +1,7 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
 #include "../json.h"
+#include "../json_msgpack.h"
 
 #define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
 #include <doctest/doctest.h>
@@ -528,3 +529,69 @@ TEST_CASE("example validation")
     REQUIRE_THROWS("{ \"n\": 101 }"_json.get<X_B>());
   }
 }
+
+template <typename T>
+void check_msgpack_round_trip(const T& t)
+{
+  const nlohmann::json j = t;
+
+  INFO("Packed directly, the same JSON is unpacked");
+  const auto packed = ds::json::to_msgpack(t);
+  REQUIRE(nlohmann::json::from_msgpack(packed) == j);
+
+  INFO("Unpacked directly, the same value is converted back to JSON");
+  const auto dom_packed = nlohmann::json::to_msgpack(j);
+  const auto t2 =
+    ds::json::from_msgpack<T>(dom_packed.data(), dom_packed.size());
+  REQUIRE(nlohmann::json(t2) == j);
+}
+
+TEST_CASE("msgpack conversion")
+{
+  Foo foo;
+  check_msgpack_round_trip(foo);
+  foo.n_1 = 0;
+  foo.opt = 44;
+  foo.vec_s = {"a", "b"};
+  check_msgpack_round_trip(foo);
+
+  Baz baz;
+  baz.a = 1;
+  baz.b = "two";
+  baz.d = 4;
+  baz.e = 5;
+  check_msgpack_round_trip(baz);
+
+  renamed::Foo renamed_foo = {1, 2, 3, 4, 5, 6};
+  check_msgpack_round_trip(renamed_foo);
+
+  EnumStruct es;
+  es.se = EnumStruct::SampleEnum::Three;
+  check_msgpack_round_trip(es);
+
+  Nest3 nest;
+  nest.v.x.a.n = 1;
+  nest.v.xs = {Nest1{{2}, {3}}, Nest1{}};
+  check_msgpack_round_trip(nest);
+
+  INFO("Errors are reported as when converting from JSON");
+  {
+    const auto missing =
+      nlohmann::json::to_msgpack(nlohmann::json{{"b", "x"}});
+    REQUIRE_THROWS_AS(
+      ds::json::from_msgpack<Bar>(missing.data(), missing.size()),
+      JsonParseError);
+
+    const auto wrong = nlohmann::json::to_msgpack(
+      nlohmann::json{{"n_0", 1}, {"i_0", 1}, {"i64_0", 1}, {"s_0", 1}});
+    try
+    {
+      ds::json::from_msgpack<Foo>(wrong.data(), wrong.size());
+      REQUIRE(false);
+    }
+    catch (const JsonParseError& e)
+    {
+      REQUIRE(e.pointer() == "#/s_0");
+    }
+  }
+}
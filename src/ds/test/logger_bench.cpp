@@ -1,6 +1,6 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
-#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#define PICOBENCH_IMPLEMENT
 #include "../logger.h"
 
 #include <picobench/picobench.hpp>
@@ -124,6 +124,47 @@ static void log_rejected_fmt(picobench::state& s)
   reset_loggers();
 }
 
+// A line typical of hot paths, with arguments
+template <bool Fmt>
+static void log_line(size_t i)
+{
+  if constexpr (Fmt)
+  {
+    LOG_DEBUG_FMT("Replicating {} entries to node {}", i, "n1");
+  }
+  else
+  {
+    LOG_DEBUG << "Replicating " << i << " entries to node " << "n1"
+              << std::endl;
+  }
+}
+
+// When Async, only the cost to the logging thread is measured. The lines are
+// formatted and written by the AsyncWriter's thread, after the timer stops.
+template <LoggerKind LK, bool Fmt, bool Async>
+static void log_accepted_args(picobench::state& s)
+{
+  prepare_loggers<LK>();
+
+  logger::config::level() = logger::DBG;
+  {
+    std::optional<logger::AsyncWriter> writer;
+    if constexpr (Async)
+    {
+      writer.emplace();
+    }
+
+    picobench::scope scope(s);
+
+    for (size_t i = 0; i < s.iterations(); ++i)
+    {
+      log_line<Fmt>(i);
+    }
+  }
+
+  reset_loggers();
+}
+
 const std::vector<int> sizes = {1000};
 
 PICOBENCH_SUITE("logger");
@@ -145,6 +186,23 @@ PICOBENCH(json_reject).iterations(sizes).samples(10);
 auto json_reject_fmt = log_rejected_fmt<LoggerKind::JSON>;
 PICOBENCH(json_reject_fmt).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("logger with args");
+auto console_accept_args = log_accepted_args<LoggerKind::Console, false, false>;
+PICOBENCH(console_accept_args).iterations(sizes).samples(10).baseline();
+auto console_accept_args_fmt =
+  log_accepted_args<LoggerKind::Console, true, false>;
+PICOBENCH(console_accept_args_fmt).iterations(sizes).samples(10);
+auto console_accept_args_async =
+  log_accepted_args<LoggerKind::Console, true, true>;
+PICOBENCH(console_accept_args_async).iterations(sizes).samples(10);
+
+auto json_accept_args = log_accepted_args<LoggerKind::JSON, false, false>;
+PICOBENCH(json_accept_args).iterations(sizes).samples(10);
+auto json_accept_args_fmt = log_accepted_args<LoggerKind::JSON, true, false>;
+PICOBENCH(json_accept_args_fmt).iterations(sizes).samples(10);
+auto json_accept_args_async = log_accepted_args<LoggerKind::JSON, true, true>;
+PICOBENCH(json_accept_args_async).iterations(sizes).samples(10);
+
 // The enabled benchmarks are artifically cheap since they talk to a broken
 // stream, skipping the cost of _actually writing something_. To compare this,
 // uncomment the lines below (~3x slower)
@@ -154,3 +212,71 @@ PICOBENCH(json_reject_fmt).iterations(sizes).samples(10);
 // PICOBENCH(json_loud).iterations(sizes).samples(10);
 // auto all_loud = log_accepted<LoggerKind::All, false>;
 // PICOBENCH(all_loud).iterations(sizes).samples(10);
+
+// Lines logged per second by each of threads, all logging at once. When Async,
+// this includes waiting for the AsyncWriter's thread when it falls behind, but
+// not writing the lines still queued when the threads finish. A single
+// AsyncWriter thread formats every line, so it only keeps up with bursts of
+// lines that fit in the logging threads' rings.
+template <bool Fmt, bool Async>
+static double lines_per_thread(size_t threads, size_t lines)
+{
+  prepare_loggers<LoggerKind::All>();
+  logger::config::level() = logger::DBG;
+
+  std::optional<logger::AsyncWriter> writer;
+  if constexpr (Async)
+  {
+    writer.emplace();
+  }
+
+  const auto start = std::chrono::high_resolution_clock::now();
+  std::vector<std::thread> logging;
+  for (size_t t = 0; t < threads; ++t)
+  {
+    logging.emplace_back([lines]() {
+      for (size_t i = 0; i < lines; ++i)
+      {
+        log_line<Fmt>(i);
+      }
+    });
+  }
+  for (auto& t : logging)
+  {
+    t.join();
+  }
+  const std::chrono::duration<double> elapsed =
+    std::chrono::high_resolution_clock::now() - start;
+
+  writer.reset();
+  reset_loggers();
+
+  return lines / elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  auto rc = runner.run();
+
+  for (const size_t lines : {100'000, 500})
+  {
+    std::cout << fmt::format("Logging {} lines from each thread:", lines)
+              << std::endl;
+    for (size_t threads = 1; threads <= 8; threads *= 2)
+    {
+      std::cout << fmt::format(
+                     "  {} threads: {:.0f} lines/s per thread through "
+                     "LOG_DEBUG, {:.0f} through LOG_DEBUG_FMT, {:.0f} "
+                     "deferred to an AsyncWriter",
+                     threads,
+                     lines_per_thread<false, false>(threads, lines),
+                     lines_per_thread<true, false>(threads, lines),
+                     lines_per_thread<true, true>(threads, lines))
+                << std::endl;
+    }
+  }
+
+  return rc;
+}
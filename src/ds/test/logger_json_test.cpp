@@ -7,6 +7,8 @@
 #include <fstream>
 #include <nlohmann/json.hpp>
 
+#undef FAIL
+
 TEST_CASE("Test custom log format")
 {
   std::string test_log_file = "./test_json_logger.txt";
@@ -37,3 +39,152 @@ TEST_CASE("Test custom log format")
   }
   REQUIRE(line_count == 1);
 }
+
+struct Unrecorded
+{
+  int i;
+};
+
+namespace fmt
+{
+  template <>
+  struct formatter<Unrecorded>
+  {
+    template <typename ParseContext>
+    constexpr auto parse(ParseContext& ctx)
+    {
+      return ctx.begin();
+    }
+
+    template <typename FormatContext>
+    auto format(const Unrecorded& u, FormatContext& ctx)
+    {
+      return format_to(ctx.begin(), "<{}>", u.i);
+    }
+  };
+}
+
+std::vector<nlohmann::json> read_log(const std::string& path)
+{
+  std::vector<nlohmann::json> lines;
+  std::ifstream f(path);
+  std::string line;
+  while (std::getline(f, line))
+  {
+    lines.push_back(nlohmann::json::parse(line));
+  }
+  return lines;
+}
+
+TEST_CASE("Deferred formatting")
+{
+  std::string test_log_file = "./test_json_logger_deferred.txt";
+  remove(test_log_file.c_str());
+  logger::config::loggers().clear();
+  logger::config::loggers().emplace_back(
+    std::make_unique<logger::JsonLogger>(test_log_file));
+  logger::config::level() = logger::DBG;
+
+  const std::string s = "string";
+  const char* cs = "chars";
+  const Unrecorded u{7};
+  const std::vector<std::string> expected = {
+    "-1 2 0.50 true c string chars <7>\n",
+    "  42|2a|42.0\n",
+    "not a literal string\n",
+    "Could not format log record \"{} {}\": argument index out of range\n"};
+
+  const auto log_all = [&]() {
+    LOG_DEBUG_FMT(
+      "{} {} {:.2f} {} {} {} {} {}", -1, 2u, 0.5f, true, 'c', s, cs, u);
+    LOG_DEBUG_FMT("{:>4}|{:x}|{:.1f}", (uint8_t)42, 42, 42.0);
+    LOG_DEBUG_FMT(fmt::format("not a literal {}", s));
+    LOG_DEBUG_FMT("{} {}", 1);
+    LOG_TRACE_FMT("Not logged {}", 1);
+  };
+
+  SUBCASE("Written immediately")
+  {
+    log_all();
+  }
+
+  SUBCASE("Written by an AsyncWriter")
+  {
+    logger::AsyncWriter writer;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < 4; ++i)
+    {
+      threads.emplace_back(log_all);
+    }
+    for (auto& t : threads)
+    {
+      t.join();
+    }
+  }
+
+  const auto lines = read_log(test_log_file);
+  REQUIRE(lines.size() % expected.size() == 0);
+  REQUIRE(lines.size() > 0);
+
+  std::map<std::string, size_t> counts;
+  for (const auto& j : lines)
+  {
+    counts[j["msg"]]++;
+    REQUIRE(j["file"] == __FILE__);
+  }
+  for (const auto& msg : expected)
+  {
+    REQUIRE(counts[msg] == lines.size() / expected.size());
+  }
+}
+
+TEST_CASE("Lines written immediately follow queued records")
+{
+  std::string test_log_file = "./test_json_logger_order.txt";
+  remove(test_log_file.c_str());
+  logger::config::loggers().clear();
+  logger::config::loggers().emplace_back(
+    std::make_unique<logger::JsonLogger>(test_log_file));
+  logger::config::level() = logger::DBG;
+
+  constexpr size_t queued = 100;
+
+  logger::AsyncWriter writer;
+
+  // Records queued by another thread are written before a FAIL line, even
+  // though the AsyncWriter has not been destroyed
+  std::thread other([]() {
+    for (size_t i = 0; i < queued; ++i)
+    {
+      LOG_DEBUG_FMT("other {}", i);
+    }
+  });
+  other.join();
+
+  LOG_DEBUG_FMT("queued");
+  LOG_DEBUG << "stream" << std::endl;
+  LOG_FAIL_FMT("failed {}", 1);
+
+  const auto lines = read_log(test_log_file);
+  REQUIRE(lines.size() == queued + 3);
+
+  size_t next_other = 0;
+  std::vector<std::string> own;
+  for (const auto& j : lines)
+  {
+    const std::string msg = j["msg"];
+    if (msg.rfind("other ", 0) == 0)
+    {
+      REQUIRE(msg == fmt::format("other {}\n", next_other++));
+    }
+    else
+    {
+      own.push_back(msg);
+    }
+  }
+  REQUIRE(next_other == queued);
+  const std::vector<std::string> expected_own = {
+    "queued\n", "stream\n", "failed 1\n"};
+  REQUIRE(own == expected_own);
+  REQUIRE(lines.back()["msg"] == "failed 1\n");
+}
@@ -136,3 +136,58 @@ TEST_CASE("persistent map operations")
     champ = champ_new;
   }
 }
+
+TEST_CASE("transient map operations")
+{
+  RBMap<K, V> rb;
+  champ::Map<K, V, H> champ;
+
+  auto ops = gen_ops(500);
+  auto transient = champ.transient();
+  for (auto& op : ops)
+  {
+    auto put = dynamic_cast<Put*>(op.get());
+    REQUIRE(put != nullptr);
+    rb = rb.put(put->k, put->v);
+    transient.put(put->k, put->v);
+    REQUIRE(transient.get(put->k) == put->v);
+  }
+
+  INFO("check original map is unmodified");
+  REQUIRE(champ.size() == 0);
+
+  auto champ_new = transient.persistent();
+
+  INFO("check consistency with persistent map");
+  {
+    size_t n = 0;
+    champ_new.foreach([&](const auto& k, const auto& v) {
+      n++;
+      auto p = rb.get(k);
+      REQUIRE(p.has_value());
+      REQUIRE(p.value() == v);
+      return true;
+    });
+    REQUIRE(n == champ_new.size());
+    REQUIRE(n == transient.size());
+  }
+
+  INFO("check frozen map is unaffected by further transient puts");
+  {
+    for (auto& op : gen_ops(100))
+    {
+      auto put = dynamic_cast<Put*>(op.get());
+      transient.put(put->k, put->v + 1);
+    }
+
+    size_t n = 0;
+    champ_new.foreach([&](const auto& k, const auto& v) {
+      n++;
+      auto p = rb.get(k);
+      REQUIRE(p.has_value());
+      REQUIRE(p.value() == v);
+      return true;
+    });
+    REQUIRE(n == champ_new.size());
+  }
+}
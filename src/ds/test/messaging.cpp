@@ -522,3 +522,113 @@ TEST_CASE("Deadlock" * doctest::test_suite("messaging"))
     processor_inside.read_n(target_writes, circuit.read_from_outside());
   REQUIRE(n_read > 0);
 }
+
+TEST_CASE("Waiter" * doctest::test_suite("messaging"))
+{
+  ds::Waiter waiter;
+  constexpr auto long_timeout = std::chrono::seconds(10);
+
+  SUBCASE("Times out without notification")
+  {
+    const auto seen = waiter.prepare_wait();
+    REQUIRE_FALSE(waiter.wait(seen, std::chrono::milliseconds(1)));
+  }
+
+  SUBCASE("Does not sleep after a notification it has not seen")
+  {
+    const auto seen = waiter.prepare_wait();
+    waiter.notify();
+    REQUIRE(waiter.wait(seen, long_timeout));
+    waiter.wait(seen);
+  }
+
+  SUBCASE("Is woken by notifications from other threads")
+  {
+    constexpr size_t count = 100;
+    std::atomic<size_t> produced = 0;
+
+    std::thread producer([&]() {
+      for (size_t i = 0; i < count; ++i)
+      {
+        ++produced;
+        waiter.notify();
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+      }
+    });
+
+    size_t consumed = 0;
+    while (consumed < count)
+    {
+      const auto seen = waiter.prepare_wait();
+      if (produced.load() > consumed)
+      {
+        consumed = produced.load();
+        continue;
+      }
+      REQUIRE(waiter.wait(seen, long_timeout));
+    }
+
+    producer.join();
+  }
+}
+
+TEST_CASE("Sleeping message loop" * doctest::test_suite("messaging"))
+{
+  enum : Message
+  {
+    ping = Const::msg_min,
+    finish
+  };
+
+  struct Flag
+  {
+    std::atomic<bool>* set;
+  };
+
+  BufferProcessor bp;
+  bp.set_max_idle_spins(0);
+
+  std::atomic<size_t> pings = 0;
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, ping, [&pings](const uint8_t*, size_t) { ++pings; });
+  DISPATCHER_SET_MESSAGE_HANDLER(
+    bp, finish, [&bp](const uint8_t*, size_t) { bp.set_finished(); });
+
+  // The loop runs on an unregistered thread, so uses the first thread's tasks
+  auto& waiter = enclave::ThreadMessaging::thread_messaging.get_waiter(
+    enclave::ThreadMessaging::main_thread);
+
+  Reader r(1 << 10);
+  NotifyingWriter w(r, waiter);
+
+  size_t read_count = 0;
+  std::thread loop([&]() { read_count = bp.run(r); });
+
+  constexpr size_t count = 10;
+  for (size_t i = 0; i < count; ++i)
+  {
+    // Give the loop time to go to sleep before each message
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    w.write(ping);
+    while (pings.load() <= i)
+    {
+      std::this_thread::yield();
+    }
+  }
+
+  std::atomic<bool> task_run = false;
+  auto msg = std::make_unique<enclave::Tmsg<Flag>>(
+    [](std::unique_ptr<enclave::Tmsg<Flag>> msg) { *msg->data.set = true; });
+  msg->data.set = &task_run;
+  enclave::ThreadMessaging::thread_messaging.add_task<Flag>(
+    enclave::ThreadMessaging::main_thread, std::move(msg));
+  while (!task_run.load())
+  {
+    std::this_thread::yield();
+  }
+
+  w.write(finish);
+  loop.join();
+
+  REQUIRE(read_count == count + 1);
+}
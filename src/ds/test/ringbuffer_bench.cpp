@@ -1,14 +1,21 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
-#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#define PICOBENCH_IMPLEMENT
 #define PICOBENCH_DONT_BIND_TO_ONE_CORE
+#include "../messaging.h"
 #include "../ringbuffer.h"
 
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+#include <iostream>
 #include <picobench/picobench.hpp>
 #include <thread>
+#include <time.h>
 
 using namespace ringbuffer;
 
+enclave::ThreadMessaging enclave::ThreadMessaging::thread_messaging;
+
 constexpr Message msg_type = Const::msg_min + 1;
 
 using ReadHandler = void (*)(ringbuffer::Message, const uint8_t*, size_t);
@@ -181,3 +188,125 @@ auto spin_200 = specialize<32, 1, 4, spin_pause_handler<200>>;
 FIXED_PICO(spin_200);
 auto spin_400 = specialize<32, 1, 4, spin_pause_handler<400>>;
 FIXED_PICO(spin_400);
+
+// A message loop running on its own thread, as the enclave's main thread does.
+// With max_idle_spins of SIZE_MAX, the loop never sleeps.
+struct IdleLoop
+{
+  static constexpr Message finish = msg_type + 1;
+
+  Reader r;
+  NotifyingWriter w;
+  messaging::BufferProcessor bp;
+  std::atomic<size_t> handled = 0;
+  std::chrono::nanoseconds cpu_time = {};
+  std::thread thread;
+
+  IdleLoop(size_t max_idle_spins) :
+    r(1 << 10),
+    w(r,
+      enclave::ThreadMessaging::thread_messaging.get_waiter(
+        enclave::ThreadMessaging::main_thread))
+  {
+    bp.set_max_idle_spins(max_idle_spins);
+    DISPATCHER_SET_MESSAGE_HANDLER(
+      bp, msg_type, [this](const uint8_t*, size_t) { ++handled; });
+    DISPATCHER_SET_MESSAGE_HANDLER(
+      bp, finish, [this](const uint8_t*, size_t) { bp.set_finished(); });
+
+    thread = std::thread([this]() {
+      bp.run(r);
+
+      timespec ts;
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+      cpu_time = std::chrono::seconds(ts.tv_sec) +
+        std::chrono::nanoseconds(ts.tv_nsec);
+    });
+  }
+
+  // Returns the CPU time used by the loop
+  std::chrono::nanoseconds stop()
+  {
+    if (thread.joinable())
+    {
+      w.write(finish);
+      thread.join();
+    }
+    return cpu_time;
+  }
+
+  ~IdleLoop()
+  {
+    stop();
+  }
+};
+
+// Long enough for a loop to have stopped spinning and gone to sleep
+static constexpr auto idle_period = std::chrono::milliseconds(5);
+
+// Each message is written to a loop which has been idle for idle_period, and
+// the time until it has been handled is measured
+template <size_t MaxIdleSpins>
+static void wake_idle_loop(picobench::state& s)
+{
+  IdleLoop loop(MaxIdleSpins);
+
+  // Only the time spent waking the loop is recorded, not the idle periods
+  for (int i = 0; i < s.iterations(); ++i)
+  {
+    std::this_thread::sleep_for(idle_period);
+
+    const auto handled = loop.handled.load();
+    const auto start = std::chrono::high_resolution_clock::now();
+    loop.w.write(msg_type);
+    while (loop.handled.load() == handled)
+      CCF_PAUSE();
+    const auto end = std::chrono::high_resolution_clock::now();
+
+    s.add_custom_duration(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+        .count());
+  }
+}
+
+const std::vector<int> wake_counts = {10, 50};
+
+PICOBENCH_SUITE("wake idle loop");
+auto spin_only = wake_idle_loop<SIZE_MAX>;
+PICOBENCH(spin_only).iterations(wake_counts).samples(10).baseline();
+auto spin_then_sleep =
+  wake_idle_loop<enclave::ThreadMessaging::default_max_idle_spins>;
+PICOBENCH(spin_then_sleep).iterations(wake_counts).samples(10);
+auto sleep_immediately = wake_idle_loop<0>;
+PICOBENCH(sleep_immediately).iterations(wake_counts).samples(10);
+
+int main(int argc, char* argv[])
+{
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  auto rc = runner.run();
+
+  // CPU used by a loop which receives no messages at all
+  constexpr auto idle_time = std::chrono::milliseconds(500);
+  for (const auto& [name, max_idle_spins] :
+       {std::make_pair("spin_only", SIZE_MAX),
+        std::make_pair(
+          "spin_then_sleep", enclave::ThreadMessaging::default_max_idle_spins),
+        std::make_pair("sleep_immediately", (size_t)0)})
+  {
+    IdleLoop loop(max_idle_spins);
+    std::this_thread::sleep_for(idle_time);
+    const auto cpu_time = loop.stop();
+
+    std::cout << fmt::format(
+                   "{}: idle loop used {:.1f}% of a core",
+                   name,
+                   100.0 * cpu_time.count() /
+                     std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       idle_time)
+                       .count())
+              << std::endl;
+  }
+
+  return rc;
+}
@@ -5,6 +5,7 @@
 //#define USE_MPSCQ
 
 #include "ds/logger.h"
+#include "ds/waiter.h"
 #ifdef USE_MPSCQ
 #  include "ds/mpscq.h"
 #endif
@@ -61,6 +62,9 @@ namespace enclave
 #endif
 
   public:
+    // Notified whenever a task is added
+    ds::Waiter waiter;
+
     Task()
     {
 #ifdef USE_MPSCQ
@@ -118,6 +122,7 @@ namespace enclave
         item->next = tmp_head;
       } while (!item_head.compare_exchange_strong(tmp_head, item));
 #endif
+      waiter.notify();
     }
 
   private:
@@ -154,6 +159,10 @@ namespace enclave
 
     static const uint16_t max_num_threads = 64;
 
+    // Number of consecutive idle iterations a thread spins for before it
+    // sleeps until it is given more work
+    static constexpr size_t default_max_idle_spins = 10000;
+
   public:
     ThreadMessaging(uint16_t num_threads = max_num_threads) :
       finished(false),
@@ -163,15 +172,38 @@ namespace enclave
     void set_finished(bool v = true)
     {
       finished.store(v);
+
+      if (v)
+      {
+        for (auto& task : tasks)
+        {
+          task.waiter.notify();
+        }
+      }
     }
 
-    void run()
+    void run(size_t max_idle_spins = default_max_idle_spins)
     {
       Task& task = tasks[thread_ids[std::this_thread::get_id()]];
+      size_t idle_spins = 0;
 
       while (!is_finished())
       {
-        task.run_next_task();
+        const auto seen = task.waiter.prepare_wait();
+
+        if (task.run_next_task())
+        {
+          idle_spins = 0;
+        }
+        else if (idle_spins < max_idle_spins)
+        {
+          ++idle_spins;
+          CCF_PAUSE();
+        }
+        else if (!is_finished())
+        {
+          task.waiter.wait(seen);
+        }
       }
     }
 
@@ -190,6 +222,14 @@ namespace enclave
       task.add_task(reinterpret_cast<ThreadMsg*>(msg.release()));
     }
 
+    /** Waiter notified whenever a task is added for thread tid, so that a
+     * thread polling for other work alongside its tasks can sleep on it
+     */
+    ds::Waiter& get_waiter(uint16_t tid)
+    {
+      return tasks[tid].waiter;
+    }
+
     template <typename RetType, typename InputType>
     static std::unique_ptr<Tmsg<RetType>> ConvertMessage(
       std::unique_ptr<Tmsg<InputType>> msg,
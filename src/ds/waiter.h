@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
+namespace ds
+{
+  /** Lets a thread that has run out of work sleep until another thread
+   * produces some, rather than spinning.
+   *
+   * To avoid missing a notification, the sleeping thread must call
+   * prepare_wait() before it checks for work, and pass the returned value to
+   * wait(). Producers must make their work visible before calling notify().
+   * notify() only takes the lock when a thread is actually sleeping, so it is
+   * cheap to call on every write.
+   */
+  class Waiter
+  {
+  private:
+    std::atomic<uint64_t> epoch = 0;
+    std::atomic<size_t> sleepers = 0;
+
+    std::mutex lock;
+    std::condition_variable cv;
+
+  public:
+    uint64_t prepare_wait() const
+    {
+      return epoch.load();
+    }
+
+    /** Sleep until notify() is called, unless it has already been called
+     * since prepare_wait() returned seen.
+     *
+     * @return false if the timeout expired without a notification
+     */
+    template <typename Rep, typename Period>
+    bool wait(uint64_t seen, const std::chrono::duration<Rep, Period>& timeout)
+    {
+      ++sleepers;
+      bool notified;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        notified =
+          cv.wait_for(guard, timeout, [&]() { return epoch.load() != seen; });
+      }
+      --sleepers;
+      return notified;
+    }
+
+    void wait(uint64_t seen)
+    {
+      ++sleepers;
+      {
+        std::unique_lock<std::mutex> guard(lock);
+        cv.wait(guard, [&]() { return epoch.load() != seen; });
+      }
+      --sleepers;
+    }
+
+    void notify()
+    {
+      ++epoch;
+
+      // If this reads 0, any thread about to sleep will increment sleepers
+      // after the epoch was incremented, and so will not sleep
+      if (sleepers.load() > 0)
+      {
+        // Taking the lock ensures a sleeper that has checked the epoch is
+        // waiting on the condition variable before it is notified
+        std::lock_guard<std::mutex> guard(lock);
+        cv.notify_all();
+      }
+    }
+  };
+}
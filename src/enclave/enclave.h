@@ -58,6 +58,8 @@ namespace enclave
       consensus_type(consensus_type_)
     {
       logger::config::msg() = AdminMessage::log_msg;
+      logger::config::site_msg() = AdminMessage::log_site;
+      logger::config::record_msg() = AdminMessage::log_record;
       logger::config::writer() = writer_factory.create_writer_to_outside();
 
       REGISTER_FRONTEND(
@@ -211,24 +213,40 @@ namespace enclave
 
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp,
-          consensus::ledger_entry,
+          consensus::ledger_entries,
           [this](const uint8_t* data, size_t size) {
-            auto [body] =
-              ringbuffer::read_message<consensus::ledger_entry>(data, size);
-            if (node.is_reading_public_ledger())
-              node.recover_public_ledger_entry(body);
-            else if (node.is_reading_private_ledger())
-              node.recover_private_ledger_entry(body);
-            else
-              LOG_FAIL_FMT("Cannot recover ledger entry: Unexpected state");
+            auto [from, body] =
+              ringbuffer::read_message<consensus::ledger_entries>(data, size);
+            node.recover_ledger_entries(from, body);
           });
 
         DISPATCHER_SET_MESSAGE_HANDLER(
           bp,
           consensus::ledger_no_entry,
           [this](const uint8_t* data, size_t size) {
-            ringbuffer::read_message<consensus::ledger_no_entry>(data, size);
-            node.recover_ledger_end();
+            auto [idx] =
+              ringbuffer::read_message<consensus::ledger_no_entry>(data, size);
+            node.recover_ledger_end(idx);
+          });
+
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp,
+          consensus::ledger_historical_entries,
+          [this](const uint8_t* data, size_t size) {
+            auto [from, body] =
+              ringbuffer::read_message<consensus::ledger_historical_entries>(
+                data, size);
+            node.recv_historical_entries(from, body);
+          });
+
+        DISPATCHER_SET_MESSAGE_HANDLER(
+          bp,
+          consensus::ledger_historical_no_entry,
+          [this](const uint8_t* data, size_t size) {
+            auto [idx] =
+              ringbuffer::read_message<consensus::ledger_historical_no_entry>(
+                data, size);
+            node.recv_historical_no_entry(idx);
           });
 
         rpcsessions->register_message_handlers(bp.get_dispatcher());
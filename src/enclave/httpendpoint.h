@@ -9,6 +9,9 @@
 #include "rpcmap.h"
 #include "wsupgrade.h"
 
+#include <deque>
+#include <functional>
+
 namespace enclave
 {
   class HTTPEndpoint : public TLSEndpoint, public http::MsgProcessor
@@ -17,6 +20,10 @@ namespace enclave
     http::Parser p;
     bool is_websocket = false;
 
+    // When the request being parsed started to be received, or when the last
+    // request was handled if it was parsed from the same read
+    metrics::StageClock::time_point received_at;
+
   public:
     HTTPEndpoint(
       http_parser_type parser_type,
@@ -45,6 +52,7 @@ namespace enclave
 
     void recv_(const uint8_t* data, size_t size)
     {
+      received_at = metrics::StageClock::now();
       recv_buffered(data, size);
 
       LOG_TRACE_FMT("recv called with {} bytes", size);
@@ -98,6 +106,102 @@ namespace enclave
 
     size_t request_index = 0;
 
+    // Time spent decrypting and parsing the request being handled
+    std::chrono::nanoseconds receive_time = {};
+
+    // Requests are answered in the order they were received. A request with a
+    // client signature may have its signature verified on another worker
+    // first, in which case requests received after it wait in this queue
+    // until it has been processed.
+    struct PendingRequest
+    {
+      std::function<void()> process;
+      bool ready;
+    };
+    std::deque<std::shared_ptr<PendingRequest>> pending_requests;
+
+    struct VerifyMsg
+    {
+      std::shared_ptr<Endpoint> self;
+      std::shared_ptr<JsonRpcContext> rpc_ctx;
+      std::shared_ptr<RpcHandler> handler;
+      std::shared_ptr<PendingRequest> pending;
+    };
+
+    static void verify_cb(std::unique_ptr<enclave::Tmsg<VerifyMsg>> msg)
+    {
+      try
+      {
+        msg->data.handler->verify_signature_ahead(msg->data.rpc_ctx);
+      }
+      catch (const std::exception& e)
+      {
+        // The signature is verified again when the request is processed,
+        // which reports the error
+        LOG_DEBUG_FMT("Failed to verify signature ahead: {}", e.what());
+      }
+
+      auto self = reinterpret_cast<HTTPServerEndpoint*>(msg->data.self.get());
+      auto reply = std::make_unique<enclave::Tmsg<VerifyMsg>>(&verified_cb);
+      reply->data = std::move(msg->data);
+      enclave::ThreadMessaging::thread_messaging.add_task<VerifyMsg>(
+        self->execution_thread, std::move(reply));
+    }
+
+    static void verified_cb(std::unique_ptr<enclave::Tmsg<VerifyMsg>> msg)
+    {
+      msg->data.pending->ready = true;
+      reinterpret_cast<HTTPServerEndpoint*>(msg->data.self.get())
+        ->process_pending();
+    }
+
+    // Worker that verifies the next client signature, or nullopt if it should
+    // be verified when the request is processed
+    std::optional<uint16_t> next_verifying_thread()
+    {
+      static std::atomic<uint16_t> next = 0;
+
+      const uint16_t thread_count = enclave::ThreadMessaging::thread_count;
+      if (thread_count <= 2)
+        return std::nullopt;
+
+      const uint16_t tid = (next++ % (thread_count - 1)) + 1;
+      if (tid == execution_thread)
+        return std::nullopt;
+
+      return tid;
+    }
+
+    void process_pending()
+    {
+      while (!pending_requests.empty() && pending_requests.front()->ready)
+      {
+        auto pending = std::move(pending_requests.front());
+        pending_requests.pop_front();
+        pending->process();
+      }
+    }
+
+    // Process the request now if there is nothing ahead of it, otherwise once
+    // everything ahead of it has been processed
+    void enqueue(std::function<void()> process)
+    {
+      if (pending_requests.empty())
+      {
+        process();
+        return;
+      }
+
+      pending_requests.push_back(std::make_shared<PendingRequest>(
+        PendingRequest{std::move(process), true}));
+    }
+
+    void send_response_in_order(
+      const std::string& data, http_status status = HTTP_STATUS_OK)
+    {
+      enqueue([this, data, status]() { send_response(data, status); });
+    }
+
   public:
     HTTPServerEndpoint(
       std::shared_ptr<RPCMap> rpc_map,
@@ -190,19 +294,88 @@ namespace enclave
       }
     }
 
+    void process_in_order(
+      std::shared_ptr<JsonRpcContext> rpc_ctx,
+      std::shared_ptr<RpcHandler> handler)
+    {
+      auto process = [this, rpc_ctx, handler]() {
+        try
+        {
+          auto response = handler->process(rpc_ctx);
+
+          if (!response.has_value())
+          {
+            // If the RPC is pending, hold the connection.
+            LOG_TRACE_FMT("Pending");
+            return;
+          }
+
+          {
+            metrics::StageTimer timer(
+              rpc_ctx->stage_times, metrics::Stage::Reply);
+            send_response(response.value());
+          }
+          handler->record_stage_times(*rpc_ctx);
+        }
+        catch (const std::exception& e)
+        {
+          send_response(
+            fmt::format("Exception:\n{}\n", e.what()),
+            HTTP_STATUS_INTERNAL_SERVER_ERROR);
+
+          // On any exception, close the connection.
+          pending_requests.clear();
+          close();
+        }
+      };
+
+      const auto tid = rpc_ctx->signed_request.has_value() ?
+        next_verifying_thread() :
+        std::nullopt;
+      if (!tid.has_value())
+      {
+        enqueue(std::move(process));
+        return;
+      }
+
+      auto pending = std::make_shared<PendingRequest>(
+        PendingRequest{std::move(process), false});
+      pending_requests.push_back(pending);
+
+      auto msg = std::make_unique<enclave::Tmsg<VerifyMsg>>(&verify_cb);
+      msg->data.self = this->shared_from_this();
+      msg->data.rpc_ctx = rpc_ctx;
+      msg->data.handler = handler;
+      msg->data.pending = pending;
+      enclave::ThreadMessaging::thread_messaging.add_task<VerifyMsg>(
+        tid.value(), std::move(msg));
+    }
+
     void handle_message(
       http_method verb,
-      const std::string& path,
-      const std::string& query,
-      const http::HeaderMap& headers,
-      const std::vector<uint8_t>& body) override
+      const std::string_view& path,
+      const std::string_view& query,
+      const http::HeaderViews& headers,
+      const CBuffer& body) override
+    {
+      receive_time = metrics::StageClock::now() - received_at;
+      handle_request(verb, path, query, headers, body);
+      received_at = metrics::StageClock::now();
+    }
+
+    void handle_request(
+      http_method verb,
+      const std::string_view& path,
+      const std::string_view& query,
+      const http::HeaderViews& headers,
+      const CBuffer& body)
     {
       LOG_TRACE_FMT(
         "Processing msg({}, {}, {}, [{} bytes])",
         http_method_str(verb),
         path,
         query,
-        body.size());
+        body.n);
 
       try
       {
@@ -226,20 +399,21 @@ namespace enclave
           "'{}'.\n";
 
         if (
-          first_slash != 0 || first_slash == std::string::npos ||
-          second_slash == std::string::npos)
+          first_slash != 0 || first_slash == std::string_view::npos ||
+          second_slash == std::string_view::npos)
         {
-          send_response(
+          send_response_in_order(
             fmt::format(path_parse_error, path), HTTP_STATUS_BAD_REQUEST);
           return;
         }
 
-        const auto actor_s = path.substr(first_slash + 1, second_slash - 1);
-        const auto method_s = path.substr(second_slash + 1);
+        const auto actor_s =
+          std::string(path.substr(first_slash + 1, second_slash - 1));
+        const auto method_s = std::string(path.substr(second_slash + 1));
 
         if (actor_s.empty() || method_s.empty())
         {
-          send_response(
+          send_response_in_order(
             fmt::format(path_parse_error, path), HTTP_STATUS_BAD_REQUEST);
           return;
         }
@@ -248,7 +422,7 @@ namespace enclave
         auto search = rpc_map->find(actor);
         if (actor == ccf::ActorsType::unknown || !search.has_value())
         {
-          send_response(
+          send_response_in_order(
             fmt::format("Unknown session '{}'.\n", actor_s),
             HTTP_STATUS_NOT_FOUND);
           return;
@@ -256,7 +430,7 @@ namespace enclave
 
         if (!search.value()->is_open())
         {
-          send_response(
+          send_response_in_order(
             fmt::format("Session '{}' is not open.\n", actor_s),
             HTTP_STATUS_NOT_FOUND);
           return;
@@ -264,19 +438,34 @@ namespace enclave
 
         const SessionContext session(session_id, peer_cert());
         std::optional<jsonrpc::Pack> pack;
-
-        auto [success, json_rpc] = jsonrpc::unpack_rpc(body, pack);
+        std::optional<jsonrpc::PackedParams> packed_params;
+
+        // The body only refers to the parser's input, so is copied once here
+        // to outlive this call as the raw request
+        auto raw = std::vector<uint8_t>(body.p, body.p + body.n);
+        const auto unpack_start = metrics::StageClock::now();
+        auto [success, json_rpc] =
+          jsonrpc::unpack_rpc(raw, pack, packed_params);
+        const auto unpack_time = metrics::StageClock::now() - unpack_start;
         if (!success)
         {
-          send_response(
+          send_response_in_order(
             fmt::format("Unable to unpack body.\n"), HTTP_STATUS_BAD_REQUEST);
           return;
         }
 
         auto rpc_ctx =
           std::make_shared<JsonRpcContext>(session, pack.value(), json_rpc);
+        rpc_ctx->packed_params = std::move(packed_params);
         rpc_ctx->set_request_index(request_index++);
 
+        if constexpr (metrics::StageClock::enabled)
+        {
+          rpc_ctx->stage_times.start = received_at;
+          rpc_ctx->stage_times.add(metrics::Stage::Receive, receive_time);
+          rpc_ctx->stage_times.add(metrics::Stage::Unpack, unpack_time);
+        }
+
         auto signed_req = http::HttpSignatureVerifier::parse(
           std::string(http_method_str(verb)), path, query, headers, body);
         if (signed_req.has_value())
@@ -287,7 +476,7 @@ namespace enclave
         const auto expected = fmt::format("{}/{}", actor_s, method_s);
         if (rpc_ctx->method != expected)
         {
-          send_response(
+          send_response_in_order(
             fmt::format(
               "RPC method must match path ('{}' != '{}').\n",
               expected,
@@ -296,22 +485,11 @@ namespace enclave
           return;
         }
 
-        rpc_ctx->raw = body;
+        rpc_ctx->raw = std::move(raw);
         rpc_ctx->method = method_s;
         rpc_ctx->actor = actor;
 
-        auto response = search.value()->process(rpc_ctx);
-
-        if (!response.has_value())
-        {
-          // If the RPC is pending, hold the connection.
-          LOG_TRACE_FMT("Pending");
-          return;
-        }
-        else
-        {
-          send_response(response.value());
-        }
+        process_in_order(rpc_ctx, search.value());
       }
       catch (const std::exception& e)
       {
@@ -353,12 +531,12 @@ namespace enclave
 
     void handle_message(
       http_method method,
-      const std::string& path,
-      const std::string& query,
-      const http::HeaderMap& headers,
-      const std::vector<uint8_t>& body) override
+      const std::string_view& path,
+      const std::string_view& query,
+      const http::HeaderViews& headers,
+      const CBuffer& body) override
     {
-      handle_data_cb(body);
+      handle_data_cb(std::vector<uint8_t>(body.p, body.p + body.n));
 
       close();
     }
@@ -2,28 +2,94 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/buffer.h"
 #include "httpbuilder.h"
 #include "tlsendpoint.h"
 
 #include <algorithm>
 #include <cctype>
+#include <deque>
 #include <http-parser/http_parser.h>
-#include <map>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace enclave
 {
   namespace http
   {
+    // Headers of a parsed message, as views over the data passed to the
+    // parser. Names keep the case they were sent with, and are looked up
+    // case-insensitively.
+    class HeaderViews
+    {
+    public:
+      using Header = std::pair<std::string_view, std::string_view>;
+      using const_iterator = std::vector<Header>::const_iterator;
+
+    private:
+      std::vector<Header> headers;
+
+    public:
+      static bool name_equals(const std::string_view& a, const std::string_view& b)
+      {
+        return a.size() == b.size() &&
+          std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+                 return std::tolower((unsigned char)x) ==
+                   std::tolower((unsigned char)y);
+               });
+      }
+
+      const_iterator find(const std::string_view& name) const
+      {
+        return std::find_if(
+          headers.begin(), headers.end(), [&name](const Header& h) {
+            return name_equals(h.first, name);
+          });
+      }
+
+      const_iterator begin() const
+      {
+        return headers.begin();
+      }
+
+      const_iterator end() const
+      {
+        return headers.end();
+      }
+
+      size_t size() const
+      {
+        return headers.size();
+      }
+
+      bool empty() const
+      {
+        return headers.empty();
+      }
+
+      void emplace(const std::string_view& name, const std::string_view& value)
+      {
+        headers.emplace_back(name, value);
+      }
+
+      void clear()
+      {
+        headers.clear();
+      }
+    };
+
     class MsgProcessor
     {
     public:
+      // The path, query, headers and body refer to the data passed to the
+      // parser, and are only valid for the duration of this call.
       virtual void handle_message(
         http_method method,
-        const std::string& path,
-        const std::string& query,
-        const HeaderMap& headers,
-        const std::vector<uint8_t>& body) = 0;
+        const std::string_view& path,
+        const std::string_view& query,
+        const HeaderViews& headers,
+        const CBuffer& body) = 0;
     };
 
     enum State
@@ -38,22 +104,91 @@ namespace enclave
       http_parser* parser, const char* at, size_t length);
     static int on_header_value(
       http_parser* parser, const char* at, size_t length);
-    static int on_headers_complete(http_parser* parser);
     static int on_req(http_parser* parser, const char* at, size_t length);
     static int on_msg_end(http_parser* parser);
 
-    std::string extract_url_field(
-      const http_parser_url& url, http_parser_url_fields field, char const* raw)
+    inline std::string_view extract_url_field(
+      const http_parser_url& url,
+      http_parser_url_fields field,
+      const std::string_view& raw)
     {
       if ((1 << field) & url.field_set)
       {
         const auto& data = url.field_data[field];
-        return std::string(raw + data.off, raw + data.off + data.len);
+        return raw.substr(data.off, data.len);
       }
 
       return {};
     }
 
+    // Part of a message (url, header name or value, body). While the part is
+    // received in a single contiguous fragment, it refers to the data passed
+    // to execute(). It is only copied when it arrives in several fragments,
+    // or when the message it belongs to is not complete by the end of
+    // execute(). Parts refer to their own storage, so are never moved.
+    class MessagePart
+    {
+    private:
+      std::string_view view;
+      std::string owned;
+      bool is_owned = false;
+
+    public:
+      MessagePart() = default;
+      MessagePart(const MessagePart&) = delete;
+      MessagePart& operator=(const MessagePart&) = delete;
+
+      void append(const char* at, size_t length)
+      {
+        if (!is_owned)
+        {
+          if (view.empty())
+          {
+            view = {at, length};
+            return;
+          }
+
+          if (view.data() + view.size() == at)
+          {
+            view = {view.data(), view.size() + length};
+            return;
+          }
+
+          own();
+        }
+
+        owned.append(at, length);
+        view = owned;
+      }
+
+      void own()
+      {
+        if (!is_owned && !view.empty())
+        {
+          owned.assign(view);
+          is_owned = true;
+          view = owned;
+        }
+      }
+
+      void clear()
+      {
+        view = {};
+        owned.clear();
+        is_owned = false;
+      }
+
+      bool empty() const
+      {
+        return view.empty();
+      }
+
+      const std::string_view& get() const
+      {
+        return view;
+      }
+    };
+
     class Parser
     {
     private:
@@ -61,18 +196,44 @@ namespace enclave
       http_parser_settings settings;
       MsgProcessor& proc;
       State state = DONE;
-      std::vector<uint8_t> buf;
-      std::string path = "";
-      std::string query = "";
-      HeaderMap headers;
 
-      std::pair<std::string, std::string> partial_parsed_header = {};
+      MessagePart url;
+      MessagePart body;
+
+      // Parts are reused across messages, so that their storage is only
+      // allocated for the largest message that needed copying
+      std::deque<std::pair<MessagePart, MessagePart>> header_parts;
+      size_t header_count = 0;
+      bool in_header_value = false;
+      HeaderViews headers;
+
+      std::pair<MessagePart, MessagePart>& current_header()
+      {
+        return header_parts[header_count - 1];
+      }
+
+      void clear_message()
+      {
+        url.clear();
+        body.clear();
+        for (size_t i = 0; i < header_count; ++i)
+        {
+          header_parts[i].first.clear();
+          header_parts[i].second.clear();
+        }
+        header_count = 0;
+        in_header_value = false;
+      }
 
-      void complete_header()
+      void own_message()
       {
-        headers.emplace(partial_parsed_header);
-        partial_parsed_header.first.clear();
-        partial_parsed_header.second.clear();
+        url.own();
+        body.own();
+        for (size_t i = 0; i < header_count; ++i)
+        {
+          header_parts[i].first.own();
+          header_parts[i].second.own();
+        }
       }
 
     public:
@@ -84,7 +245,6 @@ namespace enclave
         settings.on_url = on_url;
         settings.on_header_field = on_header_field;
         settings.on_header_value = on_header_value;
-        settings.on_headers_complete = on_headers_complete;
         settings.on_body = on_req;
         settings.on_message_complete = on_msg_end;
 
@@ -108,6 +268,13 @@ namespace enclave
             http_errno_description(err)));
         }
 
+        // The rest of this message will be passed to a later call, after
+        // data has been released by the caller
+        if (state == IN_MESSAGE)
+        {
+          own_message();
+        }
+
         return parsed;
       }
 
@@ -116,7 +283,7 @@ namespace enclave
         if (state == IN_MESSAGE)
         {
           LOG_TRACE_FMT("Appending chunk [{}]", std::string_view(at, length));
-          std::copy(at, at + length, std::back_inserter(buf));
+          body.append(at, length);
         }
         else
         {
@@ -130,7 +297,7 @@ namespace enclave
         {
           LOG_TRACE_FMT("Entering new message");
           state = IN_MESSAGE;
-          buf.clear();
+          clear_message();
         }
         else
         {
@@ -144,8 +311,25 @@ namespace enclave
         if (state == IN_MESSAGE)
         {
           LOG_TRACE_FMT("Done with message");
+
+          std::string_view path;
+          std::string_view query;
+          parse_url(path, query);
+
+          headers.clear();
+          for (size_t i = 0; i < header_count; ++i)
+          {
+            headers.emplace(
+              header_parts[i].first.get(), header_parts[i].second.get());
+          }
+
+          const auto& b = body.get();
           proc.handle_message(
-            http_method(parser.method), path, query, headers, buf);
+            http_method(parser.method),
+            path,
+            query,
+            headers,
+            {(const uint8_t*)b.data(), b.size()});
           state = DONE;
         }
         else
@@ -154,49 +338,56 @@ namespace enclave
         }
       }
 
-      void parse_url(const char* at, size_t length)
+      void parse_url(std::string_view& path, std::string_view& query)
       {
-        LOG_TRACE_FMT(
-          "Received url to parse: {}", std::string_view(at, length));
+        const auto& raw = url.get();
+        if (raw.empty())
+        {
+          return;
+        }
 
-        http_parser_url url;
-        http_parser_url_init(&url);
+        LOG_TRACE_FMT("Received url to parse: {}", raw);
 
-        const auto err = http_parser_parse_url(at, length, 0, &url);
+        http_parser_url parsed_url;
+        http_parser_url_init(&parsed_url);
+
+        const auto err =
+          http_parser_parse_url(raw.data(), raw.size(), 0, &parsed_url);
         if (err != 0)
         {
           throw std::runtime_error(fmt::format("Error parsing url: {}", err));
         }
 
-        path = extract_url_field(url, UF_PATH, at);
+        path = extract_url_field(parsed_url, UF_PATH, raw);
+        query = extract_url_field(parsed_url, UF_QUERY, raw);
+      }
 
-        query = extract_url_field(url, UF_QUERY, at);
+      void url_fragment(const char* at, size_t length)
+      {
+        url.append(at, length);
       }
 
       void header_field(const char* at, size_t length)
       {
-        if (!partial_parsed_header.second.empty())
+        // A field following a value starts a new header. Otherwise, this
+        // continues the name of the current header.
+        if (header_count == 0 || in_header_value)
         {
-          complete_header();
+          in_header_value = false;
+          if (header_count == header_parts.size())
+          {
+            header_parts.emplace_back();
+          }
+          ++header_count;
         }
 
-        // HTTP headers are stored lowercase as it is easier to verify HTTP
-        // signatures later on
-        auto f = std::string(at, length);
-        std::transform(f.begin(), f.end(), f.begin(), [](unsigned char c) {
-          return std::tolower(c);
-        });
-        partial_parsed_header.first.append(f);
+        current_header().first.append(at, length);
       }
 
       void header_value(const char* at, size_t length)
       {
-        partial_parsed_header.second.append(at, length);
-      }
-
-      void headers_complete()
-      {
-        complete_header();
+        in_header_value = true;
+        current_header().second.append(at, length);
       }
     };
 
@@ -210,7 +401,7 @@ namespace enclave
     static int on_url(http_parser* parser, const char* at, size_t length)
     {
       Parser* p = reinterpret_cast<Parser*>(parser->data);
-      p->parse_url(at, length);
+      p->url_fragment(at, length);
       return 0;
     }
 
@@ -230,13 +421,6 @@ namespace enclave
       return 0;
     }
 
-    static int on_headers_complete(http_parser* parser)
-    {
-      Parser* p = reinterpret_cast<Parser*>(parser->data);
-      p->headers_complete();
-      return 0;
-    }
-
     static int on_req(http_parser* parser, const char* at, size_t length)
     {
       Parser* p = reinterpret_cast<Parser*>(parser->data);
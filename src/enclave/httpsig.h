@@ -33,11 +33,12 @@ namespace enclave
     static constexpr auto SIGN_PARAMS_DELIMITER = ",";
     static constexpr auto SIGN_PARAMS_HEADERS_DELIMITER = " ";
 
+    template <typename Headers>
     std::optional<std::vector<uint8_t>> construct_raw_signed_string(
       std::string verb,
-      const std::string& path,
-      const std::string& query,
-      const http::HeaderMap& headers,
+      const std::string_view& path,
+      const std::string_view& query,
+      const Headers& headers,
       const std::vector<std::string_view>& headers_to_sign)
     {
       std::string signed_string = {};
@@ -139,7 +140,7 @@ namespace enclave
       }
 
       static bool verify_digest(
-        const http::HeaderMap& headers, const std::vector<uint8_t>& body)
+        const http::HeaderViews& headers, const CBuffer& body)
       {
         // First, retrieve digest from header
         auto digest = headers.find(HTTP_HEADER_DIGEST);
@@ -150,7 +151,7 @@ namespace enclave
         }
 
         auto equal_pos = digest->second.find("=");
-        if (equal_pos == std::string::npos)
+        if (equal_pos == std::string_view::npos)
         {
           LOG_FAIL_FMT(
             "{} header does not contain key=value", HTTP_HEADER_DIGEST);
@@ -169,7 +170,7 @@ namespace enclave
 
         // Then, hash the request body
         tls::HashBytes body_digest;
-        tls::do_hash(body.data(), body.size(), body_digest, MBEDTLS_MD_SHA256);
+        tls::do_hash(body.p, body.n, body_digest, MBEDTLS_MD_SHA256);
 
         if (raw_digest != body_digest)
         {
@@ -282,10 +283,10 @@ namespace enclave
 
       static std::optional<ccf::SignedReq> parse(
         const std::string& verb,
-        const std::string& path,
-        const std::string& query,
-        const http::HeaderMap& headers,
-        const std::vector<uint8_t>& body)
+        const std::string_view& path,
+        const std::string_view& query,
+        const http::HeaderViews& headers,
+        const CBuffer& body)
       {
         auto auth = headers.find(HTTP_HEADER_AUTHORIZATION);
         if (auth != headers.end())
@@ -322,7 +323,7 @@ namespace enclave
           }
 
           auto sig_raw = tls::raw_from_b64(parsed_sign_params->signature);
-          auto raw_req = std::vector<uint8_t>({body.begin(), body.end()});
+          auto raw_req = std::vector<uint8_t>(body.p, body.p + body.n);
           ccf::SignedReq ret = {
             sig_raw, signed_raw.value(), raw_req, MBEDTLS_MD_SHA256};
           return ret;
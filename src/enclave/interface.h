@@ -64,13 +64,29 @@ struct CCFConfig
   };
   Joining joining = {};
 
+  struct Recovery
+  {
+    /// Number of ledger entries requested from the host at once
+    size_t ledger_read_batch = 1000;
+    /// Number of ledger entries requested ahead of the one being deserialised
+    size_t ledger_read_ahead = 10000;
+    MSGPACK_DEFINE(ledger_read_batch, ledger_read_ahead);
+  };
+  Recovery recovery = {};
+
+  /// Snapshot of the store to start from when joining or recovering, so that
+  /// only later ledger entries are replayed. Empty to replay the whole ledger.
+  std::vector<uint8_t> snapshot;
+
   MSGPACK_DEFINE(
     raft_config,
     node_info_network,
     domain,
     signature_intervals,
     genesis,
-    joining);
+    joining,
+    recovery,
+    snapshot);
 };
 
 /// General administrative messages
@@ -79,6 +95,14 @@ enum AdminMessage : ringbuffer::Message
   /// Log message. Enclave -> Host
   DEFINE_RINGBUFFER_MSG_TYPE(log_msg),
 
+  /// Description of a LOG_*_FMT statement, sent on its first use. Enclave ->
+  /// Host
+  DEFINE_RINGBUFFER_MSG_TYPE(log_site),
+
+  /// Arguments of a LOG_*_FMT statement, to be formatted by the host. Enclave
+  /// -> Host
+  DEFINE_RINGBUFFER_MSG_TYPE(log_record),
+
   /// Fatal error message. Enclave -> Host
   DEFINE_RINGBUFFER_MSG_TYPE(fatal_error_msg),
 
@@ -103,6 +127,19 @@ DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   logger::Level,
   uint16_t,
   std::string);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  AdminMessage::log_site,
+  uint32_t,
+  logger::Level,
+  std::string,
+  size_t,
+  std::string);
+DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
+  AdminMessage::log_record,
+  std::chrono::milliseconds,
+  uint32_t,
+  uint16_t,
+  serializer::ByteRange);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(AdminMessage::fatal_error_msg, std::string);
 DECLARE_RINGBUFFER_MESSAGE_PAYLOAD(
   AdminMessage::sealed_secrets, kv::Version, std::vector<uint8_t>);
@@ -5,6 +5,7 @@
 #include "node/clientsignatures.h"
 #include "node/entities.h"
 #include "node/rpc/jsonrpc.h"
+#include "node/rpc/stagetimes.h"
 
 #include <variant>
 #include <vector>
@@ -57,9 +58,15 @@ namespace enclave
     std::string msg;
   };
 
+  // A result which has already been packed as msgpack
+  struct PackedResult
+  {
+    std::vector<uint8_t> data;
+  };
+
   struct RpcResponse
   {
-    std::variant<ErrorDetails, nlohmann::json> result;
+    std::variant<ErrorDetails, nlohmann::json, PackedResult> result;
   };
 
   class RpcContext
@@ -82,6 +89,9 @@ namespace enclave
 
     std::optional<ccf::SignedReq> signed_request = std::nullopt;
 
+    // Set if the client signature was verified before processing
+    std::optional<bool> signature_verified = std::nullopt;
+
     // Actor type to dispatch to appropriate frontend
     ccf::ActorsType actor = ccf::ActorsType::unknown;
 
@@ -90,8 +100,16 @@ namespace enclave
 
     nlohmann::json params = {};
 
+    // Set instead of params (and the params in unpacked_rpc) if they were left
+    // packed, until unpack_params() is called
+    std::optional<jsonrpc::PackedParams> packed_params = std::nullopt;
+
     bool is_create_request = false;
 
+    // Time spent in each stage of processing this request, recorded in the
+    // frontend's metrics once it has been replied to
+    metrics::StageTimes stage_times = {};
+
     RpcContext(const SessionContext& s) : session(s) {}
 
     RpcContext(
@@ -105,6 +123,20 @@ namespace enclave
 
     virtual ~RpcContext() {}
 
+    /** Unpack the params of the request, if they were left packed
+     *
+     * @throws JsonParseError if the params cannot be represented as JSON
+     */
+    void unpack_params()
+    {
+      if (packed_params.has_value())
+      {
+        params = ds::json::msgpack_to_json(packed_params->params);
+        unpacked_rpc[jsonrpc::PARAMS] = params;
+        packed_params.reset();
+      }
+    }
+
     void set_request_index(size_t ri)
     {
       request_index = ri;
@@ -150,6 +182,16 @@ namespace enclave
       return std::get_if<nlohmann::json>(&response.result);
     }
 
+    void set_response_packed_result(std::vector<uint8_t>&& data)
+    {
+      response.result = PackedResult{std::move(data)};
+    }
+
+    const PackedResult* get_response_packed_result() const
+    {
+      return std::get_if<PackedResult>(&response.result);
+    }
+
     void set_response(RpcResponse&& r)
     {
       response = std::move(r);
@@ -217,6 +259,54 @@ namespace enclave
       return jsonrpc::pack(j, pack_format.value());
     }
 
+    bool is_reserved_header(const std::string& k) const
+    {
+      if (k == jsonrpc::JSON_RPC || k == jsonrpc::ID || k == jsonrpc::RESULT)
+      {
+        LOG_DEBUG_FMT(
+          "Ignoring response headers with key '{}' - already present in "
+          "response object",
+          k);
+        return true;
+      }
+      return false;
+    }
+
+    // Packs a response around a result that is already packed, without
+    // unpacking it
+    std::vector<uint8_t> pack_result_response(
+      const std::vector<uint8_t>& result) const
+    {
+      size_t size = 3;
+      for (const auto& [k, v] : headers)
+      {
+        if (!is_reserved_header(k))
+        {
+          ++size;
+        }
+      }
+
+      msgpack::sbuffer sb(result.size() + 128);
+      msgpack::packer<msgpack::sbuffer> pk(sb);
+      pk.pack_map(size);
+      pk.pack(jsonrpc::JSON_RPC);
+      pk.pack(jsonrpc::RPC_VERSION);
+      pk.pack(jsonrpc::ID);
+      pk.pack(seq_no);
+      pk.pack(jsonrpc::RESULT);
+      sb.write((const char*)result.data(), result.size());
+      for (const auto& [k, v] : headers)
+      {
+        if (!is_reserved_header(k))
+        {
+          pk.pack(k);
+          ds::json::json_to_msgpack(pk, v);
+        }
+      }
+
+      return {(const uint8_t*)sb.data(), (const uint8_t*)sb.data() + sb.size()};
+    }
+
   public:
     // Packing format of original request, should be used to pack response
     std::optional<jsonrpc::Pack> pack_format = std::nullopt;
@@ -229,13 +319,16 @@ namespace enclave
     {
       std::optional<jsonrpc::Pack> p;
 
-      auto [success, rpc] = jsonrpc::unpack_rpc(packed, p);
+      std::optional<jsonrpc::PackedParams> pp;
+
+      auto [success, rpc] = jsonrpc::unpack_rpc(packed, p, pp);
       if (!success)
       {
         throw std::logic_error(fmt::format("Failed to unpack: {}", rpc.dump()));
       }
 
       init(p.value(), rpc);
+      packed_params = std::move(pp);
     }
 
     JsonRpcContext(
@@ -247,6 +340,12 @@ namespace enclave
 
     virtual std::vector<uint8_t> serialise_response() const override
     {
+      const auto packed_result = get_response_packed_result();
+      if (packed_result != nullptr && pack_format == jsonrpc::Pack::MsgPack)
+      {
+        return pack_result_response(packed_result->data);
+      }
+
       nlohmann::json full_response;
 
       if (response_is_error())
@@ -255,6 +354,11 @@ namespace enclave
         full_response = jsonrpc::error_response(
           seq_no, jsonrpc::Error(error->code, error->msg));
       }
+      else if (packed_result != nullptr)
+      {
+        full_response = jsonrpc::result_response(
+          seq_no, nlohmann::json::from_msgpack(packed_result->data));
+      }
       else
       {
         const auto payload = get_response_result();
@@ -28,6 +28,14 @@ namespace enclave
     virtual std::optional<std::vector<uint8_t>> process(
       std::shared_ptr<RpcContext> ctx) = 0;
 
+    // Used by rpcendpoint to verify the client signature of an RPC on any
+    // thread, ahead of processing it
+    virtual void verify_signature_ahead(std::shared_ptr<RpcContext> ctx) {}
+
+    // Used by rpcendpoint to record how long each stage of processing an RPC
+    // took, once it has been replied to
+    virtual void record_stage_times(const RpcContext& ctx) {}
+
     // Used by PBFT to execute commands
     struct ProcessPbftResp
     {
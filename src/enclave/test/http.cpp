@@ -10,6 +10,14 @@
 #define FMT_HEADER_ONLY
 #include <fmt/format.h>
 
+std::string to_lowercase(std::string s)
+{
+  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) {
+    return std::tolower(c);
+  });
+  return s;
+}
+
 class StubProc : public enclave::http::MsgProcessor
 {
 public:
@@ -26,12 +34,22 @@ public:
 
   virtual void handle_message(
     http_method method,
-    const std::string& path,
-    const std::string& query,
-    const enclave::http::HeaderMap& headers,
-    const std::vector<uint8_t>& body) override
+    const std::string_view& path,
+    const std::string_view& query,
+    const enclave::http::HeaderViews& headers,
+    const CBuffer& body) override
   {
-    received.emplace(Msg{method, path, query, headers, body});
+    enclave::http::HeaderMap h;
+    for (const auto& it : headers)
+    {
+      h.emplace(to_lowercase(std::string(it.first)), it.second);
+    }
+
+    received.emplace(Msg{method,
+                         std::string(path),
+                         std::string(query),
+                         h,
+                         std::vector<uint8_t>(body.p, body.p + body.n)});
   }
 };
 
@@ -44,14 +62,6 @@ std::vector<uint8_t> s_to_v(char const* s)
   return std::vector<uint8_t>(d, d + strlen(s));
 }
 
-std::string to_lowercase(std::string s)
-{
-  std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) {
-    return std::tolower(c);
-  });
-  return s;
-}
-
 using namespace enclave::http;
 
 TEST_CASE("Complete request")
@@ -251,4 +261,49 @@ TEST_CASE("Pessimal transport")
       CHECK(found->second == it.second);
     }
   }
-}
\ No newline at end of file
+}
+TEST_CASE("Headers spanning reads")
+{
+  StubProc sp;
+  enclave::http::Parser p(HTTP_REQUEST, sp);
+
+  auto builder = enclave::http::Request(HTTP_POST);
+  builder.set_path("/users/LOG_record");
+  builder.set_header("X-Custom-Header", "some value");
+
+  const auto r0 = s_to_v(request_0);
+  auto req = builder.build_request(r0);
+
+  // Each read is copied into a buffer which is overwritten once it has been
+  // parsed, as a TLS session's read buffer would be
+  std::vector<uint8_t> read_buf;
+  const size_t read_size = 7;
+  for (size_t done = 0; done < req.size(); done += read_size)
+  {
+    const auto next = std::min(read_size, req.size() - done);
+    read_buf.assign(req.begin() + done, req.begin() + done + next);
+    p.execute(read_buf.data(), read_buf.size());
+    std::fill(read_buf.begin(), read_buf.end(), 0);
+  }
+
+  CHECK(!sp.received.empty());
+  const auto& m = sp.received.front();
+  CHECK(m.path == "/users/LOG_record");
+  CHECK(m.body == r0);
+
+  const auto found = m.headers.find("x-custom-header");
+  CHECK(found != m.headers.end());
+  CHECK(found->second == "some value");
+}
+
+TEST_CASE("Header lookup")
+{
+  HeaderViews headers;
+  headers.emplace("Content-Type", "application/json");
+  headers.emplace("digest", "SHA-256=abc");
+
+  CHECK(headers.find("content-type") != headers.end());
+  CHECK(headers.find("CONTENT-TYPE")->second == "application/json");
+  CHECK(headers.find("Digest")->second == "SHA-256=abc");
+  CHECK(headers.find("content-length") == headers.end());
+}
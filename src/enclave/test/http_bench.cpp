@@ -0,0 +1,82 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "../httpbuilder.h"
+#include "../httpparser.h"
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+#include <picobench/picobench.hpp>
+
+using namespace enclave::http;
+
+class CountProc : public MsgProcessor
+{
+public:
+  size_t received = 0;
+  size_t body_bytes = 0;
+
+  void handle_message(
+    http_method method,
+    const std::string_view& path,
+    const std::string_view& query,
+    const HeaderViews& headers,
+    const CBuffer& body) override
+  {
+    ++received;
+    body_bytes += body.n;
+  }
+};
+
+static std::vector<uint8_t> make_request(size_t body_size)
+{
+  Request r(HTTP_POST);
+  r.set_path("/users/LOG_record");
+  r.set_header("authorization", "Signature keyId=\"a\",signature=\"b\"");
+  r.set_header("digest", "SHA-256=Y2NmCg==");
+  return r.build_request(std::vector<uint8_t>(body_size, 'x'));
+}
+
+// Requests are passed to the parser in reads of ReadSize bytes, as an
+// endpoint passes them after decryption. With a read size of 0, each request
+// is passed in a single read.
+template <size_t BodySize, size_t ReadSize>
+static void parse_requests(picobench::state& s)
+{
+  const auto request = make_request(BodySize);
+
+  CountProc proc;
+  Parser p(HTTP_REQUEST, proc);
+
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    const auto read_size = ReadSize == 0 ? request.size() : ReadSize;
+    for (size_t done = 0; done < request.size(); done += read_size)
+    {
+      p.execute(
+        request.data() + done, std::min(read_size, request.size() - done));
+    }
+  }
+  s.stop_timer();
+
+  if (proc.received != (size_t)s.iterations())
+    throw std::logic_error(fmt::format(
+      "Parsed {} requests, expected {}", proc.received, s.iterations()));
+}
+
+const std::vector<int> small_counts = {1000, 10000};
+const std::vector<int> large_counts = {10, 100};
+
+PICOBENCH_SUITE("parse requests with 32 byte bodies");
+auto small_single_read = parse_requests<32, 0>;
+PICOBENCH(small_single_read).iterations(small_counts).baseline();
+auto small_4k_reads = parse_requests<32, 4096>;
+PICOBENCH(small_4k_reads).iterations(small_counts);
+
+PICOBENCH_SUITE("parse requests with 1MB bodies");
+auto large_single_read = parse_requests<1024 * 1024, 0>;
+PICOBENCH(large_single_read).iterations(large_counts).baseline();
+auto large_4k_reads = parse_requests<1024 * 1024, 4096>;
+PICOBENCH(large_4k_reads).iterations(large_counts);
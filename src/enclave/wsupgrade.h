@@ -16,7 +16,6 @@ namespace enclave
     class WebSocketUpgrader
     {
     private:
-      // All HTTP headers are expected to be lowercase
       static constexpr auto HTTP_HEADER_UPGRADE = "upgrade";
       static constexpr auto HTTP_HEADER_CONNECTION = "connection";
       static constexpr auto HTTP_HEADER_WEBSOCKET_KEY = "sec-websocket-key";
@@ -52,7 +51,7 @@ namespace enclave
       WebSocketUpgrader() {}
 
       static std::optional<std::vector<uint8_t>> upgrade_if_necessary(
-        const http::HeaderMap& headers)
+        const http::HeaderViews& headers)
       {
         auto const upgrade_header = headers.find(HTTP_HEADER_UPGRADE);
         if (upgrade_header != headers.end())
@@ -65,7 +64,7 @@ namespace enclave
               HTTP_HEADER_WEBSOCKET_KEY));
           }
 
-          auto accept_string = construct_accept_string(header_key->second);
+          auto accept_string = construct_accept_string(std::string(header_key->second));
           if (!accept_string.has_value())
           {
             throw std::logic_error(fmt::format(
@@ -13,6 +13,7 @@
 #include <nlohmann/json.hpp>
 #include <string>
 #include <sys/types.h>
+#include <unordered_map>
 #include <unistd.h>
 
 namespace asynchost
@@ -29,6 +30,27 @@ namespace asynchost
     // Sealed secrets file path
     std::string sealed_secrets_file;
 
+    // A LOG_*_FMT statement in the enclave, described by a log_site message
+    struct EnclaveLogSite
+    {
+      std::string file_name;
+      std::string format;
+      logger::LogSite site;
+
+      EnclaveLogSite(
+        logger::Level level,
+        std::string file_name_,
+        size_t line_number,
+        std::string format_) :
+        file_name(std::move(file_name_)),
+        format(std::move(format_)),
+        site(level, file_name.c_str(), line_number, format.c_str())
+      {}
+    };
+
+    // Never removed, as queued log records may refer to them
+    std::unordered_map<uint32_t, std::unique_ptr<EnclaveLogSite>> log_sites;
+
   public:
     HandleRingbufferImpl(
       messaging::BufferProcessor& bp,
@@ -48,6 +70,37 @@ namespace asynchost
             file_name, line_number, log_level, thread_id, msg, elapsed.count());
         });
 
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        bp, AdminMessage::log_site, [this](const uint8_t* data, size_t size) {
+          auto [id, log_level, file_name, line_number, format] =
+            ringbuffer::read_message<AdminMessage::log_site>(data, size);
+
+          log_sites[id] = std::make_unique<EnclaveLogSite>(
+            log_level, std::move(file_name), line_number, std::move(format));
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        bp,
+        AdminMessage::log_record,
+        [this](const uint8_t* data, size_t size) {
+          auto [elapsed, site_id, thread_id, args] =
+            ringbuffer::read_message<AdminMessage::log_record>(data, size);
+
+          const auto it = log_sites.find(site_id);
+          if (it == log_sites.end())
+          {
+            LOG_FAIL_FMT("Received log record from unknown site {}", site_id);
+            return;
+          }
+
+          logger::Out::write_record(
+            it->second->site,
+            thread_id,
+            args.data,
+            args.size,
+            elapsed.count());
+        });
+
       DISPATCHER_SET_MESSAGE_HANDLER(
         bp,
         AdminMessage::fatal_error_msg,
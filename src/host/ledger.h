@@ -6,137 +6,1135 @@
 #include "ds/logger.h"
 #include "ds/messaging.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <memory>
+#include <optional>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <vector>
 
 namespace asynchost
 {
-  class Ledger
+  static constexpr size_t frame_header_size = sizeof(uint32_t);
+
+  // A contiguous range of ledger entries, stored as length-prefixed frames in
+  // its own file. The offset of each entry in the file is persisted in an
+  // index file alongside it, so that the segment can be opened without
+  // scanning it. Reads are served from a read-only mapping of the file.
+  //
+  // Writes are staged in memory, and only written to the file when the
+  // segment is flushed (or when staged entries are read back), so that a
+  // batch of entries costs a single write.
+  class LedgerSegment
   {
   private:
-    static constexpr size_t frame_header_size = sizeof(uint32_t);
+    const std::string file_path;
+    const std::string index_path;
+    int fd;
 
-    // This uses C stdio instead of fstream because an fstream
-    // cannot be truncated.
-    FILE* file;
-    std::vector<size_t> positions;
+    // Index of the first entry in this segment
+    const size_t start_idx;
+    size_t count;
     size_t total_len;
-    ringbuffer::WriterPtr to_enclave;
 
-  public:
-    Ledger(
-      const std::string& filename,
-      ringbuffer::AbstractWriterFactory& writer_factory) :
-      file(NULL),
-      to_enclave(writer_factory.create_writer_to_inside())
+    // Framed entries that have been appended but not yet written to the file,
+    // which holds the first written_len bytes of the segment
+    std::vector<uint8_t> pending;
+    size_t written_len;
+
+    // Whether entries have been written since the file was last synced
+    bool dirty;
+
+    // Offsets of each entry in the file. For segments that were complete
+    // when the ledger was opened, these are only loaded on first access.
+    std::vector<size_t> positions;
+    bool positions_loaded;
+
+    // Number of leading positions that have been persisted to the index file
+    size_t persisted;
+
+    const uint8_t* map;
+    size_t map_len;
+
+    [[noreturn]] void fail(const std::string& msg) const
     {
-      file = fopen(filename.c_str(), "r+b");
+      throw std::logic_error(
+        fmt::format("{} {}: {}", msg, file_path, strerror(errno)));
+    }
 
-      if (!file)
-        file = fopen(filename.c_str(), "w+b");
+    size_t file_size() const
+    {
+      struct stat st;
+      if (fstat(fd, &st) != 0)
+        fail("Failed to tell file size of");
+
+      return st.st_size;
+    }
 
-      if (!file)
-        throw std::logic_error("Unable to open or create ledger file");
+    // Reads frame headers from pos to the end of the file, recording the
+    // position of each complete entry
+    void scan(size_t pos)
+    {
+      const auto len = file_size();
+      uint32_t size = 0;
 
-      fseeko(file, 0, SEEK_END);
-      auto len = ftello(file);
-      if (len == 1)
+      while (len - pos >= frame_header_size)
       {
-        std::stringstream ss;
-        ss << "Failed to tell file size: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        if (pread(fd, &size, frame_header_size, pos) != frame_header_size)
+          fail("Failed to read from");
+
+        if (len - pos - frame_header_size < size)
+          throw std::logic_error("Malformed ledger file " + file_path);
+
+        positions.push_back(pos);
+        pos += (size + frame_header_size);
       }
-      fseeko(file, 0, SEEK_SET);
+
+      if (len != pos)
+        throw std::logic_error("Malformed ledger file " + file_path);
+
+      total_len = pos;
+      count = positions.size();
+    }
+
+    std::vector<size_t> read_index() const
+    {
+      std::vector<size_t> index;
+
+      auto index_fd = open(index_path.c_str(), O_RDONLY);
+      if (index_fd == -1)
+        return index;
+
+      struct stat st;
+      if (fstat(index_fd, &st) == 0)
+      {
+        index.resize(st.st_size / sizeof(uint64_t));
+        const auto bytes = index.size() * sizeof(uint64_t);
+        if (pread(index_fd, index.data(), bytes, 0) != (ssize_t)bytes)
+          index.clear();
+      }
+
+      close(index_fd);
+      return index;
+    }
+
+    void load_positions()
+    {
+      if (positions_loaded)
+        return;
+
+      positions = read_index();
+      persisted = positions.size();
+      positions_loaded = true;
+
+      if (positions.size() != count)
+      {
+        // The index does not match the segment, so rebuild it
+        LOG_FAIL_FMT("Rebuilding ledger index for {}", file_path);
+        positions.clear();
+        persisted = 0;
+        truncate_index(0);
+        scan(0);
+      }
+    }
+
+    void unmap()
+    {
+      if (map != nullptr)
+      {
+        munmap(const_cast<uint8_t*>(map), map_len);
+        map = nullptr;
+        map_len = 0;
+      }
+    }
+
+    const uint8_t* mapped(size_t pos, size_t len)
+    {
+      if (pos + len > map_len)
+      {
+        // The file has grown since it was mapped
+        write_pending();
+        unmap();
+        auto m = mmap(nullptr, total_len, PROT_READ, MAP_SHARED, fd, 0);
+        if (m == MAP_FAILED)
+          fail("Failed to map");
+
+        map = static_cast<const uint8_t*>(m);
+        map_len = total_len;
+      }
+
+      return map + pos;
+    }
+
+    void truncate_index(size_t new_count)
+    {
+      if (::truncate(index_path.c_str(), new_count * sizeof(uint64_t)) != 0)
+      {
+        if (errno != ENOENT)
+          fail("Failed to truncate index of");
+      }
+
+      persisted = std::min(persisted, new_count);
+    }
+
+  public:
+    /** Open or create a ledger segment
+     *
+     * @param file_path_ Path of the segment file
+     * @param start_idx_ Index of the first entry in the segment
+     * @param complete Whether the segment is known to be complete, in which
+     * case its index file is trusted and only read on first access
+     */
+    LedgerSegment(
+      const std::string& file_path_, size_t start_idx_, bool complete) :
+      file_path(file_path_),
+      index_path(file_path_ + ".idx"),
+      fd(-1),
+      start_idx(start_idx_),
+      count(0),
+      total_len(0),
+      written_len(0),
+      dirty(false),
+      positions_loaded(false),
+      persisted(0),
+      map(nullptr),
+      map_len(0)
+    {
+      fd = open(file_path.c_str(), O_RDWR | O_CREAT, 0644);
+      if (fd == -1)
+        fail("Unable to open or create ledger file");
+
+      struct stat st;
+      if (complete && stat(index_path.c_str(), &st) == 0)
+      {
+        count = st.st_size / sizeof(uint64_t);
+        total_len = file_size();
+        written_len = total_len;
+        return;
+      }
+
+      // The index of the last segment may lag behind the file. Entries that
+      // are not yet indexed are recovered by scanning from the last indexed
+      // entry.
+      positions = read_index();
+      positions_loaded = true;
+
+      const auto len = file_size();
       size_t pos = 0;
-      uint32_t size = 0;
+      while (!positions.empty())
+      {
+        const auto last = positions.back();
+        uint32_t size = 0;
+        if (
+          last + frame_header_size <= len &&
+          pread(fd, &size, frame_header_size, last) == frame_header_size &&
+          last + frame_header_size + size <= len)
+        {
+          pos = last + frame_header_size + size;
+          break;
+        }
+        positions.pop_back();
+      }
+
+      persisted = positions.size();
+      truncate_index(persisted);
+      scan(pos);
+      written_len = total_len;
+    }
+
+    LedgerSegment(const LedgerSegment& that) = delete;
 
-      while (len >= frame_header_size)
+    ~LedgerSegment()
+    {
+      try
       {
-        if (fread(&size, frame_header_size, 1, file) != 1)
-          throw std::logic_error("Failed to read from file");
+        write_pending();
+        persist_index();
+      }
+      catch (const std::exception& e)
+      {
+        LOG_FAIL_FMT("{}", e.what());
+      }
 
-        len -= frame_header_size;
+      unmap();
+      if (fd != -1)
+        close(fd);
+    }
 
-        if (len < size)
-          throw std::logic_error("Malformed ledger file");
+    size_t get_start_idx() const
+    {
+      return start_idx;
+    }
 
-        fseeko(file, size, SEEK_CUR);
-        len -= size;
+    size_t get_count() const
+    {
+      return count;
+    }
 
-        positions.push_back(pos);
-        pos += (size + frame_header_size);
+    size_t get_last_idx() const
+    {
+      return start_idx + count - 1;
+    }
+
+    size_t get_total_len() const
+    {
+      return total_len;
+    }
+
+    const std::string& get_path() const
+    {
+      return file_path;
+    }
+
+    /** Offset of an entry's frame in the segment file
+     *
+     * @param idx Index of the entry, or the index following the last entry to
+     * get the end of the segment
+     */
+    size_t position(size_t idx)
+    {
+      const auto offset = idx - start_idx;
+      if (offset == count)
+        return total_len;
+
+      load_positions();
+      return positions.at(offset);
+    }
+
+    /** Get framed entries [from, to], in place
+     *
+     * The returned range refers to the mapped segment, and is valid until the
+     * segment is next written to or truncated.
+     */
+    serializer::ByteRange framed_range(size_t from, size_t to)
+    {
+      const auto begin = position(from);
+      const auto end = position(to + 1);
+      return {mapped(begin, end - begin), end - begin};
+    }
+
+    /** Append an entry to the segment
+     *
+     * The entry is staged, and is only written to the file by the next call
+     * to write_pending() or sync().
+     */
+    void write_entry(const uint8_t* data, size_t size)
+    {
+      load_positions();
+
+      const uint32_t frame = (uint32_t)size;
+      const auto header = reinterpret_cast<const uint8_t*>(&frame);
+      pending.insert(pending.end(), header, header + frame_header_size);
+      pending.insert(pending.end(), data, data + size);
+
+      positions.push_back(total_len);
+      total_len += (size + frame_header_size);
+      count++;
+    }
+
+    /** Write all staged entries to the file, in a single write */
+    void write_pending()
+    {
+      size_t done = 0;
+      while (done < pending.size())
+      {
+        auto rc = pwrite(
+          fd, pending.data() + done, pending.size() - done, written_len + done);
+        if (rc < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          fail("Failed to write to");
+        }
+        done += rc;
       }
 
-      total_len = pos;
+      written_len += pending.size();
+      dirty |= !pending.empty();
+      pending.clear();
+    }
+
+    /** Write all staged entries to the file, and make them durable */
+    void sync()
+    {
+      write_pending();
+
+      if (dirty)
+      {
+        if (fdatasync(fd) != 0)
+          fail("Failed to sync");
+        dirty = false;
+      }
+    }
+
+    void truncate(size_t last_idx)
+    {
+      load_positions();
+      write_pending();
+
+      // The first segment of a ledger started from a snapshot may be
+      // truncated to before its start, which empties it
+      const auto new_count =
+        last_idx + 1 < start_idx ? 0 : last_idx + 1 - start_idx;
+      if (new_count >= count)
+        return;
+
+      unmap();
+      total_len = positions.at(new_count);
+      written_len = total_len;
+      positions.resize(new_count);
+      count = new_count;
+
+      if (ftruncate(fd, total_len))
+        fail("Failed to truncate");
+
+      if (persisted > count)
+        truncate_index(count);
+    }
+
+    /** Append any positions not yet in the index file to it */
+    void persist_index()
+    {
+      if (!positions_loaded || persisted == count)
+        return;
+
+      auto index_fd = open(index_path.c_str(), O_WRONLY | O_CREAT, 0644);
+      if (index_fd == -1)
+        fail("Unable to open index of");
+
+      std::vector<uint64_t> pending(
+        positions.begin() + persisted, positions.end());
+      const auto bytes = pending.size() * sizeof(uint64_t);
+      if (
+        pwrite(index_fd, pending.data(), bytes, persisted * sizeof(uint64_t)) !=
+        (ssize_t)bytes)
+      {
+        close(index_fd);
+        fail("Failed to write index of");
+      }
+
+      close(index_fd);
+      persisted = count;
+    }
+
+    /** Delete the segment and its index from disk */
+    void remove()
+    {
+      positions_loaded = false;
+      ::unlink(file_path.c_str());
+      ::unlink(index_path.c_str());
+    }
+  };
+
+  // Framed entries that have recently been written to the ledger, kept in
+  // memory so that they can be sent to any number of followers without being
+  // read back from the ledger. Entries are held in refcounted chunks, which
+  // are immutable once entries have been read from them, so that a chunk can
+  // be passed to several writes and outlive its eviction or truncation until
+  // they complete. The cached entries are always a contiguous range, of at
+  // most max_size bytes.
+  class RecentEntries
+  {
+  public:
+    using Chunk = std::shared_ptr<const std::vector<uint8_t>>;
+
+    // Entries in place in a chunk, which must be held for as long as data is
+    // used
+    struct SharedRange
+    {
+      Chunk chunk;
+      const uint8_t* data;
+      size_t size;
+    };
+
+  private:
+    struct Entries
+    {
+      size_t start_idx;
+      // Offsets of each entry in data, followed by the end of the last one
+      std::vector<size_t> positions;
+      std::shared_ptr<std::vector<uint8_t>> data;
+      // Once sealed, data is shared and entries are no longer appended to it
+      bool sealed;
+
+      size_t get_last_idx() const
+      {
+        return start_idx + positions.size() - 2;
+      }
+    };
+
+    // Chunks are limited to a fraction of the cache, so that evicting one
+    // does not discard most of it
+    static constexpr size_t max_chunks = 8;
+
+    const size_t max_size;
+    std::deque<Entries> chunks;
+    size_t total_size = 0;
+
+    void evict()
+    {
+      while (!chunks.empty() && total_size > max_size)
+      {
+        total_size -= chunks.front().positions.back();
+        chunks.pop_front();
+      }
+    }
+
+  public:
+    static constexpr size_t default_max_size = 1 << 26;
+
+    RecentEntries(size_t max_size_ = default_max_size) : max_size(max_size_) {}
+
+    // Index of the first cached entry, or 0 if nothing is cached
+    size_t get_first_idx() const
+    {
+      return chunks.empty() ? 0 : chunks.front().start_idx;
+    }
+
+    size_t get_size() const
+    {
+      return total_size;
+    }
+
+    /** Append the entry following the last cached entry
+     *
+     * If idx does not follow the last cached entry, the cache is cleared and
+     * restarts from idx.
+     */
+    void append(size_t idx, const uint8_t* data, size_t size)
+    {
+      const auto framed_size = frame_header_size + size;
+      if (framed_size > max_size)
+      {
+        clear();
+        return;
+      }
+
+      if (!chunks.empty() && chunks.back().get_last_idx() + 1 != idx)
+        clear();
+
+      if (
+        chunks.empty() || chunks.back().sealed ||
+        chunks.back().data->size() >= max_size / max_chunks)
+      {
+        chunks.push_back(
+          {idx, {0}, std::make_shared<std::vector<uint8_t>>(), false});
+      }
+
+      auto& chunk = chunks.back();
+      const uint32_t frame = (uint32_t)size;
+      const auto header = reinterpret_cast<const uint8_t*>(&frame);
+      chunk.data->insert(chunk.data->end(), header, header + frame_header_size);
+      chunk.data->insert(chunk.data->end(), data, data + size);
+      chunk.positions.push_back(chunk.data->size());
+
+      total_size += framed_size;
+      evict();
+    }
+
+    /** Visit cached framed entries [from, to] in place
+     *
+     * f is called once per chunk spanned by the range, and only if the whole
+     * range is cached.
+     *
+     * @return Whether the range was cached
+     */
+    template <typename F>
+    bool foreach_range(size_t from, size_t to, F&& f)
+    {
+      if (
+        chunks.empty() || to < from || from < get_first_idx() ||
+        to > chunks.back().get_last_idx())
+        return false;
+
+      auto it = std::upper_bound(
+        chunks.begin(), chunks.end(), from, [](size_t idx, const Entries& c) {
+          return idx < c.start_idx;
+        });
+
+      for (--it; from <= to; ++it)
+      {
+        auto& chunk = *it;
+        chunk.sealed = true;
+
+        const auto end = std::min(to, chunk.get_last_idx());
+        const auto begin = chunk.positions[from - chunk.start_idx];
+        const auto size = chunk.positions[end + 1 - chunk.start_idx] - begin;
+        f(SharedRange{chunk.data, chunk.data->data() + begin, size});
+        from = end + 1;
+      }
+
+      return true;
+    }
+
+    /** Discard cached entries after last_idx
+     *
+     * The data of sealed chunks is not modified, as it may still be in use.
+     */
+    void truncate(size_t last_idx)
+    {
+      while (!chunks.empty() && chunks.back().start_idx > last_idx)
+      {
+        total_size -= chunks.back().positions.back();
+        chunks.pop_back();
+      }
+
+      if (chunks.empty() || chunks.back().get_last_idx() <= last_idx)
+        return;
 
-      if (len != 0)
-        throw std::logic_error("Malformed ledger file");
+      auto& chunk = chunks.back();
+      const auto old_size = chunk.positions.back();
+      chunk.positions.resize(last_idx + 2 - chunk.start_idx);
+      if (!chunk.sealed)
+        chunk.data->resize(chunk.positions.back());
+      total_size -= old_size - chunk.positions.back();
+    }
+
+    void clear()
+    {
+      chunks.clear();
+      total_size = 0;
+    }
+  };
+
+  enum class LedgerSyncPolicy
+  {
+    /// Sync each entry as it is written
+    Entry,
+    /// Sync each batch of entries, ie once per loop iteration
+    Batch,
+    /// Sync batches at most once per sync interval
+    Interval
+  };
+
+  class Ledger
+  {
+  public:
+    static constexpr size_t default_max_segment_size = 1 << 28;
+
+    // Entries requested by the enclave are sent in batches of at most this
+    // many bytes, unless a single entry is larger
+    static constexpr size_t max_entries_batch_size = 1 << 20;
+
+  private:
+    const std::string filename;
+    const size_t max_segment_size;
+
+    const LedgerSyncPolicy sync_policy;
+    const std::chrono::milliseconds sync_interval;
+    std::chrono::steady_clock::time_point last_sync;
+
+    // Last index known to be on stable storage
+    size_t durable_idx;
+
+    // Index of the latest snapshot written alongside the ledger, or 0
+    size_t snapshot_idx;
+
+    // Snapshot being received in fragments, which is written to a temporary
+    // file until it ends. The file is -1 if it could not be written.
+    size_t pending_snapshot_idx = 0;
+    size_t pending_snapshot_size = 0;
+    int pending_snapshot_fd = -1;
+
+    // The ledger is split into segment files. The first is stored at
+    // filename, and subsequent ones at filename.1, filename.2, etc. Segments
+    // are sorted by start index, and there is always at least one.
+    std::vector<std::unique_ptr<LedgerSegment>> segments;
+    ringbuffer::WriterPtr to_enclave;
+
+    // The most recently written entries, for sending to followers
+    RecentEntries recent;
+
+    std::string segment_path(size_t segment) const
+    {
+      if (segment == 0)
+        return filename;
+
+      return filename + "." + std::to_string(segment);
+    }
+
+    // If the ledger starts after a snapshot, rather than at 1, the index of
+    // its first entry is stored in this file
+    std::string start_path() const
+    {
+      return filename + ".start";
+    }
+
+    // Snapshots are stored alongside the ledger, at filename.snapshot.<idx>,
+    // where idx is the index of the last entry included in the snapshot
+    std::string snapshot_prefix() const
+    {
+      return filename + ".snapshot.";
+    }
+
+    std::string snapshot_path(size_t idx) const
+    {
+      return snapshot_prefix() + std::to_string(idx);
+    }
+
+    size_t read_start_idx() const
+    {
+      size_t start_idx = 1;
+      auto f = fopen(start_path().c_str(), "r");
+      if (f != nullptr)
+      {
+        if (fscanf(f, "%zu", &start_idx) != 1)
+          start_idx = 1;
+        fclose(f);
+      }
+      return start_idx;
+    }
+
+    // Index of the latest snapshot in the ledger's directory, or 0
+    size_t find_latest_snapshot() const
+    {
+      const auto slash = filename.rfind('/');
+      const auto dir =
+        slash == std::string::npos ? "." : filename.substr(0, slash);
+      const auto prefix = snapshot_prefix().substr(
+        slash == std::string::npos ? 0 : slash + 1);
+
+      size_t latest = 0;
+      auto d = opendir(dir.c_str());
+      if (d == nullptr)
+        return latest;
+
+      while (auto e = readdir(d))
+      {
+        const std::string name(e->d_name);
+        if (name.compare(0, prefix.size(), prefix) != 0)
+          continue;
+
+        const auto suffix = name.substr(prefix.size());
+        if (
+          suffix.empty() ||
+          suffix.find_first_not_of("0123456789") != std::string::npos)
+          continue;
+
+        latest = std::max(latest, (size_t)std::stoull(suffix));
+      }
+
+      closedir(d);
+      return latest;
+    }
+
+    LedgerSegment& last_segment()
+    {
+      return *segments.back();
+    }
+
+    // Returns the segment containing idx, which must be a valid index
+    LedgerSegment& find_segment(size_t idx)
+    {
+      auto it = std::upper_bound(
+        segments.begin(),
+        segments.end(),
+        idx,
+        [](size_t idx, const std::unique_ptr<LedgerSegment>& s) {
+          return idx < s->get_start_idx();
+        });
+      return **std::prev(it);
+    }
+
+    void discard_pending_snapshot()
+    {
+      if (pending_snapshot_fd != -1)
+      {
+        close(pending_snapshot_fd);
+        ::unlink((snapshot_path(pending_snapshot_idx) + ".tmp").c_str());
+        pending_snapshot_fd = -1;
+      }
+      pending_snapshot_idx = 0;
+    }
+
+  public:
+    Ledger(
+      const std::string& filename_,
+      ringbuffer::AbstractWriterFactory& writer_factory,
+      size_t max_segment_size_ = default_max_segment_size,
+      LedgerSyncPolicy sync_policy_ = LedgerSyncPolicy::Batch,
+      std::chrono::milliseconds sync_interval_ = std::chrono::milliseconds(10),
+      size_t recent_entries_size = RecentEntries::default_max_size) :
+      filename(filename_),
+      max_segment_size(max_segment_size_),
+      sync_policy(sync_policy_),
+      sync_interval(sync_interval_),
+      last_sync(std::chrono::steady_clock::now()),
+      durable_idx(0),
+      to_enclave(writer_factory.create_writer_to_inside()),
+      recent(recent_entries_size)
+    {
+      // Only the index of the last segment is read on startup. Earlier
+      // segments are complete, and only their index size is needed.
+      size_t n = 1;
+      struct stat st;
+      while (stat(segment_path(n).c_str(), &st) == 0)
+        n++;
+
+      size_t start_idx = read_start_idx();
+      for (size_t i = 0; i < n; ++i)
+      {
+        segments.push_back(std::make_unique<LedgerSegment>(
+          segment_path(i), start_idx, i < n - 1));
+        start_idx += segments.back()->get_count();
+      }
+
+      // Everything already in the ledger is assumed to be durable
+      durable_idx = get_last_idx();
+
+      snapshot_idx = find_latest_snapshot();
     }
 
     Ledger(const Ledger& that) = delete;
 
     ~Ledger()
     {
-      if (file)
+      discard_pending_snapshot();
+    }
+
+    size_t get_first_idx() const
+    {
+      return segments.front()->get_start_idx();
+    }
+
+    size_t get_last_idx()
+    {
+      return last_segment().get_start_idx() + last_segment().get_count() - 1;
+    }
+
+    size_t get_durable_idx() const
+    {
+      return durable_idx;
+    }
+
+    size_t get_snapshot_idx() const
+    {
+      return snapshot_idx;
+    }
+
+    /** Read the latest snapshot written alongside the ledger
+     *
+     * @return Index of the last entry included in the snapshot, and the
+     * serialised snapshot, or nothing if there is no snapshot
+     */
+    std::optional<std::pair<size_t, std::vector<uint8_t>>> read_snapshot()
+    {
+      if (snapshot_idx == 0)
+        return {};
+
+      const auto path = snapshot_path(snapshot_idx);
+      auto f = fopen(path.c_str(), "rb");
+      if (f == nullptr)
+      {
+        LOG_FAIL_FMT("Unable to open snapshot {}", path);
+        return {};
+      }
+
+      std::vector<uint8_t> snapshot;
+      uint8_t buf[1 << 16];
+      size_t n;
+      while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+        snapshot.insert(snapshot.end(), buf, buf + n);
+
+      const auto failed = ferror(f);
+      fclose(f);
+      if (failed)
+      {
+        LOG_FAIL_FMT("Failed to read snapshot {}", path);
+        return {};
+      }
+
+      return std::make_pair(snapshot_idx, std::move(snapshot));
+    }
+
+    /** Write a fragment of a snapshot alongside the ledger
+     *
+     * Fragments are appended to a temporary file, which replaces the previous
+     * snapshot once the snapshot ends. A snapshot that is never ended is
+     * discarded when the next one starts. Failing to write a snapshot is not
+     * fatal, as the ledger still holds every entry.
+     *
+     * @param idx Index of the last entry included in the snapshot
+     */
+    void write_snapshot_fragment(size_t idx, const uint8_t* data, size_t size)
+    {
+      if (idx <= snapshot_idx)
+        return;
+
+      const auto tmp_path = snapshot_path(idx) + ".tmp";
+      if (idx != pending_snapshot_idx)
       {
-        fflush(file);
-        fclose(file);
+        discard_pending_snapshot();
+        pending_snapshot_idx = idx;
+        pending_snapshot_size = 0;
+        pending_snapshot_fd =
+          open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (pending_snapshot_fd == -1)
+        {
+          LOG_FAIL_FMT(
+            "Unable to create snapshot {}: {}",
+            snapshot_path(idx),
+            strerror(errno));
+          return;
+        }
+      }
+
+      if (pending_snapshot_fd == -1)
+        return;
+
+      size_t done = 0;
+      while (done < size)
+      {
+        auto rc = write(pending_snapshot_fd, data + done, size - done);
+        if (rc < 0 && errno == EINTR)
+          continue;
+        if (rc < 0)
+          break;
+        done += rc;
+      }
+      pending_snapshot_size += done;
+
+      if (done != size)
+      {
+        LOG_FAIL_FMT(
+          "Failed to write snapshot {}: {}",
+          snapshot_path(idx),
+          strerror(errno));
+        close(pending_snapshot_fd);
+        ::unlink(tmp_path.c_str());
+        pending_snapshot_fd = -1;
       }
     }
 
-    size_t get_last_idx()
+    /** End a snapshot written in fragments
+     *
+     * The snapshot is only moved into place once it is durable, and then
+     * replaces the previous snapshot.
+     *
+     * @param idx Index of the last entry included in the snapshot
+     */
+    void end_snapshot(size_t idx)
     {
-      return positions.size();
+      if (idx != pending_snapshot_idx)
+        return;
+
+      const auto fd = pending_snapshot_fd;
+      pending_snapshot_fd = -1;
+      pending_snapshot_idx = 0;
+      if (fd == -1)
+        return;
+
+      const auto path = snapshot_path(idx);
+      const auto tmp_path = path + ".tmp";
+      const auto ok = fdatasync(fd) == 0;
+      close(fd);
+
+      if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+      {
+        LOG_FAIL_FMT("Failed to write snapshot {}: {}", path, strerror(errno));
+        ::unlink(tmp_path.c_str());
+        return;
+      }
+
+      LOG_INFO_FMT("Wrote snapshot {} ({} bytes)", path, pending_snapshot_size);
+
+      if (snapshot_idx != 0)
+        ::unlink(snapshot_path(snapshot_idx).c_str());
+      snapshot_idx = idx;
+    }
+
+    /** Write a whole snapshot alongside the ledger
+     *
+     * @param idx Index of the last entry included in the snapshot
+     */
+    void write_snapshot(size_t idx, const uint8_t* data, size_t size)
+    {
+      write_snapshot_fragment(idx, data, size);
+      end_snapshot(idx);
+    }
+
+    /** Start an empty ledger after a snapshot, so that the next entry written
+     * is the one following the snapshot
+     *
+     * @param idx Index of the last entry included in the snapshot
+     */
+    void init_from_snapshot(size_t idx)
+    {
+      if (get_last_idx() >= get_first_idx())
+        throw std::logic_error(
+          "Cannot start a ledger that is not empty from a snapshot");
+
+      auto f = fopen(start_path().c_str(), "w");
+      if (f == nullptr)
+        throw std::logic_error(fmt::format(
+          "Unable to create {}: {}", start_path(), strerror(errno)));
+
+      const auto written = fprintf(f, "%zu", idx + 1) > 0;
+      if (fclose(f) != 0 || !written)
+        throw std::logic_error(fmt::format(
+          "Failed to write {}: {}", start_path(), strerror(errno)));
+
+      segments.front() =
+        std::make_unique<LedgerSegment>(segment_path(0), idx + 1, false);
+      durable_idx = idx;
+      recent.clear();
     }
 
     const std::vector<uint8_t> read_entry(size_t idx)
     {
-      if ((idx == 0) || (idx > positions.size()))
+      auto entry = read_entry_range(idx);
+      if (!entry.has_value())
         return {};
 
-      auto len = entry_size(idx);
-      std::vector<uint8_t> entry(len);
-      fseeko(file, positions.at(idx - 1) + frame_header_size, SEEK_SET);
+      return {entry->data, entry->data + entry->size};
+    }
 
-      if (fread(entry.data(), len, 1, file) != 1)
-        throw std::logic_error("Failed to read from file");
+    /** Get an entry in place, without copying it
+     *
+     * The returned range is valid until the ledger is next written to or
+     * truncated.
+     *
+     * @param idx Index of the entry
+     *
+     * @return Range of the entry, empty if there is no such entry
+     */
+    std::optional<serializer::ByteRange> read_entry_range(size_t idx)
+    {
+      if ((idx < get_first_idx()) || (idx > get_last_idx()))
+        return {};
 
-      return entry;
+      auto framed = find_segment(idx).framed_range(idx, idx);
+      return serializer::ByteRange{framed.data + frame_header_size,
+                                   framed.size - frame_header_size};
     }
 
     const std::vector<uint8_t> read_framed_entries(size_t from, size_t to)
     {
-      auto framed_size = framed_entries_size(from, to);
+      std::vector<uint8_t> framed_entries;
+      framed_entries.reserve(framed_entries_size(from, to));
 
-      std::vector<uint8_t> framed_entries(framed_size);
-      if (framed_size == 0)
-        return framed_entries;
+      foreach_framed_range(from, to, [&](const serializer::ByteRange& r) {
+        framed_entries.insert(framed_entries.end(), r.data, r.data + r.size);
+      });
 
-      fseeko(file, positions.at(from - 1), SEEK_SET);
+      return framed_entries;
+    }
 
-      if (fread(framed_entries.data(), framed_size, 1, file) != 1)
-        throw std::logic_error("Failed to read from file");
+    /** Visit framed entries [from, to] in place
+     *
+     * Entries in a single segment are contiguous, so f is called once per
+     * segment spanned by the range.
+     */
+    template <typename F>
+    void foreach_framed_range(size_t from, size_t to, F&& f)
+    {
+      if ((from < get_first_idx()) || (to < from) || (to > get_last_idx()))
+        return;
 
-      return framed_entries;
+      while (from <= to)
+      {
+        auto& segment = find_segment(from);
+        auto end = std::min(to, segment.get_last_idx());
+        f(segment.framed_range(from, end));
+        from = end + 1;
+      }
+    }
+
+    /** Visit recently written framed entries [from, to] in place, without
+     * copying them
+     *
+     * Unlike foreach_framed_range, each range is refcounted, and may be used
+     * until its chunk is released, even if the ledger is written to or
+     * truncated in the meantime. f is only called if all the entries are still
+     * cached.
+     *
+     * @return Whether the entries were cached
+     */
+    template <typename F>
+    bool foreach_recent_range(size_t from, size_t to, F&& f)
+    {
+      return recent.foreach_range(from, to, std::forward<F>(f));
     }
 
     size_t framed_entries_size(size_t from, size_t to)
     {
-      if ((from == 0) || (to < from) || (to > positions.size()))
-        return 0;
+      size_t size = 0;
+
+      if ((from < get_first_idx()) || (to < from) || (to > get_last_idx()))
+        return size;
+
+      while (from <= to)
+      {
+        auto& segment = find_segment(from);
+        auto end = std::min(to, segment.get_last_idx());
+        size += segment.position(end + 1) - segment.position(from);
+        from = end + 1;
+      }
+
+      return size;
+    }
+
+    /** Send entries [from, to] to the enclave
+     *
+     * Entries are written straight from the mapped ledger into the
+     * ringbuffer, in batches of at most max_entries_batch_size bytes. If the
+     * range runs past the end of the ledger, the entries up to the end are
+     * sent, followed by the index of the first entry that does not exist.
+     *
+     * @tparam Entries Message carrying a batch of entries
+     * @tparam NoEntry Message reporting that an entry does not exist
+     */
+    template <
+      ringbuffer::Message Entries = consensus::ledger_entries,
+      ringbuffer::Message NoEntry = consensus::ledger_no_entry>
+    void send_entries(size_t from, size_t to)
+    {
+      if ((from < get_first_idx()) || (from > get_last_idx()))
+      {
+        RINGBUFFER_WRITE_MESSAGE(NoEntry, to_enclave, (consensus::Index)from);
+        return;
+      }
+
+      const auto last_idx = get_last_idx();
+      const auto cut_short = to > last_idx;
+      to = std::min(to, last_idx);
 
-      if (to == positions.size())
+      while (from <= to)
       {
-        return total_len - positions.at(from - 1);
+        auto& segment = find_segment(from);
+        const auto last = std::min(to, segment.get_last_idx());
+        const auto begin = segment.position(from);
+
+        auto end = from;
+        while (end < last &&
+               segment.position(end + 2) - begin <= max_entries_batch_size)
+        {
+          ++end;
+        }
+
+        RINGBUFFER_WRITE_MESSAGE(
+          Entries,
+          to_enclave,
+          (consensus::Index)from,
+          segment.framed_range(from, end));
+        from = end + 1;
       }
-      else
+
+      if (cut_short)
       {
-        return positions.at(to) - positions.at(from - 1);
+        RINGBUFFER_WRITE_MESSAGE(
+          NoEntry, to_enclave, (consensus::Index)(last_idx + 1));
       }
     }
 
@@ -149,45 +1147,72 @@ namespace asynchost
 
     void write_entry(const uint8_t* data, size_t size)
     {
-      fseeko(file, total_len, SEEK_SET);
-      positions.push_back(total_len);
+      auto& last = last_segment();
+      if (
+        last.get_count() > 0 &&
+        last.get_total_len() + frame_header_size + size > max_segment_size)
+      {
+        // A segment is durable and its index is complete before the next one
+        // is created
+        last.sync();
+        last.persist_index();
+        segments.push_back(std::make_unique<LedgerSegment>(
+          segment_path(segments.size()), get_last_idx() + 1, false));
+      }
 
-      LOG_DEBUG_FMT("Ledger write {}: {} bytes", positions.size(), size);
+      LOG_DEBUG_FMT("Ledger write {}: {} bytes", get_last_idx() + 1, size);
 
-      total_len += (size + frame_header_size);
+      last_segment().write_entry(data, size);
+      recent.append(get_last_idx(), data, size);
 
-      uint32_t frame = (uint32_t)size;
+      if (sync_policy == LedgerSyncPolicy::Entry)
+        sync();
+    }
+
+    /** Write the batch of entries appended since the last flush
+     *
+     * This should be called once all currently available entries have been
+     * appended, so that they are written together. Depending on the sync
+     * policy, the batch is also made durable.
+     */
+    void flush()
+    {
+      if (
+        sync_policy == LedgerSyncPolicy::Interval &&
+        std::chrono::steady_clock::now() - last_sync < sync_interval)
+      {
+        last_segment().write_pending();
+        return;
+      }
 
-      if (fwrite(&frame, frame_header_size, 1, file) != 1)
-        throw std::logic_error("Failed to write to file");
+      sync();
+    }
 
-      if (fwrite(data, size, 1, file) != 1)
-        throw std::logic_error("Failed to write to file");
+    /** Write and sync all appended entries */
+    void sync()
+    {
+      last_segment().sync();
+      last_sync = std::chrono::steady_clock::now();
+      durable_idx = get_last_idx();
     }
 
     void truncate(size_t last_idx)
     {
-      LOG_DEBUG_FMT("Ledger truncate: {}/{}", last_idx, positions.size());
+      LOG_DEBUG_FMT("Ledger truncate: {}/{}", last_idx, get_last_idx());
 
-      // positions[last_idx - 1] is the position of the specified
-      // final index. Truncate the ledger at position[last_idx].
-      if (last_idx >= positions.size())
+      if (last_idx >= get_last_idx())
         return;
 
-      total_len = positions.at(last_idx);
-      positions.resize(last_idx);
-
-      if (fflush(file) != 0)
+      // Discard later segments, newest first, always keeping the first
+      while (segments.size() > 1 && last_segment().get_start_idx() > last_idx)
       {
-        std::stringstream ss;
-        ss << "Failed to flush file: " << strerror(errno);
-        throw std::logic_error(ss.str());
+        last_segment().remove();
+        segments.pop_back();
       }
 
-      if (ftruncate(fileno(file), total_len))
-        throw std::logic_error("Failed to truncate file");
-
-      fseeko(file, total_len, SEEK_SET);
+      last_segment().truncate(last_idx);
+      durable_idx = std::min(durable_idx, last_idx);
+      recent.truncate(last_idx);
     }
 
     void register_message_handlers(
@@ -206,24 +1231,43 @@ namespace asynchost
           truncate(idx);
         });
 
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_snapshot,
+        [this](const uint8_t* data, size_t size) {
+          auto idx = serialized::read<consensus::Index>(data, size);
+          write_snapshot_fragment(idx, data, size);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_snapshot_end,
+        [this](const uint8_t* data, size_t size) {
+          auto idx = serialized::read<consensus::Index>(data, size);
+          end_snapshot(idx);
+        });
+
       DISPATCHER_SET_MESSAGE_HANDLER(
         disp, consensus::ledger_get, [&](const uint8_t* data, size_t size) {
-          // The enclave has asked for a ledger entry.
-          auto [idx] =
+          // The enclave has asked for a range of ledger entries
+          auto [from, to] =
             ringbuffer::read_message<consensus::ledger_get>(data, size);
 
-          auto& entry = read_entry(idx);
-
-          if (entry.size() > 0)
-          {
-            RINGBUFFER_WRITE_MESSAGE(
-              consensus::ledger_entry, to_enclave, entry);
-          }
-          else
-          {
-            RINGBUFFER_WRITE_MESSAGE(consensus::ledger_no_entry, to_enclave);
-          }
+          send_entries(from, to);
+        });
+
+      DISPATCHER_SET_MESSAGE_HANDLER(
+        disp,
+        consensus::ledger_get_historical,
+        [&](const uint8_t* data, size_t size) {
+          auto [from, to] =
+            ringbuffer::read_message<consensus::ledger_get_historical>(
+              data, size);
+
+          send_entries<
+            consensus::ledger_historical_entries,
+            consensus::ledger_historical_no_entry>(from, to);
         });
     }
   };
-}
\ No newline at end of file
+}
@@ -0,0 +1,27 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "everyio.h"
+#include "ledger.h"
+
+namespace asynchost
+{
+  // Flushes the ledger once per loop iteration, so that all entries received
+  // from the enclave in that iteration are written (and synced) as one batch
+  class LedgerFlushImpl
+  {
+  private:
+    Ledger& ledger;
+
+  public:
+    LedgerFlushImpl(Ledger& ledger) : ledger(ledger) {}
+
+    void every()
+    {
+      ledger.flush();
+    }
+  };
+
+  using LedgerFlush = proxy_ptr<EveryIO<LedgerFlushImpl>>;
+}
@@ -8,6 +8,7 @@
 #include "ds/oversized.h"
 #include "enclave.h"
 #include "handle_ringbuffer.h"
+#include "ledgerflush.h"
 #include "nodeconnections.h"
 #include "notifyconnections.h"
 #include "rpcconnections.h"
@@ -25,8 +26,6 @@
 using namespace std::string_literals;
 using namespace std::chrono_literals;
 
-::timespec logger::config::start{0, 0};
-
 int main(int argc, char** argv)
 {
   // ignore SIGPIPE
@@ -89,6 +88,23 @@ int main(int argc, char** argv)
   std::string ledger_file("ccf.ledger");
   app.add_option("--ledger-file", ledger_file, "Ledger file", true);
 
+  std::string ledger_sync("batch");
+  app.add_set(
+    "--ledger-sync",
+    ledger_sync,
+    {"entry", "batch", "interval"},
+    "When ledger writes are synced to disk: after every entry, after every "
+    "batch of entries received from the enclave, or at most once every "
+    "--ledger-sync-interval-ms",
+    true);
+
+  size_t ledger_sync_interval_ms = 10;
+  app.add_option(
+    "--ledger-sync-interval-ms",
+    ledger_sync_interval_ms,
+    "Minimum milliseconds between ledger syncs, with --ledger-sync=interval",
+    true);
+
   std::string host_log_level("info");
   app.add_set(
     "-l,--host-log-level",
@@ -127,6 +143,21 @@ int main(int argc, char** argv)
     "Maximum milliseconds between signatures",
     true);
 
+  size_t ledger_read_batch = 1000;
+  app.add_option(
+    "--ledger-read-batch",
+    ledger_read_batch,
+    "Number of ledger entries requested at once when recovering the ledger",
+    true);
+
+  size_t ledger_read_ahead = 10000;
+  app.add_option(
+    "--ledger-read-ahead",
+    ledger_read_ahead,
+    "Number of ledger entries requested ahead of the one being recovered, so "
+    "that the host reads ahead while the enclave deserialises",
+    true);
+
   size_t circuit_size_shift = 22;
   app.add_option(
     "--circuit-size-shift",
@@ -159,6 +190,25 @@ int main(int argc, char** argv)
     "set to a significantly lower value than --raft-election-timeout-ms.",
     true);
 
+  size_t raft_append_entries_window = 64;
+  app.add_option(
+    "--raft-append-entries-window",
+    raft_append_entries_window,
+    "Maximum number of batches of entries the Raft leader sends to each "
+    "follower before waiting for them to be acknowledged. Higher values "
+    "increase replication throughput to followers with high latency.",
+    true);
+
+  size_t snapshot_interval = 0;
+  app.add_option(
+    "--snapshot-interval",
+    snapshot_interval,
+    "Minimum number of committed ledger entries between snapshots of the "
+    "key-value store, which are written alongside the ledger. Joining and "
+    "recovering nodes start from the latest snapshot found next to their "
+    "ledger, and only replay the entries after it. 0 disables snapshots.",
+    true);
+
   size_t max_msg_size = 24;
   app.add_option(
     "--max-msg-size",
@@ -332,9 +382,36 @@ int main(int argc, char** argv)
   asynchost::HandleRingbuffer handle_ringbuffer(
     bp, circuit.read_from_inside(), non_blocking_factory);
 
+  // format and write log lines on a background thread. Destroyed before
+  // handle_ringbuffer, which holds the sites of lines logged in the enclave
+  logger::AsyncWriter async_logging;
+
   // graceful shutdown on sigterm
   asynchost::Sigterm sigterm(writer_factory);
 
+  // send all TCP writes from each loop iteration together
+  asynchost::TCPFlush tcp_flush;
+
+  // ledger
+  asynchost::LedgerSyncPolicy ledger_sync_policy =
+    asynchost::LedgerSyncPolicy::Batch;
+  if (ledger_sync == "entry")
+  {
+    ledger_sync_policy = asynchost::LedgerSyncPolicy::Entry;
+  }
+  else if (ledger_sync == "interval")
+  {
+    ledger_sync_policy = asynchost::LedgerSyncPolicy::Interval;
+  }
+
+  asynchost::Ledger ledger(
+    ledger_file,
+    writer_factory,
+    asynchost::Ledger::default_max_segment_size,
+    ledger_sync_policy,
+    std::chrono::milliseconds(ledger_sync_interval_ms));
+  ledger.register_message_handlers(bp.get_dispatcher());
+
   // Initialise the enclave and create a CCF node in it
   const size_t certificate_size = 4096;
   std::vector<uint8_t> node_cert(certificate_size);
@@ -352,8 +429,12 @@ int main(int argc, char** argv)
 #endif
 
   CCFConfig ccf_config;
-  ccf_config.raft_config = {raft_timeout, raft_election_timeout};
+  ccf_config.raft_config = {raft_timeout,
+                            raft_election_timeout,
+                            raft_append_entries_window,
+                            snapshot_interval};
   ccf_config.signature_intervals = {sig_max_tx, sig_max_ms};
+  ccf_config.recovery = {ledger_read_batch, ledger_read_ahead};
   ccf_config.node_info_network = {rpc_address.hostname,
                                   public_rpc_address.hostname,
                                   node_address.hostname,
@@ -395,11 +476,31 @@ int main(int argc, char** argv)
     ccf_config.joining.target_port = target_rpc_address.port;
     ccf_config.joining.network_cert = files::slurp(network_cert_file);
     ccf_config.joining.join_timer = join_timer;
+
+    // A new node with an empty ledger can start from a snapshot, in which
+    // case its ledger starts after the snapshot
+    auto snapshot = ledger.read_snapshot();
+    if (snapshot.has_value() && ledger.get_last_idx() < ledger.get_first_idx())
+    {
+      LOG_INFO_FMT("Joining from snapshot at {}", snapshot->first);
+      ledger.init_from_snapshot(snapshot->first);
+      ccf_config.snapshot = std::move(snapshot->second);
+    }
   }
   else if (*recover)
   {
     LOG_INFO_FMT("Creating new node - recover");
     start_type = StartType::Recover;
+
+    // Only the entries after the snapshot are read from the ledger
+    auto snapshot = ledger.read_snapshot();
+    if (
+      snapshot.has_value() && snapshot->first >= ledger.get_first_idx() - 1 &&
+      snapshot->first <= ledger.get_last_idx())
+    {
+      LOG_INFO_FMT("Recovering from snapshot at {}", snapshot->first);
+      ccf_config.snapshot = std::move(snapshot->second);
+    }
   }
 
   enclave.create_node(
@@ -414,9 +515,7 @@ int main(int argc, char** argv)
 
   LOG_INFO_FMT("Created new node");
 
-  // ledger
-  asynchost::Ledger ledger(ledger_file, writer_factory);
-  ledger.register_message_handlers(bp.get_dispatcher());
+  asynchost::LedgerFlush ledger_flush(ledger);
 
   asynchost::NodeConnections node(
     ledger, writer_factory, node_address.hostname, node_address.port);
@@ -246,10 +246,22 @@ namespace asynchost
             node.value()->write(sizeof(uint32_t), (uint8_t*)&frame);
             node.value()->write(size_to_send, data_to_send);
 
-            auto framed_entries =
-              ledger.read_framed_entries(ae.prev_idx + 1, ae.idx);
-            frame = (uint32_t)framed_entries.size();
-            node.value()->write(frame, framed_entries.data());
+            // Recently written entries are shared by the writes to every
+            // follower, without being copied. Older entries, for followers
+            // that are catching up, are copied straight from the ledger.
+            auto& tcp = node.value();
+            if (!ledger.foreach_recent_range(
+                  ae.prev_idx + 1,
+                  ae.idx,
+                  [&](const RecentEntries::SharedRange& r) {
+                    tcp->write_shared(r.chunk, r.size, r.data);
+                  }))
+            {
+              ledger.foreach_framed_range(
+                ae.prev_idx + 1, ae.idx, [&](const serializer::ByteRange& r) {
+                  tcp->write(r.size, r.data);
+                });
+            }
           }
           else
           {
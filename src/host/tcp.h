@@ -3,14 +3,120 @@
 #pragma once
 
 #include "../ds/logger.h"
+#include "beforeio.h"
 #include "dns.h"
 #include "proxy.h"
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 namespace asynchost
 {
   class TCPImpl;
   using TCP = proxy_ptr<TCPImpl>;
 
+  // Outbound data is copied into fixed-size buffers that are reused across
+  // writes and connections, along with the requests used to write them, rather
+  // than allocating for each write. Only used from the uv loop thread.
+  class TCPWritePool
+  {
+  public:
+    static constexpr size_t buffer_size = 16384;
+    static constexpr size_t max_free_buffers = 256;
+
+    // Buffers are either pooled, or shared with the writer, which is then
+    // held until the write completes
+    using Owner = std::shared_ptr<const void>;
+
+    struct WriteRequest
+    {
+      uv_write_t req;
+      std::vector<uv_buf_t> bufs;
+      // Owner of each buffer, or nullptr for pooled buffers
+      std::vector<Owner> owners;
+    };
+
+  private:
+    std::vector<char*> free_buffers;
+    std::vector<WriteRequest*> free_requests;
+    size_t allocations = 0;
+
+  public:
+    ~TCPWritePool()
+    {
+      for (auto buffer : free_buffers)
+        delete[] buffer;
+
+      for (auto request : free_requests)
+        delete request;
+    }
+
+    static TCPWritePool& get()
+    {
+      static TCPWritePool pool;
+      return pool;
+    }
+
+    char* get_buffer()
+    {
+      if (free_buffers.empty())
+      {
+        allocations++;
+        return new char[buffer_size];
+      }
+
+      auto buffer = free_buffers.back();
+      free_buffers.pop_back();
+      return buffer;
+    }
+
+    void put_buffer(char* buffer)
+    {
+      if (free_buffers.size() < max_free_buffers)
+        free_buffers.push_back(buffer);
+      else
+        delete[] buffer;
+    }
+
+    WriteRequest* get_request()
+    {
+      if (free_requests.empty())
+      {
+        allocations++;
+        auto request = new WriteRequest;
+        request->req.data = request;
+        return request;
+      }
+
+      auto request = free_requests.back();
+      free_requests.pop_back();
+      return request;
+    }
+
+    void put_request(WriteRequest* request)
+    {
+      for (size_t i = 0; i < request->bufs.size(); ++i)
+      {
+        if (request->owners[i] == nullptr)
+          put_buffer(request->bufs[i].base);
+      }
+      request->bufs.clear();
+      request->owners.clear();
+
+      if (free_requests.size() < max_free_buffers)
+        free_requests.push_back(request);
+      else
+        delete request;
+    }
+
+    // Number of buffers and requests allocated since the pool was created
+    size_t get_allocations() const
+    {
+      return allocations;
+    }
+  };
+
   class TCPBehaviour
   {
   public:
@@ -33,6 +139,10 @@ namespace asynchost
     static constexpr int backlog = 128;
     static constexpr size_t max_read_size = 16384;
 
+    // Shared writes smaller than this are copied, as they would otherwise
+    // cost a buffer of their own
+    static constexpr size_t min_shared_write_size = 4096;
+
     enum Status
     {
       FRESH,
@@ -48,27 +158,18 @@ namespace asynchost
       RECONNECTING
     };
 
-    struct PendingWrite
-    {
-      uv_write_t* req;
-      size_t len;
-
-      PendingWrite(uv_write_t* req, size_t len) : req(req), len(len) {}
-
-      PendingWrite(PendingWrite&& that) : req(that.req), len(that.len)
-      {
-        that.req = nullptr;
-      }
-
-      ~PendingWrite()
-      {
-        free_write(req);
-      }
-    };
-
     Status status;
     std::unique_ptr<TCPBehaviour> behaviour;
-    std::vector<PendingWrite> pending_writes;
+
+    // Pooled and shared buffers holding writes that have not yet been passed
+    // to uv. These are sent with a single uv_write when flushed, once per loop
+    // iteration or on connecting.
+    std::vector<uv_buf_t> outbound;
+    std::vector<TCPWritePool::Owner> outbound_owners;
+    bool flush_scheduled = false;
+
+    static inline std::vector<TCPImpl*> scheduled_flushes;
+    static inline size_t write_count = 0;
 
     std::string host;
     std::string service;
@@ -87,6 +188,14 @@ namespace asynchost
     {
       if (addr_base != nullptr)
         uv_freeaddrinfo(addr_base);
+
+      if (flush_scheduled)
+      {
+        scheduled_flushes.erase(std::find(
+          scheduled_flushes.begin(), scheduled_flushes.end(), this));
+      }
+
+      discard_outbound();
     }
 
   public:
@@ -142,30 +251,80 @@ namespace asynchost
 
     bool write(size_t len, const uint8_t* data)
     {
-      auto req = new uv_write_t;
-      char* copy = new char[len];
-      if (data)
-        memcpy(copy, data, len);
-      req->data = copy;
+      if (accepts_write(len))
+        append_outbound(len, data);
+
+      return true;
+    }
+
+    /** Write data without copying it
+     *
+     * The data is passed to uv in place, and owner is held until the write
+     * completes. Small writes are copied instead.
+     *
+     * @param owner Owner of the data, which must not be modified until owner
+     * is released
+     */
+    bool write_shared(
+      TCPWritePool::Owner owner, size_t len, const uint8_t* data)
+    {
+      if (!accepts_write(len))
+        return true;
+
+      if (len < min_shared_write_size)
+      {
+        append_outbound(len, data);
+        return true;
+      }
+
+      uv_buf_t buf;
+      buf.base = reinterpret_cast<char*>(const_cast<uint8_t*>(data));
+      buf.len = len;
+      outbound.push_back(buf);
+      outbound_owners.push_back(std::move(owner));
+      schedule_flush();
+
+      return true;
+    }
+
+    static void flush_all()
+    {
+      // Flushing may disconnect, which calls back into behaviours that may
+      // write to other connections.
+      std::vector<TCPImpl*> to_flush;
+      to_flush.swap(scheduled_flushes);
+
+      for (auto tcp : to_flush)
+      {
+        tcp->flush_scheduled = false;
+        tcp->flush();
+      }
+    }
 
+    // Number of uv_write calls made by all connections
+    static size_t get_write_count()
+    {
+      return write_count;
+    }
+
+  private:
+    bool accepts_write(size_t len)
+    {
       switch (status)
       {
         case CONNECTING_RESOLVING:
         case CONNECTING:
         case RESOLVING_FAILED:
         case CONNECTING_FAILED:
+        case CONNECTED:
         {
-          pending_writes.emplace_back(req, len);
-          break;
+          return true;
         }
 
-        case CONNECTED:
-          return send_write(req, len);
-
         case DISCONNECTED:
         {
           LOG_DEBUG_FMT("Disconnected: Ignoring write of size {}", len);
-          break;
+          return false;
         }
 
         default:
@@ -174,11 +333,8 @@ namespace asynchost
             fmt::format("Unexpected status during write: {}", status));
         }
       }
-
-      return true;
     }
 
-  private:
     bool init()
     {
       assert_status(FRESH, FRESH);
@@ -196,25 +352,100 @@ namespace asynchost
         return false;
       }
 
+      // Writes are already coalesced once per loop iteration, so there is
+      // nothing to gain from also delaying them in the kernel
+      if ((rc = uv_tcp_nodelay(&uv_handle, 1)) < 0)
+      {
+        LOG_FAIL_FMT("uv_tcp_nodelay failed: {}", uv_strerror(rc));
+        return false;
+      }
+
       uv_handle.data = this;
       return true;
     }
 
-    bool send_write(uv_write_t* req, size_t len)
+    void append_outbound(size_t len, const uint8_t* data)
     {
-      char* copy = (char*)req->data;
+      auto& pool = TCPWritePool::get();
 
-      uv_buf_t buf;
-      buf.base = copy;
-      buf.len = len;
+      while (len > 0)
+      {
+        if (
+          outbound.empty() || outbound_owners.back() != nullptr ||
+          outbound.back().len == TCPWritePool::buffer_size)
+        {
+          uv_buf_t buf;
+          buf.base = pool.get_buffer();
+          buf.len = 0;
+          outbound.push_back(buf);
+          outbound_owners.push_back(nullptr);
+        }
+
+        auto& buf = outbound.back();
+        auto n = std::min(len, TCPWritePool::buffer_size - buf.len);
+
+        if (data)
+        {
+          memcpy(buf.base + buf.len, data, n);
+          data += n;
+        }
+
+        buf.len += n;
+        len -= n;
+      }
+
+      schedule_flush();
+    }
+
+    void schedule_flush()
+    {
+      if (!flush_scheduled)
+      {
+        flush_scheduled = true;
+        scheduled_flushes.push_back(this);
+      }
+    }
+
+    void discard_outbound()
+    {
+      auto& pool = TCPWritePool::get();
+
+      for (size_t i = 0; i < outbound.size(); ++i)
+      {
+        if (outbound_owners[i] == nullptr)
+          pool.put_buffer(outbound[i].base);
+      }
+
+      outbound.clear();
+      outbound_owners.clear();
+    }
+
+    bool flush()
+    {
+      if (
+        status != CONNECTED || outbound.empty() ||
+        uv_is_closing((uv_handle_t*)&uv_handle))
+        return true;
+
+      auto request = TCPWritePool::get().get_request();
+      request->bufs.swap(outbound);
+      request->owners.swap(outbound_owners);
 
       int rc;
+      write_count++;
 
-      if ((rc = uv_write(req, (uv_stream_t*)&uv_handle, &buf, 1, on_write)) < 0)
+      if (
+        (rc = uv_write(
+           &request->req,
+           (uv_stream_t*)&uv_handle,
+           request->bufs.data(),
+           request->bufs.size(),
+           on_write)) < 0)
       {
-        free_write(req);
+        TCPWritePool::get().put_request(request);
         LOG_FAIL_FMT("uv_write failed: {}", uv_strerror(rc));
         assert_status(CONNECTED, DISCONNECTED);
+        discard_outbound();
         behaviour->on_disconnect();
         return false;
       }
@@ -426,13 +657,9 @@ namespace asynchost
         if (!read_start())
           return;
 
-        for (auto& w : pending_writes)
-        {
-          send_write(w.req, w.len);
-          w.req = nullptr;
-        }
+        if (!flush())
+          return;
 
-        std::vector<PendingWrite>().swap(pending_writes);
         behaviour->on_connect();
       }
     }
@@ -444,6 +671,7 @@ namespace asynchost
       if ((rc = uv_read_start((uv_stream_t*)&uv_handle, on_alloc, on_read)) < 0)
       {
         assert_status(CONNECTED, DISCONNECTED);
+        discard_outbound();
         LOG_FAIL_FMT("uv_read_start failed: {}", uv_strerror(rc));
 
         if (behaviour)
@@ -490,6 +718,7 @@ namespace asynchost
       if (sz < 0)
       {
         assert_status(CONNECTED, DISCONNECTED);
+        discard_outbound();
         on_free(buf);
         uv_read_stop((uv_stream_t*)&uv_handle);
 
@@ -508,17 +737,8 @@ namespace asynchost
     static void on_write(uv_write_t* req, int rc)
     {
       (void)rc;
-      free_write(req);
-    }
-
-    static void free_write(uv_write_t* req)
-    {
-      if (req == nullptr)
-        return;
-
-      char* copy = (char*)req->data;
-      delete[] copy;
-      delete req;
+      TCPWritePool::get().put_request(
+        static_cast<TCPWritePool::WriteRequest*>(req->data));
     }
 
     static void on_reconnect(uv_handle_t* handle)
@@ -541,4 +761,17 @@ namespace asynchost
       connect_resolved();
     }
   };
+
+  // Flushes the outbound buffers of every connection written to during this
+  // loop iteration, before the loop polls for I/O
+  class TCPFlushImpl
+  {
+  public:
+    void before_io()
+    {
+      TCPImpl::flush_all();
+    }
+  };
+
+  using TCPFlush = proxy_ptr<BeforeIO<TCPFlushImpl>>;
 }
@@ -5,6 +5,7 @@
 
 #include <doctest/doctest.h>
 #include <string>
+#include <unistd.h>
 
 TEST_CASE("Read/Write test")
 {
@@ -58,4 +59,462 @@ TEST_CASE("Entry sizes")
     for (auto c : e)
       std::cout << std::hex << (int)c;
     std::cout << std::endl;*/
-}
\ No newline at end of file
+}
+TEST_CASE("Segmented ledger")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  // Each entry is framed as 4 bytes of size + 8 bytes of data, so a segment
+  // of at most 40 bytes holds 3 entries
+  constexpr size_t max_segment_size = 40;
+  constexpr size_t entries = 10;
+  auto entry = [](size_t i) { return std::vector<uint8_t>(8, (uint8_t)i); };
+
+  {
+    asynchost::Ledger l("testlog", wf, max_segment_size);
+    l.truncate(0);
+    REQUIRE(l.get_last_idx() == 0);
+
+    for (size_t i = 1; i <= entries; ++i)
+    {
+      auto e = entry(i);
+      l.write_entry(e.data(), e.size());
+    }
+    REQUIRE(l.get_last_idx() == entries);
+  }
+
+  INFO("Entries are read back across segments after reopening");
+  {
+    asynchost::Ledger l("testlog", wf, max_segment_size);
+    REQUIRE(l.get_last_idx() == entries);
+
+    for (size_t i = 1; i <= entries; ++i)
+    {
+      REQUIRE(l.read_entry(i) == entry(i));
+    }
+    REQUIRE(l.read_entry(entries + 1).empty());
+
+    const auto framed = l.read_framed_entries(2, 8);
+    REQUIRE(framed.size() == 7 * (sizeof(uint32_t) + 8));
+    REQUIRE(l.framed_entries_size(2, 8) == framed.size());
+
+    size_t ranges = 0;
+    l.foreach_framed_range(2, 8, [&ranges](const serializer::ByteRange&) {
+      ranges++;
+    });
+    REQUIRE(ranges == 3);
+  }
+
+  INFO("Truncation removes later segments");
+  {
+    asynchost::Ledger l("testlog", wf, max_segment_size);
+    l.truncate(5);
+    REQUIRE(l.get_last_idx() == 5);
+    REQUIRE(l.read_entry(6).empty());
+
+    auto e = entry(42);
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_last_idx() == 6);
+    REQUIRE(l.read_entry(6) == e);
+  }
+
+  asynchost::Ledger l("testlog", wf, max_segment_size);
+  REQUIRE(l.get_last_idx() == 6);
+  REQUIRE(l.read_entry(5) == entry(5));
+  REQUIRE(l.read_entry(6) == entry(42));
+  l.truncate(0);
+}
+
+TEST_CASE("Recently written entries are shared in place")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  // Each entry is framed as 4 bytes of size + 8 bytes of data, so the cache
+  // holds the last 10 entries
+  constexpr size_t recent_size = 120;
+  constexpr size_t entries = 10;
+  auto entry = [](size_t i) { return std::vector<uint8_t>(8, (uint8_t)i); };
+
+  auto read_recent = [](asynchost::Ledger& l, size_t from, size_t to) {
+    std::optional<std::vector<uint8_t>> framed = std::vector<uint8_t>();
+    if (!l.foreach_recent_range(
+          from, to, [&](const asynchost::RecentEntries::SharedRange& r) {
+            framed->insert(framed->end(), r.data, r.data + r.size);
+          }))
+      framed.reset();
+    return framed;
+  };
+
+  asynchost::Ledger l(
+    "testlog",
+    wf,
+    asynchost::Ledger::default_max_segment_size,
+    asynchost::LedgerSyncPolicy::Batch,
+    std::chrono::milliseconds(10),
+    recent_size);
+  l.truncate(0);
+
+  for (size_t i = 1; i <= entries; ++i)
+  {
+    auto e = entry(i);
+    l.write_entry(e.data(), e.size());
+  }
+
+  auto framed = read_recent(l, 2, 8);
+  REQUIRE(framed.has_value());
+  REQUIRE(framed.value() == l.read_framed_entries(2, 8));
+  REQUIRE(!read_recent(l, 2, entries + 1).has_value());
+
+  INFO("Shared ranges outlive truncation");
+  {
+    asynchost::RecentEntries::SharedRange held;
+    l.foreach_recent_range(
+      entries, entries, [&](const asynchost::RecentEntries::SharedRange& r) {
+        held = r;
+      });
+    const auto framed_last = l.read_framed_entries(entries, entries);
+
+    l.truncate(5);
+    REQUIRE(!read_recent(l, 5, 6).has_value());
+    REQUIRE(
+      std::vector<uint8_t>(held.data, held.data + held.size) == framed_last);
+
+    auto e = entry(42);
+    l.write_entry(e.data(), e.size());
+    REQUIRE(read_recent(l, 4, 6).value() == l.read_framed_entries(4, 6));
+    REQUIRE(l.read_entry(6) == e);
+  }
+
+  INFO("Older entries are evicted, and only read from the ledger");
+  {
+    for (size_t i = 7; i <= 20; ++i)
+    {
+      auto e = entry(i);
+      l.write_entry(e.data(), e.size());
+    }
+
+    REQUIRE(!read_recent(l, 1, 20).has_value());
+    REQUIRE(read_recent(l, 19, 20).value() == l.read_framed_entries(19, 20));
+    REQUIRE(l.read_entry(1) == entry(1));
+  }
+
+  INFO("Nothing is cached when the ledger is reopened");
+  {
+    asynchost::Ledger reopened("testlog", wf);
+    REQUIRE(!read_recent(reopened, 20, 20).has_value());
+  }
+
+  l.truncate(0);
+}
+
+TEST_CASE("Unindexed entries are recovered")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::vector<uint8_t> e1 = {1, 2, 3};
+  const std::vector<uint8_t> e2 = {5, 5, 6, 7};
+
+  {
+    asynchost::Ledger l("testlog", wf);
+    l.truncate(0);
+    l.write_entry(e1.data(), e1.size());
+  }
+
+  {
+    asynchost::Ledger l("testlog", wf);
+    l.write_entry(e2.data(), e2.size());
+  }
+
+  // Entries written after the index was last persisted are found by scanning
+  // the end of the last segment
+  REQUIRE(truncate("testlog.idx", sizeof(uint64_t)) == 0);
+
+  asynchost::Ledger l("testlog", wf);
+  REQUIRE(l.get_last_idx() == 2);
+  REQUIRE(l.read_entry(1) == e1);
+  REQUIRE(l.read_entry(2) == e2);
+}
+
+TEST_CASE("Sync policies")
+{
+  ringbuffer::Circuit eio(1024);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::vector<uint8_t> e = {1, 2, 3};
+
+  {
+    INFO("Entries are durable as soon as they are written");
+    asynchost::Ledger l(
+      "testlog",
+      wf,
+      asynchost::Ledger::default_max_segment_size,
+      asynchost::LedgerSyncPolicy::Entry);
+    l.truncate(0);
+    REQUIRE(l.get_durable_idx() == 0);
+
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_durable_idx() == 1);
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_durable_idx() == 2);
+  }
+
+  {
+    INFO("Entries are durable once the batch is flushed");
+    asynchost::Ledger l(
+      "testlog",
+      wf,
+      asynchost::Ledger::default_max_segment_size,
+      asynchost::LedgerSyncPolicy::Batch);
+    l.truncate(0);
+
+    l.write_entry(e.data(), e.size());
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_durable_idx() == 0);
+    REQUIRE(l.read_entry(2) == e);
+
+    l.flush();
+    REQUIRE(l.get_durable_idx() == 2);
+  }
+
+  INFO("Batches are only synced once the interval has elapsed");
+  asynchost::Ledger l(
+    "testlog",
+    wf,
+    asynchost::Ledger::default_max_segment_size,
+    asynchost::LedgerSyncPolicy::Interval,
+    std::chrono::hours(1));
+  l.truncate(0);
+
+  l.write_entry(e.data(), e.size());
+  l.flush();
+  REQUIRE(l.get_durable_idx() == 0);
+
+  l.sync();
+  REQUIRE(l.get_durable_idx() == 1);
+}
+
+TEST_CASE("Entries are sent to the enclave in batches")
+{
+  ringbuffer::Circuit eio(1 << 22);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  struct Batch
+  {
+    ringbuffer::Message m;
+    consensus::Index from;
+    std::vector<std::vector<uint8_t>> entries;
+  };
+
+  auto sent = [&eio]() {
+    std::vector<Batch> batches;
+    eio.read_from_outside().read(
+      -1, [&batches](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        Batch b{m, 0, {}};
+        if (m == consensus::ledger_no_entry)
+        {
+          std::tie(b.from) =
+            ringbuffer::read_message<consensus::ledger_no_entry>(data, size);
+        }
+        else
+        {
+          auto [from, framed] =
+            ringbuffer::read_message<consensus::ledger_entries>(data, size);
+          b.from = from;
+          const uint8_t* p = framed.data();
+          size_t remaining = framed.size();
+          while (remaining > 0)
+          {
+            auto entry_size = serialized::read<uint32_t>(p, remaining);
+            b.entries.push_back(serialized::read(p, remaining, entry_size));
+          }
+        }
+        batches.push_back(b);
+      });
+    return batches;
+  };
+
+  {
+    INFO("Batches do not span segments");
+    constexpr size_t max_segment_size = 40;
+    auto entry = [](size_t i) { return std::vector<uint8_t>(8, (uint8_t)i); };
+
+    asynchost::Ledger l("testlog", wf, max_segment_size);
+    l.truncate(0);
+    for (size_t i = 1; i <= 10; ++i)
+    {
+      auto e = entry(i);
+      l.write_entry(e.data(), e.size());
+    }
+
+    l.send_entries(2, 8);
+    auto batches = sent();
+    REQUIRE(batches.size() == 3);
+    size_t idx = 2;
+    for (const auto& b : batches)
+    {
+      REQUIRE(b.m == consensus::ledger_entries);
+      REQUIRE(b.from == idx);
+      for (const auto& e : b.entries)
+      {
+        REQUIRE(e == entry(idx++));
+      }
+    }
+    REQUIRE(idx == 9);
+
+    INFO("Ranges are truncated to the end of the ledger, which is reported");
+    l.send_entries(9, 20);
+    batches = sent();
+    REQUIRE(batches.size() == 3);
+    REQUIRE(batches[0].from == 9);
+    REQUIRE(batches[1].from == 10);
+    REQUIRE(batches[1].entries.size() == 1);
+    REQUIRE(batches[2].m == consensus::ledger_no_entry);
+    REQUIRE(batches[2].from == 11);
+
+    l.send_entries(9, 10);
+    batches = sent();
+    REQUIRE(batches.size() == 2);
+    REQUIRE(batches[1].m == consensus::ledger_entries);
+
+    l.send_entries(11, 20);
+    batches = sent();
+    REQUIRE(batches.size() == 1);
+    REQUIRE(batches[0].m == consensus::ledger_no_entry);
+    REQUIRE(batches[0].from == 11);
+    l.truncate(0);
+  }
+
+  INFO("Batches are limited in size");
+  asynchost::Ledger l("testlog", wf);
+  l.truncate(0);
+  const std::vector<uint8_t> small(16, 1);
+  const std::vector<uint8_t> large(
+    asynchost::Ledger::max_entries_batch_size / 2, 2);
+  l.write_entry(small.data(), small.size());
+  l.write_entry(large.data(), large.size());
+  l.write_entry(large.data(), large.size());
+  l.write_entry(small.data(), small.size());
+
+  l.send_entries(1, 4);
+  auto batches = sent();
+  REQUIRE(batches.size() == 2);
+  REQUIRE(batches[0].from == 1);
+  REQUIRE(batches[0].entries.size() == 2);
+  REQUIRE(batches[1].from == 3);
+  REQUIRE(batches[1].entries.size() == 2);
+  REQUIRE(batches[1].entries[0] == large);
+  REQUIRE(batches[1].entries[1] == small);
+  l.truncate(0);
+}
+
+TEST_CASE("Snapshots are written alongside the ledger")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string ledger_file = "snapshotlog";
+  const std::vector<uint8_t> s1 = {1, 2, 3};
+  const std::vector<uint8_t> s2 = {4, 5, 6, 7};
+  const std::vector<uint8_t> e = {8, 9};
+
+  {
+    asynchost::Ledger l(ledger_file, wf);
+    REQUIRE(l.get_snapshot_idx() == 0);
+    REQUIRE(!l.read_snapshot().has_value());
+
+    l.write_snapshot(10, s1.data(), s1.size());
+    l.write_snapshot(20, s2.data(), s2.size());
+
+    INFO("Older snapshots are ignored");
+    l.write_snapshot(15, s1.data(), s1.size());
+    REQUIRE(l.get_snapshot_idx() == 20);
+  }
+
+  INFO("The latest snapshot is found when the ledger is opened");
+  {
+    asynchost::Ledger l(ledger_file, wf);
+    REQUIRE(l.get_snapshot_idx() == 20);
+    auto snapshot = l.read_snapshot();
+    REQUIRE(snapshot.has_value());
+    REQUIRE(snapshot->first == 20);
+    REQUIRE(snapshot->second == s2);
+    REQUIRE(access((ledger_file + ".snapshot.10").c_str(), F_OK) != 0);
+
+    INFO("An empty ledger can start after the snapshot");
+    l.init_from_snapshot(snapshot->first);
+    REQUIRE(l.get_first_idx() == 21);
+    REQUIRE(l.get_last_idx() == 20);
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_last_idx() == 21);
+    REQUIRE(l.read_entry(21) == e);
+    REQUIRE(l.read_entry(20).empty());
+
+    REQUIRE_THROWS_AS(l.init_from_snapshot(30), std::logic_error);
+  }
+
+  {
+    asynchost::Ledger l(ledger_file, wf);
+    REQUIRE(l.get_first_idx() == 21);
+    REQUIRE(l.get_last_idx() == 21);
+    REQUIRE(l.read_entry(21) == e);
+
+    INFO("The ledger can be truncated to before the snapshot");
+    l.write_entry(e.data(), e.size());
+    l.truncate(15);
+    REQUIRE(l.get_first_idx() == 21);
+    REQUIRE(l.get_last_idx() == 20);
+    REQUIRE(l.read_entry(21).empty());
+    l.write_entry(e.data(), e.size());
+    REQUIRE(l.get_last_idx() == 21);
+    REQUIRE(l.read_entry(21) == e);
+  }
+
+  for (auto suffix : {"", ".idx", ".start", ".snapshot.20"})
+    ::unlink((ledger_file + suffix).c_str());
+}
+
+TEST_CASE("Snapshots can be written in fragments")
+{
+  ringbuffer::Circuit eio(2);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  const std::string ledger_file = "fragmentlog";
+  const std::vector<uint8_t> f1 = {1, 2, 3};
+  const std::vector<uint8_t> f2 = {4, 5};
+  const std::vector<uint8_t> s = {1, 2, 3, 4, 5};
+
+  {
+    asynchost::Ledger l(ledger_file, wf);
+
+    INFO("A snapshot is only in place once it ends");
+    l.write_snapshot_fragment(10, f1.data(), f1.size());
+    l.write_snapshot_fragment(10, f2.data(), f2.size());
+    REQUIRE(l.get_snapshot_idx() == 0);
+    REQUIRE(!l.read_snapshot().has_value());
+    l.end_snapshot(10);
+    REQUIRE(l.get_snapshot_idx() == 10);
+    REQUIRE(l.read_snapshot()->second == s);
+
+    INFO("A snapshot that never ends is discarded by the next one");
+    l.write_snapshot_fragment(20, f1.data(), f1.size());
+    l.write_snapshot_fragment(30, f2.data(), f2.size());
+    l.end_snapshot(20);
+    REQUIRE(l.get_snapshot_idx() == 10);
+    REQUIRE(access((ledger_file + ".snapshot.20.tmp").c_str(), F_OK) != 0);
+    l.end_snapshot(30);
+    REQUIRE(l.get_snapshot_idx() == 30);
+    REQUIRE(l.read_snapshot()->second == f2);
+
+    INFO("An unfinished snapshot is discarded when the ledger is closed");
+    l.write_snapshot_fragment(40, f1.data(), f1.size());
+  }
+
+  REQUIRE(access((ledger_file + ".snapshot.40.tmp").c_str(), F_OK) != 0);
+  REQUIRE(access((ledger_file + ".snapshot.10").c_str(), F_OK) != 0);
+
+  for (auto suffix : {"", ".idx", ".snapshot.30"})
+    ::unlink((ledger_file + suffix).c_str());
+}
@@ -0,0 +1,112 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include "../ledger.h"
+
+#include <picobench/picobench.hpp>
+
+using namespace asynchost;
+
+// Entries are appended in batches, as they would be when several arrive from
+// the enclave in a single loop iteration
+template <LedgerSyncPolicy P, size_t BatchSize>
+static void write_entries(picobench::state& s)
+{
+  ringbuffer::Circuit eio(1 << 16);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  Ledger l(
+    "bench_ledger",
+    wf,
+    Ledger::default_max_segment_size,
+    P,
+    std::chrono::milliseconds(1));
+  l.truncate(0);
+
+  const std::vector<uint8_t> entry(256, 42);
+
+  s.start_timer();
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    l.write_entry(entry.data(), entry.size());
+
+    if ((i + 1) % BatchSize == 0)
+    {
+      l.flush();
+      eio.read_from_outside().read(
+        -1, [](ringbuffer::Message, const uint8_t*, size_t) {});
+    }
+  }
+  l.sync();
+  s.stop_timer();
+
+  s.set_result(l.get_durable_idx());
+  l.truncate(0);
+}
+
+const std::vector<int> entry_counts = {10, 100};
+
+PICOBENCH_SUITE("sync policy (batches of 10 entries)");
+auto sync_entry = write_entries<LedgerSyncPolicy::Entry, 10>;
+PICOBENCH(sync_entry).iterations(entry_counts).baseline();
+auto sync_batch = write_entries<LedgerSyncPolicy::Batch, 10>;
+PICOBENCH(sync_batch).iterations(entry_counts);
+auto sync_interval = write_entries<LedgerSyncPolicy::Interval, 10>;
+PICOBENCH(sync_interval).iterations(entry_counts);
+
+PICOBENCH_SUITE("sync policy (batches of 100 entries)");
+auto sync_entry_100 = write_entries<LedgerSyncPolicy::Entry, 100>;
+PICOBENCH(sync_entry_100).iterations(entry_counts).baseline();
+auto sync_batch_100 = write_entries<LedgerSyncPolicy::Batch, 100>;
+PICOBENCH(sync_batch_100).iterations(entry_counts);
+auto sync_interval_100 = write_entries<LedgerSyncPolicy::Interval, 100>;
+PICOBENCH(sync_interval_100).iterations(entry_counts);
+
+// Entries are sent to the enclave, as during recovery, in ranges of
+// BatchSize entries. With a batch size of 1, every entry is requested
+// separately.
+template <size_t BatchSize>
+static void send_entries(picobench::state& s)
+{
+  ringbuffer::Circuit eio(1 << 22);
+  auto wf = ringbuffer::WriterFactory(eio);
+
+  Ledger l("bench_ledger", wf);
+  l.truncate(0);
+
+  const std::vector<uint8_t> entry(256, 42);
+  for (size_t i = 0; i < s.iterations(); ++i)
+  {
+    l.write_entry(entry.data(), entry.size());
+  }
+  l.sync();
+  eio.read_from_outside().read(
+    -1, [](ringbuffer::Message, const uint8_t*, size_t) {});
+
+  size_t received = 0;
+  s.start_timer();
+  for (size_t from = 1; from <= s.iterations(); from += BatchSize)
+  {
+    l.send_entries(from, from + BatchSize - 1);
+    eio.read_from_outside().read(
+      -1, [&received](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        auto [from, body] =
+          ringbuffer::read_message<consensus::ledger_entries>(data, size);
+        received += body.size();
+      });
+  }
+  s.stop_timer();
+
+  s.set_result(received);
+  l.truncate(0);
+}
+
+const std::vector<int> recovery_counts = {1000, 10000};
+
+PICOBENCH_SUITE("send entries for recovery");
+auto send_single = send_entries<1>;
+PICOBENCH(send_single).iterations(recovery_counts).baseline();
+auto send_batch_100 = send_entries<100>;
+PICOBENCH(send_batch_100).iterations(recovery_counts);
+auto send_batch_1000 = send_entries<1000>;
+PICOBENCH(send_batch_1000).iterations(recovery_counts);
@@ -0,0 +1,222 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT
+#include "../ledger.h"
+#include "../tcp.h"
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+#include <iostream>
+#include <picobench/picobench.hpp>
+#include <sys/resource.h>
+
+using namespace asynchost;
+
+static constexpr auto host = "127.0.0.1";
+static constexpr auto port = "18765";
+static constexpr size_t max_followers = 4;
+static constexpr size_t entry_size = 4096;
+static constexpr size_t entries_per_batch = 32;
+
+class CountReceived : public TCPBehaviour
+{
+private:
+  size_t& received;
+
+public:
+  CountReceived(size_t& received) : received(received) {}
+
+  void on_read(size_t len, uint8_t*& data) override
+  {
+    received += len;
+  }
+};
+
+class AcceptPeers : public TCPBehaviour
+{
+private:
+  std::vector<TCP>& peers;
+  size_t& received;
+
+public:
+  AcceptPeers(std::vector<TCP>& peers, size_t& received) :
+    peers(peers),
+    received(received)
+  {}
+
+  void on_accept(TCP& accepted) override
+  {
+    accepted->set_behaviour(std::make_unique<CountReceived>(received));
+    peers.push_back(accepted);
+  }
+};
+
+// A primary's ledger, and a connection to each of its followers on the
+// loopback interface, shared by all benchmarks. Batches of entries are written
+// to the ledger, and then sent to each follower, as they would be by
+// NodeConnections when appending entries.
+struct Replication
+{
+  ringbuffer::Circuit eio;
+  ringbuffer::WriterFactory wf;
+  Ledger ledger;
+
+  TCPFlush flush;
+  TCP server;
+  std::vector<TCP> followers;
+  std::vector<TCP> peers;
+  size_t received = 0;
+
+  Replication() : eio(1 << 16), wf(eio), ledger("bench_replication_ledger", wf)
+  {
+    ledger.truncate(0);
+
+    server->set_behaviour(std::make_unique<AcceptPeers>(peers, received));
+    if (!server->listen(host, port))
+      throw std::logic_error("Could not listen");
+
+    for (size_t i = 0; i < max_followers; ++i)
+    {
+      TCP follower;
+      follower->set_behaviour(std::make_unique<TCPBehaviour>());
+      if (!follower->connect(host, port))
+        throw std::logic_error("Could not connect");
+      followers.push_back(follower);
+    }
+
+    while (peers.size() < max_followers)
+      uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+  }
+
+  ~Replication()
+  {
+    ledger.truncate(0);
+  }
+
+  // Replicate batches of entries to the first follower_count followers,
+  // copying the entries from the ledger for each of them unless Shared
+  template <bool Shared>
+  void replicate(size_t batches, size_t follower_count)
+  {
+    const std::vector<uint8_t> entry(entry_size, 42);
+    const auto batch_size =
+      entries_per_batch * (entry_size + frame_header_size);
+    const auto target = received + batches * batch_size * follower_count;
+
+    for (size_t i = 0; i < batches; ++i)
+    {
+      const auto from = ledger.get_last_idx() + 1;
+      for (size_t j = 0; j < entries_per_batch; ++j)
+        ledger.write_entry(entry.data(), entry.size());
+      const auto to = ledger.get_last_idx();
+      ledger.flush();
+
+      for (size_t f = 0; f < follower_count; ++f)
+      {
+        auto& follower = followers[f];
+        if constexpr (Shared)
+        {
+          ledger.foreach_recent_range(
+            from, to, [&](const RecentEntries::SharedRange& r) {
+              follower->write_shared(r.chunk, r.size, r.data);
+            });
+        }
+        else
+        {
+          ledger.foreach_framed_range(
+            from, to, [&](const serializer::ByteRange& r) {
+              follower->write(r.size, r.data);
+            });
+        }
+      }
+
+      uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+      eio.read_from_outside().read(
+        -1, [](ringbuffer::Message, const uint8_t*, size_t) {});
+    }
+
+    while (received < target)
+      uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+  }
+
+  static Replication& get()
+  {
+    static Replication replication;
+    return replication;
+  }
+};
+
+template <bool Shared, size_t Followers>
+static void replicate(picobench::state& s)
+{
+  auto& replication = Replication::get();
+
+  s.start_timer();
+  replication.replicate<Shared>(s.iterations(), Followers);
+  s.stop_timer();
+}
+
+const std::vector<int> batch_counts = {10, 100};
+
+PICOBENCH_SUITE("replicate 128KB batches to 1 follower");
+auto copy_1 = replicate<false, 1>;
+PICOBENCH(copy_1).iterations(batch_counts).baseline();
+auto shared_1 = replicate<true, 1>;
+PICOBENCH(shared_1).iterations(batch_counts);
+
+PICOBENCH_SUITE("replicate 128KB batches to 2 followers");
+auto copy_2 = replicate<false, 2>;
+PICOBENCH(copy_2).iterations(batch_counts).baseline();
+auto shared_2 = replicate<true, 2>;
+PICOBENCH(shared_2).iterations(batch_counts);
+
+PICOBENCH_SUITE("replicate 128KB batches to 4 followers");
+auto copy_4 = replicate<false, 4>;
+PICOBENCH(copy_4).iterations(batch_counts).baseline();
+auto shared_4 = replicate<true, 4>;
+PICOBENCH(shared_4).iterations(batch_counts);
+
+// User and system CPU time used by the process so far, in seconds
+static double cpu_time()
+{
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+    (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char* argv[])
+{
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  auto rc = runner.run();
+
+  // The followers' reads are made by this process too, and are included in
+  // the CPU time, but they cost the same whether or not entries are copied
+  constexpr size_t batches = 256;
+  const auto mb =
+    batches * entries_per_batch * (entry_size + frame_header_size) / 1e6;
+
+  for (size_t followers = 1; followers <= max_followers; followers *= 2)
+  {
+    auto& replication = Replication::get();
+
+    auto start = cpu_time();
+    replication.replicate<false>(batches, followers);
+    const auto copied = cpu_time() - start;
+
+    start = cpu_time();
+    replication.replicate<true>(batches, followers);
+    const auto shared = cpu_time() - start;
+
+    std::cout << fmt::format(
+                   "{} followers: {:.3f}ms CPU per MB replicated when copied, "
+                   "{:.3f}ms when shared",
+                   followers,
+                   copied * 1e3 / mb,
+                   shared * 1e3 / mb)
+              << std::endl;
+  }
+
+  return rc;
+}
@@ -0,0 +1,144 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define PICOBENCH_IMPLEMENT
+#include "../tcp.h"
+
+#define FMT_HEADER_ONLY
+#include <fmt/format.h>
+#include <iostream>
+#include <picobench/picobench.hpp>
+
+using namespace asynchost;
+
+static constexpr auto host = "127.0.0.1";
+static constexpr auto port = "18764";
+static constexpr size_t message_size = 128;
+
+class CountReceived : public TCPBehaviour
+{
+private:
+  size_t& received;
+
+public:
+  CountReceived(size_t& received) : received(received) {}
+
+  void on_read(size_t len, uint8_t*& data) override
+  {
+    received += len;
+  }
+};
+
+class AcceptPeer : public TCPBehaviour
+{
+private:
+  TCP& peer;
+  size_t& received;
+
+public:
+  AcceptPeer(TCP& peer, size_t& received) : peer(peer), received(received) {}
+
+  void on_accept(TCP& accepted) override
+  {
+    accepted->set_behaviour(std::make_unique<CountReceived>(received));
+    peer = accepted;
+  }
+};
+
+// A pair of connected sockets on the loopback interface, shared by all
+// benchmarks
+struct Connection
+{
+  TCPFlush flush;
+  TCP server;
+  TCP client;
+  TCP peer = nullptr;
+  size_t received = 0;
+
+  Connection()
+  {
+    server->set_behaviour(std::make_unique<AcceptPeer>(peer, received));
+    if (!server->listen(host, port))
+      throw std::logic_error("Could not listen");
+
+    client->set_behaviour(std::make_unique<TCPBehaviour>());
+    if (!client->connect(host, port))
+      throw std::logic_error("Could not connect");
+
+    while (peer.is_null())
+      uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+  }
+
+  void send(size_t count, size_t messages_per_loop)
+  {
+    const std::vector<uint8_t> message(message_size, 42);
+    const auto target = received + count * message_size;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+      client->write(message.size(), message.data());
+
+      if ((i + 1) % messages_per_loop == 0)
+        uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+    }
+
+    while (received < target)
+      uv_run(uv_default_loop(), UV_RUN_NOWAIT);
+  }
+
+  static Connection& get()
+  {
+    static Connection connection;
+    return connection;
+  }
+};
+
+// Messages are written in batches, as they would be when several are sent
+// during a single loop iteration. With a batch size of 1, every message is
+// written with its own uv_write.
+template <size_t MessagesPerLoop>
+static void write_messages(picobench::state& s)
+{
+  auto& connection = Connection::get();
+
+  s.start_timer();
+  connection.send(s.iterations(), MessagesPerLoop);
+  s.stop_timer();
+}
+
+const std::vector<int> message_counts = {100, 1000};
+
+PICOBENCH_SUITE("write 128 byte messages");
+auto loop_per_message = write_messages<1>;
+PICOBENCH(loop_per_message).iterations(message_counts).baseline();
+auto loop_per_10_messages = write_messages<10>;
+PICOBENCH(loop_per_10_messages).iterations(message_counts);
+auto loop_per_100_messages = write_messages<100>;
+PICOBENCH(loop_per_100_messages).iterations(message_counts);
+
+int main(int argc, char* argv[])
+{
+  picobench::runner runner;
+  runner.parse_cmd_line(argc, argv);
+  auto rc = runner.run();
+
+  constexpr size_t count = 10000;
+  for (size_t messages_per_loop : {1, 10, 100})
+  {
+    auto& connection = Connection::get();
+    const auto allocations = TCPWritePool::get().get_allocations();
+    const auto writes = TCPImpl::get_write_count();
+
+    connection.send(count, messages_per_loop);
+
+    std::cout << fmt::format(
+                   "{} messages per loop: {:.3f} allocations and {:.3f} "
+                   "uv_write calls per message",
+                   messages_per_loop,
+                   (TCPWritePool::get().get_allocations() - allocations) /
+                     (double)count,
+                   (TCPImpl::get_write_count() - writes) / (double)count)
+              << std::endl;
+  }
+
+  return rc;
+}
@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ds/buffer.h"
+#include "ds/serialized.h"
 #include "kvtypes.h"
 
 #include <optional>
@@ -191,6 +192,78 @@ namespace kv
         serialised_public_domain, serialised_private_domain);
     }
 
+    /** Get the size of the serialised transaction
+     *
+     * @return Number of bytes that get_raw_data_into will write
+     */
+    size_t get_raw_data_size()
+    {
+      auto public_size = public_writer.get_raw_buffer().n;
+
+      if (!crypto_util)
+        return public_size;
+
+      return crypto_util->get_header_length() + sizeof(size_t) + public_size +
+        private_writer.get_raw_buffer().n;
+    }
+
+    /** Serialise the transaction into a caller-supplied buffer
+     *
+     * This produces the same frame as get_raw_data, but each domain is copied
+     * exactly once, straight into the buffer, and the private domain is
+     * encrypted directly into its place in the frame.
+     *
+     * @param data Start of buffer, e.g. a ringbuffer reservation
+     * @param size Size of buffer, at least get_raw_data_size()
+     */
+    void get_raw_data_into(uint8_t* data, size_t size)
+    {
+      // make sure the private buffer is empty when we return
+      auto writer_guard_func = [](W* writer) { writer->clear(); };
+      std::unique_ptr<decltype(private_writer), decltype(writer_guard_func)>
+        writer_guard(&private_writer, writer_guard_func);
+
+      auto serialised_public_domain = public_writer.get_raw_buffer();
+
+      if (!crypto_util)
+      {
+        serialized::write(
+          data,
+          size,
+          serialised_public_domain.p,
+          serialised_public_domain.n);
+        return;
+      }
+
+      auto serialised_private_domain = private_writer.get_raw_buffer();
+
+      // Format: gcm hdr (iv + tag) + len of public domain + public domain +
+      // encrypted privated domain
+      const auto hdr_size = crypto_util->get_header_length();
+      const auto space = hdr_size + sizeof(size_t) +
+        serialised_public_domain.n + serialised_private_domain.n;
+      if (size < space)
+        throw KvSerialiserException(fmt::format(
+          "Insufficient space to serialise transaction ({} < {})",
+          size,
+          space));
+
+      auto serialised_hdr = data;
+      data += hdr_size;
+      size -= hdr_size;
+
+      serialized::write(data, size, serialised_public_domain.n);
+      serialized::write(
+        data, size, serialised_public_domain.p, serialised_public_domain.n);
+
+      crypto_util->encrypt(
+        serialised_private_domain,
+        serialised_public_domain,
+        serialised_hdr,
+        data,
+        version);
+    }
+
     std::vector<uint8_t> serialise_domains(
       const std::vector<uint8_t>& serialised_public_domain,
       const std::vector<uint8_t>& serialised_private_domain =
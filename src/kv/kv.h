@@ -4,18 +4,20 @@
 
 #include "ds/champmap.h"
 #include "ds/logger.h"
+#include "ds/serialized.h"
 #include "ds/spinlock.h"
 #include "kvtypes.h"
 
+#include <atomic>
 #include <functional>
 #include <iostream>
 #include <limits>
-#include <list>
 #include <map>
 #include <mutex>
 #include <optional>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 namespace kv
 {
@@ -51,6 +53,129 @@ namespace kv
     }
   }
 
+  // Contiguous ring of entries in strictly increasing version order. Entries
+  // are added at the back by commits, discarded from the front by compaction
+  // and from the back by rollback, and looked up by version in O(log n).
+  template <class T>
+  class VersionRing
+  {
+  private:
+    // Empty slots hold no value, so that discarded entries are released
+    std::vector<std::optional<T>> entries;
+    size_t head = 0;
+    size_t count = 0;
+
+    size_t physical(size_t idx) const
+    {
+      return (head + idx) & (entries.size() - 1);
+    }
+
+    void grow()
+    {
+      std::vector<std::optional<T>> grown(
+        entries.empty() ? 8 : entries.size() * 2);
+      for (size_t i = 0; i < count; ++i)
+        grown[i] = std::move(entries[physical(i)]);
+
+      entries = std::move(grown);
+      head = 0;
+    }
+
+  public:
+    size_t size() const
+    {
+      return count;
+    }
+
+    bool empty() const
+    {
+      return count == 0;
+    }
+
+    T& operator[](size_t idx)
+    {
+      return *entries[physical(idx)];
+    }
+
+    const T& operator[](size_t idx) const
+    {
+      return *entries[physical(idx)];
+    }
+
+    T& front()
+    {
+      return (*this)[0];
+    }
+
+    const T& front() const
+    {
+      return (*this)[0];
+    }
+
+    T& back()
+    {
+      return (*this)[count - 1];
+    }
+
+    const T& back() const
+    {
+      return (*this)[count - 1];
+    }
+
+    void push_back(T&& t)
+    {
+      if (count == entries.size())
+        grow();
+
+      entries[physical(count++)] = std::move(t);
+    }
+
+    void pop_front()
+    {
+      entries[head].reset();
+      head = physical(1);
+      count--;
+    }
+
+    void pop_back()
+    {
+      entries[physical(--count)].reset();
+    }
+
+    void clear()
+    {
+      entries.clear();
+      head = 0;
+      count = 0;
+    }
+
+    /** Find the last entry at or before a version
+     *
+     * @param version Version to search for
+     *
+     * @return Pointer to the entry, or nullptr if all entries are later
+     */
+    T* find(Version version)
+    {
+      size_t lo = 0;
+      size_t hi = count;
+
+      while (lo < hi)
+      {
+        const auto mid = lo + (hi - lo) / 2;
+        if ((*this)[mid].version <= version)
+          lo = mid + 1;
+        else
+          hi = mid;
+      }
+
+      if (lo == 0)
+        return nullptr;
+
+      return &(*this)[lo - 1];
+    }
+  };
+
   template <class S, class D>
   class Tx;
 
@@ -90,7 +215,48 @@ namespace kv
       State state;
       Write writes;
     };
-    using LocalCommits = std::list<LocalCommit>;
+    using LocalCommits = VersionRing<LocalCommit>;
+
+    // The latest and compacted states of the map, republished whenever the
+    // roll changes. Views reading at or after the latest version can be
+    // created from this without taking the map lock.
+    struct Snapshot
+    {
+      Version version;
+      State state;
+      State committed;
+      size_t rollback_counter;
+    };
+
+    // The state of the map at a version, in a snapshot of the store. Every
+    // entry is serialised with the version it was written at, so that reads
+    // after the snapshot is applied conflict as they would have before.
+    class MapSnapshot : public AbstractMapSnapshot<S>
+    {
+    public:
+      const std::string name;
+      const SecurityDomain security_domain;
+      const State state;
+
+      MapSnapshot(
+        const std::string& name_,
+        SecurityDomain security_domain_,
+        const State& state_) :
+        name(name_),
+        security_domain(security_domain_),
+        state(state_)
+      {}
+
+      void serialise(S& s) override
+      {
+        s.start_map(name, security_domain);
+        s.serialise_count_header(state.size());
+        state.foreach([&s](const K& k, const VersionV& v) {
+          s.serialise_write_version(k, v.value, v.version);
+          return true;
+        });
+      }
+    };
 
     Store<S, D>* store;
     std::string name;
@@ -98,11 +264,17 @@ namespace kv
     std::unique_ptr<LocalCommits> roll;
     CommitHook local_hook;
     CommitHook global_hook;
-    LocalCommits commit_deltas;
+    std::vector<LocalCommit> commit_deltas;
     SpinLock sl;
     const SecurityDomain security_domain;
     const bool replicated;
 
+    std::shared_ptr<const Snapshot> snapshot;
+    // Set while the map is locked for a commit, compaction or rollback, so
+    // that readers know the published snapshot may be about to change
+    std::atomic<bool> updating;
+    bool roll_changed;
+
     Map(
       Store<S, D>* store_,
       std::string name_,
@@ -117,9 +289,24 @@ namespace kv
       security_domain(security_domain_),
       replicated(replicated_),
       local_hook(local_hook_),
-      global_hook(global_hook_)
+      global_hook(global_hook_),
+      updating(false),
+      roll_changed(false)
     {
       roll->push_back({0, State(), Write()});
+      publish();
+    }
+
+    void publish()
+    {
+      // The map must be locked, or not yet shared, when publishing.
+      auto& latest = roll->back();
+      std::atomic_store(
+        &snapshot,
+        std::shared_ptr<const Snapshot>(new Snapshot{latest.version,
+                                                     latest.state,
+                                                     roll->front().state,
+                                                     rollback_counter}));
     }
 
     Map(const Map& that) = delete;
@@ -269,10 +456,11 @@ namespace kv
       bool deserialised;
       bool committed_writes;
 
-      TxView(This& parent, State& s, Version v, size_t r) :
+      TxView(
+        This& parent, const State& s, const State& c, Version v, size_t r) :
         map(parent),
         state(s),
-        committed(parent.roll->front().state),
+        committed(c),
         start_version(v),
         rollback_counter(r),
         read_version(NoVersion),
@@ -345,6 +533,41 @@ namespace kv
         return found.value;
       }
 
+      /** Get version at which the value for key was written
+       *
+       * This records the same read dependency as get(). It can be used to
+       * tell whether a value has changed since it was last read, without
+       * comparing the values themselves.
+       *
+       * @param key Key
+       *
+       * @return optional containing the version, empty if the key doesn't
+       * exist or has been written in the current transaction
+       */
+      std::optional<Version> get_version(const K& key)
+      {
+        if (commit_version != NoVersion)
+          return {};
+
+        if (writes.find(key) != writes.end())
+          return {};
+
+        auto search = state.get(key);
+        if (!search.has_value())
+        {
+          reads.insert(std::make_pair(key, NoVersion));
+          return {};
+        }
+
+        auto& found = search.value();
+        reads.insert(std::make_pair(key, found.version));
+
+        if (deleted(found.version))
+          return {};
+
+        return found.version;
+      }
+
       /** Get globally committed value for key
        *
        * This reads a globally replicated value for the specified key.
@@ -567,7 +790,9 @@ namespace kv
 
         if (!writes.empty())
         {
-          auto state = map.roll->back().state;
+          // Apply the whole write set through a single Transient, so that
+          // nodes are only copied once per commit rather than once per write.
+          auto state = map.roll->back().state.transient();
 
           for (auto it = writes.begin(); it != writes.end(); ++it)
           {
@@ -575,7 +800,7 @@ namespace kv
             {
               // Write the new value with the global version.
               changes = true;
-              state = state.put(it->first, VersionV{v, it->second.value});
+              state.put(it->first, VersionV{v, it->second.value});
             }
             else
             {
@@ -585,13 +810,16 @@ namespace kv
               if (search.has_value())
               {
                 changes = true;
-                state = state.put(it->first, VersionV{-v, V()});
+                state.put(it->first, VersionV{-v, V()});
               }
             }
           }
 
           if (changes)
-            map.roll->push_back({v, state, writes});
+          {
+            map.roll->push_back({v, state.persistent(), writes});
+            map.roll_changed = true;
+          }
         }
       }
 
@@ -711,28 +939,33 @@ namespace kv
 
     TxView* create_view(Version version) override
     {
-      lock();
-
-      // Find the last entry committed at or before this version.
-      TxView* view = nullptr;
-
-      for (auto it = roll->rbegin(); it != roll->rend(); ++it)
+      // Any transaction committing at or before this version took the map
+      // lock before its version was allocated. If the map is not being
+      // updated, that transaction has completed and is reflected in the
+      // published snapshot, which can then be used if it is not too recent.
+      if (!updating.load())
       {
-        if (it->version <= version)
+        auto latest = std::atomic_load(&snapshot);
+        if (latest->version <= version)
         {
-          view = new TxView(*this, it->state, it->version, rollback_counter);
-          break;
+          return new TxView(
+            *this,
+            latest->state,
+            latest->committed,
+            latest->version,
+            latest->rollback_counter);
         }
       }
 
-      if (view == nullptr)
-      {
-        view = new TxView(
-          *this, roll->front().state, roll->front().version, rollback_counter);
-      }
+      std::lock_guard<SpinLock> guard(sl);
+
+      // Find the last entry committed at or before this version.
+      auto r = roll->find(version);
+      if (r == nullptr)
+        r = &roll->front();
 
-      unlock();
-      return view;
+      return new TxView(
+        *this, r->state, roll->front().state, r->version, rollback_counter);
     }
 
     void compact(Version v) override
@@ -742,36 +975,39 @@ namespace kv
       // one, up to version v. The Map expects to be locked during compaction.
       while (roll->size() > 1)
       {
-        auto r = roll->begin();
+        auto& r = roll->front();
 
         // Globally committed but not discardable.
-        if (r->version == v)
+        if (r.version == v)
         {
           // We know that write set is not empty.
           if (global_hook)
             commit_deltas.emplace_back(
-              LocalCommit{r->version, r->state, move(r->writes)});
+              LocalCommit{r.version, r.state, move(r.writes)});
           return;
         }
 
-        // Discardable, so move to commit_deltas.
-        if (global_hook && !r->writes.empty())
-          std::move(r, std::next(r), std::back_inserter(commit_deltas));
+        // Discardable, so move to commit_deltas. The state is copied rather
+        // than moved, as it is still needed if this entry is retained.
+        if (global_hook && !r.writes.empty())
+          commit_deltas.emplace_back(
+            LocalCommit{r.version, r.state, move(r.writes)});
 
         // Stop if the next state may be rolled back or is the only state.
         // This ensures there is always a state present.
-        if (std::next(r)->version > v)
+        if ((*roll)[1].version > v)
           return;
 
         roll->pop_front();
+        roll_changed = true;
       }
 
       // There is only one roll. We may need to call the commit hook.
-      auto r = roll->begin();
+      auto& r = roll->front();
 
-      if (global_hook && !r->writes.empty())
+      if (global_hook && !r.writes.empty())
         commit_deltas.emplace_back(
-          LocalCommit{r->version, r->state, move(r->writes)});
+          LocalCommit{r.version, r.state, move(r.writes)});
     }
 
     void post_compact() override
@@ -805,7 +1041,10 @@ namespace kv
       }
 
       if (advance)
+      {
         rollback_counter++;
+        roll_changed = true;
+      }
     }
 
     void clear() override
@@ -815,15 +1054,24 @@ namespace kv
       roll->clear();
       roll->push_back({0, State(), Write()});
       rollback_counter = 0;
+      roll_changed = true;
     }
 
     void lock() override
     {
       sl.lock();
+      updating.store(true);
     }
 
     void unlock() override
     {
+      if (roll_changed)
+      {
+        publish();
+        roll_changed = false;
+      }
+
+      updating.store(false);
       sl.unlock();
     }
 
@@ -836,6 +1084,52 @@ namespace kv
 
       std::swap(rollback_counter, map->rollback_counter);
       std::swap(roll, map->roll);
+      roll_changed = true;
+      map->roll_changed = true;
+    }
+
+    std::unique_ptr<AbstractMapSnapshot<S>> create_snapshot(
+      Version v) override
+    {
+      // The store was last compacted at v, so the compacted state published
+      // then is the state at v. Copying it is O(1) and does not take the map
+      // lock. Its entries are serialised later.
+      auto published = std::atomic_load(&snapshot);
+      return std::make_unique<MapSnapshot>(
+        name, security_domain, published->committed);
+    }
+
+    std::unique_ptr<AbstractMapSnapshot<S>> deserialise_snapshot(
+      D& d) override
+    {
+      auto t = State().transient();
+      auto ctr = d.deserialise_write_header();
+      for (size_t i = 0; i < ctr; ++i)
+      {
+        auto w = d.template deserialise_write_version<K, V, Version>();
+        if (!w.has_value())
+          return nullptr;
+
+        t.put(w->key, VersionV(w->version, w->value));
+      }
+
+      return std::make_unique<MapSnapshot>(
+        name, security_domain, t.persistent());
+    }
+
+    void apply_snapshot(AbstractMapSnapshot<S>* snapshot_, Version v) override
+    {
+      // This replaces the whole roll with the state in the snapshot, as the
+      // only, compacted, state at version v. The Map expects to be locked.
+      auto snapshot = dynamic_cast<MapSnapshot*>(snapshot_);
+      if (snapshot == nullptr)
+        throw std::logic_error(
+          "Attempted to apply snapshot of a map with an incompatible type");
+
+      roll->clear();
+      roll->push_back({v, snapshot->state, Write()});
+      rollback_counter++;
+      roll_changed = true;
     }
   };
 
@@ -1181,8 +1475,11 @@ namespace kv
         }
       }
 
-      // Return serialised Tx.
-      return replicated_serialiser.get_raw_data();
+      // Return serialised Tx, written directly into a buffer of the final
+      // size.
+      std::vector<uint8_t> data(replicated_serialiser.get_raw_data_size());
+      replicated_serialiser.get_raw_data_into(data.data(), data.size());
+      return data;
     }
 
     // Used by frontend for reserved transactions
@@ -1514,6 +1811,111 @@ namespace kv
         e->rollback(v);
     }
 
+  private:
+    struct DecodedTx : public AbstractDecodedTx
+    {
+      Version version;
+      Version rollback_count;
+      OrderedViews<S, D> views;
+    };
+
+    // Deserialises each map written by the transaction into a new view at
+    // version v. Deserialised transactions express read dependencies as
+    // versions, rather than with the actual value read. As a result, they
+    // don't need snapshot isolation on the map state, and maps_lock is only
+    // held while looking up each map.
+    bool deserialise_into(
+      D& d, Version v, Version deserialise_version, OrderedViews<S, D>& views)
+    {
+      for (auto r = d.start_map(); r.has_value(); r = d.start_map())
+      {
+        const auto map_name = r.value();
+
+        AbstractMap<S, D>* map = nullptr;
+        {
+          std::lock_guard<SpinLock> mguard(maps_lock);
+          auto search = maps.find(map_name);
+          if (search == maps.end())
+          {
+            LOG_FAIL_FMT("No such map {} at version {}", map_name, v);
+            return false;
+          }
+          map = search->second.get();
+        }
+
+        auto view_search = views.find(map_name);
+        if (view_search != views.end())
+        {
+          LOG_FAIL_FMT("Multiple writes on {} at version {}", map_name, v);
+          return false;
+        }
+
+        auto view = map->create_view(v);
+        if (!view->deserialise(d, deserialise_version))
+        {
+          delete view;
+          LOG_FAIL_FMT(
+            "Could not deserialise Tx for map {} at version {}",
+            map_name,
+            deserialise_version);
+          return false;
+        }
+
+        views[map_name] = {map, std::unique_ptr<AbstractTxView<S, D>>(view)};
+      }
+
+      if (!d.end())
+      {
+        LOG_FAIL_FMT("Unexpected content in Tx at version {}", v);
+        return false;
+      }
+
+      return true;
+    }
+
+    DeserialiseSuccess commit_deserialised_views(
+      OrderedViews<S, D>& views,
+      Version v,
+      const std::vector<uint8_t>& data,
+      Term* term)
+    {
+      std::lock_guard<SpinLock> mguard(maps_lock);
+
+      auto success = commit_deserialised(views, v);
+      if (success == DeserialiseSuccess::FAILED)
+      {
+        return success;
+      }
+
+      auto h = get_history();
+      if (h)
+      {
+        auto search = views.find("ccf.signatures");
+        if (search != views.end())
+        {
+          // Transactions containing a signature must only contain
+          // a signature and must be verified
+          if (views.size() > 1)
+          {
+            LOG_FAIL_FMT("Unexpected contents in signature transaction {}", v);
+            return DeserialiseSuccess::FAILED;
+          }
+
+          if (!h->verify(term))
+          {
+            LOG_FAIL_FMT("Signature in transaction {} failed to verify", v);
+            return DeserialiseSuccess::FAILED;
+          }
+          success = DeserialiseSuccess::PASS_SIGNATURE;
+        }
+
+        h->append(data.data(), data.size());
+      }
+
+      return success;
+    }
+
+  public:
     DeserialiseSuccess deserialise_views(
       const std::vector<uint8_t>& data,
       bool public_only = false,
@@ -1560,131 +1962,303 @@ namespace kv
         return DeserialiseSuccess::FAILED;
       }
 
-      // Deserialised transactions express read dependencies as versions,
-      // rather than with the actual value read. As a result, they don't
-      // need snapshot isolation on the map state, and so do not need to
-      // lock all the maps before creating the transaction.
-      std::lock_guard<SpinLock> mguard(maps_lock);
+      // if we are not committing now then use NoVersion to deserialise
+      // otherwise the view will be considered as having a committed
+      // version
       OrderedViews<S, D> views;
+      if (!deserialise_into(*d, v, commit ? v : NoVersion, views))
+      {
+        return DeserialiseSuccess::FAILED;
+      }
 
-      for (auto r = d->start_map(); r.has_value(); r = d->start_map())
+      if (commit)
       {
-        const auto map_name = r.value();
+        return commit_deserialised_views(views, v, data, term);
+      }
 
-        auto search = maps.find(map_name);
-        if (search == maps.end())
-        {
-          LOG_FAIL_FMT("No such map {} at version {}", map_name, v);
-          return DeserialiseSuccess::FAILED;
-        }
+      // Transactions containing a pre prepare or a pbft request should not
+      // contain anything else
+      if (views.size() > 1)
+      {
+        LOG_FAIL_FMT("Unexpected contents in pbft transaction {}", v);
+        return DeserialiseSuccess::FAILED;
+      }
 
-        auto view_search = views.find(map_name);
-        if (view_search != views.end())
+      auto success = DeserialiseSuccess::PASS;
+      auto search = views.find("ccf.pbft.preprepares");
+      if (search != views.end())
+      {
+        success = DeserialiseSuccess::PASS_PRE_PREPARE;
+      }
+      else
+      {
+        auto search = views.find("ccf.pbft.requests");
+        if (search == views.end())
         {
-          LOG_FAIL_FMT("Multiple writes on {} at version {}", map_name, v);
+          // we have deserialised an entry that didn't belong to the pbft
+          // requests nor the pbft pre prepares table
           return DeserialiseSuccess::FAILED;
         }
+      }
 
-        auto view = search->second->create_view(v);
-        // if we are not committing now then use NoVersion to deserialise
-        // otherwise the view will be considered as having a committed
-        // version
-        auto deserialise_version = (commit ? v : NoVersion);
-        if (!view->deserialise(*d, deserialise_version))
-        {
-          LOG_FAIL_FMT(
-            "Could not deserialise Tx for map {} at version {}",
-            map_name,
-            deserialise_version);
-          return DeserialiseSuccess::FAILED;
-        }
+      tx->set_view_list(views);
+
+      return success;
+    }
+
+    DeserialiseSuccess deserialise(
+      const std::vector<uint8_t>& data,
+      bool public_only = false,
+      Term* term = nullptr) override
+    {
+      return deserialise_views(data, public_only, term);
+    }
 
-        views[map_name] = {search->second.get(),
-                           std::unique_ptr<AbstractTxView<S, D>>(view)};
+    /** Decrypt and deserialise a transaction ahead of applying it with
+     * deserialise(decoded, ...). This does not modify the store and may be
+     * called concurrently, from any thread, for entries that will later be
+     * applied in order.
+     *
+     * @return nullptr if the entry cannot be decoded yet, for example
+     * because it is encrypted with a key that has not been applied.
+     */
+    DecodedTxPtr decode(
+      const std::vector<uint8_t>& data, bool public_only = false) override
+    {
+      auto decoded = std::make_unique<DecodedTx>();
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
+        decoded->rollback_count = rollback_count;
       }
 
-      if (!d->end())
+      auto d = std::make_unique<D>(
+        get_encryptor(),
+        public_only ? kv::SecurityDomain::PUBLIC :
+                      std::optional<kv::SecurityDomain>());
+
+      if (!d->init(data.data(), data.size()))
+        return nullptr;
+
+      decoded->version = d->template deserialise_version<Version>();
+      if (!deserialise_into(
+            *d, decoded->version, decoded->version, decoded->views))
+        return nullptr;
+
+      return decoded;
+    }
+
+    DeserialiseSuccess deserialise(
+      DecodedTxPtr decoded,
+      const std::vector<uint8_t>& data,
+      bool public_only = false,
+      Term* term = nullptr) override
+    {
+      auto tx = dynamic_cast<DecodedTx*>(decoded.get());
+      if (tx == nullptr)
+        return deserialise_views(data, public_only, term);
+
+      auto v = tx->version;
+      rollback(v - 1);
+
+      // Views decoded before a rollback may refer to discarded state, and
+      // must be decoded again.
+      bool rolled_back;
       {
-        LOG_FAIL_FMT("Unexpected content in Tx at version {}", v);
+        std::lock_guard<SpinLock> vguard(version_lock);
+        rolled_back = (tx->rollback_count != rollback_count);
+      }
+      if (rolled_back)
+        return deserialise_views(data, public_only, term);
+
+      auto cv = current_version();
+      if (cv != (v - 1))
+      {
+        LOG_FAIL_FMT(
+          "Tried to deserialise {} but current_version is {}", v, cv);
         return DeserialiseSuccess::FAILED;
       }
 
-      auto success = DeserialiseSuccess::PASS;
+      return commit_deserialised_views(tx->views, v, data, term);
+    }
 
-      if (commit)
+    /** The state of every replicated map, and the history tree, at a
+     * version. This is captured by snapshot() while the store is briefly
+     * locked, and can then be serialised while transactions carry on.
+     */
+    class Snapshot : public AbstractSnapshot
+    {
+    private:
+      friend Store;
+
+      Version version;
+      std::shared_ptr<AbstractTxEncryptor> encryptor;
+      std::vector<std::unique_ptr<AbstractMapSnapshot<S>>> maps;
+      std::vector<uint8_t> tree;
+
+    public:
+      Version get_version() const override
       {
-        success = commit_deserialised(views, v);
-        if (success == DeserialiseSuccess::FAILED)
-        {
-          return success;
-        }
+        return version;
+      }
+
+      /** Serialise the snapshot. The history tree is followed by all maps,
+       * serialised as a transaction at the snapshot's version, so that
+       * private maps are encrypted as any other transaction would be.
+       */
+      std::vector<uint8_t> serialise() override
+      {
+        S s(encryptor, version);
+        for (auto& map : maps)
+          map->serialise(s);
+        auto serialised_maps = s.get_raw_data();
+
+        std::vector<uint8_t> data(
+          sizeof(uint64_t) + tree.size() + serialised_maps.size());
+        auto data_ = data.data();
+        auto size = data.size();
+        serialized::write(data_, size, (uint64_t)tree.size());
+        serialized::write(data_, size, tree.data(), tree.size());
+        serialized::write(
+          data_, size, serialised_maps.data(), serialised_maps.size());
+        return data;
+      }
+    };
+
+    /** Capture the state of the store at a version, which must be the last
+     * compaction, so that it is globally committed.
+     *
+     * Each map's state is copied in O(1) from the state it published when it
+     * was compacted, so no map is locked. Compaction is blocked while the
+     * states are copied, but transactions are not.
+     */
+    std::unique_ptr<Snapshot> snapshot(Version v)
+    {
+      std::lock_guard<SpinLock> mguard(maps_lock);
+
+      if (v != commit_version())
+        throw std::logic_error(fmt::format(
+          "Cannot snapshot version {} other than the last compaction ({})",
+          v,
+          commit_version()));
+
+      auto snapshot = std::make_unique<Snapshot>();
+      snapshot->version = v;
+      snapshot->encryptor = get_encryptor();
+
+      for (auto& map : maps)
+      {
+        if (map.second->is_replicated())
+          snapshot->maps.push_back(map.second->create_snapshot(v));
+      }
+
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
         auto h = get_history();
         if (h)
-        {
-          auto search = views.find("ccf.signatures");
-          if (search != views.end())
-          {
-            // Transactions containing a signature must only contain
-            // a signature and must be verified
-            if (views.size() > 1)
-            {
-              LOG_FAIL_FMT(
-                "Unexpected contents in signature transaction {}", v);
-              return DeserialiseSuccess::FAILED;
-            }
+          snapshot->tree = h->serialise_tree(v);
+      }
 
-            if (!h->verify(term))
-            {
-              LOG_FAIL_FMT("Signature in transaction {} failed to verify", v);
-              return DeserialiseSuccess::FAILED;
-            }
-            success = DeserialiseSuccess::PASS_SIGNATURE;
-          }
+      return snapshot;
+    }
 
-          h->append(data.data(), data.size());
-        }
+    std::vector<uint8_t> serialise_snapshot(Version v)
+    {
+      return snapshot(v)->serialise();
+    }
+
+    /** Replace the state of the store with a serialised snapshot, so that
+     * only transactions after the snapshot's version need to be
+     * deserialised.
+     *
+     * @param data Serialised snapshot
+     * @param public_only Only apply public maps, leaving private maps as they
+     * are, eg while the ledger secrets are not known yet
+     *
+     * @return FAILED if the snapshot could not be deserialised, PASS
+     * otherwise
+     */
+    DeserialiseSuccess deserialise_snapshot(
+      const std::vector<uint8_t>& data, bool public_only = false)
+    {
+      auto data_ = data.data();
+      auto size = data.size();
+      auto tree_size = serialized::read<uint64_t>(data_, size);
+      if (tree_size > size)
+      {
+        LOG_FAIL_FMT("Snapshot tree of size {} is truncated", tree_size);
+        return DeserialiseSuccess::FAILED;
       }
-      else
+      std::vector<uint8_t> tree(data_, data_ + tree_size);
+      serialized::skip(data_, size, tree_size);
+
+      auto d = std::make_unique<D>(
+        get_encryptor(),
+        public_only ? kv::SecurityDomain::PUBLIC :
+                      std::optional<kv::SecurityDomain>());
+
+      if (!d->init(data_, size))
+      {
+        LOG_FAIL_FMT("Initialisation of snapshot deserialiser failed");
+        return DeserialiseSuccess::FAILED;
+      }
+
+      Version v = d->template deserialise_version<Version>();
+
+      std::lock_guard<SpinLock> mguard(maps_lock);
+
+      std::vector<
+        std::pair<AbstractMap<S, D>*, std::unique_ptr<AbstractMapSnapshot<S>>>>
+        snapshots;
+      for (auto r = d->start_map(); r.has_value(); r = d->start_map())
       {
-        // Transactions containing a pre prepare or a pbft request should not
-        // contain anything else
-        if (views.size() > 1)
+        const auto& map_name = r.value();
+        auto search = maps.find(map_name);
+        if (search == maps.end())
         {
-          LOG_FAIL_FMT("Unexpected contents in pbft transaction {}", v);
+          LOG_FAIL_FMT("No such map {} in snapshot at version {}", map_name, v);
           return DeserialiseSuccess::FAILED;
         }
 
-        auto search = views.find("ccf.pbft.preprepares");
-        if (search != views.end())
-        {
-          success = DeserialiseSuccess::PASS_PRE_PREPARE;
-        }
-        else
+        auto snapshot = search->second->deserialise_snapshot(*d);
+        if (snapshot == nullptr)
         {
-          auto search = views.find("ccf.pbft.requests");
-          if (search == views.end())
-          {
-            // we have deserialised an entry that didn't belong to the pbft
-            // requests nor the pbft pre prepares table
-            return DeserialiseSuccess::FAILED;
-          }
+          LOG_FAIL_FMT(
+            "Could not deserialise snapshot of map {} at version {}",
+            map_name,
+            v);
+          return DeserialiseSuccess::FAILED;
         }
+
+        snapshots.emplace_back(search->second.get(), std::move(snapshot));
       }
 
-      if (tx)
+      if (!d->end())
       {
-        tx->set_view_list(views);
+        LOG_FAIL_FMT("Unexpected content in snapshot at version {}", v);
+        return DeserialiseSuccess::FAILED;
       }
 
-      return success;
-    }
+      for (auto& map : maps)
+        map.second->lock();
 
-    DeserialiseSuccess deserialise(
-      const std::vector<uint8_t>& data,
-      bool public_only = false,
-      Term* term = nullptr) override
-    {
-      return deserialise_views(data, public_only, term);
+      for (auto& [map, snapshot] : snapshots)
+        map->apply_snapshot(snapshot.get(), v);
+
+      for (auto& map : maps)
+        map.second->unlock();
+
+      std::lock_guard<SpinLock> vguard(version_lock);
+      version = v;
+      compacted = v;
+      last_replicated = v;
+      last_committable = v;
+      rollback_count++;
+      pending_txs.clear();
+      auto h = get_history();
+      if (h)
+        h->deserialise_tree(tree);
+
+      return DeserialiseSuccess::PASS;
     }
 
     bool operator==(const Store<S, D>& that) const
@@ -1742,11 +2316,6 @@ namespace kv
         version,
         (globally_committable ? " globally_committable" : ""));
 
-      BatchVector batch;
-      Version previous_last_replicated = 0;
-      Version next_last_replicated = 0;
-      Version previous_rollback_count = 0;
-
       {
         std::lock_guard<SpinLock> vguard(version_lock);
         if (globally_committable && version > last_committable)
@@ -1755,7 +2324,30 @@ namespace kv
         pending_txs.insert(
           {version,
            std::make_pair(std::move(pending_tx), globally_committable)});
+      }
 
+      return flush_pending();
+    }
+
+    /** Replicate the pending transactions that follow the last replicated
+     * one, in order, up to the first that is missing or not ready.
+     *
+     * This is called on each commit, and should also be called when a
+     * transaction that was not ready becomes ready.
+     */
+    CommitSuccess flush_pending() override
+    {
+      auto r = get_consensus();
+      if (!r)
+        return CommitSuccess::OK;
+
+      BatchVector batch;
+      Version previous_last_replicated = 0;
+      Version next_last_replicated = 0;
+      Version previous_rollback_count = 0;
+
+      {
+        std::lock_guard<SpinLock> vguard(version_lock);
         auto h = get_history();
 
         for (Version offset = 1; true; ++offset)
@@ -1765,18 +2357,24 @@ namespace kv
             break;
 
           auto& [pending_tx_, committable_] = search->second;
-          auto [success_, reqid, data_] = pending_tx_();
+          auto pending_info = pending_tx_();
+          if (!pending_info.has_value())
+            break;
+
+          auto& info = pending_info.value();
+          auto& data_ = info.data;
 
           // NB: this cannot happen currently. Regular Tx only make it here if
           // they did succeed, and signatures cannot conflict because they
           // execute in order with a read_version that's version - 1, so even
           // two contiguous signatures are fine
-          if (success_ != CommitSuccess::OK)
+          if (info.success != CommitSuccess::OK)
             LOG_DEBUG_FMT("Failed Tx commit {}", last_replicated + offset);
 
           if (h)
           {
-            h->add_result(reqid, version, data_.data(), data_.size());
+            h->add_result(
+              info.reqid, last_replicated + offset, data_.data(), data_.size());
           }
 
           LOG_DEBUG_FMT(
@@ -11,6 +11,7 @@
 #include <functional>
 #include <limits>
 #include <memory>
+#include <optional>
 #include <unordered_set>
 #include <vector>
 
@@ -56,6 +57,16 @@ namespace kv
     PASS_PRE_PREPARE = 3
   };
 
+  // The result of decoding (and decrypting) a serialised transaction ahead of
+  // applying it. Opaque outside the store that produced it.
+  class AbstractDecodedTx
+  {
+  public:
+    virtual ~AbstractDecodedTx() {}
+  };
+
+  using DecodedTxPtr = std::unique_ptr<AbstractDecodedTx>;
+
   enum ReplicateType
   {
     ALL = 0,
@@ -145,8 +156,14 @@ namespace kv
     virtual void clear_on_result() = 0;
     virtual void clear_on_response() = 0;
     virtual crypto::Sha256Hash get_replicated_state_root() = 0;
-    virtual std::vector<uint8_t> get_receipt(Version v) = 0;
+    // Returns nothing if the receipt is not available yet, and should be
+    // asked for again later
+    virtual std::optional<std::vector<uint8_t>> get_receipt(Version v) = 0;
     virtual bool verify_receipt(const std::vector<uint8_t>& receipt) = 0;
+    virtual std::vector<uint8_t> serialise_tree(Version v) = 0;
+    virtual void deserialise_tree(const std::vector<uint8_t>& tree) = 0;
+    // Verify the last signature against the tree restored from a snapshot
+    virtual bool verify_snapshot(Term* term = nullptr) = 0;
   };
 
   class Consensus
@@ -210,6 +227,13 @@ namespace kv
       state = Primary;
     }
 
+    virtual void init_as_backup(SeqNo seqno, View view)
+    {
+      throw std::logic_error(
+        "Consensus cannot be started from a snapshot at " +
+        std::to_string(seqno));
+    }
+
     virtual bool replicate(const BatchVector& entries) = 0;
     virtual View get_view() = 0;
 
@@ -254,7 +278,10 @@ namespace kv
     {}
   };
 
-  using PendingTx = std::function<PendingTxInfo()>;
+  // Returns nothing if the transaction is not ready yet, in which case it
+  // stays pending, and holds back the transactions after it, until it is
+  // ready when next asked
+  using PendingTx = std::function<std::optional<PendingTxInfo>()>;
 
   class MovePendingTx
   {
@@ -301,6 +328,14 @@ namespace kv
       std::vector<uint8_t>& serialised_header,
       std::vector<uint8_t>& cipher,
       kv::Version version) = 0;
+    // Writes get_header_length() bytes of header to serialised_header and
+    // plain.n bytes of ciphertext to cipher, without intermediate buffers
+    virtual void encrypt(
+      CBuffer plain,
+      CBuffer additional_data,
+      uint8_t* serialised_header,
+      uint8_t* cipher,
+      kv::Version version) = 0;
     virtual bool decrypt(
       const std::vector<uint8_t>& cipher,
       const std::vector<uint8_t>& additional_data,
@@ -326,10 +361,18 @@ namespace kv
       const std::vector<uint8_t>& data,
       bool public_only = false,
       Term* term = nullptr) = 0;
+    virtual DecodedTxPtr decode(
+      const std::vector<uint8_t>& data, bool public_only = false) = 0;
+    virtual DeserialiseSuccess deserialise(
+      DecodedTxPtr decoded,
+      const std::vector<uint8_t>& data,
+      bool public_only = false,
+      Term* term = nullptr) = 0;
     virtual void compact(Version v) = 0;
     virtual void rollback(Version v) = 0;
     virtual CommitSuccess commit(
       Version v, PendingTx pt, bool globally_committable) = 0;
+    virtual CommitSuccess flush_pending() = 0;
     virtual size_t commit_gap() = 0;
   };
 
@@ -350,6 +393,22 @@ namespace kv
     virtual bool is_replicated() = 0;
   };
 
+  class AbstractSnapshot
+  {
+  public:
+    virtual ~AbstractSnapshot() {}
+    virtual Version get_version() const = 0;
+    virtual std::vector<uint8_t> serialise() = 0;
+  };
+
+  template <class S>
+  class AbstractMapSnapshot
+  {
+  public:
+    virtual ~AbstractMapSnapshot() {}
+    virtual void serialise(S& s) = 0;
+  };
+
   template <class S, class D>
   class AbstractMap
   {
@@ -371,5 +430,12 @@ namespace kv
 
     virtual AbstractMap<S, D>* clone(AbstractStore* store) = 0;
     virtual void swap(AbstractMap<S, D>* map) = 0;
+
+    virtual std::unique_ptr<AbstractMapSnapshot<S>> create_snapshot(
+      Version v) = 0;
+    virtual std::unique_ptr<AbstractMapSnapshot<S>> deserialise_snapshot(
+      D& d) = 0;
+    virtual void apply_snapshot(
+      AbstractMapSnapshot<S>* snapshot, Version v) = 0;
   };
 }
\ No newline at end of file
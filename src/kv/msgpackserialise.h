@@ -55,6 +55,11 @@ namespace kv
       return {reinterpret_cast<uint8_t*>(sb.data()),
               reinterpret_cast<uint8_t*>(sb.data()) + sb.size()};
     }
+
+    CBuffer get_raw_buffer()
+    {
+      return {reinterpret_cast<const uint8_t*>(sb.data()), sb.size()};
+    }
   };
 
   class MsgPackReader
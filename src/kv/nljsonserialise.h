@@ -28,6 +28,7 @@ namespace kv
   {
   private:
     nlohmann::json arr;
+    std::vector<uint8_t> raw;
 
   public:
     template <typename T>
@@ -51,6 +52,12 @@ namespace kv
     {
       return nlohmann::json::to_msgpack(arr);
     }
+
+    CBuffer get_raw_buffer()
+    {
+      raw = nlohmann::json::to_msgpack(arr);
+      return raw;
+    }
   };
 
   class JsonReader
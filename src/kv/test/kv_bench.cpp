@@ -7,12 +7,34 @@
 #include "node/encryptor.h"
 #include "stub_consensus.h"
 
+#include <atomic>
+#include <cstdlib>
 #include <picobench/picobench.hpp>
 #include <string>
 
 using namespace ccfapp;
 using namespace ccf;
 
+// Count heap allocations, so that benchmarks can report the number and size
+// of allocations made by the code under test
+static std::atomic<size_t> allocations(0);
+static std::atomic<size_t> allocated_bytes(0);
+
+void* operator new(size_t size)
+{
+  ++allocations;
+  allocated_bytes += size;
+  auto p = std::malloc(size);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept
+{
+  std::free(p);
+}
+
 // Helper functions to use a dummy encryption key
 std::shared_ptr<ccf::LedgerSecrets> create_ledger_secrets()
 {
@@ -87,6 +109,133 @@ static void deserialise(picobench::state& s)
   s.stop_timer();
 }
 
+constexpr size_t views_per_sample = 1000;
+
+template <class A>
+inline void do_not_optimize(A const& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Reports the number of allocations made while committing a transaction
+// writing s.iterations() keys to a map already containing as many keys
+template <kv::SecurityDomain SD>
+static void commit_allocations(picobench::state& s)
+{
+  Store kv_store;
+  auto secrets = create_ledger_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+  kv_store.set_encryptor(encryptor);
+
+  auto& map0 = kv_store.create<std::string, std::string>("map0", SD);
+
+  Store::Tx tx;
+  auto tx0 = tx.get_view(map0);
+  for (int i = 0; i < s.iterations(); i++)
+  {
+    tx0->put("key" + std::to_string(i), "value");
+  }
+  tx.commit();
+
+  Store::Tx tx2;
+  auto tx1 = tx2.get_view(map0);
+  for (int i = 0; i < s.iterations(); i++)
+  {
+    tx1->put("key" + std::to_string(s.iterations() + i), "value");
+  }
+
+  s.start_timer();
+  const auto before = allocations.load();
+  auto rc = tx2.commit();
+  const auto after = allocations.load();
+  if (rc != kv::CommitSuccess::OK)
+    throw std::logic_error("Transaction commit failed: " + std::to_string(rc));
+  s.stop_timer();
+
+  s.set_result(after - before);
+}
+
+// Measures the cost of creating views over a map with s.iterations()
+// uncommitted local commits, reading either at the latest version or at the
+// globally committed version, which is at the far end of the window
+template <bool READ_COMMITTED>
+static void create_view(picobench::state& s)
+{
+  Store kv_store;
+  auto secrets = create_ledger_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+  kv_store.set_encryptor(encryptor);
+
+  auto& map0 = kv_store.create<std::string, std::string>(
+    "map0", kv::SecurityDomain::PUBLIC);
+
+  for (int i = 0; i < s.iterations(); i++)
+  {
+    Store::Tx tx;
+    auto tx0 = tx.get_view(map0);
+    tx0->put("key" + std::to_string(i), "value");
+    auto rc = tx.commit();
+    if (rc != kv::CommitSuccess::OK)
+      throw std::logic_error(
+        "Transaction commit failed: " + std::to_string(rc));
+  }
+
+  s.start_timer();
+  for (size_t i = 0; i < views_per_sample; i++)
+  {
+    Store::Tx tx;
+    if (READ_COMMITTED)
+      tx.set_read_committed();
+    auto tx0 = tx.get_view(map0);
+    do_not_optimize(tx0);
+  }
+  s.stop_timer();
+}
+
+// Reports the number of bytes allocated, and so copied into, while producing
+// the serialised frame of a transaction writing s.iterations() keys to each
+// of a public and a private map
+template <bool INTO>
+static void serialise_copies(picobench::state& s)
+{
+  auto secrets = create_ledger_secrets();
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(0x1, secrets);
+
+  kv::KvStoreSerialiser serialiser(encryptor, 1);
+  const std::string value(100, 'v');
+  for (auto domain :
+       {kv::SecurityDomain::PUBLIC, kv::SecurityDomain::PRIVATE})
+  {
+    serialiser.start_map("map", domain);
+    serialiser.serialise_read_version(kv::NoVersion);
+    serialiser.serialise_count_header(0);
+    serialiser.serialise_count_header(s.iterations());
+    for (int i = 0; i < s.iterations(); i++)
+    {
+      serialiser.serialise_write("key" + std::to_string(i), value);
+    }
+    serialiser.serialise_count_header(0);
+  }
+
+  s.start_timer();
+  const auto before = allocated_bytes.load();
+  if (INTO)
+  {
+    std::vector<uint8_t> data(serialiser.get_raw_data_size());
+    serialiser.get_raw_data_into(data.data(), data.size());
+    do_not_optimize(data);
+  }
+  else
+  {
+    auto data = serialiser.get_raw_data();
+    do_not_optimize(data);
+  }
+  const auto after = allocated_bytes.load();
+  s.stop_timer();
+
+  s.set_result(after - before);
+}
+
 const std::vector<int> tx_count = {10, 100, 200};
 const uint32_t sample_size = 100;
 
@@ -105,3 +254,24 @@ PICOBENCH(deserialise<SD::PUBLIC>)
   .samples(sample_size)
   .baseline();
 PICOBENCH(deserialise<SD::PRIVATE>).iterations(tx_count).samples(sample_size);
+
+const std::vector<int> write_count = {10, 100, 1000, 10000};
+
+PICOBENCH_SUITE("commit_allocations");
+PICOBENCH(commit_allocations<SD::PUBLIC>)
+  .iterations(write_count)
+  .samples(sample_size)
+  .baseline();
+
+const std::vector<int> window_size = {10, 100, 1000, 10000};
+
+PICOBENCH_SUITE("create_view");
+PICOBENCH(create_view<false>).iterations(window_size).samples(10).baseline();
+PICOBENCH(create_view<true>).iterations(window_size).samples(10);
+
+PICOBENCH_SUITE("serialise_copies");
+PICOBENCH(serialise_copies<false>)
+  .iterations(tx_count)
+  .samples(sample_size)
+  .baseline();
+PICOBENCH(serialise_copies<true>).iterations(tx_count).samples(sample_size);
@@ -8,6 +8,7 @@
 #include <atomic>
 #include <chrono>
 #include <doctest/doctest.h>
+#include <iostream>
 #include <string>
 #include <thread>
 #include <vector>
@@ -199,3 +200,90 @@ TEST_CASE("Concurrent kv access" * doctest::test_suite("concurrency"))
     compact_thread.join();
   }
 }
+
+TEST_CASE(
+  "Reader throughput with concurrent writers" *
+  doctest::test_suite("concurrency"))
+{
+  // Reader threads repeatedly create views over every map and read a key,
+  // while writer threads continually commit to the same maps. Reports the
+  // total number of reads completed as the number of reader threads grows
+  using MapType = Store::Map<size_t, size_t>;
+  constexpr size_t map_count = 4;
+  constexpr size_t max_k = 32;
+  constexpr size_t writer_count = 2;
+  constexpr auto duration = std::chrono::milliseconds(500);
+
+  for (size_t reader_count : {1, 2, 4, 8})
+  {
+    Store kv_store;
+    std::vector<MapType*> maps;
+    for (size_t i = 0u; i < map_count; ++i)
+    {
+      maps.push_back(&kv_store.create<MapType>(
+        std::to_string(i), kv::SecurityDomain::PUBLIC));
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> reads(0);
+    std::atomic<size_t> writes(0);
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0u; i < writer_count; ++i)
+    {
+      threads.emplace_back([&]() {
+        size_t n = 0;
+        while (!stop.load())
+        {
+          Store::Tx tx;
+          for (const auto map : maps)
+          {
+            tx.get_view(*map)->put(rand() % max_k, n);
+          }
+          if (tx.commit() == kv::CommitSuccess::OK)
+          {
+            ++n;
+          }
+          kv_store.compact(kv_store.current_version());
+        }
+        writes += n;
+      });
+    }
+
+    for (size_t i = 0u; i < reader_count; ++i)
+    {
+      threads.emplace_back([&]() {
+        size_t n = 0;
+        while (!stop.load())
+        {
+          Store::Tx tx;
+          for (const auto map : maps)
+          {
+            tx.get_view(*map)->get(rand() % max_k);
+          }
+          ++n;
+        }
+        reads += n;
+      });
+    }
+
+    std::this_thread::sleep_for(duration);
+    stop.store(true);
+
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+
+    REQUIRE(reads.load() > 0);
+    REQUIRE(writes.load() > 0);
+
+    std::cout << fmt::format(
+                   "{} readers: {} read txs, {} write txs in {}ms",
+                   reader_count,
+                   reads.load(),
+                   writes.load(),
+                   duration.count())
+              << std::endl;
+  }
+}
@@ -10,6 +10,7 @@
 #include <doctest/doctest.h>
 #include <msgpack-c/msgpack.hpp>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace ccf;
@@ -247,6 +248,91 @@ TEST_CASE(
   }
 }
 
+TEST_CASE(
+  "Decode ahead and deserialise in order" *
+  doctest::test_suite("serialisation"))
+{
+  auto consensus = std::make_shared<kv::StubConsensus>();
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+
+  Store kv_store(consensus);
+  Store kv_store_target;
+  kv_store.set_encryptor(encryptor);
+  kv_store_target.set_encryptor(encryptor);
+
+  auto& priv_map = kv_store.create<size_t, size_t>("priv_map");
+  kv_store_target.clone_schema(kv_store);
+  auto& priv_map_target = *kv_store_target.get<size_t, size_t>("priv_map");
+
+  constexpr size_t tx_count = 20;
+  std::vector<std::vector<uint8_t>> entries;
+  for (size_t i = 0; i < tx_count; ++i)
+  {
+    Store::Tx tx;
+    auto view_priv = tx.get_view(priv_map);
+    view_priv->put(i, i);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    entries.push_back(consensus->get_latest_data().first);
+  }
+
+  INFO("Entries decoded concurrently and out of order apply in order");
+  {
+    constexpr size_t half = tx_count / 2;
+    std::vector<kv::DecodedTxPtr> decoded(half);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < 2; ++t)
+    {
+      threads.emplace_back([&, t]() {
+        for (size_t i = half - 1 - t; i < half; i -= 2)
+          decoded[i] = kv_store_target.decode(entries[i]);
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+
+    for (size_t i = 0; i < half; ++i)
+    {
+      REQUIRE(decoded[i] != nullptr);
+      REQUIRE(
+        kv_store_target.deserialise(std::move(decoded[i]), entries[i]) ==
+        kv::DeserialiseSuccess::PASS);
+    }
+    REQUIRE(kv_store_target.current_version() == half);
+  }
+
+  INFO("Entries decoded before a rollback are decoded again");
+  {
+    const auto next = kv_store_target.current_version();
+    auto decoded = kv_store_target.decode(entries[next]);
+
+    Store::Tx tx;
+    auto view_priv = tx.get_view(priv_map_target);
+    view_priv->put(tx_count, tx_count);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    REQUIRE(
+      kv_store_target.deserialise(std::move(decoded), entries[next]) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(kv_store_target.current_version() == next + 1);
+
+    Store::Tx tx_target;
+    auto view_priv_target = tx_target.get_view(priv_map_target);
+    REQUIRE(view_priv_target->get(next) == next);
+    REQUIRE(!view_priv_target->get(tx_count).has_value());
+  }
+
+  INFO("Entries that were not decoded ahead are deserialised directly");
+  {
+    for (size_t i = kv_store_target.current_version(); i < tx_count; ++i)
+    {
+      REQUIRE(
+        kv_store_target.deserialise(nullptr, entries[i]) ==
+        kv::DeserialiseSuccess::PASS);
+    }
+    REQUIRE(kv_store_target.current_version() == tx_count);
+  }
+}
+
 TEST_CASE(
   "Custom type serialisation test" * doctest::test_suite("serialisation"))
 {
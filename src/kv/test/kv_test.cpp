@@ -149,6 +149,64 @@ TEST_CASE("Reads/writes and deletions")
   }
 }
 
+TEST_CASE("Read versions")
+{
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+
+  constexpr auto k = "key";
+  constexpr auto v1 = "value1";
+  constexpr auto v2 = "value2";
+
+  INFO("Keys that do not exist or are written locally have no version");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(!view->get_version(k).has_value());
+    view->put(k, v1);
+    REQUIRE(!view->get_version(k).has_value());
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  INFO("Version is that of the write");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->get_version(k) == kv_store.current_version());
+  }
+
+  INFO("Version changes with the value");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    const auto version = view->get_version(k);
+
+    Store::Tx tx2;
+    tx2.get_view(map)->put(k, v2);
+    REQUIRE(tx2.commit() == kv::CommitSuccess::OK);
+
+    Store::Tx tx3;
+    auto view3 = tx3.get_view(map);
+    REQUIRE(view3->get_version(k).has_value());
+    REQUIRE(view3->get_version(k) != version);
+
+    INFO("Reading the version records a read dependency");
+    view->put("other_key", v1);
+    REQUIRE(tx.commit() == kv::CommitSuccess::CONFLICT);
+  }
+
+  INFO("Removed keys have no version");
+  {
+    Store::Tx tx;
+    REQUIRE(tx.get_view(map)->remove(k));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    Store::Tx tx2;
+    REQUIRE(!tx2.get_view(map)->get_version(k).has_value());
+  }
+}
+
 TEST_CASE("Rollback and compact")
 {
   Store kv_store;
@@ -203,6 +261,54 @@ TEST_CASE("Rollback and compact")
   }
 }
 
+TEST_CASE("Read at versions across many local commits")
+{
+  Store kv_store;
+  auto& map = kv_store.create<std::string, std::string>(
+    "map", kv::SecurityDomain::PUBLIC);
+
+  // Enough commits to wrap and grow the roll of local commits several times
+  constexpr size_t commits = 100;
+  constexpr size_t compact_every = 7;
+  constexpr auto k = "key";
+
+  for (size_t i = 1; i <= commits; ++i)
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    view->put(k, std::to_string(i));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+
+    if (i % compact_every == 0)
+      kv_store.compact(i - 3);
+  }
+
+  INFO("Read latest and globally committed values");
+  {
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->get(k).value() == std::to_string(commits));
+    REQUIRE(view->get_globally_committed(k).value() == std::to_string(95));
+
+    Store::Tx tx2;
+    tx2.set_read_committed();
+    auto view2 = tx2.get_view(map);
+    REQUIRE(view2->get(k).value() == std::to_string(95));
+  }
+
+  INFO("Read after rolling back part of the uncommitted window");
+  {
+    kv_store.rollback(97);
+
+    Store::Tx tx;
+    auto view = tx.get_view(map);
+    REQUIRE(view->get(k).value() == std::to_string(97));
+    view->put(k, "new");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    REQUIRE(view->end_order() == 98);
+  }
+}
+
 TEST_CASE("Clear entire store")
 {
   Store kv_store;
@@ -461,6 +567,123 @@ TEST_CASE("Clone schema")
   REQUIRE(clone.deserialise(data) == kv::DeserialiseSuccess::PASS);
 }
 
+TEST_CASE("Snapshot and restore")
+{
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  Store store;
+  store.set_encryptor(encryptor);
+
+  auto& public_map =
+    store.create<size_t, std::string>("public", kv::SecurityDomain::PUBLIC);
+  auto& private_map = store.create<size_t, std::string>("private");
+
+  for (size_t i = 0; i < 10; ++i)
+  {
+    Store::Tx tx;
+    auto [view1, view2] = tx.get_view(public_map, private_map);
+    view1->put(i, "public " + std::to_string(i));
+    view2->put(i, "private " + std::to_string(i));
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  {
+    Store::Tx tx;
+    auto view1 = tx.get_view(public_map);
+    view1->remove(0);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  const auto snapshot_version = store.current_version();
+
+  INFO("Cannot snapshot an uncompacted version");
+  {
+    REQUIRE_THROWS_AS(store.snapshot(snapshot_version), std::logic_error);
+  }
+
+  store.compact(snapshot_version);
+
+  INFO("Cannot snapshot a version before the last compaction");
+  {
+    REQUIRE_THROWS_AS(store.snapshot(snapshot_version - 1), std::logic_error);
+  }
+
+  auto snapshot = store.snapshot(snapshot_version);
+  REQUIRE(snapshot->get_version() == snapshot_version);
+
+  // Writes after the snapshot was captured are not in it
+  Store::Tx next(store.next_version());
+  auto next_view = next.get_view(public_map);
+  next_view->put(1, "overwritten");
+  next_view->put(100, "after snapshot");
+  auto [success, reqid, next_data] = next.commit_reserved();
+  REQUIRE(success == kv::CommitSuccess::OK);
+
+  const auto serialised = snapshot->serialise();
+
+  INFO("Restore all maps");
+  {
+    Store restored;
+    restored.clone_schema(store);
+    restored.set_encryptor(encryptor);
+    REQUIRE(
+      restored.deserialise_snapshot(serialised) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(restored.current_version() == snapshot_version);
+    REQUIRE(restored.commit_version() == snapshot_version);
+
+    auto public_restored = restored.get<Store::Map<size_t, std::string>>("public");
+    auto private_restored =
+      restored.get<Store::Map<size_t, std::string>>("private");
+
+    Store::Tx tx;
+    auto [view1, view2] = tx.get_view(*public_restored, *private_restored);
+    REQUIRE(!view1->get(0).has_value());
+    REQUIRE(view1->get(1) == "public 1");
+    REQUIRE(view2->get(0) == "private 0");
+    REQUIRE(view2->get(9) == "private 9");
+    REQUIRE(!view1->get(100).has_value());
+  }
+
+  INFO("Only the suffix after the snapshot is deserialised");
+  {
+    Store restored;
+    restored.clone_schema(store);
+    restored.set_encryptor(encryptor);
+    REQUIRE(
+      restored.deserialise_snapshot(serialised) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE(restored.deserialise(next_data) == kv::DeserialiseSuccess::PASS);
+    REQUIRE(restored.current_version() == snapshot_version + 1);
+
+    auto public_restored = restored.get<Store::Map<size_t, std::string>>("public");
+
+    Store::Tx tx;
+    auto view1 = tx.get_view(*public_restored);
+    REQUIRE(view1->get(1) == "overwritten");
+    REQUIRE(view1->get(100) == "after snapshot");
+    REQUIRE(view1->get(2) == "public 2");
+  }
+
+  INFO("Restore public maps only");
+  {
+    Store restored;
+    restored.clone_schema(store);
+    restored.set_encryptor(encryptor);
+    REQUIRE(
+      restored.deserialise_snapshot(serialised, true) ==
+      kv::DeserialiseSuccess::PASS);
+
+    auto public_restored = restored.get<Store::Map<size_t, std::string>>("public");
+    auto private_restored =
+      restored.get<Store::Map<size_t, std::string>>("private");
+
+    Store::Tx tx;
+    auto [view1, view2] = tx.get_view(*public_restored, *private_restored);
+    REQUIRE(view1->get(1) == "public 1");
+    REQUIRE(!view2->get(1).has_value());
+  }
+}
+
 TEST_CASE("Deserialise return status")
 {
   Store store;
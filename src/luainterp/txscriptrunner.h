@@ -1,12 +1,16 @@
 // Copyright (c) Microsoft Corporation. All rights reserved.
 // Licensed under the Apache 2.0 License.
 #pragma once
+#include "ds/thread_messaging.h"
 #include "luainterp/luainterp.h"
 #include "luainterp/luakv.h"
 #include "node/networktables.h"
 #include "node/rpc/rpcexception.h"
 
+#include <array>
+#include <memory>
 #include <sstream>
+#include <thread>
 #include <type_traits>
 #include <unordered_map>
 #include <vector>
@@ -26,6 +30,12 @@ namespace ccf
       std::optional<WlId> whitelist_read;
       //! [optional] script to setup the environment for the actual script
       std::optional<Script> env_script;
+      //! [optional] key and version of the script in its table. If set, and
+      //! env_script_version is set whenever there is an env_script, the script
+      //! is run in a pooled interpreter
+      std::optional<std::pair<std::string, kv::Version>> script_version;
+      //! [optional] version of the environment script in its table
+      std::optional<kv::Version> env_script_version;
     };
 
     class TxScriptRunner
@@ -204,9 +214,15 @@ namespace ccf
         return 0;
       }
 
-      virtual void setup_environment(
+      /** Set up the globals scripts expect, before the environment script
+       * runs
+       */
+      virtual void setup_globals(lua::Interpreter& li) const {}
+
+      void setup_environment(
         lua::Interpreter& li, const std::optional<Script>& env_script) const
       {
+        setup_globals(li);
         if (env_script)
         {
           load(li, *env_script);
@@ -218,40 +234,265 @@ namespace ccf
         lua::Interpreter& li, Store::Tx& tx, int& n_registered_tables) const
       {}
 
-    public:
-      /** Run a script transactionally in a given environment.
-       *
-       * For each given whitelist id (read or write, in TxScript), a table of
-       * corresponding table objects is passed to the script as arguments. The
-       * script can use those table objects to access the key-value store. For
-       * example, if both a read and a write whitelist are specified, a script
-       * with three arguments a,b,c would start as follows:
-       *
-       * tables_writable, tables_readable, a, b, c = ...
-       * -- read members table
-       * local member_0 = tables_readable["ccf.members"]:get(0)
-       *
-       * Further, subclasses of this class may add custom tables by overriding
-       * the add_custom_tables() method.
-       *
-       * @tparam T the return type of the script
-       * @tparam Args the types of the arguments to the script
-       * @param tx the transaction to run the script in
-       * @param txs the script to run and corresponding parameters (i.e.,
-       * read/write whitelists and environment script).
-       * @param args the arguments to the script
-       * @return T the result of the script
+      /** Interpreter kept to run further scripts. Its global table only holds
+       * the standard libraries, and no script can write to it: each run gets
+       * a global table of its own, in which the globals and the environment
+       * script are set up again, and which reads the shared one through
+       * read-only proxies. The environment script and the scripts are only
+       * loaded once, and kept in the Lua registry, the scripts by key along
+       * with the version they were loaded at.
        */
-      template <typename T, typename... Args>
-      T run(Store::Tx& tx, const TxScript& txs, Args&&... args) const
+      struct PooledInterpreter
       {
         lua::Interpreter li;
+        std::optional<kv::Version> env_version;
+        std::unordered_map<std::string, std::pair<kv::Version, int>> scripts;
+        // Registry references to the shared global table, to the loaded
+        // environment script, to the function making read-only proxies, and
+        // to the names in the registry once set up
+        int globals = LUA_NOREF;
+        int env_script = LUA_NOREF;
+        int read_only = LUA_NOREF;
+        int registry_names = LUA_NOREF;
+      };
+
+      /** Returns a function which returns a read-only proxy for the given
+       * table. The tables read through a proxy are proxied in turn, once per
+       * call of the function, so that only the tables a script reads are
+       * proxied.
+       */
+      static constexpr auto read_only_script = R"xxx(
+        local error, next, setmetatable, type = error, next, setmetatable, type
+        return function (shared)
+          local proxies = {}
+          local function proxy (t)
+            local p = proxies[t]
+            if p == nil then
+              p = setmetatable({}, {
+                __index = function (_, k)
+                  local v = t[k]
+                  if type(v) == "table" then
+                    return proxy(v)
+                  end
+                  return v
+                end,
+                __newindex = function ()
+                  error("shared tables are read-only", 2)
+                end,
+                __len = function ()
+                  return #t
+                end,
+                __pairs = function ()
+                  return function (_, k)
+                    local nk, v = next(t, k)
+                    if type(v) == "table" then
+                      v = proxy(v)
+                    end
+                    return nk, v
+                  end, p, nil
+                end,
+                __metatable = false
+              })
+              proxies[t] = p
+            end
+            return p
+          end
+          return proxy(shared)
+        end
+      )xxx";
+
+      std::unique_ptr<PooledInterpreter> make_pooled(const TxScript& txs) const
+      {
+        auto pi = std::make_unique<PooledInterpreter>();
+        auto l = pi->li.get_state();
+
+        lua_pushglobaltable(l);
+        pi->globals = luaL_ref(l, LUA_REGISTRYINDEX);
+
+        // Strings share a metatable, through which scripts could otherwise
+        // reach the string table
+        lua_pushliteral(l, "");
+        lua_getmetatable(l, -1);
+        lua_pushboolean(l, false);
+        lua_setfield(l, -2, "__metatable");
+        lua_pop(l, 2);
+
+        pi->li.push_code(read_only_script);
+        pi->li.invoke_raw(0);
+        pi->read_only = luaL_ref(l, LUA_REGISTRYINDEX);
+
+        if (txs.env_script)
+        {
+          load(pi->li, *txs.env_script);
+          pi->env_script = luaL_ref(l, LUA_REGISTRYINDEX);
+        }
+        pi->env_version = txs.env_script_version;
+
+        lua_newtable(l);
+        lua_pushnil(l);
+        while (lua_next(l, LUA_REGISTRYINDEX) != 0)
+        {
+          lua_pop(l, 1);
+          if (lua_type(l, -1) == LUA_TSTRING)
+          {
+            lua_pushvalue(l, -1);
+            lua_pushboolean(l, true);
+            lua_rawset(l, -4);
+          }
+        }
+        pi->registry_names = luaL_ref(l, LUA_REGISTRYINDEX);
+
+        return pi;
+      }
+
+      /** Give the interpreter a new global table, which falls back to
+       * read-only proxies of the shared one, and set up the globals and the
+       * environment script in it.
+       */
+      void enter_sandbox(PooledInterpreter& pi) const
+      {
+        auto l = pi.li.get_state();
+
+        lua_newtable(l);
+        lua_pushvalue(l, -1);
+        lua_setfield(l, -2, "_G");
+        lua_createtable(l, 0, 1);
+        lua_rawgeti(l, LUA_REGISTRYINDEX, pi.read_only);
+        lua_rawgeti(l, LUA_REGISTRYINDEX, pi.globals);
+        lua_call(l, 1, 1);
+        lua_setfield(l, -2, "__index");
+        lua_setmetatable(l, -2);
+        lua_rawseti(l, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+
+        setup_globals(pi.li);
+        if (pi.env_script != LUA_NOREF)
+        {
+          push_with_globals(l, pi.env_script);
+          pi.li.invoke_raw(0);
+        }
+        lua_settop(l, 0);
+      }
+
+      /** Restore the shared global table, and remove any names added to the
+       * registry since the interpreter was set up, such as metatables
+       * registered while running a script, so that they are registered again
+       * by the next script.
+       */
+      static void leave_sandbox(PooledInterpreter& pi)
+      {
+        auto l = pi.li.get_state();
+        lua_settop(l, 0);
+
+        lua_rawgeti(l, LUA_REGISTRYINDEX, pi.globals);
+        lua_rawseti(l, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+
+        lua_rawgeti(l, LUA_REGISTRYINDEX, pi.registry_names);
+        lua_pushnil(l);
+        while (lua_next(l, LUA_REGISTRYINDEX) != 0)
+        {
+          lua_pop(l, 1);
+          if (lua_type(l, -1) == LUA_TSTRING)
+          {
+            lua_pushvalue(l, -1);
+            if (lua_rawget(l, 1) == LUA_TNIL)
+            {
+              lua_pushvalue(l, -2);
+              lua_pushnil(l);
+              lua_rawset(l, LUA_REGISTRYINDEX);
+            }
+            lua_pop(l, 1);
+          }
+        }
+        lua_settop(l, 0);
+      }
+
+      // Push the loaded chunk with the given registry reference, with the
+      // current global table as its _ENV
+      static void push_with_globals(lua_State* l, int ref)
+      {
+        lua_rawgeti(l, LUA_REGISTRYINDEX, ref);
+        lua_pushglobaltable(l);
+        // The first upvalue of a loaded chunk is always its _ENV
+        if (lua_setupvalue(l, -2, 1) == nullptr)
+          throw std::logic_error("Loaded script has no _ENV upvalue");
+      }
+
+      // Interpreters not currently in use, for each thread. A thread takes one
+      // for the duration of a script, so there are never more in a thread's
+      // pool than scripts the thread has run at once.
+      mutable std::array<
+        std::vector<std::unique_ptr<PooledInterpreter>>,
+        enclave::ThreadMessaging::max_num_threads>
+        pools;
 
-        // run an optional environment script
-        setup_environment(li, txs.env_script);
+      static bool can_pool(const TxScript& txs)
+      {
+        return txs.script_version.has_value() &&
+          (!txs.env_script || txs.env_script_version.has_value());
+      }
+
+      std::unique_ptr<PooledInterpreter> acquire(const TxScript& txs) const
+      {
+        auto& pool = pools[thread_ids[std::this_thread::get_id()]];
+
+        std::unique_ptr<PooledInterpreter> pi;
+        if (!pool.empty())
+        {
+          pi = std::move(pool.back());
+          pool.pop_back();
+        }
+
+        // An interpreter set up with an older environment script is discarded
+        if (pi == nullptr || pi->env_version != txs.env_script_version)
+          pi = make_pooled(txs);
+
+        enter_sandbox(*pi);
+        return pi;
+      }
+
+      void release(std::unique_ptr<PooledInterpreter> pi) const
+      {
+        leave_sandbox(*pi);
+        pools[thread_ids[std::this_thread::get_id()]].push_back(std::move(pi));
+      }
+
+      /** Push the script, loading it only if it has not been loaded at its
+       * current version by this interpreter already, with the global table of
+       * this run as its _ENV.
+       */
+      static void load_pooled(PooledInterpreter& pi, const TxScript& txs)
+      {
+        auto l = pi.li.get_state();
+        const auto& [key, version] = *txs.script_version;
+
+        auto it = pi.scripts.find(key);
+        if (it != pi.scripts.end() && it->second.first != version)
+        {
+          luaL_unref(l, LUA_REGISTRYINDEX, it->second.second);
+          pi.scripts.erase(it);
+          it = pi.scripts.end();
+        }
 
-        load(li, txs.script);
+        if (it == pi.scripts.end())
+        {
+          load(pi.li, txs.script);
+          it = pi.scripts
+                 .emplace(
+                   key,
+                   std::make_pair(version, luaL_ref(l, LUA_REGISTRYINDEX)))
+                 .first;
+        }
 
+        push_with_globals(l, it->second.second);
+      }
+
+      template <typename T, typename... Args>
+      T invoke(
+        lua::Interpreter& li,
+        Store::Tx& tx,
+        const TxScript& txs,
+        Args&&... args) const
+      {
         // register writable and read-only tables with respect to the given
         // whitelists the table of writable tables will be pushed on the stack
         // first. the table of readable tables second
@@ -290,6 +531,73 @@ namespace ccf
         }
       }
 
+    public:
+      /** Run a script transactionally in a given environment.
+       *
+       * For each given whitelist id (read or write, in TxScript), a table of
+       * corresponding table objects is passed to the script as arguments. The
+       * script can use those table objects to access the key-value store. For
+       * example, if both a read and a write whitelist are specified, a script
+       * with three arguments a,b,c would start as follows:
+       *
+       * tables_writable, tables_readable, a, b, c = ...
+       * -- read members table
+       * local member_0 = tables_readable["ccf.members"]:get(0)
+       *
+       * Further, subclasses of this class may add custom tables by overriding
+       * the add_custom_tables() method.
+       *
+       * If TxScript gives the versions of the script and its environment
+       * script, the script runs in a pooled interpreter. Its environment is
+       * only set up again when the environment script's version changes, and
+       * the script is only loaded again when its own version changes. Each
+       * run still gets its own globals, in which the environment script is
+       * run again, so that nothing a script sets, including state captured by
+       * the environment script's functions, outlives the transaction. Shared
+       * tables, such as string, are read-only.
+       *
+       * @tparam T the return type of the script
+       * @tparam Args the types of the arguments to the script
+       * @param tx the transaction to run the script in
+       * @param txs the script to run and corresponding parameters (i.e.,
+       * read/write whitelists and environment script).
+       * @param args the arguments to the script
+       * @return T the result of the script
+       */
+      template <typename T, typename... Args>
+      T run(Store::Tx& tx, const TxScript& txs, Args&&... args) const
+      {
+        if (!can_pool(txs))
+        {
+          lua::Interpreter li;
+
+          // run an optional environment script
+          setup_environment(li, txs.env_script);
+
+          load(li, txs.script);
+
+          return invoke<T>(li, tx, txs, std::forward<Args>(args)...);
+        }
+
+        // If the script throws, the interpreter is discarded rather than
+        // returned to the pool, since the exception may have left it in an
+        // inconsistent state
+        auto pi = acquire(txs);
+        load_pooled(*pi, txs);
+
+        if constexpr (std::is_same_v<T, void>)
+        {
+          invoke<T>(pi->li, tx, txs, std::forward<Args>(args)...);
+          release(std::move(pi));
+        }
+        else
+        {
+          auto r = invoke<T>(pi->li, tx, txs, std::forward<Args>(args)...);
+          release(std::move(pi));
+          return r;
+        }
+      }
+
       TxScriptRunner(NetworkTables& network_tables) :
         network_tables(network_tables)
       {}
@@ -30,6 +30,18 @@ namespace ccf
       cipher = plain;
     }
 
+    void encrypt(
+      CBuffer plain,
+      CBuffer additional_data,
+      uint8_t* serialised_header,
+      uint8_t* cipher,
+      kv::Version version) override
+    {
+      crypto::GcmHeader<crypto::GCM_SIZE_IV> gcm_hdr = {};
+      gcm_hdr.serialise(serialised_header);
+      std::memmove(cipher, plain.p, plain.n);
+    }
+
     bool decrypt(
       const std::vector<uint8_t>& cipher,
       const std::vector<uint8_t>& additional_data,
@@ -163,6 +175,36 @@ namespace ccf
       serialised_header = std::move(gcm_hdr.serialise());
     }
 
+    /**
+     * Encrypt data directly into caller-supplied buffers.
+     *
+     * @param[in]   plain             Plaintext to encrypt
+     * @param[in]   additional_data   Additional data to tag
+     * @param[out]  serialised_header Serialised header (iv + tag), of
+     * get_header_length() bytes
+     * @param[out]  cipher            Encrypted ciphertext, of plain.n bytes.
+     * This may be the same buffer as plain.
+     * @param[in]   version           Version used to retrieve the corresponding
+     * encryption key
+     */
+    void encrypt(
+      CBuffer plain,
+      CBuffer additional_data,
+      uint8_t* serialised_header,
+      uint8_t* cipher,
+      kv::Version version) override
+    {
+      crypto::GcmHeader<crypto::GCM_SIZE_IV> gcm_hdr;
+
+      // Set IV
+      set_iv(gcm_hdr);
+
+      get_encryption_key(version).encrypt(
+        gcm_hdr.get_iv(), plain, additional_data, cipher, gcm_hdr.tag);
+
+      gcm_hdr.serialise(serialised_header);
+    }
+
     /**
      * Decrypt cipher and return plaintext.
      *
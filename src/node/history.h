@@ -2,9 +2,12 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "consensus/ledgerenclavetypes.h"
 #include "consensus/pbft/pbfttypes.h"
 #include "crypto/hash.h"
 #include "ds/logger.h"
+#include "ds/spinlock.h"
+#include "ds/thread_messaging.h"
 #include "entities.h"
 #include "kv/kvtypes.h"
 #include "nodes.h"
@@ -13,8 +16,13 @@
 #include "tls/verifier.h"
 
 #include <array>
+#include <chrono>
 #include <deque>
+#include <list>
+#include <map>
+#include <memory>
 #include <string.h>
+#include <unordered_map>
 
 extern "C"
 {
@@ -52,7 +60,8 @@ namespace ccf
     APPEND,
     VERIFY,
     ROLLBACK,
-    COMPACT
+    COMPACT,
+    DESERIALISE
   };
 
   constexpr size_t MAX_HISTORY_LEN = 1000;
@@ -76,6 +85,10 @@ namespace ccf
       case COMPACT:
         os << "compact";
         break;
+
+      case DESERIALISE:
+        os << "deserialise";
+        break;
     }
 
     return os;
@@ -176,15 +189,27 @@ namespace ccf
       return crypto::Sha256Hash();
     }
 
-    std::vector<uint8_t> get_receipt(kv::Version v) override
+    std::optional<std::vector<uint8_t>> get_receipt(kv::Version v) override
     {
-      return {};
+      return std::vector<uint8_t>();
     }
 
     bool verify_receipt(const std::vector<uint8_t>& v) override
     {
       return true;
     }
+
+    std::vector<uint8_t> serialise_tree(kv::Version v) override
+    {
+      return {};
+    }
+
+    void deserialise_tree(const std::vector<uint8_t>& tree) override {}
+
+    bool verify_snapshot(kv::Term* term = nullptr) override
+    {
+      return true;
+    }
   };
 
   class Receipt
@@ -258,6 +283,124 @@ namespace ccf
     }
   };
 
+  // The peaks of a Merkle tree: the root of each perfect subtree that the
+  // leaves are split into, one for each bit set in the number of leaves. This
+  // is enough to compute the root and to append further leaves, so a tree
+  // can be rebuilt incrementally from the frontier in a signature and the
+  // leaves appended since.
+  class MerkleFrontier
+  {
+    uint64_t size = 0;
+    // Highest level first
+    std::vector<crypto::Sha256Hash> peaks;
+
+  public:
+    MerkleFrontier() = default;
+
+    MerkleFrontier(uint64_t size_, std::vector<crypto::Sha256Hash>&& peaks_) :
+      size(size_),
+      peaks(std::move(peaks_))
+    {}
+
+    MerkleFrontier(const std::vector<uint8_t>& serialised)
+    {
+      const uint8_t* buf = serialised.data();
+      size_t s = serialised.size();
+      size = serialized::read<decltype(size)>(buf, s);
+      for (; s >= crypto::Sha256Hash::SIZE; s -= crypto::Sha256Hash::SIZE)
+      {
+        crypto::Sha256Hash h;
+        std::copy(buf, buf + h.SIZE, h.h);
+        buf += h.SIZE;
+        peaks.push_back(h);
+      }
+    }
+
+    uint64_t get_size() const
+    {
+      return size;
+    }
+
+    // The peak at a level where the size has a bit set
+    const crypto::Sha256Hash& get_peak(uint32_t level) const
+    {
+      size_t pos = 0;
+      for (auto s = size >> (level + 1); s > 0; s >>= 1)
+        pos += s % 2;
+      return peaks.at(pos);
+    }
+
+    void append(const crypto::Sha256Hash& hash)
+    {
+      // As mt_insert, each peak at a level where the current size has a bit
+      // set is combined with the new leaf, and carried to the next level
+      crypto::Sha256Hash acc = hash;
+      for (uint64_t s = size; s % 2 == 1; s /= 2)
+      {
+        hash_2(peaks.back().h, acc.h, acc.h);
+        peaks.pop_back();
+      }
+      peaks.push_back(acc);
+      ++size;
+    }
+
+    /** Advance to the frontier in a later signature, by appending the
+     * leaves in its delta that are not in this frontier yet.
+     *
+     * @param sig Signature to advance to
+     *
+     * @return false if the delta does not start at or before this frontier,
+     * or if the result differs from the frontier in the signature
+     */
+    bool apply(const Signature& sig)
+    {
+      const MerkleFrontier next(sig.frontier);
+      const auto delta_leaves = sig.delta.size() / crypto::Sha256Hash::SIZE;
+      if (size > next.size || size + delta_leaves < next.size)
+        return false;
+
+      const auto skip = delta_leaves - (next.size - size);
+      for (size_t i = skip; i < delta_leaves; ++i)
+      {
+        crypto::Sha256Hash h;
+        const auto leaf = sig.delta.data() + i * h.SIZE;
+        std::copy(leaf, leaf + h.SIZE, h.h);
+        append(h);
+      }
+
+      return *this == next;
+    }
+
+    crypto::Sha256Hash get_root() const
+    {
+      // As mt_get_root, peaks are combined from the lowest level up
+      crypto::Sha256Hash acc;
+      if (peaks.empty())
+        return acc;
+
+      acc = peaks.back();
+      for (auto it = peaks.rbegin() + 1; it != peaks.rend(); ++it)
+        hash_2(const_cast<uint8_t*>(it->h), acc.h, acc.h);
+      return acc;
+    }
+
+    std::vector<uint8_t> serialise() const
+    {
+      size_t vs = sizeof(size) + crypto::Sha256Hash::SIZE * peaks.size();
+      std::vector<uint8_t> v(vs);
+      uint8_t* buf = v.data();
+      serialized::write(buf, vs, size);
+      for (const auto& p : peaks)
+        serialized::write(buf, vs, p.h, p.SIZE);
+      return v;
+    }
+
+    bool operator==(const MerkleFrontier& that) const
+    {
+      return size == that.size && peaks == that.peaks;
+    }
+  };
+
   class MerkleTreeHistory
   {
     merkle_tree* tree;
@@ -277,6 +420,81 @@ namespace ccf
       free_hash(ih);
     }
 
+    /** A tree from which the leaves up to the frontier have been flushed,
+     * followed by leaves_count leaves. Receipts can be produced for the
+     * leaves that follow the frontier.
+     *
+     * At each level, the tree holds the node before the first unflushed one
+     * when its position is odd. That node is a peak of the frontier, and all
+     * other nodes can be computed from it and the leaves.
+     */
+    MerkleTreeHistory(
+      const MerkleFrontier& frontier,
+      const uint8_t* leaves,
+      size_t leaves_count)
+    {
+      constexpr uint32_t levels = 32;
+      const uint32_t i = frontier.get_size();
+      const uint32_t j = i + leaves_count;
+
+      std::vector<std::vector<crypto::Sha256Hash>> hs(levels);
+      for (uint32_t lv = 0; lv < levels; ++lv)
+      {
+        for (auto pos = offset_of(i >> lv); pos < (j >> lv); ++pos)
+        {
+          crypto::Sha256Hash h;
+          if (pos < (i >> lv))
+          {
+            h = frontier.get_peak(lv);
+          }
+          else if (lv == 0)
+          {
+            const auto leaf = leaves + (pos - i) * h.SIZE;
+            std::copy(leaf, leaf + h.SIZE, h.h);
+          }
+          else
+          {
+            auto& below = hs[lv - 1];
+            const auto first = offset_of(i >> (lv - 1));
+            hash_2(below[2 * pos - first].h, below[2 * pos + 1 - first].h, h.h);
+          }
+          hs[lv].push_back(h);
+        }
+      }
+
+      // Laid out as mt_serialize would, with the root left to be computed
+      size_t size = 1 + 4 + 8 + 4 + 4 + 4 + 1 + 4 +
+        (levels + 1) * crypto::Sha256Hash::SIZE;
+      for (const auto& level : hs)
+        size += 4 + level.size() * crypto::Sha256Hash::SIZE;
+
+      std::vector<uint8_t> serialised;
+      serialised.reserve(size);
+      auto write_be = [&serialised](uint64_t v, size_t bytes) {
+        while (bytes-- > 0)
+          serialised.push_back(v >> (8 * bytes));
+      };
+      write_be(0, 1);
+      write_be(crypto::Sha256Hash::SIZE, 4);
+      write_be(0, 8);
+      write_be(i, 4);
+      write_be(j, 4);
+      write_be(levels, 4);
+      for (const auto& level : hs)
+      {
+        write_be(level.size(), 4);
+        for (const auto& h : level)
+          serialised.insert(serialised.end(), h.h, h.h + h.SIZE);
+      }
+      write_be(0, 1);
+      write_be(levels, 4);
+      serialised.resize(size, 0);
+
+      tree = mt_deserialize(serialised.data(), serialised.size());
+      if (tree == nullptr)
+        throw std::logic_error("Tree could not be rebuilt from frontier");
+    }
+
     ~MerkleTreeHistory()
     {
       mt_free(tree);
@@ -331,6 +549,58 @@ namespace ccf
       return r.verify(tree);
     }
 
+    uint64_t get_size() const
+    {
+      return tree->offset + tree->j;
+    }
+
+    // First leaf that has not been flushed, and so has a receipt
+    uint64_t get_first_index() const
+    {
+      return tree->offset + tree->i;
+    }
+
+    // Peaks are the last hash at each level where the number of leaves has a
+    // bit set, and are never flushed
+    MerkleFrontier get_frontier() const
+    {
+      std::vector<crypto::Sha256Hash> peaks;
+      for (uint32_t lv = tree->hs.sz; lv-- > 0;)
+      {
+        const auto j = tree->j >> lv;
+        if (j % 2 == 1)
+        {
+          const auto& level = tree->hs.vs[lv];
+          const auto pos = j - 1 - offset_of(tree->i >> lv);
+          crypto::Sha256Hash h;
+          std::copy(level.vs[pos], level.vs[pos] + h.SIZE, h.h);
+          peaks.push_back(h);
+        }
+      }
+      return {get_size(), std::move(peaks)};
+    }
+
+    // Leaves from index to the end of the tree, concatenated. Leaves that
+    // have been flushed are skipped.
+    std::vector<uint8_t> get_leaves_from(uint64_t index) const
+    {
+      const auto& leaves = tree->hs.vs[0];
+      const uint64_t first = tree->offset + offset_of(tree->i);
+      const uint64_t end = tree->offset + tree->j;
+      index = std::max(index, first);
+      if (index >= end)
+        return {};
+
+      std::vector<uint8_t> v((end - index) * crypto::Sha256Hash::SIZE);
+      uint8_t* buf = v.data();
+      for (auto i = index; i < end; ++i, buf += crypto::Sha256Hash::SIZE)
+      {
+        const auto leaf = leaves.vs[i - first];
+        std::copy(leaf, leaf + crypto::Sha256Hash::SIZE, buf);
+      }
+      return v;
+    }
+
     std::vector<uint8_t> serialise()
     {
       LOG_TRACE_FMT("mt_serialize_size {}", mt_serialize_size(tree));
@@ -338,10 +608,406 @@ namespace ccf
       mt_serialize(tree, output.data(), output.capacity());
       return output;
     }
+
+    // The tree as it was when index was its last leaf
+    std::vector<uint8_t> serialise(uint64_t index)
+    {
+      MerkleTreeHistory retracted(serialise());
+      retracted.retract(index);
+      return retracted.serialise();
+    }
+
+    void deserialise(const std::vector<uint8_t>& serialised)
+    {
+      mt_free(tree);
+      tree = mt_deserialize(serialised.data(), serialised.size());
+    }
+  };
+
+  /** Receipts for transactions whose leaves have been flushed from the
+   * in-memory tree.
+   *
+   * The first signature after a transaction is read back from the ledger,
+   * followed by the signature its delta starts from. The frontier of the
+   * earlier signature and the leaves in the later one's delta are enough to
+   * rebuild the part of the tree that the receipt's path goes through. The
+   * rebuilt root is checked against the later signature, so that the host
+   * cannot forge receipts.
+   *
+   * Entries are read asynchronously: get_receipt() returns nothing until the
+   * receipt has been produced. Requests the host does not answer in time are
+   * sent again, a few times, before the receipt fails. Only the most recently
+   * requested receipts, and the most recent failures, are cached, so memory
+   * use does not grow with the ledger.
+   */
+  class HistoricalReceipts
+  {
+  public:
+    static constexpr size_t default_max_cached = 1000;
+    static constexpr size_t default_max_fetches = 10;
+    static constexpr size_t default_read_batch = 100;
+    static constexpr std::chrono::milliseconds default_fetch_timeout{1000};
+
+    // Times a request for ledger entries is sent again before giving up
+    static constexpr size_t max_retries = 3;
+    // Failures are reported to the next get_receipt() for their version, if
+    // there is one within this time
+    static constexpr std::chrono::milliseconds failure_expiry{60'000};
+
+  private:
+    struct Fetch
+    {
+      // Next ledger entry expected, and the last one requested
+      consensus::Index next = 0;
+      consensus::Index requested = 0;
+      // First signature after the transaction, once it has been read
+      std::optional<Signature> covering = std::nullopt;
+      // When the last request was sent, and how many times it was sent again
+      std::chrono::milliseconds requested_at{0};
+      size_t retries = 0;
+    };
+
+    // Most recently used first
+    using Receipts = std::list<std::pair<kv::Version, std::vector<uint8_t>>>;
+
+    struct Failure
+    {
+      kv::Version version;
+      std::string reason;
+      std::chrono::milliseconds failed_at;
+    };
+
+    // Most recent first
+    using Failures = std::list<Failure>;
+
+    Store& store;
+    Nodes& nodes;
+    ringbuffer::WriterPtr to_host;
+    const size_t max_cached;
+    const size_t max_fetches;
+    const size_t read_batch;
+    const std::chrono::milliseconds fetch_timeout;
+
+    SpinLock lock;
+    // Time elapsed, as told by tick()
+    std::chrono::milliseconds now{0};
+    std::map<kv::Version, Fetch> fetches;
+    Failures failures;
+    std::unordered_map<kv::Version, Failures::iterator> failures_index;
+    Receipts receipts;
+    std::unordered_map<kv::Version, Receipts::iterator> receipts_index;
+
+    // Signature transactions only write to the signatures map, which is
+    // public, so other transactions are recognised from their first map
+    std::optional<Signature> get_signature(const std::vector<uint8_t>& entry)
+    {
+      try
+      {
+        StoreDeserialiser d(store.get_encryptor(), kv::SecurityDomain::PUBLIC);
+        if (!d.init(entry.data(), entry.size()))
+          return std::nullopt;
+
+        d.deserialise_version<kv::Version>();
+        auto map = d.start_map();
+        if (!map.has_value() || map.value() != Tables::SIGNATURES)
+          return std::nullopt;
+
+        d.deserialise_read_version<kv::Version>();
+        for (auto reads = d.deserialise_read_header(); reads > 0; --reads)
+          d.deserialise_read<ObjectId>();
+        if (d.deserialise_write_header() == 0)
+          return std::nullopt;
+        return std::get<1>(d.deserialise_write<ObjectId, Signature>());
+      }
+      catch (const std::exception& e)
+      {
+        LOG_FAIL_FMT("Could not read ledger entry: {}", e.what());
+        return std::nullopt;
+      }
+    }
+
+    void request_entries(Fetch& fetch, consensus::Index last)
+    {
+      fetch.requested = std::min<consensus::Index>(
+        fetch.next + read_batch - 1, last);
+      fetch.requested_at = now;
+      fetch.retries = 0;
+      RINGBUFFER_WRITE_MESSAGE(
+        consensus::ledger_get_historical,
+        to_host,
+        fetch.next,
+        fetch.requested);
+    }
+
+    bool fail(kv::Version version, const std::string& reason)
+    {
+      LOG_FAIL_FMT("Historical receipt for {}: {}", version, reason);
+
+      auto previous = failures_index.find(version);
+      if (previous != failures_index.end())
+        failures.erase(previous->second);
+
+      failures.push_front({version, reason, now});
+      failures_index[version] = failures.begin();
+      if (failures.size() > max_cached)
+      {
+        failures_index.erase(failures.back().version);
+        failures.pop_back();
+      }
+      return true;
+    }
+
+    bool complete(
+      kv::Version version, const Fetch& fetch, const MerkleFrontier& frontier)
+    {
+      const auto& sig = fetch.covering.value();
+      const MerkleFrontier signed_frontier(sig.frontier);
+      const auto delta_leaves = sig.delta.size() / crypto::Sha256Hash::SIZE;
+      const auto skip =
+        delta_leaves - (signed_frontier.get_size() - frontier.get_size());
+
+      MerkleTreeHistory tree(
+        frontier,
+        sig.delta.data() + skip * crypto::Sha256Hash::SIZE,
+        delta_leaves - skip);
+      const auto root = tree.get_root();
+      if (root != signed_frontier.get_root())
+        return fail(version, "ledger entries do not match signature");
+
+      Store::Tx tx;
+      auto ni = tx.get_view(nodes)->get(sig.node);
+      if (
+        !ni.has_value() ||
+        !tls::make_verifier(ni->cert)->verify_hash(
+          root.h, root.SIZE, sig.sig.data(), sig.sig.size()))
+        return fail(version, "signature could not be verified");
+
+      receipts.emplace_front(version, tree.get_receipt(version).to_v());
+      receipts_index[version] = receipts.begin();
+      if (receipts.size() > max_cached)
+      {
+        receipts_index.erase(receipts.back().first);
+        receipts.pop_back();
+      }
+
+      LOG_DEBUG_FMT("Historical receipt for {} is ready", version);
+      return true;
+    }
+
+    // Returns true once the fetch is over
+    bool process_entries(
+      kv::Version version,
+      Fetch& fetch,
+      const std::vector<uint8_t>& framed_entries)
+    {
+      auto data = framed_entries.data();
+      auto size = framed_entries.size();
+      while (size > 0)
+      {
+        const auto entry_size = serialized::read<uint32_t>(data, size);
+        const auto entry = serialized::read(data, size, entry_size);
+        const auto idx = fetch.next++;
+
+        auto sig = get_signature(entry);
+        if (!fetch.covering.has_value())
+        {
+          if (!sig.has_value())
+            continue;
+
+          // The delta covers the leaves since the signature it starts from,
+          // unless they had been flushed
+          const MerkleFrontier signed_frontier(sig->frontier);
+          const auto delta_leaves =
+            sig->delta.size() / crypto::Sha256Hash::SIZE;
+          if (
+            signed_frontier.get_size() <= version ||
+            signed_frontier.get_size() < delta_leaves)
+            return fail(version, "signature is malformed");
+          const auto start = signed_frontier.get_size() - delta_leaves;
+          if (start > version)
+            return fail(version, "leaf is not in the signature's delta");
+
+          fetch.covering = std::move(sig);
+          if (start == 0)
+            return complete(version, fetch, MerkleFrontier());
+
+          fetch.next = start;
+          request_entries(fetch, version);
+          return false;
+        }
+
+        if (sig.has_value())
+        {
+          const MerkleFrontier frontier(sig->frontier);
+          if (frontier.get_size() != idx)
+            return fail(version, "signature frontier is malformed");
+          return complete(version, fetch, frontier);
+        }
+
+        if (idx >= version)
+          return fail(version, "delta does not start from a signature");
+      }
+
+      if (fetch.next > fetch.requested)
+      {
+        request_entries(
+          fetch,
+          fetch.covering.has_value() ? version :
+                                       std::numeric_limits<kv::Version>::max());
+      }
+      return false;
+    }
+
+  public:
+    HistoricalReceipts(
+      Store& store,
+      Nodes& nodes,
+      ringbuffer::WriterPtr to_host,
+      size_t max_cached = default_max_cached,
+      size_t max_fetches = default_max_fetches,
+      size_t read_batch = default_read_batch,
+      std::chrono::milliseconds fetch_timeout = default_fetch_timeout) :
+      store(store),
+      nodes(nodes),
+      to_host(to_host),
+      max_cached(max_cached),
+      max_fetches(max_fetches),
+      read_batch(std::max<size_t>(read_batch, 1)),
+      fetch_timeout(fetch_timeout)
+    {}
+
+    /** Get the receipt for a committed transaction, or start reading the
+     * ledger entries it is produced from.
+     *
+     * @param version Version of the transaction
+     *
+     * @return The receipt, or nothing if it is not ready yet and should be
+     * asked for again later
+     *
+     * @throw std::logic_error if the receipt could not be produced
+     */
+    std::optional<std::vector<uint8_t>> get_receipt(kv::Version version)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      auto cached = receipts_index.find(version);
+      if (cached != receipts_index.end())
+      {
+        receipts.splice(receipts.begin(), receipts, cached->second);
+        return cached->second->second;
+      }
+
+      auto failed = failures_index.find(version);
+      if (failed != failures_index.end())
+      {
+        const auto reason = failed->second->reason;
+        failures.erase(failed->second);
+        failures_index.erase(failed);
+        throw std::logic_error(reason);
+      }
+
+      if (fetches.find(version) == fetches.end())
+      {
+        if (fetches.size() >= max_fetches)
+          throw std::logic_error("Too many receipts are being read");
+
+        auto& fetch = fetches[version];
+        fetch.next = version + 1;
+        request_entries(fetch, std::numeric_limits<kv::Version>::max());
+      }
+
+      return std::nullopt;
+    }
+
+    void recv_entries(
+      consensus::Index from, const std::vector<uint8_t>& framed_entries)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      for (auto it = fetches.begin(); it != fetches.end();)
+      {
+        if (
+          it->second.next == from &&
+          process_entries(it->first, it->second, framed_entries))
+          it = fetches.erase(it);
+        else
+          ++it;
+      }
+    }
+
+    /** Send again the requests the host has not answered in time, or fail
+     * their receipts once they have been sent too many times, and forget old
+     * failures.
+     *
+     * @param elapsed Time since the last call
+     */
+    void tick(std::chrono::milliseconds elapsed)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      now += elapsed;
+
+      for (auto it = fetches.begin(); it != fetches.end();)
+      {
+        auto& fetch = it->second;
+        if (now - fetch.requested_at < fetch_timeout)
+        {
+          ++it;
+          continue;
+        }
+
+        if (fetch.retries >= max_retries)
+        {
+          fail(
+            it->first,
+            fmt::format(
+              "ledger entries from {} were not received", fetch.next));
+          it = fetches.erase(it);
+          continue;
+        }
+
+        LOG_DEBUG_FMT(
+          "Requesting ledger entries {} to {} again for historical receipt "
+          "for {}",
+          fetch.next,
+          fetch.requested,
+          it->first);
+        fetch.requested_at = now;
+        ++fetch.retries;
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_get_historical,
+          to_host,
+          fetch.next,
+          fetch.requested);
+        ++it;
+      }
+
+      while (
+        !failures.empty() &&
+        now - failures.back().failed_at >= failure_expiry)
+      {
+        failures_index.erase(failures.back().version);
+        failures.pop_back();
+      }
+    }
+
+    void recv_no_entry(consensus::Index idx)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      for (auto it = fetches.begin(); it != fetches.end();)
+      {
+        if (
+          it->second.next == idx &&
+          fail(it->first, fmt::format("ledger entry {} is not available", idx)))
+          it = fetches.erase(it);
+        else
+          ++it;
+      }
+    }
   };
 
   template <class T>
-  class HashedTxHistory : public kv::TxHistory
+  class HashedTxHistory
+    : public kv::TxHistory,
+      public std::enable_shared_from_this<HashedTxHistory<T>>
   {
     Store& store;
     NodeId id;
@@ -353,12 +1019,48 @@ namespace ccf
 
     std::shared_ptr<kv::Consensus> consensus;
 
-    std::map<RequestID, std::vector<uint8_t>> requests;
-    std::map<RequestID, std::pair<kv::Version, crypto::Sha256Hash>> results;
-    std::map<RequestID, std::vector<uint8_t>> responses;
+    // Size of the tree when the last signature was emitted or verified, from
+    // which the next signature's delta starts
+    uint64_t last_signed_size = 0;
+
+    // A signature whose root has been taken at its version, and which is
+    // being signed on a worker thread. The signature transaction, and those
+    // after it, are only replicated once it is ready.
+    struct PendingSignature
+    {
+      Signature value;
+      crypto::Sha256Hash root;
+      bool started = false;
+      std::atomic<bool> ready{false};
+    };
+
+    struct SignMsg
+    {
+      std::shared_ptr<PendingSignature> pending;
+      std::weak_ptr<HashedTxHistory<T>> self;
+    };
+
+    static void sign_cb(std::unique_ptr<enclave::Tmsg<SignMsg>> msg)
+    {
+      // The history may have been replaced or destroyed, along with the
+      // signature transaction waiting for it, before the signature is signed
+      auto self = msg->data.self.lock();
+      if (self == nullptr)
+        return;
+
+      auto& pending = *msg->data.pending;
+
+      pending.value.sig = self->kp.sign_hash(pending.root.h, pending.root.SIZE);
+      pending.ready.store(true);
+
+      self->store.flush_pending();
+    }
+
     std::optional<ResultCallbackHandler> on_result;
     std::optional<ResponseCallbackHandler> on_response;
 
+    std::shared_ptr<HistoricalReceipts> historical_receipts;
+
   public:
     HashedTxHistory(
       Store& store_,
@@ -443,6 +1145,7 @@ namespace ccf
       tls::VerifierPtr from_cert = tls::make_verifier(ni.value().cert);
       crypto::Sha256Hash root = replicated_state_tree.get_root();
       log_hash(root, VERIFY);
+      last_signed_size = replicated_state_tree.get_size();
       return from_cert->verify_hash(
         root.h, root.SIZE, sig_value.sig.data(), sig_value.sig.size());
     }
@@ -450,6 +1153,10 @@ namespace ccf
     void rollback(kv::Version v) override
     {
       replicated_state_tree.retract(v);
+      // The last signature may have been rolled back, so the next delta
+      // starts from the first leaf that has not been flushed
+      if (last_signed_size > v + 1)
+        last_signed_size = 0;
       log_hash(replicated_state_tree.get_root(), ROLLBACK);
     }
 
@@ -475,20 +1182,56 @@ namespace ccf
       auto commit = consensus->get_commit_seqno();
       LOG_DEBUG_FMT("Issuing signature at {}", version);
       LOG_DEBUG_FMT("Signed at {} view: {} commit: {}", version, view, commit);
+      auto pending = std::make_shared<PendingSignature>();
+      // The history is kept alive until the signature transaction is
+      // committed, even if it is replaced in the store before then
       store.commit(
         version,
-        [version, view, commit, this]() {
+        [version, view, commit, pending, self = this->shared_from_this()]()
+          -> std::optional<kv::PendingTxInfo> {
+          // Called in order, once all transactions before the signature have
+          // been appended to the tree
+          if (!pending->started)
+          {
+            pending->started = true;
+            auto& tree = self->replicated_state_tree;
+            pending->root = tree.get_root();
+            auto frontier = tree.get_frontier();
+            pending->value = Signature(
+              self->id,
+              version,
+              view,
+              commit,
+              {},
+              frontier.serialise(),
+              tree.get_leaves_from(self->last_signed_size));
+            self->last_signed_size = frontier.get_size();
+
+            // Signing is slow enough that it is done on the last worker
+            // thread, rather than by the transaction that happened to
+            // replicate the signature
+            if (enclave::ThreadMessaging::thread_count > 1)
+            {
+              auto msg = std::make_unique<enclave::Tmsg<SignMsg>>(&sign_cb);
+              msg->data.pending = pending;
+              msg->data.self = self;
+              enclave::ThreadMessaging::thread_messaging.add_task<SignMsg>(
+                enclave::ThreadMessaging::thread_count - 1, std::move(msg));
+            }
+            else
+            {
+              const auto& root = pending->root;
+              pending->value.sig = self->kp.sign_hash(root.h, root.SIZE);
+              pending->ready.store(true);
+            }
+          }
+
+          if (!pending->ready.load())
+            return std::nullopt;
+
           Store::Tx sig(version);
-          auto sig_view = sig.get_view(signatures);
-          crypto::Sha256Hash root = replicated_state_tree.get_root();
-          Signature sig_value(
-            id,
-            version,
-            view,
-            commit,
-            kp.sign_hash(root.h, root.SIZE),
-            replicated_state_tree.serialise());
-          sig_view->put(0, sig_value);
+          auto sig_view = sig.get_view(self->signatures);
+          sig_view->put(0, pending->value);
           return sig.commit_reserved();
         },
         true);
@@ -503,7 +1246,6 @@ namespace ccf
       const std::vector<uint8_t>& request) override
     {
       LOG_DEBUG_FMT("HISTORY: add_request {0}", id);
-      requests[id] = request;
 
       auto consensus = store.get_consensus();
       if (!consensus)
@@ -528,15 +1270,7 @@ namespace ccf
       size_t replicated_size) override
     {
       append(replicated, replicated_size);
-#ifdef PBFT
-      if (on_result.has_value())
-      {
-        auto root = get_replicated_state_root();
-        LOG_DEBUG_FMT("HISTORY: add_result {0} {1} {2}", id, version, root);
-        results[id] = {version, root};
-        on_result.value()({id, version, root});
-      }
-#endif
+      add_result(id, version);
     }
 
     void add_result(kv::TxHistory::RequestID id, kv::Version version) override
@@ -546,7 +1280,6 @@ namespace ccf
       {
         auto root = get_replicated_state_root();
         LOG_DEBUG_FMT("HISTORY: add_result {0} {1} {2}", id, version, root);
-        results[id] = {version, root};
         on_result.value()({id, version, root});
       }
 #endif
@@ -557,11 +1290,21 @@ namespace ccf
       const std::vector<uint8_t>& response) override
     {
       LOG_DEBUG_FMT("HISTORY: add_response {0}", id);
-      responses[id] = response;
     }
 
-    std::vector<uint8_t> get_receipt(kv::Version index) override
+    void set_historical_receipts(std::shared_ptr<HistoricalReceipts> h)
     {
+      historical_receipts = h;
+    }
+
+    std::optional<std::vector<uint8_t>> get_receipt(
+      kv::Version index) override
+    {
+      if (
+        historical_receipts != nullptr &&
+        index < replicated_state_tree.get_first_index())
+        return historical_receipts->get_receipt(index);
+
       return replicated_state_tree.get_receipt(index).to_v();
     }
 
@@ -570,6 +1313,64 @@ namespace ccf
       auto r = Receipt::from_v(v);
       return replicated_state_tree.verify(r);
     }
+
+    std::vector<uint8_t> serialise_tree(kv::Version v) override
+    {
+      return replicated_state_tree.serialise(v);
+    }
+
+    void deserialise_tree(const std::vector<uint8_t>& tree) override
+    {
+      replicated_state_tree.deserialise(tree);
+      // Snapshots are taken at a signature. As when the signature was
+      // emitted, the next delta starts with the signature transaction.
+      last_signed_size = replicated_state_tree.get_size() - 1;
+      log_hash(replicated_state_tree.get_root(), DESERIALISE);
+    }
+
+    // The signature and the signer's cert are read from the restored maps.
+    // This only authenticates the tree if the maps have been authenticated,
+    // by decrypting the snapshot with the ledger secrets.
+    bool verify_snapshot(kv::Term* term = nullptr) override
+    {
+      Store::Tx tx;
+      auto [sig_tv, ni_tv] = tx.get_view(signatures, nodes);
+      auto sig = sig_tv->get(0);
+      if (!sig.has_value())
+      {
+        LOG_FAIL_FMT("No signature found in snapshot");
+        return false;
+      }
+      auto sig_value = sig.value();
+      if (term)
+        *term = sig_value.term;
+
+      if (replicated_state_tree.get_size() != sig_value.index + 1)
+      {
+        LOG_FAIL_FMT(
+          "Snapshot tree of size {} does not end with signature at {}",
+          replicated_state_tree.get_size(),
+          sig_value.index);
+        return false;
+      }
+
+      auto ni = ni_tv->get(sig_value.node);
+      if (!ni.has_value())
+      {
+        LOG_FAIL_FMT(
+          "No node info, and therefore no cert for node {}", sig_value.node);
+        return false;
+      }
+
+      // The signature was taken over the tree before the signature
+      // transaction's own leaf was appended
+      T signed_tree(replicated_state_tree.serialise(sig_value.index - 1));
+      crypto::Sha256Hash root = signed_tree.get_root();
+      log_hash(root, VERIFY);
+      tls::VerifierPtr from_cert = tls::make_verifier(ni.value().cert);
+      return from_cert->verify_hash(
+        root.h, root.SIZE, sig_value.sig.data(), sig_value.sig.size());
+    }
   };
 
   using MerkleTxHistory = HashedTxHistory<MerkleTreeHistory>;
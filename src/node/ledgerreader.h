@@ -0,0 +1,78 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "consensus/ledgerenclavetypes.h"
+
+#include <algorithm>
+
+namespace ccf
+{
+  /** Requests the ledger from the host, when it is read during recovery.
+   *
+   * Entries are requested in batches, up to read_ahead entries ahead of the
+   * last one read. The host replies to each request, in order, so only a
+   * reply starting at the entry following the last one read is expected.
+   * Replies to requests past the end of the ledger are not.
+   */
+  class LedgerReader
+  {
+  private:
+    ringbuffer::WriterPtr to_host;
+    size_t batch = 1;
+    size_t read_ahead = 1;
+    consensus::Index idx = 0;
+    consensus::Index requested_idx = 0;
+
+  public:
+    LedgerReader(const ringbuffer::WriterPtr& to_host_) : to_host(to_host_) {}
+
+    /** Start reading the ledger
+     *
+     * @param last_idx Index of the last entry already present, from which
+     * reading continues
+     * @param batch_ Number of entries requested at once
+     * @param read_ahead_ Number of entries requested ahead of the last one
+     * read
+     */
+    void start(consensus::Index last_idx, size_t batch_, size_t read_ahead_)
+    {
+      batch = std::max<size_t>(batch_, 1);
+      read_ahead = std::max<size_t>(read_ahead_, batch);
+      idx = last_idx;
+      requested_idx = last_idx;
+      request_entries();
+    }
+
+    // Keeps enough entries requested for the host to read ahead of the entry
+    // being deserialised
+    void request_entries()
+    {
+      while (requested_idx < idx + read_ahead)
+      {
+        RINGBUFFER_WRITE_MESSAGE(
+          consensus::ledger_get,
+          to_host,
+          requested_idx + 1,
+          requested_idx + batch);
+        requested_idx += batch;
+      }
+    }
+
+    bool is_expected(consensus::Index from) const
+    {
+      return from == idx + 1;
+    }
+
+    // Records that the next entry has been read, and returns its index
+    consensus::Index advance()
+    {
+      return ++idx;
+    }
+
+    consensus::Index get_idx() const
+    {
+      return idx;
+    }
+  };
+}
@@ -12,6 +12,7 @@
 #include "entities.h"
 #include "genesisgen.h"
 #include "history.h"
+#include "ledgerreader.h"
 #include "networkstate.h"
 #include "nodetonode.h"
 #include "notifier.h"
@@ -182,6 +183,7 @@ namespace ccf
     Timers& timers;
 
     std::shared_ptr<kv::TxHistory> history;
+    std::shared_ptr<HistoricalReceipts> historical_receipts;
     std::shared_ptr<kv::AbstractTxEncryptor> encryptor;
 
     std::shared_ptr<Seal> seal;
@@ -204,7 +206,16 @@ namespace ccf
     std::vector<kv::Version> term_history;
     kv::Version last_recovered_commit_idx = 1;
 
-    consensus::Index ledger_idx = 0;
+    // Snapshot the host found alongside the ledger at startup, if any. The
+    // ledger is read from the entry following it
+    std::vector<uint8_t> startup_snapshot;
+    kv::Version snapshot_idx = 0;
+
+    // Ledger entries are requested from the host in batches, up to
+    // ledger_read_ahead entries ahead of the last one deserialised
+    CCFConfig::Recovery recovery_config;
+    LedgerReader ledger_reader;
+    std::chrono::milliseconds ledger_read_time{0};
 
   public:
     NodeState(
@@ -223,7 +234,8 @@ namespace ccf
       rpcsessions(rpcsessions),
       notifier(notifier),
       timers(timers),
-      seal(std::make_shared<Seal>(writer_factory))
+      seal(std::make_shared<Seal>(writer_factory)),
+      ledger_reader(to_host)
     {
       ::EverCrypt_AutoConfig2_init();
     }
@@ -256,6 +268,8 @@ namespace ccf
       std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::initialized);
 
+      recovery_config = args.config.recovery;
+      startup_snapshot = args.config.snapshot;
       create_node_cert(args.config);
       open_node_frontend();
 
@@ -330,6 +344,11 @@ namespace ccf
           setup_history();
           setup_encryptor();
 
+          if (!startup_snapshot.empty())
+          {
+            recover_public_snapshot_unsafe();
+          }
+
           // Accept members connections for members to finish recovery once the
           // public ledger has been read
           open_member_frontend();
@@ -406,6 +425,11 @@ namespace ccf
             setup_history();
             setup_encryptor();
 
+            if (!startup_snapshot.empty())
+            {
+              join_from_snapshot_unsafe(resp->public_only);
+            }
+
             open_member_frontend();
 
             accept_network_tls_connections(args.config);
@@ -495,14 +519,13 @@ namespace ccf
       std::lock_guard<SpinLock> guard(lock);
       sm.expect(State::readingPublicLedger);
       LOG_INFO_FMT("Start public recovery");
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger_unsafe();
     }
 
-    void recover_public_ledger_entry(const std::vector<uint8_t>& ledger_entry)
+    // Returns false if reading the public ledger has ended
+    bool recover_public_ledger_entry_unsafe(
+      const std::vector<uint8_t>& ledger_entry)
     {
-      std::lock_guard<SpinLock> guard(lock);
-      sm.expect(State::readingPublicLedger);
-
       LOG_DEBUG_FMT(
         "Deserialising public ledger entry ({})", ledger_entry.size());
 
@@ -511,27 +534,29 @@ namespace ccf
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in public ledger");
-        network.tables->rollback(ledger_idx - 1);
+        network.tables->rollback(ledger_reader.get_idx() - 1);
         recover_public_ledger_end_unsafe();
-        return;
+        return false;
       }
 
       // If the ledger entry is a signature, it is safe to compact the store
       if (result == kv::DeserialiseSuccess::PASS_SIGNATURE)
       {
-        network.tables->compact(ledger_idx);
+        network.tables->compact(ledger_reader.get_idx());
         Store::Tx tx;
         GenesisGenerator g(network, tx);
         auto last_sig = g.get_last_signature();
         if (last_sig.has_value())
         {
           LOG_DEBUG_FMT(
-            "Read signature at {} for term {}", ledger_idx, last_sig->term);
+            "Read signature at {} for term {}",
+            ledger_reader.get_idx(),
+            last_sig->term);
           for (auto i = term_history.size(); i <= last_sig->term; ++i)
           {
             term_history.push_back(last_recovered_commit_idx + 1);
           }
-          last_recovered_commit_idx = ledger_idx;
+          last_recovered_commit_idx = ledger_reader.get_idx();
         }
         else
         {
@@ -539,12 +564,13 @@ namespace ccf
         }
       }
 
-      read_ledger_idx(++ledger_idx);
+      return true;
     }
 
     void recover_public_ledger_end_unsafe()
     {
       sm.expect(State::readingPublicLedger);
+      log_ledger_read_unsafe("public");
 
       // When reaching the end of the public ledger, truncate to last signed
       // index and promote network secrets to this index
@@ -632,12 +658,11 @@ namespace ccf
     //
     // funcs in state "readingPrivateLedger"
     //
-    void recover_private_ledger_entry(const std::vector<uint8_t>& ledger_entry)
+    // Returns false if reading the private ledger has ended
+    bool recover_private_ledger_entry_unsafe(
+      const std::vector<uint8_t>& ledger_entry)
     {
-      std::lock_guard<SpinLock> guard(lock);
-      sm.expect(State::readingPrivateLedger);
-
-      LOG_INFO_FMT(
+      LOG_DEBUG_FMT(
         "Deserialising private ledger entry ({})", ledger_entry.size());
 
       // When reading the private ledger, deserialise in the recovery store
@@ -645,28 +670,28 @@ namespace ccf
       if (result == kv::DeserialiseSuccess::FAILED)
       {
         LOG_FAIL_FMT("Failed to deserialise entry in private ledger");
-        recovery_store->rollback(ledger_idx - 1);
+        recovery_store->rollback(ledger_reader.get_idx() - 1);
         recover_private_ledger_end_unsafe();
-        return;
+        return false;
       }
 
       if (result == kv::DeserialiseSuccess::PASS_SIGNATURE)
-        recovery_store->compact(ledger_idx);
+        recovery_store->compact(ledger_reader.get_idx());
 
       if (recovery_store->current_version() == recovery_v)
       {
         LOG_INFO_FMT("Reached recovery final version at {}", recovery_v);
         recover_private_ledger_end_unsafe();
+        return false;
       }
-      else
-      {
-        read_ledger_idx(++ledger_idx);
-      }
+
+      return true;
     }
 
     void recover_private_ledger_end_unsafe()
     {
       sm.expect(State::readingPrivateLedger);
+      log_ledger_read_unsafe("private");
 
       // When reaching the end of the private ledger, make sure the same
       // ledger has been read and swap in private state
@@ -715,24 +740,82 @@ namespace ccf
     //
     // funcs in state "readingPublicLedger" or "readingPrivateLedger"
     //
-    void recover_ledger_end()
+    void recover_ledger_entries(
+      consensus::Index from, const std::vector<uint8_t>& framed_entries)
     {
       std::lock_guard<SpinLock> guard(lock);
 
+      // Entries requested ahead of the end of the ledger, or of the last
+      // entry needed, may still arrive once reading has ended
+      if (!is_expected_ledger_read_unsafe(from))
+      {
+        LOG_DEBUG_FMT("Ignoring ledger entries from {}", from);
+        return;
+      }
+
+      auto data = framed_entries.data();
+      auto size = framed_entries.size();
+      while (size > 0)
+      {
+        const auto entry_size = serialized::read<uint32_t>(data, size);
+        const auto entry = serialized::read(data, size, entry_size);
+        ledger_reader.advance();
+
+        const bool more = is_reading_public_ledger() ?
+          recover_public_ledger_entry_unsafe(entry) :
+          recover_private_ledger_entry_unsafe(entry);
+        if (!more)
+        {
+          return;
+        }
+      }
+
+      ledger_reader.request_entries();
+    }
+
+    void recover_ledger_end(consensus::Index idx)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+
+      if (!is_expected_ledger_read_unsafe(idx))
+      {
+        LOG_DEBUG_FMT("Ignoring end of ledger at {}", idx);
+        return;
+      }
+
       if (is_reading_public_ledger())
       {
         recover_public_ledger_end_unsafe();
       }
-      else if (is_reading_private_ledger())
+      else
       {
         recover_private_ledger_end_unsafe();
       }
-      else
+    }
+
+    void recv_historical_entries(
+      consensus::Index from, const std::vector<uint8_t>& framed_entries)
+    {
+      std::shared_ptr<HistoricalReceipts> h;
       {
-        throw std::logic_error(
-          "Cannot end ledger recovery if not reading public or private "
-          "ledger");
+        std::lock_guard<SpinLock> guard(lock);
+        h = historical_receipts;
       }
+
+      if (h != nullptr)
+        h->recv_entries(from, framed_entries);
+    }
+
+    void recv_historical_no_entry(consensus::Index idx)
+    {
+      std::shared_ptr<HistoricalReceipts> h;
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        h = historical_receipts;
+      }
+
+      if (h != nullptr)
+        h->recv_no_entry(idx);
     }
 
     //
@@ -767,6 +850,13 @@ namespace ccf
       recovery_store->set_history(recovery_history);
       recovery_store->set_encryptor(recovery_encryptor);
 
+      // The private ledger is read from the snapshot onwards, so all domains
+      // of the snapshot are restored first
+      if (!startup_snapshot.empty())
+      {
+        install_snapshot_unsafe(*recovery_store, false);
+      }
+
       // Record real store version and root
       recovery_v = network.tables->current_version();
       auto h = dynamic_cast<MerkleTxHistory*>(history.get());
@@ -810,8 +900,7 @@ namespace ccf
       setup_private_recovery_store();
 
       // Start reading private security domain of ledger
-      ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger_unsafe();
 
       sm.advance(State::readingPrivateLedger);
       return true;
@@ -822,12 +911,28 @@ namespace ccf
     //
     void tick(std::chrono::milliseconds elapsed)
     {
+      if (is_reading_public_ledger() || is_reading_private_ledger())
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        ledger_read_time += elapsed;
+        return;
+      }
+
       if (
         !sm.check(State::partOfNetwork) &&
         !sm.check(State::partOfPublicNetwork))
         return;
 
       consensus->periodic(elapsed);
+
+      std::shared_ptr<HistoricalReceipts> h;
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        h = historical_receipts;
+      }
+
+      if (h != nullptr)
+        h->tick(elapsed);
     }
 
     void node_msg(const std::vector<uint8_t>& data)
@@ -1232,8 +1337,7 @@ namespace ccf
       consensus->suspend_replication(recovery_v + 1);
 
       // Start reading private security domain of ledger
-      ledger_idx = 0;
-      read_ledger_idx(++ledger_idx);
+      start_reading_ledger_unsafe();
 
       sm.advance(State::readingPrivateLedger);
     }
@@ -1360,7 +1464,9 @@ namespace ccf
         self,
         std::chrono::milliseconds(raft_config.request_timeout),
         std::chrono::milliseconds(raft_config.election_timeout),
-        public_only);
+        public_only,
+        raft_config.append_entries_window,
+        raft_config.snapshot_interval);
 
       consensus = std::make_shared<RaftConsensusType>(std::move(raft));
 
@@ -1421,13 +1527,18 @@ namespace ccf
     {
       // This function can be called once the node has started up and before
       // it has joined the service.
-      history = std::make_shared<MerkleTxHistory>(
+      auto h = std::make_shared<MerkleTxHistory>(
         *network.tables.get(),
         self,
         *node_sign_kp,
         network.signatures,
         network.nodes);
 
+      historical_receipts = std::make_shared<HistoricalReceipts>(
+        *network.tables.get(), network.nodes, to_host);
+      h->set_historical_receipts(historical_receipts);
+
+      history = h;
       network.tables->set_history(history);
     }
 
@@ -1464,9 +1575,102 @@ namespace ccf
       }
     }
 
-    void read_ledger_idx(consensus::Index idx)
+    kv::Term install_snapshot_unsafe(Store& store, bool public_only)
+    {
+      if (
+        store.deserialise_snapshot(startup_snapshot, public_only) ==
+        kv::DeserialiseSuccess::FAILED)
+      {
+        throw std::logic_error("Snapshot could not be deserialised");
+      }
+
+      snapshot_idx = store.current_version();
+
+      // The snapshot comes from the host. Unless only its public domain is
+      // deserialised, it has been decrypted with the ledger secrets, which
+      // come from the network when joining and from the members when
+      // recovering, so that its maps, including the nodes and signatures
+      // tables, are authenticated. Snapshots are only taken at signature
+      // indices, and the last signature is verified against the history tree,
+      // which is not encrypted, to authenticate it as well.
+      auto sig = store.get<Signatures>(Tables::SIGNATURES);
+      Store::Tx tx;
+      auto last_sig = tx.get_view(*sig)->get(0);
+      if (!last_sig.has_value() || last_sig->index != snapshot_idx)
+      {
+        throw std::logic_error(fmt::format(
+          "Snapshot at {} does not end with a signature", snapshot_idx));
+      }
+
+      auto h = store.get_history();
+      if (h == nullptr || !h->verify_snapshot())
+      {
+        throw std::logic_error(fmt::format(
+          "Signature of snapshot at {} could not be verified", snapshot_idx));
+      }
+
+      LOG_INFO_FMT(
+        "Restored snapshot at {} for term {}", snapshot_idx, last_sig->term);
+      return last_sig->term;
+    }
+
+    void recover_public_snapshot_unsafe()
     {
-      RINGBUFFER_WRITE_MESSAGE(consensus::ledger_get, to_host, idx);
+      // As for the public ledger, the public domain of the snapshot is not
+      // authenticated until the private ledger is recovered. The snapshot is
+      // then installed again, decrypted with the recovered ledger secrets, and
+      // the resulting root must match that of the public store.
+      auto term = install_snapshot_unsafe(*network.tables, true);
+
+      // Entries up to the snapshot are not replayed, so all terms up to that
+      // of the snapshot are recorded as starting at it
+      for (auto i = term_history.size(); i <= term; ++i)
+      {
+        term_history.push_back(snapshot_idx);
+      }
+      last_recovered_commit_idx = snapshot_idx;
+    }
+
+    void join_from_snapshot_unsafe(bool public_only)
+    {
+      // While the network is only public, the ledger secrets that encrypted
+      // the snapshot are not known, so it could not be authenticated
+      if (public_only)
+      {
+        throw std::logic_error(
+          "Cannot join a network that has not recovered its private ledger "
+          "from a snapshot");
+      }
+
+      auto term = install_snapshot_unsafe(*network.tables, false);
+      consensus->init_as_backup(snapshot_idx, term);
+    }
+
+    void start_reading_ledger_unsafe()
+    {
+      ledger_read_time = std::chrono::milliseconds(0);
+      ledger_reader.start(
+        snapshot_idx,
+        recovery_config.ledger_read_batch,
+        recovery_config.ledger_read_ahead);
+    }
+
+    bool is_expected_ledger_read_unsafe(consensus::Index from)
+    {
+      return (is_reading_public_ledger() || is_reading_private_ledger()) &&
+        ledger_reader.is_expected(from);
+    }
+
+    void log_ledger_read_unsafe(const char* domain)
+    {
+      const auto ms = ledger_read_time.count();
+      const auto read = ledger_reader.get_idx();
+      LOG_INFO_FMT(
+        "Read {} entries of {} ledger in {}ms ({:.1f}s per million entries)",
+        read,
+        domain,
+        ms,
+        read == 0 ? 0.0 : (ms * 1000.0) / read);
     }
 
     void ledger_truncate(consensus::Index idx)
@@ -36,10 +36,27 @@ namespace ccf
       nlohmann::json buckets = {};
     };
 
+    // Latencies, in nanoseconds, of each stage of processing requests, or of
+    // whole requests for a method
+    struct LatencyResults
+    {
+      size_t count = {};
+      uint64_t low = {};
+      uint64_t high = {};
+      uint64_t p50 = {};
+      uint64_t p90 = {};
+      uint64_t p99 = {};
+      nlohmann::json buckets = {};
+    };
+
     struct Out
     {
       HistogramResults histogram;
       nlohmann::json tx_rates;
+      // LatencyResults for each stage, by stage name
+      nlohmann::json stages;
+      // LatencyResults for each method, by method name
+      nlohmann::json methods;
     };
   };
 
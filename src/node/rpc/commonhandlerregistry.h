@@ -196,8 +196,18 @@ namespace ccf
           try
           {
             auto p = history->get_receipt(in.commit);
-            const GetReceipt::Out out{p};
+            if (!p.has_value())
+            {
+              // Receipts for old transactions are produced from the ledger
+              return make_error(
+                jsonrpc::CCFErrorCodes::RECEIPT_NOT_READY,
+                fmt::format(
+                  "Receipt for commit {} is being read from the ledger, try "
+                  "again later",
+                  in.commit));
+            }
 
+            const GetReceipt::Out out{p.value()};
             return make_success(out);
           }
           catch (const std::exception& e)
@@ -280,5 +290,22 @@ namespace ccf
 
       HandlerRegistry::tick(elapsed, tx_count);
     }
+
+    void record_latency(
+      const std::string& method, const metrics::StageTimes& times) override
+    {
+      // Latencies are only recorded for installed methods, so that requests
+      // for arbitrary methods cannot grow the metrics
+      if (handlers.find(method) != handlers.end())
+      {
+        metrics.record_latency(method, times);
+      }
+      else
+      {
+        metrics.record_latency(times);
+      }
+
+      HandlerRegistry::record_latency(method, times);
+    }
   };
 }
\ No newline at end of file
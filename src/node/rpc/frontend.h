@@ -12,7 +12,7 @@
 #include "node/nodes.h"
 #include "nodeinterface.h"
 #include "rpcexception.h"
-#include "tls/verifier.h"
+#include "tls/verifiercache.h"
 
 #include <fmt/format_header_only.h>
 #include <mutex>
@@ -38,7 +38,7 @@ namespace ccf
     }
 
   private:
-    std::map<CallerId, tls::VerifierPtr> verifiers;
+    tls::VerifierCache verifiers;
     SpinLock lock;
     bool is_open_ = false;
 
@@ -124,30 +124,24 @@ namespace ccf
       }
     }
 
-    bool verify_client_signature(
-      const std::vector<uint8_t>& caller,
-      const CallerId caller_id,
-      const SignedReq& signed_request)
+    bool verify_client_signature(std::shared_ptr<enclave::RpcContext> ctx)
     {
       if (!client_signatures)
       {
         return false;
       }
 
-      auto v = verifiers.find(caller_id);
-      if (v == verifiers.end())
+      if (ctx->signature_verified.has_value())
       {
-        std::vector<uint8_t> caller_cert(caller);
-        verifiers.emplace(
-          std::make_pair(caller_id, tls::make_verifier(caller_cert)));
-      }
-      if (!verifiers[caller_id]->verify(
-            signed_request.req, signed_request.sig, signed_request.md))
-      {
-        return false;
+        return ctx->signature_verified.value();
       }
 
-      return true;
+      const auto& signed_request = ctx->signed_request.value();
+      return verifiers.verify(
+        ctx->session.caller_cert,
+        signed_request.req,
+        signed_request.sig,
+        signed_request.md);
     }
 
   public:
@@ -192,6 +186,30 @@ namespace ccf
       return is_open_;
     }
 
+    /** Verify the client signature of an RPC, recording the result in its
+     * context so that process() does not verify it again. Can be called from
+     * any thread.
+     *
+     * @param ctx Context for this RPC
+     */
+    void verify_signature_ahead(
+      std::shared_ptr<enclave::RpcContext> ctx) override
+    {
+      if (
+        client_signatures == nullptr || !ctx->signed_request.has_value() ||
+        ctx->is_create_request)
+      {
+        return;
+      }
+
+      metrics::StageTimer timer(ctx->stage_times, metrics::Stage::Verify);
+      ctx->signature_verified = verifiers.verify(
+        ctx->session.caller_cert,
+        ctx->signed_request->req,
+        ctx->signed_request->sig,
+        ctx->signed_request->md);
+    }
+
     /** Process a serialised command with the associated RPC context
      *
      * If an RPC that requires writing to the kv store is processed on a
@@ -228,12 +246,14 @@ namespace ccf
 
       if (ctx->signed_request.has_value())
       {
-        if (
-          !ctx->is_create_request &&
-          !verify_client_signature(
-            ctx->session.caller_cert,
-            caller_id.value(),
-            ctx->signed_request.value()))
+        bool verified = true;
+        if (!ctx->is_create_request)
+        {
+          metrics::StageTimer timer(ctx->stage_times, metrics::Stage::Verify);
+          verified = verify_client_signature(ctx);
+        }
+
+        if (!verified)
         {
           return ctx->error_response(
             jsonrpc::CCFErrorCodes::INVALID_CLIENT_SIGNATURE,
@@ -325,6 +345,11 @@ namespace ccf
       return ctx->session.caller_cert;
     }
 
+    void record_stage_times(const enclave::RpcContext& ctx) override
+    {
+      handlers.record_latency(ctx.method, ctx.stage_times);
+    }
+
     /** Process a serialised command with the associated RPC context via PBFT
      *
      * @param ctx Context for this RPC
@@ -416,6 +441,10 @@ namespace ccf
         throw std::logic_error("Forwarded RPC cannot be forwarded");
       }
 
+      // The forwarded RPC was received and is replied to by the backup, so
+      // its latency is recorded from when it reached this node
+      handlers.record_latency(ctx->method, ctx->stage_times);
+
       return rep.value();
     }
 
@@ -448,6 +477,31 @@ namespace ccf
             rpc_version.dump()));
       }
 
+      auto handler = handlers.find_handler(ctx->method);
+
+      // Handlers with typed params read them directly from msgpack requests,
+      // so they are only unpacked to JSON for other handlers
+      if (ctx->packed_params.has_value())
+      {
+        const auto type = ctx->packed_params->params.type;
+        if (
+          handler == nullptr || handler->packed_func == nullptr ||
+          (type != msgpack::type::MAP && type != msgpack::type::ARRAY))
+        {
+          try
+          {
+            metrics::StageTimer timer(ctx->stage_times, metrics::Stage::Unpack);
+            ctx->unpack_params();
+          }
+          catch (const std::exception& e)
+          {
+            return ctx->error_response(
+              jsonrpc::StandardErrorCodes::INVALID_REQUEST,
+              fmt::format("Exception during unpack: {}", e.what()));
+          }
+        }
+      }
+
       const auto params_it = ctx->unpacked_rpc.find(jsonrpc::PARAMS);
       if (
         params_it != ctx->unpacked_rpc.end() &&
@@ -464,7 +518,6 @@ namespace ccf
         nlohmann::json(nullptr) :
         *params_it;
 
-      auto handler = handlers.find_handler(ctx->method);
       if (handler == nullptr)
       {
         return ctx->error_response(
@@ -506,6 +559,17 @@ namespace ccf
       }
 #endif
 
+      if (handler->params_validator != nullptr && !params.is_null())
+      {
+        const auto validation_error =
+          handler->params_validator->validate(params);
+        if (validation_error.has_value())
+        {
+          return ctx->error_response(
+            jsonrpc::StandardErrorCodes::PARSE_ERROR, *validation_error);
+        }
+      }
+
       auto func = handler->func;
       auto args = RequestArgs{ctx, tx, caller_id, ctx->method, params};
 
@@ -515,14 +579,33 @@ namespace ccf
       {
         try
         {
-          func(args);
+          {
+            metrics::StageTimer timer(
+              ctx->stage_times, metrics::Stage::Execute);
+            if (ctx->packed_params.has_value())
+            {
+              handler->packed_func(args, ctx->packed_params->params);
+            }
+            else
+            {
+              func(args);
+            }
+          }
 
           if (ctx->response_is_error())
           {
+            metrics::StageTimer timer(
+              ctx->stage_times, metrics::Stage::Serialise);
             return ctx->serialise_response();
           }
 
-          switch (tx.commit())
+          kv::CommitSuccess committed;
+          {
+            metrics::StageTimer timer(ctx->stage_times, metrics::Stage::Commit);
+            committed = tx.commit();
+          }
+
+          switch (committed)
           {
             case kv::CommitSuccess::OK:
             {
@@ -553,6 +636,8 @@ namespace ccf
                 }
               }
 
+              metrics::StageTimer timer(
+                ctx->stage_times, metrics::Stage::Serialise);
               return ctx->serialise_response();
             }
 
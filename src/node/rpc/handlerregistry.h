@@ -2,7 +2,9 @@
 // Licensed under the Apache 2.0 License.
 #pragma once
 
+#include "ds/json_msgpack.h"
 #include "ds/json_schema.h"
+#include "ds/json_validator.h"
 #include "enclave/rpccontext.h"
 #include "node/certs.h"
 #include "serialization.h"
@@ -23,6 +25,10 @@ namespace ccf
 
   using HandleFunction = std::function<void(RequestArgs& args)>;
 
+  // Handles a request whose params have been left packed. args.params is null.
+  using PackedHandleFunction =
+    std::function<void(RequestArgs& args, const msgpack::object& params)>;
+
   static enclave::RpcResponse make_success(nlohmann::json&& result_payload)
   {
     return enclave::RpcResponse{std::move(result_payload)};
@@ -64,9 +70,43 @@ namespace ccf
       nlohmann::json result_schema;
       Forwardable forwardable;
       bool execute_locally = false;
+      // Compiled from params_schema on install, and used to validate the
+      // params of each request before calling func
+      std::shared_ptr<const ds::json::SchemaValidator> params_validator =
+        nullptr;
+      // Set for handlers with typed params, which read them directly from
+      // msgpack requests, rather than from JSON
+      PackedHandleFunction packed_func = nullptr;
     };
 
   protected:
+    template <typename In, typename Out, typename F>
+    static constexpr bool is_typed_handler()
+    {
+      if constexpr (std::is_same_v<In, void> || std::is_same_v<Out, void>)
+      {
+        return false;
+      }
+      else
+      {
+        return std::is_invocable_r_v<Out, F, Store::Tx&, In&&> ||
+          std::is_invocable_r_v<Out, F, Store::Tx&, CallerId, In&&>;
+      }
+    }
+
+    template <typename In, typename Out, typename F>
+    static Out call_typed(const F& f, RequestArgs& args, In&& in)
+    {
+      if constexpr (std::is_invocable_r_v<Out, F, Store::Tx&, CallerId, In&&>)
+      {
+        return f(args.tx, args.caller_id, std::move(in));
+      }
+      else
+      {
+        return f(args.tx, std::move(in));
+      }
+    }
+
     std::optional<Handler> default_handler;
     std::unordered_map<std::string, Handler> handlers;
 
@@ -89,7 +129,9 @@ namespace ccf
     /** Install HandleFunction for method name
      *
      * If an implementation is already installed for that method, it will be
-     * replaced.
+     * replaced. If a params schema is given, it is compiled once here, and the
+     * params of every request (if present) are validated against it before f
+     * is called.
      *
      * @param method Method name
      * @param f Method implementation
@@ -107,8 +149,20 @@ namespace ccf
       Forwardable forwardable = Forwardable::CanForward,
       bool execute_locally = false)
     {
-      handlers[method] = {
-        f, rw, params_schema, result_schema, forwardable, execute_locally};
+      std::shared_ptr<const ds::json::SchemaValidator> params_validator;
+      if (!params_schema.empty())
+      {
+        params_validator =
+          std::make_shared<ds::json::SchemaValidator>(params_schema);
+      }
+
+      handlers[method] = {f,
+                          rw,
+                          params_schema,
+                          result_schema,
+                          forwardable,
+                          execute_locally,
+                          params_validator};
     }
 
     void install(
@@ -126,6 +180,18 @@ namespace ccf
         forwardable);
     }
 
+    /** Install HandleFunction for method name, with schemas generated from
+     * its params and result types
+     *
+     * Params are not validated against the generated schema, as converting
+     * them to In already checks the same constraints.
+     *
+     * f may instead be a typed handler, taking (Store::Tx&, In&&) or
+     * (Store::Tx&, CallerId, In&&) and returning Out, which reports errors by
+     * throwing RpcException. The params of msgpack requests are then read
+     * directly into In, and Out is packed directly into the response, without
+     * building JSON documents for either.
+     */
     template <typename In, typename Out, typename F>
     void install_with_auto_schema(
       const std::string& method,
@@ -146,14 +212,39 @@ namespace ccf
         result_schema = ds::json::build_schema<Out>(method + "/result");
       }
 
-      install(
-        method,
-        std::forward<F>(f),
-        rw,
-        params_schema,
-        result_schema,
-        forwardable,
-        execute_locally);
+      if constexpr (is_typed_handler<In, Out, F>())
+      {
+        auto func = [f](RequestArgs& args) {
+          args.rpc_ctx->set_response_result(
+            call_typed<In, Out>(f, args, args.params.get<In>()));
+        };
+
+        auto packed_func = [f](
+                             RequestArgs& args, const msgpack::object& params) {
+          In in;
+          ds::json::read_msgpack(params, in);
+          args.rpc_ctx->set_response_packed_result(
+            ds::json::to_msgpack(call_typed<In, Out>(f, args, std::move(in))));
+        };
+
+        handlers[method] = {func,
+                            rw,
+                            params_schema,
+                            result_schema,
+                            forwardable,
+                            execute_locally,
+                            nullptr,
+                            packed_func};
+      }
+      else
+      {
+        handlers[method] = {std::forward<F>(f),
+                            rw,
+                            params_schema,
+                            result_schema,
+                            forwardable,
+                            execute_locally};
+      }
     }
 
     template <typename T, typename... Ts>
@@ -209,6 +300,10 @@ namespace ccf
 
     virtual void tick(std::chrono::milliseconds elapsed, size_t tx_count) {}
 
+    virtual void record_latency(
+      const std::string& method, const metrics::StageTimes& times)
+    {}
+
     virtual std::optional<CallerId> valid_caller(
       Store::Tx& tx, const std::vector<uint8_t>& caller)
     {
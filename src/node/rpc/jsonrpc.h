@@ -3,6 +3,7 @@
 #pragma once
 
 #include "ds/json.h"
+#include "ds/json_msgpack.h"
 
 #include <string>
 #include <vector>
@@ -48,6 +49,7 @@ namespace jsonrpc
   XX(CODE_ID_RETIRED, -32010) \
   XX(RPC_NOT_FORWARDED, -32011) \
   XX(QUOTE_NOT_VERIFIED, -32012) \
+  XX(RECEIPT_NOT_READY, -32013) \
   XX(APP_ERROR_START, -32050)
 
   using ErrorBaseType = int;
@@ -359,4 +361,91 @@ namespace jsonrpc
 
     return {true, rpc};
   }
+
+  /** Params of a request which have been left packed, so that handlers with
+   * typed params can read them without first building a JSON document
+   */
+  struct PackedParams
+  {
+    // Owns the memory that params refers to
+    std::shared_ptr<msgpack::object_handle> handle;
+    msgpack::object params;
+  };
+
+  /** Unpack an RPC as above, but if it is an unsigned msgpack request, leave
+   * its params packed
+   *
+   * @param input Packed RPC
+   * @param o_pack Set to the packing format of the RPC
+   * @param o_params Set to the packed params, if any were left packed. These
+   * are then not included in the returned RPC.
+   */
+  inline std::pair<bool, nlohmann::json> unpack_rpc(
+    const std::vector<uint8_t>& input,
+    std::optional<Pack>& o_pack,
+    std::optional<PackedParams>& o_params)
+  {
+    if (detect_pack(input) != Pack::MsgPack)
+    {
+      return unpack_rpc(input, o_pack);
+    }
+
+    o_pack = Pack::MsgPack;
+
+    auto rpc = nlohmann::json::object();
+    try
+    {
+      auto handle = std::make_shared<msgpack::object_handle>(
+        msgpack::unpack((const char*)input.data(), input.size()));
+      const auto& o = handle->get();
+      if (o.type != msgpack::type::MAP)
+      {
+        return jsonrpc::error(
+          StandardErrorCodes::INVALID_REQUEST,
+          fmt::format(
+            "RPC payload is a not a valid object: {}",
+            ds::json::msgpack_to_json(o).dump()));
+      }
+
+      std::optional<msgpack::object> params;
+      for (auto i = 0u; i < o.via.map.size; ++i)
+      {
+        const auto& kv = o.via.map.ptr[i];
+        if (kv.key.type != msgpack::type::STR)
+        {
+          throw JsonParseError("Expected string keys in msgpack map");
+        }
+
+        const std::string key(kv.key.via.str.ptr, kv.key.via.str.size);
+        if (key == SIG)
+        {
+          // The signed request is re-packed from its JSON, so must be
+          // unpacked in full
+          return unpack_rpc(input, o_pack);
+        }
+
+        if (key == PARAMS)
+        {
+          params = kv.val;
+        }
+        else
+        {
+          rpc[key] = ds::json::msgpack_to_json(kv.val);
+        }
+      }
+
+      if (params.has_value())
+      {
+        o_params = PackedParams{handle, params.value()};
+      }
+    }
+    catch (const std::exception& e)
+    {
+      return error(
+        StandardErrorCodes::INVALID_REQUEST,
+        fmt::format("Exception during unpack: {}", e.what()));
+    }
+
+    return {true, rpc};
+  }
 }
@@ -5,13 +5,22 @@
 #include "ds/histogram.h"
 #include "ds/logger.h"
 #include "serialization.h"
+#include "stagetimes.h"
 
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <nlohmann/json.hpp>
+#include <unordered_map>
+#include <vector>
 
 #define HIST_MAX (1 << 17)
 #define HIST_MIN 1
 #define HIST_BUCKET_GRANULARITY 5
 #define TX_RATE_BUCKETS_LEN 4000
+#define LATENCY_BUCKET_BITS 3
 
 namespace metrics
 {
@@ -28,6 +37,123 @@ namespace metrics
       histogram::Global<Hist>("histogram", __FILE__, __LINE__);
     Hist histogram = Hist(global);
 
+    // Latencies in nanoseconds, up to 16s
+    using LatencyHist =
+      histogram::Histogram<uint64_t, 1, (uint64_t)1 << 34, LATENCY_BUCKET_BITS>;
+
+    // Latencies recorded by a single thread. As only that thread records to
+    // them, they are only locked to add a method, and to be read.
+    struct ThreadLatencies
+    {
+      std::mutex lock;
+      std::array<LatencyHist, stage_count> stages;
+      std::unordered_map<std::string, std::unique_ptr<LatencyHist>> methods;
+    };
+
+    // Distinguishes these metrics from any others, in each thread's map from
+    // metrics to its latencies, even if they reuse the same address
+    const size_t id = next_id();
+
+    std::mutex threads_lock;
+    std::vector<std::unique_ptr<ThreadLatencies>> threads;
+
+    static size_t next_id()
+    {
+      static std::atomic<size_t> next = 0;
+      return next++;
+    }
+
+    ThreadLatencies& local_latencies()
+    {
+      thread_local std::unordered_map<size_t, ThreadLatencies*> local;
+
+      auto it = local.find(id);
+      if (it != local.end())
+      {
+        return *it->second;
+      }
+
+      std::lock_guard<std::mutex> guard(threads_lock);
+      threads.push_back(std::make_unique<ThreadLatencies>());
+      return *local.emplace(id, threads.back().get()).first->second;
+    }
+
+    void record_stages(ThreadLatencies& latencies, const StageTimes& times)
+    {
+      for (size_t i = 0; i < stage_count; ++i)
+      {
+        const auto& t = times.times[i];
+        if (t.has_value())
+        {
+          latencies.stages[i].record(t->count());
+        }
+      }
+    }
+
+    static ccf::GetMetrics::LatencyResults get_latency_results(
+      LatencyHist& hist)
+    {
+      ccf::GetMetrics::LatencyResults result;
+      result.buckets = nlohmann::json::array();
+      result.count = hist.get_total();
+      if (result.count == 0)
+      {
+        return result;
+      }
+
+      result.low = hist.get_low();
+      result.high = hist.get_high();
+      result.p50 = hist.get_percentile(0.5);
+      result.p90 = hist.get_percentile(0.9);
+      result.p99 = hist.get_percentile(0.99);
+      for (size_t i = 0; i < hist.get_buckets(); ++i)
+      {
+        const auto count = hist.get_count(i);
+        if (count > 0)
+        {
+          result.buckets.push_back(std::make_pair(hist.get_range(i), count));
+        }
+      }
+      return result;
+    }
+
+    // Merges the latencies recorded by every thread
+    std::pair<nlohmann::json, nlohmann::json> get_latencies()
+    {
+      std::array<LatencyHist, stage_count> stages;
+      std::map<std::string, LatencyHist> methods;
+
+      {
+        std::lock_guard<std::mutex> guard(threads_lock);
+        for (auto& t : threads)
+        {
+          std::lock_guard<std::mutex> thread_guard(t->lock);
+          for (size_t i = 0; i < stage_count; ++i)
+          {
+            stages[i].add(t->stages[i]);
+          }
+          for (auto& [method, hist] : t->methods)
+          {
+            methods[method].add(*hist);
+          }
+        }
+      }
+
+      auto stage_results = nlohmann::json::object();
+      for (size_t i = 0; i < stage_count; ++i)
+      {
+        stage_results[stage_names[i]] = get_latency_results(stages[i]);
+      }
+
+      auto method_results = nlohmann::json::object();
+      for (auto& [method, hist] : methods)
+      {
+        method_results[method] = get_latency_results(hist);
+      }
+
+      return {stage_results, method_results};
+    }
+
     ccf::GetMetrics::HistogramResults get_histogram_results()
     {
       ccf::GetMetrics::HistogramResults result;
@@ -69,10 +195,52 @@ namespace metrics
       nlohmann::json result;
       result["histogram"] = get_histogram_results();
       result["tx_rates"] = get_tx_rates();
+      auto [stages, methods] = get_latencies();
+      result["stages"] = stages;
+      result["methods"] = methods;
 
       return result;
     }
 
+    /** Record the time spent in each stage of processing a request. Recording
+     * is local to the calling thread, and is only merged with other threads'
+     * when the metrics are read.
+     *
+     * @param times Time spent in each stage
+     */
+    void record_latency(const StageTimes& times)
+    {
+      if constexpr (StageClock::enabled)
+      {
+        record_stages(local_latencies(), times);
+      }
+    }
+
+    /** Record the time spent in each stage of processing a request, and the
+     * time since it was received, for its method
+     *
+     * @param method Method called by the request
+     * @param times Time spent in each stage
+     */
+    void record_latency(const std::string& method, const StageTimes& times)
+    {
+      if constexpr (StageClock::enabled)
+      {
+        auto& latencies = local_latencies();
+        record_stages(latencies, times);
+
+        auto it = latencies.methods.find(method);
+        if (it == latencies.methods.end())
+        {
+          std::lock_guard<std::mutex> guard(latencies.lock);
+          it = latencies.methods
+                 .emplace(method, std::make_unique<LatencyHist>())
+                 .first;
+        }
+        it->second->record(times.total().count());
+      }
+    }
+
     void track_tx_rates(
       const std::chrono::milliseconds& elapsed, size_t tx_count)
     {
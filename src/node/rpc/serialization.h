@@ -65,8 +65,12 @@ namespace ccf
   DECLARE_JSON_TYPE(GetMetrics::HistogramResults)
   DECLARE_JSON_REQUIRED_FIELDS(
     GetMetrics::HistogramResults, low, high, overflow, underflow, buckets)
+  DECLARE_JSON_TYPE(GetMetrics::LatencyResults)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    GetMetrics::LatencyResults, count, low, high, p50, p90, p99, buckets)
   DECLARE_JSON_TYPE(GetMetrics::Out)
-  DECLARE_JSON_REQUIRED_FIELDS(GetMetrics::Out, histogram, tx_rates)
+  DECLARE_JSON_REQUIRED_FIELDS(
+    GetMetrics::Out, histogram, tx_rates, stages, methods)
 
   DECLARE_JSON_TYPE(GetPrimaryInfo::Out)
   DECLARE_JSON_REQUIRED_FIELDS(
@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <optional>
+
+namespace metrics
+{
+  // Stages of processing an RPC, each of which is timed separately
+  enum class Stage : size_t
+  {
+    // Decrypting and parsing the request, in its session
+    Receive = 0,
+    // Unpacking the request, and its params
+    Unpack,
+    // Verifying the client signature, if the request is signed
+    Verify,
+    // Calling the handler, including any retries after conflicts
+    Execute,
+    // Committing the handler's transaction
+    Commit,
+    // Serialising the response
+    Serialise,
+    // Encrypting and sending the response, in its session
+    Reply
+  };
+
+  static constexpr size_t stage_count = (size_t)Stage::Reply + 1;
+
+  static constexpr std::array<const char*, stage_count> stage_names = {
+    "receive", "unpack", "verify", "execute", "commit", "serialise", "reply"};
+
+  struct StageClock
+  {
+    using time_point = std::chrono::steady_clock::time_point;
+
+#if defined(INSIDE_ENCLAVE) && !defined(VIRTUAL_ENCLAVE) && \
+  !defined(TIME_RPC_STAGES)
+    // Reading the clock in an SGX enclave leaves the enclave, which takes
+    // longer than most stages, so stages are not timed there unless
+    // TIME_RPC_STAGES is defined
+    static constexpr bool enabled = false;
+#else
+    static constexpr bool enabled = true;
+#endif
+
+    static time_point now()
+    {
+      if constexpr (enabled)
+      {
+        return std::chrono::steady_clock::now();
+      }
+      else
+      {
+        return {};
+      }
+    }
+  };
+
+  /** Time spent in each stage of processing an RPC. Stages that the RPC did
+   * not go through, or that were not timed, are left empty.
+   */
+  struct StageTimes
+  {
+    StageClock::time_point start = StageClock::now();
+    std::array<std::optional<std::chrono::nanoseconds>, stage_count> times =
+      {};
+
+    void add(Stage stage, std::chrono::nanoseconds elapsed)
+    {
+      auto& t = times[(size_t)stage];
+      t = t.value_or(std::chrono::nanoseconds(0)) + elapsed;
+    }
+
+    // Time since start, which is when the RPC was received
+    std::chrono::nanoseconds total() const
+    {
+      return StageClock::now() - start;
+    }
+  };
+
+  // Adds the time from its construction to its destruction to a stage
+  class StageTimer
+  {
+  private:
+    StageTimes& times;
+    Stage stage;
+    StageClock::time_point start;
+
+  public:
+    StageTimer(StageTimes& times_, Stage stage_) :
+      times(times_),
+      stage(stage_),
+      start(StageClock::now())
+    {}
+
+    ~StageTimer()
+    {
+      if constexpr (StageClock::enabled)
+      {
+        times.add(stage, StageClock::now() - start);
+      }
+    }
+  };
+}
@@ -266,6 +266,76 @@ public:
   }
 };
 
+class TestValidatedParamsFrontend : public SimpleUserRpcFrontend
+{
+public:
+  size_t calls = 0;
+
+  TestValidatedParamsFrontend(Store& tables) : SimpleUserRpcFrontend(tables)
+  {
+    open();
+
+    const auto params_schema = nlohmann::json::parse(R"xxx(
+      {
+        "type": "object",
+        "properties": {"x": {"type": "number", "minimum": 0}},
+        "required": ["x"]
+      }
+    )xxx");
+
+    auto counted_function = [this](RequestArgs& args) {
+      calls++;
+      args.rpc_ctx->set_response_result(true);
+    };
+    install(
+      "counted_function",
+      counted_function,
+      HandlerRegistry::Read,
+      params_schema);
+  }
+};
+
+struct TypedCall
+{
+  struct In
+  {
+    size_t x;
+    std::string s;
+  };
+
+  struct Out
+  {
+    size_t x;
+    std::string s;
+    CallerId caller_id;
+  };
+};
+DECLARE_JSON_TYPE(TypedCall::In)
+DECLARE_JSON_REQUIRED_FIELDS(TypedCall::In, x, s)
+DECLARE_JSON_TYPE(TypedCall::Out)
+DECLARE_JSON_REQUIRED_FIELDS(TypedCall::Out, x, s, caller_id)
+
+class TestTypedParamsFrontend : public SimpleUserRpcFrontend
+{
+public:
+  TestTypedParamsFrontend(Store& tables) : SimpleUserRpcFrontend(tables)
+  {
+    open();
+
+    auto typed_function =
+      [](Store::Tx& tx, CallerId caller_id, TypedCall::In&& in) {
+        if (in.s.empty())
+        {
+          throw RpcException(
+            "Empty string", (int)jsonrpc::StandardErrorCodes::INVALID_PARAMS);
+        }
+        return TypedCall::Out{in.x + 1, in.s, caller_id};
+      };
+    install_with_auto_schema<TypedCall>(
+      "typed_function", typed_function, HandlerRegistry::Read);
+  }
+};
+
 // used throughout
 auto kp = tls::make_key_pair();
 NetworkState network;
@@ -507,6 +577,27 @@ TEST_CASE("process")
     CHECK(value.sig == signed_req.sig);
   }
 
+  SUBCASE("with signature verified ahead")
+  {
+    const auto serialized_call = jsonrpc::pack(signed_call, default_pack);
+    auto rpc_ctx = enclave::make_rpc_context(user_session, serialized_call);
+
+    frontend.verify_signature_ahead(rpc_ctx);
+    REQUIRE(rpc_ctx->signature_verified.has_value());
+    CHECK(rpc_ctx->signature_verified.value());
+
+    const auto serialized_response = frontend.process(rpc_ctx).value();
+    auto response = jsonrpc::unpack(serialized_response, default_pack);
+    CHECK(response[jsonrpc::RESULT] == true);
+
+    // A failed verification is not repeated when the request is processed
+    auto rejected_ctx = enclave::make_rpc_context(user_session, serialized_call);
+    rejected_ctx->signature_verified = false;
+    const auto rejected_response = frontend.process(rejected_ctx).value();
+    response = jsonrpc::unpack(rejected_response, default_pack);
+    CHECK(response[jsonrpc::ERR] != nullptr);
+  }
+
   SUBCASE("request with signature but do not store")
   {
     TestReqNotStoredFrontend frontend_nostore(*network.tables);
@@ -525,6 +616,52 @@ TEST_CASE("process")
   }
 }
 
+TEST_CASE("Request latencies are reported by getMetrics")
+{
+  prepare_callers();
+  TestUserFrontend frontend(*network.tables);
+
+  auto unknown_call = create_simple_json();
+  unknown_call[jsonrpc::METHOD] = "unknown_function";
+
+  const std::vector<nlohmann::json> calls = {
+    create_simple_json(), create_signed_json(), unknown_call};
+  for (const auto& call : calls)
+  {
+    const auto serialized_call = jsonrpc::pack(call, default_pack);
+    auto rpc_ctx = enclave::make_rpc_context(user_session, serialized_call);
+    frontend.process(rpc_ctx);
+    frontend.record_stage_times(*rpc_ctx);
+  }
+
+  auto metrics_call = create_simple_json();
+  metrics_call[jsonrpc::METHOD] = GeneralProcs::GET_METRICS;
+  auto rpc_ctx = enclave::make_rpc_context(
+    user_session, jsonrpc::pack(metrics_call, default_pack));
+  auto response =
+    jsonrpc::unpack(frontend.process(rpc_ctx).value(), default_pack);
+  const auto result = response[jsonrpc::RESULT].get<GetMetrics::Out>();
+
+  if constexpr (metrics::StageClock::enabled)
+  {
+    const auto& stages = result.stages;
+    CHECK(stages["verify"]["count"] == 1);
+    CHECK(stages["execute"]["count"] == 2);
+    CHECK(stages["commit"]["count"] == 2);
+    CHECK(stages["serialise"]["count"] == 2);
+    CHECK(stages["receive"]["count"] == 0);
+
+    // Only installed methods are recorded
+    REQUIRE(result.methods.size() == 1);
+    const auto latency =
+      result.methods["empty_function"].get<GetMetrics::LatencyResults>();
+    CHECK(latency.count == 2);
+    CHECK(latency.low <= latency.p50);
+    CHECK(latency.p50 <= latency.p99);
+    CHECK(latency.p99 <= latency.high);
+  }
+}
+
 TEST_CASE("MinimalHandleFunction")
 {
   prepare_callers();
@@ -598,6 +735,101 @@ TEST_CASE("MinimalHandleFunction")
   }
 }
 
+TEST_CASE("Params are validated against the installed schema")
+{
+  prepare_callers();
+  TestValidatedParamsFrontend frontend(*network.tables);
+
+  auto call = [&frontend](const nlohmann::json& params) {
+    auto j = create_simple_json();
+    j[jsonrpc::METHOD] = "counted_function";
+    j[jsonrpc::PARAMS] = params;
+
+    const auto serialized_call =
+      jsonrpc::pack(create_signed_json(j), default_pack);
+    auto rpc_ctx = enclave::make_rpc_context(user_session, serialized_call);
+    return jsonrpc::unpack(frontend.process(rpc_ctx).value(), default_pack);
+  };
+
+  INFO("Valid params reach the handler");
+  {
+    const auto response = call({{"x", 42}});
+    CHECK(response[jsonrpc::RESULT] == true);
+    CHECK(frontend.calls == 1);
+  }
+
+  INFO("Invalid params are rejected before the handler is called");
+  {
+    for (const auto& params : {nlohmann::json::object(),
+                               nlohmann::json{{"x", "not a number"}},
+                               nlohmann::json{{"x", -1}}})
+    {
+      const auto response = call(params);
+      const auto err_it = response.find(jsonrpc::ERR);
+      REQUIRE(err_it != response.end());
+      CHECK(
+        (*err_it)[jsonrpc::CODE] ==
+        (jsonrpc::ErrorBaseType)jsonrpc::StandardErrorCodes::PARSE_ERROR);
+    }
+    CHECK(frontend.calls == 1);
+  }
+}
+
+TEST_CASE("Typed handlers are called with params of either packing")
+{
+  prepare_callers();
+  TestTypedParamsFrontend frontend(*network.tables);
+
+  for (const auto pack : {jsonrpc::Pack::MsgPack, jsonrpc::Pack::Text})
+  {
+    auto call = [&frontend, pack](const nlohmann::json& params) {
+      auto j = create_simple_json();
+      j[jsonrpc::METHOD] = "typed_function";
+      j[jsonrpc::PARAMS] = params;
+
+      auto rpc_ctx =
+        enclave::make_rpc_context(user_session, jsonrpc::pack(j, pack));
+      CHECK(
+        rpc_ctx->packed_params.has_value() == (pack == jsonrpc::Pack::MsgPack));
+      return jsonrpc::unpack(frontend.process(rpc_ctx).value(), pack);
+    };
+
+    INFO("Params are converted to In, and Out is returned");
+    {
+      const auto response = call({{"x", 41}, {"s", "hello"}});
+      const auto out = response[jsonrpc::RESULT].get<TypedCall::Out>();
+      CHECK(out.x == 42);
+      CHECK(out.s == "hello");
+      CHECK(out.caller_id == user_id);
+      CHECK(response.find(COMMIT) != response.end());
+    }
+
+    INFO("Params which do not match In are rejected");
+    {
+      for (const auto& params :
+           {nlohmann::json::object(), nlohmann::json{{"x", 1}}})
+      {
+        const auto response = call(params);
+        const auto err_it = response.find(jsonrpc::ERR);
+        REQUIRE(err_it != response.end());
+        CHECK(
+          (*err_it)[jsonrpc::CODE] ==
+          (jsonrpc::ErrorBaseType)jsonrpc::StandardErrorCodes::PARSE_ERROR);
+      }
+    }
+
+    INFO("Errors thrown by the handler are returned");
+    {
+      const auto response = call({{"x", 1}, {"s", ""}});
+      const auto err_it = response.find(jsonrpc::ERR);
+      REQUIRE(err_it != response.end());
+      CHECK(
+        (*err_it)[jsonrpc::CODE] ==
+        (jsonrpc::ErrorBaseType)jsonrpc::StandardErrorCodes::INVALID_PARAMS);
+    }
+  }
+}
+
 // callers
 
 TEST_CASE("User caller")
@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#include "node/rpc/metrics.h"
+
+#define PICOBENCH_IMPLEMENT_WITH_MAIN
+#include <picobench/picobench.hpp>
+#include <thread>
+
+template <class A>
+inline void do_not_optimize(A const& value)
+{
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+static const std::string method = "getCommit";
+
+// The stages of a request, as timed by the endpoint and frontend, with no
+// work in any of them
+static void time_stages(metrics::StageTimes& times)
+{
+  for (size_t i = 0; i < metrics::stage_count; ++i)
+  {
+    metrics::StageTimer timer(times, (metrics::Stage)i);
+    do_not_optimize(times);
+  }
+}
+
+static void untimed(picobench::state& s)
+{
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    metrics::StageTimes times;
+    do_not_optimize(times);
+  }
+  s.stop_timer();
+}
+
+static void timed(picobench::state& s)
+{
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    metrics::StageTimes times;
+    time_stages(times);
+  }
+  s.stop_timer();
+}
+
+static void timed_and_recorded(picobench::state& s)
+{
+  metrics::Metrics metrics;
+
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    metrics::StageTimes times;
+    time_stages(times);
+    metrics.record_latency(method, times);
+  }
+  s.stop_timer();
+}
+
+const std::vector<int> counts = {1000, 10000};
+
+PICOBENCH_SUITE("time request stages");
+PICOBENCH(untimed).iterations(counts).baseline();
+PICOBENCH(timed).iterations(counts);
+PICOBENCH(timed_and_recorded).iterations(counts);
+
+// Requests are recorded from several threads at once, while the metrics are
+// read every 1000 requests, as they would be by getMetrics
+template <size_t Threads>
+static void record_concurrently(picobench::state& s)
+{
+  metrics::Metrics metrics;
+  const size_t per_thread = s.iterations() / Threads;
+
+  s.start_timer();
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < Threads; ++t)
+  {
+    threads.emplace_back([&metrics, per_thread, t]() {
+      for (size_t i = 0; i < per_thread; ++i)
+      {
+        metrics::StageTimes times;
+        time_stages(times);
+        metrics.record_latency(method, times);
+
+        if (t == 0 && i % 1000 == 0)
+        {
+          do_not_optimize(metrics.get_metrics());
+        }
+      }
+    });
+  }
+
+  for (auto& thread : threads)
+  {
+    thread.join();
+  }
+  s.stop_timer();
+}
+
+const std::vector<int> concurrent_counts = {8000, 80000};
+
+PICOBENCH_SUITE("record request latencies concurrently");
+auto record_1 = record_concurrently<1>;
+PICOBENCH(record_1).iterations(concurrent_counts).baseline();
+auto record_2 = record_concurrently<2>;
+PICOBENCH(record_2).iterations(concurrent_counts);
+auto record_4 = record_concurrently<4>;
+PICOBENCH(record_4).iterations(concurrent_counts);
+auto record_8 = record_concurrently<8>;
+PICOBENCH(record_8).iterations(concurrent_counts);
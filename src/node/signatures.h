@@ -16,9 +16,14 @@ namespace ccf
     ObjectId index;
     ObjectId term;
     ObjectId commit;
-    std::vector<uint8_t> tree;
+    // Serialised MerkleFrontier of the tree that was signed
+    std::vector<uint8_t> frontier;
+    // Leaves appended to the tree since the previous signature, concatenated.
+    // Appending these to the previous signature's frontier gives this one.
+    std::vector<uint8_t> delta;
 
-    MSGPACK_DEFINE(MSGPACK_BASE(RawSignature), node, index, term, commit, tree);
+    MSGPACK_DEFINE(
+      MSGPACK_BASE(RawSignature), node, index, term, commit, frontier, delta);
 
     Signature() {}
 
@@ -35,13 +40,15 @@ namespace ccf
       ObjectId term_,
       ObjectId commit_,
       const std::vector<uint8_t> sig_,
-      const std::vector<uint8_t> tree_) :
+      const std::vector<uint8_t> frontier_,
+      const std::vector<uint8_t> delta_) :
       RawSignature{sig_},
       node(node_),
       index(index_),
       term(term_),
       commit(commit_),
-      tree(tree_)
+      frontier(frontier_),
+      delta(delta_)
     {}
   };
   DECLARE_JSON_TYPE_WITH_BASE(Signature, RawSignature)
@@ -4,10 +4,13 @@
 
 #include "../encryptor.h"
 
+#include "../../kv/kv.h"
+#include "../../kv/kvserialiser.h"
 #include "../../kv/kvtypes.h"
 #include "../entities.h"
 #include "../node/ledgersecrets.h"
 
+#include <algorithm>
 #include <doctest/doctest.h>
 #include <random>
 #include <string>
@@ -39,6 +42,38 @@ TEST_CASE("Simple encryption/decryption")
   REQUIRE(plain == decrypted_cipher);
 }
 
+TEST_CASE("Encryption into caller-supplied buffers")
+{
+  uint64_t node_id = 0;
+  auto secrets = std::make_shared<ccf::LedgerSecrets>();
+  secrets->set_secret(1, std::vector<uint8_t>(16, 0x42));
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(node_id, secrets);
+
+  std::vector<uint8_t> plain(128, 0x42);
+  std::vector<uint8_t> additional_data(16, 0x10);
+  kv::Version version = 10;
+
+  // Header and cipher are written to a single frame, as by the kv serialiser
+  const auto header_length = encryptor->get_header_length();
+  std::vector<uint8_t> frame(header_length + plain.size());
+  encryptor->encrypt(
+    plain,
+    additional_data,
+    frame.data(),
+    frame.data() + header_length,
+    version);
+
+  std::vector<uint8_t> serialised_header(
+    frame.begin(), frame.begin() + header_length);
+  std::vector<uint8_t> cipher(frame.begin() + header_length, frame.end());
+  REQUIRE(cipher != plain);
+
+  std::vector<uint8_t> decrypted_cipher;
+  REQUIRE(encryptor->decrypt(
+    cipher, additional_data, serialised_header, decrypted_cipher, version));
+  REQUIRE(plain == decrypted_cipher);
+}
+
 TEST_CASE("Two ciphers from same plaintext are different")
 {
   uint64_t node_id = 0;
@@ -156,4 +191,69 @@ TEST_CASE("Encryption/decryption with multiple ledger secrets")
     REQUIRE_FALSE(
       encryptor->decrypt(cipher, {}, serialised_header, decrypted_cipher, 1));
   }
-}
\ No newline at end of file
+}
+TEST_CASE("Snapshots are authenticated with the ledger secrets")
+{
+  using Store = kv::Store<kv::KvStoreSerialiser, kv::KvStoreDeserialiser>;
+
+  uint64_t node_id = 0;
+  auto secrets = std::make_shared<ccf::LedgerSecrets>();
+  secrets->set_secret(1, std::vector<uint8_t>(16, 0x42));
+  auto encryptor = std::make_shared<ccf::TxEncryptor>(node_id, secrets);
+
+  Store store;
+  store.set_encryptor(encryptor);
+  auto& public_map =
+    store.create<size_t, std::string>("public", kv::SecurityDomain::PUBLIC);
+  auto& private_map = store.create<size_t, std::string>("private");
+
+  const std::string public_value = "public value";
+  {
+    Store::Tx tx;
+    auto [view1, view2] = tx.get_view(public_map, private_map);
+    view1->put(0, public_value);
+    view2->put(0, "private value");
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  const auto version = store.current_version();
+  store.compact(version);
+  const auto snapshot = store.serialise_snapshot(version);
+
+  auto restore = [&store](
+                   const std::vector<uint8_t>& data,
+                   std::shared_ptr<kv::AbstractTxEncryptor> e) {
+    Store restored;
+    restored.set_encryptor(e);
+    restored.clone_schema(store);
+    return restored.deserialise_snapshot(data);
+  };
+
+  INFO("A snapshot is restored with the ledger secrets that encrypted it");
+  {
+    REQUIRE(restore(snapshot, encryptor) == kv::DeserialiseSuccess::PASS);
+  }
+
+  INFO("A snapshot whose public domain was modified is rejected");
+  {
+    auto tampered = snapshot;
+    auto value = std::search(
+      tampered.begin(),
+      tampered.end(),
+      public_value.begin(),
+      public_value.end());
+    REQUIRE(value != tampered.end());
+    *value ^= 1;
+    REQUIRE(restore(tampered, encryptor) == kv::DeserialiseSuccess::FAILED);
+  }
+
+  INFO("A snapshot encrypted with other ledger secrets is rejected");
+  {
+    auto other_secrets = std::make_shared<ccf::LedgerSecrets>();
+    other_secrets->set_secret(1, std::vector<uint8_t>(16, 0x43));
+    auto other_encryptor =
+      std::make_shared<ccf::TxEncryptor>(node_id, other_secrets);
+    REQUIRE(
+      restore(snapshot, other_encryptor) == kv::DeserialiseSuccess::FAILED);
+  }
+}
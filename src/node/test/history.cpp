@@ -3,6 +3,7 @@
 #define DOCTEST_CONFIG_IMPLEMENT
 #include "node/history.h"
 
+#include "ds/ringbuffer.h"
 #include "enclave/appinterface.h"
 #include "kv/kv.h"
 #include "kv/test/stub_consensus.h"
@@ -12,12 +13,17 @@
 #include "node/signatures.h"
 
 #include <doctest/doctest.h>
+#include <optional>
+#include <random>
 
 extern "C"
 {
 #include <evercrypt/EverCrypt_AutoConfig2.h>
 }
 
+enclave::ThreadMessaging enclave::ThreadMessaging::thread_messaging;
+std::atomic<uint16_t> enclave::ThreadMessaging::thread_count = 0;
+
 using namespace ccf;
 
 class DummyConsensus : public kv::StubConsensus
@@ -128,6 +134,133 @@ TEST_CASE("Check signature verification")
   }
 }
 
+class BatchConsensus : public DummyConsensus
+{
+public:
+  BatchConsensus(Store* store_) : DummyConsensus(store_) {}
+
+  bool replicate(const kv::BatchVector& entries) override
+  {
+    for (const auto& entry : entries)
+    {
+      if (!store->deserialise(std::get<1>(entry)))
+        return false;
+    }
+    return true;
+  }
+};
+
+#ifndef PBFT
+TEST_CASE("Signatures are signed on a worker thread")
+{
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  Store primary_store;
+  primary_store.set_encryptor(encryptor);
+  auto& primary_nodes = primary_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& primary_signatures = primary_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  Store backup_store;
+  backup_store.set_encryptor(encryptor);
+  auto& backup_nodes = backup_store.create<ccf::Nodes>(
+    ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& backup_signatures = backup_store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+  auto kp = tls::make_key_pair();
+
+  std::shared_ptr<kv::Consensus> consensus =
+    std::make_shared<BatchConsensus>(&backup_store);
+  primary_store.set_consensus(consensus);
+  std::shared_ptr<kv::Consensus> null_consensus =
+    std::make_shared<DummyConsensus>(nullptr);
+  backup_store.set_consensus(null_consensus);
+
+  std::shared_ptr<kv::TxHistory> primary_history =
+    std::make_shared<ccf::MerkleTxHistory>(
+      primary_store, 0, *kp, primary_signatures, primary_nodes);
+  primary_store.set_history(primary_history);
+
+  std::shared_ptr<kv::TxHistory> backup_history =
+    std::make_shared<ccf::MerkleTxHistory>(
+      backup_store, 1, *kp, backup_signatures, backup_nodes);
+  backup_store.set_history(backup_history);
+
+  INFO("Write certificate");
+  {
+    Store::Tx txs;
+    auto tx = txs.get_view(primary_nodes);
+    ccf::NodeInfo ni;
+    ni.cert = kp->self_sign("CN=name");
+    tx->put(0, ni);
+    REQUIRE(txs.commit() == kv::CommitSuccess::OK);
+    REQUIRE(backup_store.current_version() == 1);
+  }
+
+  enclave::ThreadMessaging::thread_count = 2;
+
+  INFO("Issue signature, which is not replicated until it is signed");
+  {
+    primary_history->emit_signature();
+    REQUIRE(backup_store.current_version() == 1);
+  }
+
+  INFO("Transactions after the signature are held back");
+  {
+    Store::Tx txs;
+    auto tx = txs.get_view(primary_nodes);
+    ccf::NodeInfo ni;
+    tx->put(1, ni);
+    REQUIRE(txs.commit() == kv::CommitSuccess::OK);
+    REQUIRE(backup_store.current_version() == 1);
+  }
+
+  INFO("Sign on the worker thread, and verify successfully on backup");
+  {
+    REQUIRE(enclave::ThreadMessaging::thread_messaging.run_one(1));
+    REQUIRE(backup_store.current_version() == 3);
+  }
+
+  enclave::ThreadMessaging::thread_count = 0;
+}
+
+TEST_CASE("Signatures are not signed once their history is destroyed")
+{
+  auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
+  auto kp = tls::make_key_pair();
+
+  enclave::ThreadMessaging::thread_count = 2;
+
+  INFO("Issue signature, and destroy the store and its history");
+  {
+    Store store;
+    store.set_encryptor(encryptor);
+    auto& nodes = store.create<ccf::Nodes>(
+      ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+    auto& signatures = store.create<ccf::Signatures>(
+      ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+
+    std::shared_ptr<kv::Consensus> consensus =
+      std::make_shared<DummyConsensus>(nullptr);
+    store.set_consensus(consensus);
+
+    auto history =
+      std::make_shared<ccf::MerkleTxHistory>(store, 0, *kp, signatures, nodes);
+    store.set_history(history);
+
+    history->emit_signature();
+  }
+
+  INFO("Signing on the worker thread does nothing");
+  {
+    REQUIRE(enclave::ThreadMessaging::thread_messaging.run_one(1));
+  }
+
+  enclave::ThreadMessaging::thread_count = 0;
+}
+#endif
+
 TEST_CASE("Check signing works across rollback")
 {
   auto encryptor = std::make_shared<ccf::NullTxEncryptor>();
@@ -443,6 +576,395 @@ TEST_CASE(
   }
 }
 
+TEST_CASE("Tree can be rebuilt from signature frontiers and deltas")
+{
+  constexpr size_t leaves = 5000;
+  constexpr size_t sig_interval = 97;
+  constexpr size_t history_len = 300;
+
+  MerkleTreeHistory tree;
+  std::random_device r;
+
+  // As in HashedTxHistory, each delta starts at the previous signature
+  uint64_t last_signed_size = 0;
+  std::optional<MerkleFrontier> rebuilt;
+  bool rolled_back = false;
+  uint64_t flushed = 0;
+
+  for (size_t step = 1; step < leaves; ++step)
+  {
+    crypto::Sha256Hash h;
+    for (size_t j = 0; j < crypto::Sha256Hash::SIZE; j++)
+      h.h[j] = r();
+    tree.append(h);
+    const auto i = tree.get_size() - 1;
+
+    if (i % sig_interval == 0)
+    {
+      const auto frontier = tree.get_frontier();
+      REQUIRE(frontier.get_root() == tree.get_root());
+
+      Signature sig(0, i);
+      sig.frontier = frontier.serialise();
+      sig.delta = tree.get_leaves_from(last_signed_size);
+      last_signed_size = frontier.get_size();
+
+      // The frontier only holds one hash for each level of the tree
+      REQUIRE(sig.frontier.size() <= 8 + 32 * crypto::Sha256Hash::SIZE);
+
+      if (!rebuilt.has_value())
+      {
+        rebuilt = MerkleFrontier(sig.frontier);
+      }
+      else if (!rebuilt->apply(sig))
+      {
+        // Only a follower that applied signatures which have since been
+        // rolled back needs to start again from the signature's frontier
+        REQUIRE(rolled_back);
+        rebuilt = MerkleFrontier(sig.frontier);
+      }
+      rolled_back = false;
+
+      REQUIRE(rebuilt.value() == frontier);
+      REQUIRE(rebuilt->get_root() == tree.get_root());
+    }
+
+    if (i > history_len + flushed && i % 100 == 0)
+    {
+      flushed = i - history_len;
+      tree.flush(flushed);
+    }
+
+    if (step % 1001 == 0)
+    {
+      tree.retract(i - 60);
+      if (last_signed_size > tree.get_size())
+      {
+        last_signed_size = 0;
+        rolled_back = true;
+      }
+    }
+  }
+}
+
+TEST_CASE("Receipts can be produced from a frontier and the leaves after it")
+{
+  constexpr size_t leaves = 300;
+  std::random_device r;
+
+  MerkleTreeHistory tree;
+  MerkleFrontier frontier;
+  std::vector<uint8_t> delta;
+  const size_t frontier_size = 1 + r() % (leaves - 1);
+
+  // The first leaf is the one the tree is created with
+  crypto::Sha256Hash h;
+  frontier.append(h);
+  for (size_t i = 1; i < leaves; ++i)
+  {
+    for (size_t j = 0; j < crypto::Sha256Hash::SIZE; j++)
+      h.h[j] = r();
+    if (i < frontier_size)
+      frontier.append(h);
+    else
+      delta.insert(delta.end(), h.h, h.h + h.SIZE);
+    // Appending to the tree overwrites the hash
+    auto leaf = h;
+    tree.append(leaf);
+  }
+
+  MerkleTreeHistory rebuilt(
+    frontier, delta.data(), delta.size() / crypto::Sha256Hash::SIZE);
+  REQUIRE(rebuilt.get_first_index() == frontier_size);
+  REQUIRE(rebuilt.get_size() == leaves);
+  REQUIRE(rebuilt.get_root() == tree.get_root());
+
+  for (size_t i = frontier_size; i < leaves; ++i)
+  {
+    const auto receipt = rebuilt.get_receipt(i).to_v();
+    REQUIRE(receipt == tree.get_receipt(i).to_v());
+    REQUIRE(tree.verify(Receipt::from_v(receipt)));
+  }
+}
+
+class LedgerConsensus : public CompactingConsensus
+{
+public:
+  std::vector<std::vector<uint8_t>> ledger;
+
+  LedgerConsensus(Store* store_) : CompactingConsensus(store_) {}
+
+  bool replicate(const kv::BatchVector& entries) override
+  {
+    for (auto& [version, data, committable] : entries)
+      ledger.push_back(data);
+    return CompactingConsensus::replicate(entries);
+  }
+};
+
+TEST_CASE("Receipts for flushed transactions are produced from the ledger")
+{
+  Store store;
+  store.set_encryptor(std::make_shared<ccf::NullTxEncryptor>());
+  auto& nodes =
+    store.create<ccf::Nodes>(ccf::Tables::NODES, kv::SecurityDomain::PUBLIC);
+  auto& signatures = store.create<ccf::Signatures>(
+    ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC);
+  auto& table =
+    store.create<size_t, size_t>("table", kv::SecurityDomain::PUBLIC);
+
+  auto kp = tls::make_key_pair();
+  auto consensus = std::make_shared<LedgerConsensus>(&store);
+  store.set_consensus(consensus);
+  auto history = std::make_shared<ccf::MerkleTxHistory>(
+    store, 0, *kp, signatures, nodes);
+  store.set_history(history);
+
+  ringbuffer::Circuit eio(1 << 20);
+  ringbuffer::WriterFactory wf(eio);
+  auto historical_receipts = std::make_shared<ccf::HistoricalReceipts>(
+    store, nodes, wf.create_writer_to_outside());
+  history->set_historical_receipts(historical_receipts);
+
+  {
+    Store::Tx tx;
+    ccf::NodeInfo ni;
+    ni.cert = kp->self_sign("CN=name");
+    tx.get_view(nodes)->put(0, ni);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+
+  constexpr size_t sig_interval = 97;
+  for (size_t i = 0; i < 3 * ccf::MAX_HISTORY_LEN; ++i)
+  {
+    Store::Tx tx;
+    tx.get_view(table)->put(i, i);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    if (i % sig_interval == 0)
+      history->emit_signature();
+  }
+  history->emit_signature();
+
+  // Serves requests for ledger entries, as the host would
+  auto serve_ledger = [&]() {
+    std::vector<std::pair<consensus::Index, consensus::Index>> requests;
+    eio.read_from_inside().read(
+      -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        REQUIRE(m == consensus::ledger_get_historical);
+        auto [from, to] =
+          ringbuffer::read_message<consensus::ledger_get_historical>(
+            data, size);
+        requests.emplace_back(from, to);
+      });
+
+    for (auto [from, to] : requests)
+    {
+      if (from > consensus->ledger.size())
+      {
+        historical_receipts->recv_no_entry(from);
+        continue;
+      }
+
+      std::vector<uint8_t> framed;
+      for (auto i = from; i <= std::min<size_t>(to, consensus->ledger.size());
+           ++i)
+      {
+        const auto& entry = consensus->ledger[i - 1];
+        const uint32_t entry_size = entry.size();
+        const auto header = reinterpret_cast<const uint8_t*>(&entry_size);
+        framed.insert(framed.end(), header, header + sizeof(entry_size));
+        framed.insert(framed.end(), entry.begin(), entry.end());
+      }
+      historical_receipts->recv_entries(from, framed);
+    }
+    return !requests.empty();
+  };
+
+  INFO("Recent transactions have receipts straight away");
+  {
+    const auto recent = store.current_version() - 10;
+    const auto receipt = history->get_receipt(recent);
+    REQUIRE(receipt.has_value());
+    REQUIRE(history->verify_receipt(receipt.value()));
+    REQUIRE_FALSE(serve_ledger());
+  }
+
+  INFO("Receipts for flushed transactions are read from the ledger");
+  {
+    for (kv::Version v : {1, 2, 98, 99, 500, 1000})
+    {
+      REQUIRE_FALSE(history->get_receipt(v).has_value());
+      while (serve_ledger())
+        ;
+
+      const auto receipt = history->get_receipt(v);
+      REQUIRE(receipt.has_value());
+      REQUIRE(history->verify_receipt(receipt.value()));
+
+      INFO("Receipts are cached");
+      REQUIRE(history->get_receipt(v) == receipt);
+      REQUIRE_FALSE(serve_ledger());
+    }
+  }
+
+  INFO("Receipts cannot be produced without a later signature");
+  {
+    const auto v = store.current_version() + 1;
+    REQUIRE_FALSE(historical_receipts->get_receipt(v).has_value());
+    while (serve_ledger())
+      ;
+    REQUIRE_THROWS(historical_receipts->get_receipt(v));
+  }
+
+  // Reads the requests for ledger entries without answering them, as if the
+  // host had lost them
+  auto drop_requests = [&]() {
+    size_t count = 0;
+    eio.read_from_inside().read(
+      -1, [&](ringbuffer::Message m, const uint8_t*, size_t) {
+        REQUIRE(m == consensus::ledger_get_historical);
+        ++count;
+      });
+    return count;
+  };
+
+  const auto timeout = ccf::HistoricalReceipts::default_fetch_timeout;
+
+  INFO("Unanswered requests are sent again");
+  {
+    const kv::Version v = 3;
+    REQUIRE_FALSE(historical_receipts->get_receipt(v).has_value());
+    REQUIRE(drop_requests() == 1);
+
+    historical_receipts->tick(timeout / 2);
+    REQUIRE(drop_requests() == 0);
+    historical_receipts->tick(timeout / 2);
+    REQUIRE(serve_ledger());
+    while (serve_ledger())
+      ;
+
+    const auto receipt = history->get_receipt(v);
+    REQUIRE(receipt.has_value());
+    REQUIRE(history->verify_receipt(receipt.value()));
+  }
+
+  INFO("Receipts fail once their requests have been sent too many times");
+  {
+    const kv::Version first = 4;
+    const auto max_fetches = ccf::HistoricalReceipts::default_max_fetches;
+    for (auto v = first; v < first + max_fetches; ++v)
+      REQUIRE_FALSE(historical_receipts->get_receipt(v).has_value());
+    REQUIRE_THROWS(historical_receipts->get_receipt(first + max_fetches));
+    REQUIRE(drop_requests() == max_fetches);
+
+    for (size_t i = 0; i < ccf::HistoricalReceipts::max_retries; ++i)
+    {
+      historical_receipts->tick(timeout);
+      REQUIRE(drop_requests() == max_fetches);
+    }
+    historical_receipts->tick(timeout);
+    REQUIRE(drop_requests() == 0);
+
+    REQUIRE_THROWS(historical_receipts->get_receipt(first));
+
+    INFO("Failed receipts are no longer being read");
+    const auto v = first + max_fetches;
+    REQUIRE_FALSE(historical_receipts->get_receipt(v).has_value());
+    while (serve_ledger())
+      ;
+    REQUIRE(historical_receipts->get_receipt(v).has_value());
+
+    INFO("Failures are forgotten after a while");
+    historical_receipts->tick(ccf::HistoricalReceipts::failure_expiry);
+    REQUIRE_FALSE(historical_receipts->get_receipt(first + 1).has_value());
+    while (serve_ledger())
+      ;
+    REQUIRE(historical_receipts->get_receipt(first + 1).has_value());
+  }
+}
+
+TEST_CASE("Snapshots are only accepted if their signature verifies")
+{
+  auto kp = tls::make_key_pair();
+
+  // A store, with the maps and history of a node, to take or restore
+  // snapshots
+  struct Node
+  {
+    Store store;
+    ccf::Nodes& nodes;
+    ccf::Signatures& signatures;
+    Store::Map<size_t, size_t>& table;
+    std::shared_ptr<CompactingConsensus> consensus;
+    std::shared_ptr<ccf::MerkleTxHistory> history;
+
+    Node(tls::KeyPair& kp) :
+      nodes(store.create<ccf::Nodes>(
+        ccf::Tables::NODES, kv::SecurityDomain::PUBLIC)),
+      signatures(store.create<ccf::Signatures>(
+        ccf::Tables::SIGNATURES, kv::SecurityDomain::PUBLIC)),
+      table(store.create<size_t, size_t>("table", kv::SecurityDomain::PUBLIC))
+    {
+      store.set_encryptor(std::make_shared<ccf::NullTxEncryptor>());
+      consensus = std::make_shared<CompactingConsensus>(&store);
+      store.set_consensus(consensus);
+      history = std::make_shared<ccf::MerkleTxHistory>(
+        store, 0, kp, signatures, nodes);
+      store.set_history(history);
+    }
+  };
+
+  Node primary(*kp);
+  {
+    Store::Tx tx;
+    ccf::NodeInfo ni;
+    ni.cert = kp->self_sign("CN=name");
+    tx.get_view(primary.nodes)->put(0, ni);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+  for (size_t i = 0; i < 10; ++i)
+  {
+    Store::Tx tx;
+    tx.get_view(primary.table)->put(i, i);
+    REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+  }
+  primary.history->emit_signature();
+
+  INFO("A snapshot taken at a signature is accepted");
+  {
+    const auto snapshot =
+      primary.store.serialise_snapshot(primary.store.current_version());
+
+    Node joiner(*kp);
+    REQUIRE(
+      joiner.store.deserialise_snapshot(snapshot) ==
+      kv::DeserialiseSuccess::PASS);
+    kv::Term term;
+    REQUIRE(joiner.history->verify_snapshot(&term));
+    REQUIRE(term == 2);
+  }
+
+  INFO("A snapshot whose signature does not match its tree is rejected");
+  {
+    const auto version = primary.store.current_version() + 1;
+    {
+      Store::Tx tx;
+      auto sig = tx.get_view(primary.signatures)->get(0).value();
+      sig.index = version;
+      tx.get_view(primary.signatures)->put(0, sig);
+      REQUIRE(tx.commit() == kv::CommitSuccess::OK);
+    }
+    primary.store.compact(version);
+    const auto snapshot = primary.store.serialise_snapshot(version);
+
+    Node joiner(*kp);
+    REQUIRE(
+      joiner.store.deserialise_snapshot(snapshot) ==
+      kv::DeserialiseSuccess::PASS);
+    REQUIRE_FALSE(joiner.history->verify_snapshot());
+  }
+}
+
 // We need an explicit main to initialize kremlib and EverCrypt
 int main(int argc, char** argv)
 {
@@ -2,17 +2,25 @@
 // Licensed under the Apache 2.0 License.
 #define PICOBENCH_IMPLEMENT
 #include "kv/test/stub_consensus.h"
+#include "node/encryptor.h"
 #include "node/history.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <ctime>
+#include <iostream>
 #include <picobench/picobench.hpp>
+#include <thread>
 
 extern "C"
 {
 #include <evercrypt/EverCrypt_AutoConfig2.h>
 }
 
+enclave::ThreadMessaging enclave::ThreadMessaging::thread_messaging;
+std::atomic<uint16_t> enclave::ThreadMessaging::thread_count = 0;
+
 using namespace ccf;
 
 class DummyConsensus : public kv::StubConsensus
@@ -204,6 +212,76 @@ static void append_compact(picobench::state& s)
   s.stop_timer();
 }
 
+// Commits transactions, emitting a signature every sig_interval of them as
+// the frontend does. With more than one thread, signatures are signed by a
+// worker thread rather than by the committing thread. Reports the p99 and
+// maximum time taken to commit a transaction.
+template <uint16_t Threads>
+static void commit_and_sign(picobench::state& s)
+{
+  constexpr size_t sig_interval = 100;
+
+  Store store;
+  store.set_encryptor(std::make_shared<ccf::NullTxEncryptor>());
+  auto& nodes = store.create<ccf::Nodes>(ccf::Tables::NODES);
+  auto& signatures = store.create<ccf::Signatures>(ccf::Tables::SIGNATURES);
+  auto& table = store.create<size_t, size_t>("table");
+
+  auto kp = tls::make_key_pair();
+
+  std::shared_ptr<kv::Consensus> consensus = std::make_shared<DummyConsensus>();
+  store.set_consensus(consensus);
+
+  std::shared_ptr<kv::TxHistory> history =
+    std::make_shared<ccf::MerkleTxHistory>(store, 0, *kp, signatures, nodes);
+  store.set_history(history);
+
+  enclave::ThreadMessaging::thread_count = Threads;
+  std::atomic<bool> stop = false;
+  std::thread worker;
+  if (Threads > 1)
+  {
+    worker = std::thread([&stop]() {
+      while (enclave::ThreadMessaging::thread_messaging.run_one(Threads - 1) ||
+             !stop)
+        ;
+    });
+  }
+
+  std::vector<std::chrono::nanoseconds> latencies;
+  latencies.reserve(s.iterations());
+
+  size_t idx = 0;
+  s.start_timer();
+  for (auto _ : s)
+  {
+    (void)_;
+    const auto start = std::chrono::high_resolution_clock::now();
+    Store::Tx tx;
+    auto view = tx.get_view(table);
+    view->put(0, idx);
+    tx.commit();
+    if (++idx % sig_interval == sig_interval / 2)
+      history->emit_signature();
+    latencies.push_back(std::chrono::high_resolution_clock::now() - start);
+  }
+  s.stop_timer();
+
+  stop = true;
+  if (worker.joinable())
+    worker.join();
+  enclave::ThreadMessaging::thread_count = 0;
+
+  std::sort(latencies.begin(), latencies.end());
+  std::cout << fmt::format(
+                 "{} threads, n={} : p99 {}ns, max {}ns",
+                 Threads,
+                 s.iterations(),
+                 latencies[latencies.size() * 99 / 100].count(),
+                 latencies.back().count())
+            << std::endl;
+}
+
 const std::vector<int> sizes = {1000, 10000};
 
 PICOBENCH_SUITE("hash_only");
@@ -231,6 +309,10 @@ PICOBENCH(append_compact<10>).iterations(sizes).samples(10).baseline();
 PICOBENCH(append_compact<100>).iterations(sizes).samples(10);
 PICOBENCH(append_compact<1000>).iterations(sizes).samples(10);
 
+PICOBENCH_SUITE("commit_and_sign");
+PICOBENCH(commit_and_sign<1>).iterations(sizes).samples(1).baseline();
+PICOBENCH(commit_and_sign<2>).iterations(sizes).samples(1);
+
 // We need an explicit main to initialize kremlib and EverCrypt
 int main(int argc, char* argv[])
 {
@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "node/ledgerreader.h"
+
+#include "host/ledger.h"
+
+#include <doctest/doctest.h>
+#include <optional>
+
+struct ReadConfig
+{
+  size_t length;
+  size_t batch;
+  size_t read_ahead;
+};
+
+// Reads a ledger of the given length from the host, as NodeState does during
+// recovery, and returns the index reported as the end of the ledger
+static consensus::Index read_ledger(const ReadConfig& config)
+{
+  ringbuffer::Circuit eio(1 << 20);
+  auto wf = ringbuffer::WriterFactory(eio);
+  auto entry = [](size_t i) { return std::vector<uint8_t>(8, (uint8_t)i); };
+
+  asynchost::Ledger l("readerlog", wf);
+  l.truncate(0);
+  for (size_t i = 1; i <= config.length; ++i)
+  {
+    auto e = entry(i);
+    l.write_entry(e.data(), e.size());
+  }
+  eio.read_from_outside().read(
+    -1, [](ringbuffer::Message, const uint8_t*, size_t) {});
+
+  ccf::LedgerReader reader(wf.create_writer_to_outside());
+  reader.start(0, config.batch, config.read_ahead);
+
+  std::optional<consensus::Index> end;
+  while (!end.has_value())
+  {
+    size_t handled = 0;
+
+    handled += eio.read_from_inside().read(
+      -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        REQUIRE(m == consensus::ledger_get);
+        auto [from, to] =
+          ringbuffer::read_message<consensus::ledger_get>(data, size);
+        l.send_entries(from, to);
+      });
+
+    handled += eio.read_from_outside().read(
+      -1, [&](ringbuffer::Message m, const uint8_t* data, size_t size) {
+        if (end.has_value())
+          return;
+
+        if (m == consensus::ledger_no_entry)
+        {
+          auto [idx] =
+            ringbuffer::read_message<consensus::ledger_no_entry>(data, size);
+          if (reader.is_expected(idx))
+            end = idx;
+          return;
+        }
+
+        REQUIRE(m == consensus::ledger_entries);
+        auto [from, framed] =
+          ringbuffer::read_message<consensus::ledger_entries>(data, size);
+        if (!reader.is_expected(from))
+          return;
+
+        const uint8_t* p = framed.data();
+        size_t remaining = framed.size();
+        while (remaining > 0)
+        {
+          auto entry_size = serialized::read<uint32_t>(p, remaining);
+          auto e = serialized::read(p, remaining, entry_size);
+          REQUIRE(e == entry(reader.advance()));
+        }
+        reader.request_entries();
+      });
+
+    // If nothing is left to handle before the end is found, recovery would
+    // never finish
+    REQUIRE(handled > 0);
+  }
+
+  REQUIRE(reader.get_idx() == config.length);
+  l.truncate(0);
+  for (auto suffix : {"", ".idx"})
+    ::unlink((std::string("readerlog") + suffix).c_str());
+
+  return end.value();
+}
+
+TEST_CASE("The end of the ledger is found whatever its length")
+{
+  for (const auto& config : std::vector<ReadConfig>{{0, 1000, 10000},
+                                                    {1, 1000, 10000},
+                                                    {999, 1000, 10000},
+                                                    {1000, 1000, 10000},
+                                                    {1500, 1000, 10000},
+                                                    {2000, 1000, 1000},
+                                                    {2500, 1000, 1000},
+                                                    {1234, 7, 100},
+                                                    {1234, 1, 1}})
+  {
+    INFO(
+      "Ledger of " << config.length << " entries, read in batches of "
+                   << config.batch << " up to " << config.read_ahead
+                   << " ahead");
+    REQUIRE(read_ledger(config) == config.length + 1);
+  }
+}
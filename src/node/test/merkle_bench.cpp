@@ -201,6 +201,53 @@ static void serialised_size(picobench::state& s)
             << std::endl;
 }
 
+// Compares the size of the tree carried by each signature, serialised in full
+// or as the frontier and the leaves since the previous signature, with the
+// tree compacted as HashedTxHistory does
+static void signature_size(picobench::state& s)
+{
+  constexpr size_t sig_interval = 100;
+
+  ccf::MerkleTreeHistory t;
+  std::random_device r;
+  uint64_t last_signed_size = 0;
+  size_t full_bytes = 0;
+  size_t frontier_bytes = 0;
+  size_t signatures = 0;
+
+  s.start_timer();
+  for (size_t i = 1; i <= s.iterations(); ++i)
+  {
+    crypto::Sha256Hash h;
+    for (size_t j = 0; j < crypto::Sha256Hash::SIZE; j++)
+      h.h[j] = r();
+    t.append(h);
+
+    if (i % sig_interval == 0)
+    {
+      full_bytes += t.serialise().size();
+
+      const auto frontier = t.get_frontier();
+      frontier_bytes += frontier.serialise().size() +
+        t.get_leaves_from(last_signed_size).size();
+      last_signed_size = frontier.get_size();
+      ++signatures;
+
+      if (i > ccf::MAX_HISTORY_LEN)
+        t.flush(i - ccf::MAX_HISTORY_LEN);
+    }
+  }
+  s.stop_timer();
+
+  std::cout << fmt::format(
+                 "n={} : {} bytes/signature with mt_serialize, {} "
+                 "bytes/signature with frontier and delta",
+                 s.iterations(),
+                 full_bytes / signatures,
+                 frontier_bytes / signatures)
+            << std::endl;
+}
+
 const std::vector<int> sizes = {1000, 10000};
 
 PICOBENCH_SUITE("append_retract");
@@ -220,6 +267,13 @@ PICOBENCH(serialised_size)
   .iterations({1, 2, 10, 100, 1000, 10000})
   .samples(1)
   .baseline();
+// Checks the size of signatures as the ledger grows, timing results are
+// irrelevant here
+PICOBENCH_SUITE("signature_size");
+PICOBENCH(signature_size)
+  .iterations({1000, 10000, 100000})
+  .samples(1)
+  .baseline();
 
 // We need an explicit main to initialize kremlib and EverCrypt
 int main(int argc, char* argv[])
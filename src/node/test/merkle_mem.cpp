@@ -18,6 +18,7 @@ using namespace std;
 static constexpr size_t appends = 1000000;
 static constexpr size_t max_tree_size = 1000;
 static constexpr size_t flushes_without_retract = 10;
+static constexpr size_t sig_interval = 100;
 
 static constexpr size_t max_expected_rss = 4096;
 
@@ -42,6 +43,8 @@ static int append_flush_and_retract()
 {
   ccf::MerkleTreeHistory t;
   std::random_device r;
+  uint64_t last_signed_size = 0;
+  size_t signature_bytes = 0;
 
   for (size_t index = 0; index < appends; ++index)
   {
@@ -54,6 +57,8 @@ static int append_flush_and_retract()
       {
         t.retract(index - max_tree_size);
         LOG_DEBUG_FMT("retract() {}", index - max_tree_size);
+        if (last_signed_size > t.get_size())
+          last_signed_size = 0;
       }
       else
       {
@@ -61,8 +66,27 @@ static int append_flush_and_retract()
         LOG_DEBUG_FMT("flush() {}", index - max_tree_size);
       }
     }
+
+    // A signature carries the frontier, and the leaves appended since the
+    // previous signature
+    if (index % sig_interval == 0)
+    {
+      const auto frontier = t.get_frontier();
+      signature_bytes = frontier.serialise().size() +
+        t.get_leaves_from(last_signed_size).size();
+      last_signed_size = frontier.get_size();
+    }
+
     if (index % (appends / 10) == 0)
+    {
       LOG_INFO_FMT("MAX RSS: {}Kb", get_maxrss());
+      LOG_INFO_FMT(
+        "Signature at {}: {} bytes with mt_serialize, {} bytes with frontier "
+        "and delta",
+        index,
+        t.serialise().size(),
+        signature_bytes);
+    }
   }
   LOG_INFO_FMT("MAX RSS: {}Kb", get_maxrss());
 
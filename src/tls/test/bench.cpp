@@ -2,8 +2,10 @@
 // Licensed under the Apache 2.0 License.
 #define PICOBENCH_IMPLEMENT_WITH_MAIN
 #include "../keypair.h"
+#include "../verifiercache.h"
 
 #include <picobench/picobench.hpp>
+#include <thread>
 
 using namespace std;
 
@@ -102,6 +104,45 @@ static void benchmark_hash(picobench::state& s)
   s.stop_timer();
 }
 
+// Signed requests from a set of callers are verified by Threads workers,
+// sharing a cache of verifiers, as client signatures are verified ahead of
+// processing.
+template <size_t Threads>
+static void benchmark_verify_requests(picobench::state& s)
+{
+  constexpr size_t callers = 10;
+  const auto contents = make_contents<256>();
+
+  std::vector<std::vector<uint8_t>> certs;
+  std::vector<std::vector<uint8_t>> signatures;
+  for (size_t i = 0; i < callers; ++i)
+  {
+    auto kp = tls::make_key_pair();
+    certs.push_back(kp->self_sign("CN=caller"));
+    signatures.push_back(kp->sign(contents));
+  }
+
+  tls::VerifierCache verifiers;
+  const size_t requests = s.iterations();
+
+  s.start_timer();
+  std::vector<std::thread> workers;
+  for (size_t t = 0; t < Threads; ++t)
+  {
+    workers.emplace_back([&, t]() {
+      for (size_t i = t; i < requests; i += Threads)
+      {
+        const auto caller = i % callers;
+        if (!verifiers.verify(certs[caller], contents, signatures[caller]))
+          throw std::logic_error("Failed to verify request");
+      }
+    });
+  }
+  for (auto& w : workers)
+    w.join();
+  s.stop_timer();
+}
+
 const std::vector<int> sizes = {1};
 
 using namespace tls;
@@ -229,4 +270,21 @@ namespace
   auto hash_256k1_bitc_100k =
     benchmark_hash<CurveImpl::secp256k1_bitcoin, 102400>;
   PICOBENCH(hash_256k1_bitc_100k).PICO_SUFFIX(CurveImpl::secp256k1_bitcoin);
-}
\ No newline at end of file
+}
+const std::vector<int> request_counts = {100};
+
+PICOBENCH_SUITE("verify signed requests");
+namespace
+{
+  auto verify_requests_1_thread = benchmark_verify_requests<1>;
+  PICOBENCH(verify_requests_1_thread)
+    .iterations(request_counts)
+    .samples(10)
+    .baseline();
+  auto verify_requests_2_threads = benchmark_verify_requests<2>;
+  PICOBENCH(verify_requests_2_threads).iterations(request_counts).samples(10);
+  auto verify_requests_4_threads = benchmark_verify_requests<4>;
+  PICOBENCH(verify_requests_4_threads).iterations(request_counts).samples(10);
+  auto verify_requests_8_threads = benchmark_verify_requests<8>;
+  PICOBENCH(verify_requests_8_threads).iterations(request_counts).samples(10);
+}
@@ -5,6 +5,7 @@
 #include "../base64.h"
 #include "../keypair.h"
 #include "../verifier.h"
+#include "../verifiercache.h"
 
 #include <chrono>
 #include <doctest/doctest.h>
@@ -208,6 +209,47 @@ TEST_CASE("Sign, verify. Fail to verify with bad contents")
   }
 }
 
+TEST_CASE("Verify with cached verifiers")
+{
+  constexpr size_t max_size = 2;
+  tls::VerifierCache verifiers(max_size);
+
+  vector<uint8_t> contents(contents_.begin(), contents_.end());
+  vector<vector<uint8_t>> certs;
+  vector<vector<uint8_t>> signatures;
+  for (size_t i = 0; i < max_size + 1; ++i)
+  {
+    auto kp = tls::make_key_pair();
+    certs.push_back(kp->self_sign("CN=name"));
+    signatures.push_back(kp->sign(contents));
+  }
+
+  INFO("Signatures are verified with the verifier for the given certificate");
+  {
+    CHECK(verifiers.verify(certs[0], contents, signatures[0]));
+    CHECK_FALSE(verifiers.verify(certs[0], contents, signatures[1]));
+    CHECK(verifiers.verify(certs[1], contents, signatures[1]));
+    CHECK(verifiers.size() == 2);
+  }
+
+  INFO("Least recently used verifier is evicted");
+  {
+    CHECK(verifiers.verify(certs[0], contents, signatures[0]));
+    CHECK(verifiers.verify(certs[2], contents, signatures[2]));
+    CHECK(verifiers.size() == max_size);
+    CHECK(verifiers.contains(certs[0]));
+    CHECK_FALSE(verifiers.contains(certs[1]));
+    CHECK(verifiers.contains(certs[2]));
+  }
+
+  INFO("Evicted verifiers are created again");
+  {
+    CHECK(verifiers.verify(certs[1], contents, signatures[1]));
+    CHECK(verifiers.contains(certs[1]));
+    CHECK_FALSE(verifiers.contains(certs[0]));
+  }
+}
+
 tls::HashBytes bad_manual_hash(const std::vector<uint8_t>& data)
 {
   // secp256k1 requires 32-byte hashes, other curves don't care. So use 32 for
@@ -0,0 +1,128 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the Apache 2.0 License.
+#pragma once
+
+#include "ds/spinlock.h"
+#include "verifier.h"
+
+#include <list>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+
+namespace tls
+{
+  /** Verifiers for the certificates that have most recently been used to
+   * verify signatures, so that each certificate is not parsed again for every
+   * signature. Once max_size certificates are cached, the least recently used
+   * is evicted. Safe to use from multiple threads.
+   */
+  class VerifierCache
+  {
+  public:
+    static constexpr size_t default_max_size = 1000;
+
+  private:
+    struct Entry
+    {
+      VerifierPtr verifier;
+      // mbedtls may update a key's precomputed values while verifying with
+      // it, so signatures are verified with each verifier one at a time
+      SpinLock lock;
+    };
+
+    struct CertHash
+    {
+      size_t operator()(const std::vector<uint8_t>& cert) const
+      {
+        return std::hash<std::string_view>()(
+          {reinterpret_cast<const char*>(cert.data()), cert.size()});
+      }
+    };
+
+    // Most recently used first
+    using Entries =
+      std::list<std::pair<std::vector<uint8_t>, std::shared_ptr<Entry>>>;
+
+    const size_t max_size;
+    SpinLock lock;
+    Entries entries;
+    std::unordered_map<std::vector<uint8_t>, Entries::iterator, CertHash>
+      index;
+
+    std::shared_ptr<Entry> get_entry(const std::vector<uint8_t>& cert)
+    {
+      {
+        std::lock_guard<SpinLock> guard(lock);
+        auto it = index.find(cert);
+        if (it != index.end())
+        {
+          entries.splice(entries.begin(), entries, it->second);
+          return it->second->second;
+        }
+      }
+
+      // Parsing the certificate is the expensive part of a miss, so it is
+      // done without holding the lock
+      auto entry = std::make_shared<Entry>();
+      entry->verifier = make_verifier(cert);
+
+      std::lock_guard<SpinLock> guard(lock);
+      auto it = index.find(cert);
+      if (it != index.end())
+      {
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->second;
+      }
+
+      entries.emplace_front(cert, entry);
+      index.emplace(cert, entries.begin());
+
+      if (entries.size() > max_size)
+      {
+        index.erase(entries.back().first);
+        entries.pop_back();
+      }
+
+      return entry;
+    }
+
+  public:
+    VerifierCache(size_t max_size = default_max_size) : max_size(max_size) {}
+
+    /** Verify that a signature was produced on contents with the private key
+     * associated with the public key contained in the certificate.
+     *
+     * @param cert Certificate, in PEM or DER format
+     * @param contents Sequence of bytes that was signed
+     * @param signature Signature as a sequence of bytes
+     * @param md_type Digest algorithm to use. Derived from the
+     * public key if MBEDTLS_MD_NONE.
+     *
+     * @return Whether the signature matches the contents and the key
+     */
+    bool verify(
+      const std::vector<uint8_t>& cert,
+      const std::vector<uint8_t>& contents,
+      const std::vector<uint8_t>& signature,
+      mbedtls_md_type_t md_type = {})
+    {
+      auto entry = get_entry(cert);
+
+      std::lock_guard<SpinLock> guard(entry->lock);
+      return entry->verifier->verify(contents, signature, md_type);
+    }
+
+    size_t size()
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      return entries.size();
+    }
+
+    bool contains(const std::vector<uint8_t>& cert)
+    {
+      std::lock_guard<SpinLock> guard(lock);
+      return index.find(cert) != index.end();
+    }
+  };
+}
@@ -113,6 +113,43 @@ def test_update_lua(network, args):
     return network
 
 
+@reqs.description("Calling JS scripts with top-level declarations repeatedly")
+@reqs.js_generic_app
+def test_js_top_level_declarations(network, args):
+    primary, _ = network.find_primary()
+
+    check = infra.checker.Checker()
+
+    # Each call runs in a fresh context, so declaring the same globals again,
+    # or reading those of another script, must not fail
+    new_app_file = "new_js_app.lua"
+    with open(new_app_file, "w") as qfile:
+        qfile.write(
+            """
+                return {
+                sum = [[
+                    const p = 1;
+                    let q = 2;
+                    class C {}
+                    p + q
+                ]],
+                declared = [[
+                    typeof p + " " + typeof q
+                ]],
+                }"""
+        )
+
+    network.consortium.set_js_app(
+        member_id=1, remote_node=primary, app_script=new_app_file
+    )
+    with primary.user_client() as c:
+        for _ in range(3):
+            check(c.rpc("sum", params={}), result=3)
+        check(c.rpc("declared", params={}), result="undefined undefined")
+
+    return network
+
+
 def run(args):
     hosts = ["localhost"] * (4 if args.consensus == "pbft" else 2)
 
@@ -138,6 +175,7 @@ def run(args):
             network = test_large_messages(network, args)
             network = test_forwarding_frontends(network, args)
             network = test_update_lua(network, args)
+            network = test_js_top_level_declarations(network, args)
 
 
 if __name__ == "__main__":
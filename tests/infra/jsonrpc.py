@@ -26,4 +26,5 @@ class ErrorCode(IntEnum):
     CODE_ID_RETIRED = -32010
     RPC_NOT_FORWARDED = -32011
     QUOTE_NOT_VERIFIED = -32012
+    RECEIPT_NOT_READY = -32013
     SERVER_ERROR_END = -32099
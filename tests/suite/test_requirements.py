@@ -85,6 +85,10 @@ def lua_generic_app(func):
     return installed_package("libluageneric")(func)
 
 
+def js_generic_app(func):
+    return installed_package("libjsgeneric")(func)
+
+
 # Runs some transactions before recovering the network and guarantees that all
 # transactions are successfully recovered
 def recover(number_txs=5):